@@ -3,6 +3,7 @@ TEMPLATE = subdirs
 CONFIG += ordered warn_on qt debug_and_release
 
 SUBDIRS += src/core \
+    src/miam-scan \
     src/cover-fetcher \
     src/library \
     src/tabplaylists \
@@ -12,6 +13,9 @@ SUBDIRS += src/core \
     src/tageditor \
     src/player
 
+# Measures scans and models on a generated library, run with "make check" or directly
+qtHaveModule(testlib): SUBDIRS += src/benchmark
+
 RESOURCES += src/player/mp.qrc \
     src/tabplaylists/mp.qrc \
     src/tageditor/player.qrc
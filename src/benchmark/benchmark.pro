@@ -0,0 +1,62 @@
+QT += sql multimedia widgets testlib
+
+TEMPLATE = app
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+SOURCES += librarygenerator.cpp \
+    main.cpp \
+    scanbenchmark.cpp
+
+HEADERS += librarygenerator.h \
+    scanbenchmark.h
+
+TARGET = miam-benchmark
+
+CONFIG(debug, debug|release) {
+    win32 {
+        LIBS += -L$$PWD/../../lib/debug/win-x64/ -ltag
+        LIBS += -L$$OUT_PWD/../core/debug/ -lmiam-core
+        LIBS += -L$$OUT_PWD/../library/debug/ -lmiam-library
+        LIBS += -L$$OUT_PWD/../uniquelibrary/debug/ -lmiam-uniquelibrary
+    }
+    OBJECTS_DIR = debug/.obj
+    MOC_DIR = debug/.moc
+    RCC_DIR = debug/.rcc
+}
+
+CONFIG(release, debug|release) {
+    win32 {
+        LIBS += -L$$PWD/../../lib/release/win-x64/ -ltag
+        LIBS += -L$$OUT_PWD/../core/release/ -lmiam-core
+        LIBS += -L$$OUT_PWD/../library/release/ -lmiam-library
+        LIBS += -L$$OUT_PWD/../uniquelibrary/release/ -lmiam-uniquelibrary
+    }
+    OBJECTS_DIR = release/.obj
+    MOC_DIR = release/.moc
+    RCC_DIR = release/.rcc
+}
+unix {
+    LIBS += -L$$OUT_PWD/../core/ -lmiam-core
+    LIBS += -L$$OUT_PWD/../library/ -lmiam-library
+    LIBS += -L$$OUT_PWD/../uniquelibrary/ -lmiam-uniquelibrary
+}
+unix:!macx {
+    LIBS += -L/usr/lib/x86_64-linux-gnu/ -ltag
+}
+macx {
+    LIBS += -L$$PWD/../../lib/osx/ -ltag
+}
+
+3rdpartyDir  = $$PWD/../core/3rdparty
+INCLUDEPATH += $$3rdpartyDir
+DEPENDPATH += $$3rdpartyDir
+
+INCLUDEPATH += $$PWD/../core
+INCLUDEPATH += $$PWD/../library
+INCLUDEPATH += $$PWD/../uniquelibrary
+
+DEPENDPATH += $$PWD/../core
+DEPENDPATH += $$PWD/../library
+DEPENDPATH += $$PWD/../uniquelibrary
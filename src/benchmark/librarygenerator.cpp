@@ -0,0 +1,486 @@
+#include "librarygenerator.h"
+
+#include <QBuffer>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QImage>
+#include <QPainter>
+#include <QRegExp>
+
+#include <taglib/attachedpictureframe.h>
+#include <taglib/flacfile.h>
+#include <taglib/flacpicture.h>
+#include <taglib/id3v2tag.h>
+#include <taglib/mp4coverart.h>
+#include <taglib/mp4file.h>
+#include <taglib/mpegfile.h>
+#include <taglib/tpropertymap.h>
+#include <taglib/vorbisfile.h>
+
+#include <QtDebug>
+
+namespace {
+
+const char *syllables[] = { "ka", "lo", "mi", "ra", "ten", "dor", "vel", "sa", "nu", "bri", "zo", "ga", "fen", "lu", "mar",
+							"tho", "qui", "yen", "pas", "dre", "sil", "ber", "an", "ko", "rin" };
+
+const char *genres[] = { "Rock", "Pop", "Jazz", "Electronic", "Classical", "Hip-Hop", "Metal", "Folk", "Soundtrack", "Blues",
+						 "Reggae", "Ambient" };
+
+/** Words which can't be built from syllables, to keep the normalizer busy. */
+const char *foreignWords[] = { "Björk", "Sigur Rós", "Mötley", "Beyoncé", "Ærø", "Ñandú", "Дельфин", "Кино", "Лето", "坂本",
+							   "細野", "東京", "Ελλάδα", "Œuvre", "Straße" };
+
+/** Writes an integer in big-endian order. */
+void appendBE(QByteArray &data, quint64 value, int bytes)
+{
+	for (int i = bytes - 1; i >= 0; i--) {
+		data.append(static_cast<char>((value >> (8 * i)) & 0xFF));
+	}
+}
+
+/** Writes an integer in little-endian order. */
+void appendLE(QByteArray &data, quint64 value, int bytes)
+{
+	for (int i = 0; i < bytes; i++) {
+		data.append(static_cast<char>((value >> (8 * i)) & 0xFF));
+	}
+}
+
+QByteArray mp4Atom(const char *type, const QByteArray &payload)
+{
+	QByteArray atom;
+	appendBE(atom, 8 + payload.size(), 4);
+	atom.append(type, 4);
+	atom.append(payload);
+	return atom;
+}
+
+/** CRC of Ogg pages: polynomial 0x04C11DB7, without reflection. */
+quint32 oggCrc(const QByteArray &data)
+{
+	quint32 crc = 0;
+	for (char c : data) {
+		crc ^= static_cast<quint32>(static_cast<uchar>(c)) << 24;
+		for (int i = 0; i < 8; i++) {
+			crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+QByteArray oggPage(const QList<QByteArray> &packets, int headerType, qint64 granulePosition, quint32 sequence)
+{
+	QByteArray lacing;
+	QByteArray body;
+	for (const QByteArray &packet : packets) {
+		int size = packet.size();
+		while (size >= 255) {
+			lacing.append(static_cast<char>(255));
+			size -= 255;
+		}
+		lacing.append(static_cast<char>(size));
+		body.append(packet);
+	}
+	QByteArray page("OggS");
+	page.append('\0');
+	page.append(static_cast<char>(headerType));
+	appendLE(page, granulePosition, 8);
+	appendLE(page, 0x6D61694D, 4);
+	appendLE(page, sequence, 4);
+	appendLE(page, 0, 4);
+	page.append(static_cast<char>(lacing.size()));
+	page.append(lacing);
+	page.append(body);
+
+	QByteArray crc;
+	appendLE(crc, oggCrc(page), 4);
+	page.replace(22, 4, crc);
+	return page;
+}
+
+/** Replaces characters which are forbidden in file names on some systems. */
+QString safeFileName(const QString &name)
+{
+	return QString(name).replace(QRegExp("[/\\\\:*?\"<>|]"), "_");
+}
+
+} // namespace
+
+LibraryGenerator::LibraryGenerator(quint32 seed)
+	: _random(seed)
+	, _pictureCount(0)
+{
+	for (int i = 0; i < 8; i++) {
+		QImage image(500, 500, QImage::Format_RGB32);
+		QColor color = QColor::fromHsv(i * 45, 160, 200);
+		QPainter painter(&image);
+		QLinearGradient gradient(0, 0, 500, 500);
+		gradient.setColorAt(0, color);
+		gradient.setColorAt(1, color.darker(300));
+		painter.fillRect(image.rect(), gradient);
+		painter.end();
+
+		QByteArray jpeg;
+		QBuffer buffer(&jpeg);
+		buffer.open(QIODevice::WriteOnly);
+		image.save(&buffer, "JPG", 85);
+		_covers.append(jpeg);
+	}
+}
+
+/** Returns a number in [min, max]. */
+int LibraryGenerator::between(int min, int max)
+{
+	return std::uniform_int_distribution<int>(min, max)(_random);
+}
+
+/** Returns true with a probability of p. */
+bool LibraryGenerator::chance(double p)
+{
+	return std::uniform_real_distribution<double>(0.0, 1.0)(_random) < p;
+}
+
+/** Builds a word which looks like a name, sometimes with accents or in another script. */
+QString LibraryGenerator::word()
+{
+	if (this->chance(0.05)) {
+		return QString::fromUtf8(foreignWords[this->between(0, sizeof(foreignWords) / sizeof(foreignWords[0]) - 1)]);
+	}
+	QString w;
+	int count = this->between(1, 3);
+	for (int i = 0; i < count; i++) {
+		w.append(QString::fromLatin1(syllables[this->between(0, sizeof(syllables) / sizeof(syllables[0]) - 1)]));
+	}
+	if (this->chance(0.1)) {
+		w.replace(w.indexOf(QRegExp("[aeiou]")), 1, QString::fromUtf8("é"));
+	}
+	w[0] = w.at(0).toUpper();
+	return w;
+}
+
+/** Builds a title of one to maxWords words. */
+QString LibraryGenerator::title(int maxWords)
+{
+	QStringList words;
+	int count = this->between(1, maxWords);
+	for (int i = 0; i < count; i++) {
+		words << this->word();
+	}
+	return words.join(" ");
+}
+
+/** Picks an artist: famous ones are picked more often, new artists keep appearing. */
+QString LibraryGenerator::artist()
+{
+	if (_artists.isEmpty() || this->chance(0.4)) {
+		QString name = this->title(2);
+		if (this->chance(0.1)) {
+			name.prepend("The ");
+		}
+		_artists << name;
+		return name;
+	}
+	// Squaring a uniform number favours first artists
+	double u = std::uniform_real_distribution<double>(0.0, 1.0)(_random);
+	return _artists.at(qMin(_artists.size() - 1, static_cast<int>(u * u * _artists.size())));
+}
+
+/** Writes trackCount tracks in root, with one directory for each album. Returns the number of tracks written. */
+int LibraryGenerator::generate(const QString &root, int trackCount)
+{
+	_pictureCount = 0;
+	int written = 0;
+	int album = 0;
+	while (written < trackCount) {
+		bool isCompilation = this->chance(0.08);
+		QString albumArtist = isCompilation ? QString("Various Artists") : this->artist();
+		QString albumTitle = this->chance(0.03) ? QString() : this->title(4);
+		QString year = this->chance(0.05) ? QString() : QString::number(1960 + (this->between(0, 60) + this->between(0, 60)) / 2);
+		QString genre = QString::fromLatin1(genres[this->between(0, sizeof(genres) / sizeof(genres[0]) - 1)]);
+		int discCount = this->chance(0.07) ? 2 : 1;
+		int tracksPerDisc = this->between(8, 14);
+
+		// Most albums are MP3, then FLAC, M4A and Ogg Vorbis
+		int f = this->between(0, 99);
+		Format format = f < 50 ? F_MP3 : f < 75 ? F_FLAC : f < 90 ? F_M4A : F_OGG;
+		static const char *suffixes[] = { "mp3", "flac", "ogg", "m4a" };
+
+		// Covers are in a file next to tracks, embedded in tracks, both or missing
+		int c = this->between(0, 99);
+		bool hasFolderCover = c < 55 || (c >= 80 && c < 90);
+		bool hasEmbeddedCover = c >= 55 && c < 90;
+		const QByteArray &cover = _covers.at(album % _covers.size());
+
+		QString albumDir = QString("%1 - %2").arg(year.isEmpty() ? QString("0000") : year,
+												  albumTitle.isEmpty() ? QString("Unknown %1").arg(album) : albumTitle);
+		QString dirName = root + "/" + safeFileName(albumArtist) + "/" + safeFileName(albumDir);
+		if (!QDir().mkpath(dirName)) {
+			qWarning() << Q_FUNC_INFO << "cannot create" << dirName;
+			return written;
+		}
+		if (hasFolderCover) {
+			static const char *coverNames[] = { "folder.jpg", "cover.jpg", "Front.jpg" };
+			QFile coverFile(dirName + "/" + coverNames[album % 3]);
+			if (coverFile.open(QIODevice::WriteOnly)) {
+				coverFile.write(cover);
+				_pictureCount++;
+			}
+		}
+
+		for (int disc = 1; disc <= discCount && written < trackCount; disc++) {
+			for (int track = 1; track <= tracksPerDisc && written < trackCount; track++) {
+				QMap<QString, QString> tags;
+				QString trackTitle = this->title(5);
+				tags.insert("TITLE", trackTitle);
+				tags.insert("ARTIST", isCompilation ? this->artist() : albumArtist);
+				if (isCompilation || this->chance(0.2)) {
+					tags.insert("ALBUMARTIST", albumArtist);
+				}
+				if (!albumTitle.isEmpty()) {
+					tags.insert("ALBUM", albumTitle);
+				}
+				if (!this->chance(0.05)) {
+					tags.insert("TRACKNUMBER", QString::number(track));
+				}
+				if (discCount > 1) {
+					tags.insert("DISCNUMBER", QString::number(disc));
+				}
+				if (!year.isEmpty()) {
+					tags.insert("DATE", year);
+				}
+				tags.insert("GENRE", genre);
+
+				QString fileName = QString("%1/%2%3 - %4.%5").arg(dirName)
+						.arg(discCount > 1 ? QString::number(disc) : QString())
+						.arg(track, 2, 10, QChar('0'))
+						.arg(safeFileName(trackTitle))
+						.arg(suffixes[format]);
+				if (writeTrack(fileName, format, this->between(90, 420), tags, hasEmbeddedCover ? cover : QByteArray())) {
+					written++;
+				} else {
+					qWarning() << Q_FUNC_INFO << "cannot write" << fileName;
+					return written;
+				}
+			}
+		}
+		album++;
+	}
+	return written;
+}
+
+QByteArray LibraryGenerator::mp3Stream(int seconds)
+{
+	// MPEG-1 Layer III, 128 kbps, 44.1 kHz, joint stereo: 417 bytes for 1152 samples of silence
+	const int frameLength = 417;
+	QByteArray frame(frameLength, '\0');
+	frame[0] = static_cast<char>(0xFF);
+	frame[1] = static_cast<char>(0xFB);
+	frame[2] = static_cast<char>(0x90);
+	frame[3] = static_cast<char>(0x44);
+
+	// Frames are not all written: the first one holds a Xing header which declares the duration
+	quint32 frameCount = static_cast<quint32>(seconds * 44100LL / 1152);
+	QByteArray xing = frame;
+	QByteArray header("Xing");
+	appendBE(header, 0x03, 4);
+	appendBE(header, frameCount, 4);
+	appendBE(header, frameCount * frameLength, 4);
+	xing.replace(36, header.size(), header);
+
+	QByteArray data = xing;
+	for (int i = 0; i < 32; i++) {
+		data.append(frame);
+	}
+	return data;
+}
+
+QByteArray LibraryGenerator::flacStream(int seconds)
+{
+	QByteArray data("fLaC");
+
+	// STREAMINFO is the only metadata block, TagLib inserts the others
+	data.append(static_cast<char>(0x80));
+	appendBE(data, 34, 3);
+	appendBE(data, 4096, 2);
+	appendBE(data, 4096, 2);
+	appendBE(data, 0, 3);
+	appendBE(data, 0, 3);
+	quint64 totalSamples = seconds * 44100ULL;
+	appendBE(data, (44100ULL << 44) | (1ULL << 41) | (15ULL << 36) | totalSamples, 8);
+	data.append(QByteArray(16, '\0'));
+	return data;
+}
+
+QByteArray LibraryGenerator::oggStream(int seconds)
+{
+	QByteArray identification("\x01vorbis", 7);
+	appendLE(identification, 0, 4);
+	identification.append(static_cast<char>(2));
+	appendLE(identification, 44100, 4);
+	appendLE(identification, 0, 4);
+	appendLE(identification, 160000, 4);
+	appendLE(identification, 0, 4);
+	identification.append(static_cast<char>(0xB8));
+	identification.append(static_cast<char>(0x01));
+
+	QByteArray comment("\x03vorbis", 7);
+	QByteArray vendor("Miam-Player benchmark");
+	appendLE(comment, vendor.size(), 4);
+	comment.append(vendor);
+	appendLE(comment, 0, 4);
+	comment.append(static_cast<char>(0x01));
+
+	// Tag readers are not decoding the setup header
+	QByteArray setup("\x05vorbis", 7);
+	setup.append(QByteArray(32, '\0'));
+
+	QByteArray data = oggPage(QList<QByteArray>() << identification, 0x02, 0, 0);
+	data.append(oggPage(QList<QByteArray>() << comment << setup, 0x00, 0, 1));
+	data.append(oggPage(QList<QByteArray>() << QByteArray(1, '\0'), 0x04, seconds * 44100LL, 2));
+	return data;
+}
+
+QByteArray LibraryGenerator::m4aStream(int seconds)
+{
+	QByteArray ftyp("M4A ");
+	appendBE(ftyp, 0, 4);
+	ftyp.append("M4A mp42isom");
+
+	QByteArray mvhd;
+	appendBE(mvhd, 0, 4);
+	appendBE(mvhd, 0, 4);
+	appendBE(mvhd, 0, 4);
+	appendBE(mvhd, 1000, 4);
+	appendBE(mvhd, seconds * 1000, 4);
+	appendBE(mvhd, 0x00010000, 4);
+	appendBE(mvhd, 0x0100, 2);
+	mvhd.append(QByteArray(10, '\0'));
+	for (quint32 m : { 0x00010000u, 0u, 0u, 0u, 0x00010000u, 0u, 0u, 0u, 0x40000000u }) {
+		appendBE(mvhd, m, 4);
+	}
+	mvhd.append(QByteArray(24, '\0'));
+	appendBE(mvhd, 2, 4);
+
+	QByteArray mdhd;
+	appendBE(mdhd, 0, 4);
+	appendBE(mdhd, 0, 4);
+	appendBE(mdhd, 0, 4);
+	appendBE(mdhd, 44100, 4);
+	appendBE(mdhd, seconds * 44100LL, 4);
+	appendBE(mdhd, 0x55C4, 2);
+	appendBE(mdhd, 0, 2);
+
+	QByteArray hdlr;
+	appendBE(hdlr, 0, 4);
+	appendBE(hdlr, 0, 4);
+	hdlr.append("soun");
+	hdlr.append(QByteArray(13, '\0'));
+
+	QByteArray mp4a;
+	mp4a.append(QByteArray(6, '\0'));
+	appendBE(mp4a, 1, 2);
+	appendBE(mp4a, 0, 8);
+	appendBE(mp4a, 2, 2);
+	appendBE(mp4a, 16, 2);
+	appendBE(mp4a, 0, 4);
+	appendBE(mp4a, 44100u << 16, 4);
+
+	QByteArray stsd;
+	appendBE(stsd, 0, 4);
+	appendBE(stsd, 1, 4);
+	stsd.append(mp4Atom("mp4a", mp4a));
+
+	QByteArray stbl = mp4Atom("stbl", mp4Atom("stsd", stsd));
+	QByteArray mdia = mp4Atom("mdia", mp4Atom("mdhd", mdhd) + mp4Atom("hdlr", hdlr) + mp4Atom("minf", stbl));
+	QByteArray moov = mp4Atom("moov", mp4Atom("mvhd", mvhd) + mp4Atom("trak", mdia));
+
+	return mp4Atom("ftyp", ftyp) + moov + mp4Atom("mdat", QByteArray(1024, '\0'));
+}
+
+/** Writes an empty audio stream of format, then its tags and its cover if any. */
+bool LibraryGenerator::writeTrack(const QString &absFilePath, Format format, int seconds, const QMap<QString, QString> &tags, const QByteArray &cover)
+{
+	QFile file(absFilePath);
+	if (!file.open(QIODevice::WriteOnly)) {
+		return false;
+	}
+	switch (format) {
+	case F_MP3:
+		file.write(mp3Stream(seconds));
+		break;
+	case F_FLAC:
+		file.write(flacStream(seconds));
+		break;
+	case F_OGG:
+		file.write(oggStream(seconds));
+		break;
+	case F_M4A:
+		file.write(m4aStream(seconds));
+		break;
+	}
+	file.close();
+
+	TagLib::PropertyMap properties;
+	for (auto it = tags.cbegin(); it != tags.cend(); ++it) {
+		properties.insert(it.key().toStdString(), TagLib::String(it.value().toUtf8().constData(), TagLib::String::UTF8));
+	}
+	TagLib::ByteVector picture(cover.constData(), static_cast<unsigned int>(cover.size()));
+
+#ifdef _WIN32
+	TagLib::FileName fp(QDir::toNativeSeparators(absFilePath).toStdWString().data());
+#else
+	TagLib::String s(QDir::toNativeSeparators(absFilePath).toUtf8().constData(), TagLib::String::UTF8);
+	TagLib::FileName fp(s.toCString(true));
+#endif
+	switch (format) {
+	case F_MP3: {
+		TagLib::MPEG::File f(fp);
+		f.setProperties(properties);
+		if (!cover.isEmpty()) {
+			TagLib::ID3v2::AttachedPictureFrame *frame = new TagLib::ID3v2::AttachedPictureFrame;
+			frame->setMimeType("image/jpeg");
+			frame->setType(TagLib::ID3v2::AttachedPictureFrame::FrontCover);
+			frame->setPicture(picture);
+			f.ID3v2Tag(true)->addFrame(frame);
+		}
+		return f.isValid() && f.save();
+	}
+	case F_FLAC: {
+		TagLib::FLAC::File f(fp);
+		f.setProperties(properties);
+		if (!cover.isEmpty()) {
+			TagLib::FLAC::Picture *p = new TagLib::FLAC::Picture;
+			p->setMimeType("image/jpeg");
+			p->setType(TagLib::FLAC::Picture::FrontCover);
+			p->setData(picture);
+			f.addPicture(p);
+		}
+		return f.isValid() && f.save();
+	}
+	case F_OGG: {
+		TagLib::Vorbis::File f(fp);
+		f.setProperties(properties);
+		if (!cover.isEmpty()) {
+			TagLib::FLAC::Picture *p = new TagLib::FLAC::Picture;
+			p->setMimeType("image/jpeg");
+			p->setType(TagLib::FLAC::Picture::FrontCover);
+			p->setData(picture);
+			f.tag()->addPicture(p);
+		}
+		return f.isValid() && f.save();
+	}
+	case F_M4A: {
+		TagLib::MP4::File f(fp);
+		f.setProperties(properties);
+		if (!cover.isEmpty()) {
+			TagLib::MP4::CoverArtList covers;
+			covers.append(TagLib::MP4::CoverArt(TagLib::MP4::CoverArt::JPEG, picture));
+			f.tag()->setItem("covr", covers);
+		}
+		return f.isValid() && f.save();
+	}
+	}
+	return false;
+}
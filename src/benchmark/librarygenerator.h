@@ -0,0 +1,72 @@
+#ifndef LIBRARYGENERATOR_H
+#define LIBRARYGENERATOR_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+#include <QString>
+#include <QStringList>
+
+#include <random>
+
+/**
+ * \brief		The LibraryGenerator class writes a synthetic music library, to measure scans and models on a known input.
+ * \details		Files are small but valid MP3, FLAC, Ogg Vorbis and M4A containers: audio properties are declared by their
+ *				headers, like the duration, and tags are written by TagLib itself. Artists, albums, compilations, discs, years,
+ *				genres and covers (embedded, in a folder.jpg file, both or none) follow proportions found in real libraries,
+ *				with some non-ASCII names and some missing fields. The same seed always gives the same library.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+class LibraryGenerator
+{
+public:
+	enum Format : int { F_MP3	= 0,
+						F_FLAC	= 1,
+						F_OGG	= 2,
+						F_M4A	= 3};
+
+private:
+	std::mt19937 _random;
+
+	/** A few pictures shared by all albums, encoded once. */
+	QList<QByteArray> _covers;
+
+	QStringList _artists;
+
+	int _pictureCount;
+
+	/** Returns a number in [min, max]. */
+	int between(int min, int max);
+
+	/** Returns true with a probability of p. */
+	bool chance(double p);
+
+	/** Builds a word which looks like a name, sometimes with accents or in another script. */
+	QString word();
+
+	/** Builds a title of one to maxWords words. */
+	QString title(int maxWords);
+
+	/** Picks an artist: famous ones are picked more often, new artists keep appearing. */
+	QString artist();
+
+	static QByteArray mp3Stream(int seconds);
+	static QByteArray flacStream(int seconds);
+	static QByteArray oggStream(int seconds);
+	static QByteArray m4aStream(int seconds);
+
+	/** Writes an empty audio stream of format, then its tags and its cover if any. */
+	static bool writeTrack(const QString &absFilePath, Format format, int seconds, const QMap<QString, QString> &tags, const QByteArray &cover);
+
+public:
+	explicit LibraryGenerator(quint32 seed = 42);
+
+	/** Writes trackCount tracks in root, with one directory for each album. Returns the number of tracks written. */
+	int generate(const QString &root, int trackCount);
+
+	/** Number of external pictures written by the last call to generate(). */
+	inline int pictureCount() const { return _pictureCount; }
+};
+
+#endif // LIBRARYGENERATOR_H
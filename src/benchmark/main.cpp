@@ -0,0 +1,28 @@
+#include "scanbenchmark.h"
+
+#include <QApplication>
+#include <QFile>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QTest>
+
+int main(int argc, char *argv[])
+{
+	// Models are using pixmaps and fonts, but nothing has to be displayed
+	if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+	}
+
+	// The database and settings of the user are left untouched
+	QStandardPaths::setTestModeEnabled(true);
+	QSettings::setDefaultFormat(QSettings::IniFormat);
+	QSettings::setPath(QSettings::IniFormat, QSettings::UserScope, QStandardPaths::writableLocation(QStandardPaths::GenericConfigLocation));
+	QString db = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + "/MmeMiamMiam/MiamPlayer/mp.db";
+	for (QString suffix : { "", "-wal", "-shm" }) {
+		QFile::remove(db + suffix);
+	}
+
+	QApplication app(argc, argv);
+	ScanBenchmark benchmark;
+	return QTest::qExec(&benchmark, argc, argv);
+}
@@ -0,0 +1,353 @@
+#include "scanbenchmark.h"
+
+#include "librarygenerator.h"
+
+#include <filehelper.h>
+#include <libraryitemmodel.h>
+#include <model/schemamigration.h>
+#include <model/sqldatabase.h>
+#include <musicsearchengine.h>
+#include <normalizer.h>
+#include <settingsprivate.h>
+#include <uniquelibraryitemmodel.h>
+
+#include <algorithm>
+
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSqlQuery>
+#include <QtTest>
+
+/** Forgets the highest memory usage of this process so far. Linux only. */
+void ScanBenchmark::resetPeakMemory()
+{
+#ifdef Q_OS_LINUX
+	QFile clearRefs("/proc/self/clear_refs");
+	if (clearRefs.open(QIODevice::WriteOnly)) {
+		clearRefs.write("5");
+	}
+#endif
+}
+
+/** Returns the highest memory usage of this process in kB, or -1 when it's unknown. */
+qint64 ScanBenchmark::peakMemory()
+{
+#ifdef Q_OS_LINUX
+	QFile status("/proc/self/status");
+	if (status.open(QIODevice::ReadOnly | QIODevice::Text)) {
+		for (QByteArray line = status.readLine(); !line.isEmpty(); line = status.readLine()) {
+			if (line.startsWith("VmHWM:")) {
+				return line.mid(6).trimmed().split(' ').first().toLongLong();
+			}
+		}
+	}
+#endif
+	return -1;
+}
+
+/** Loads model and waits for its items, which are read in the database thread. Returns false after a minute. */
+bool ScanBenchmark::loadAndWait(MiamItemModel *model)
+{
+	QSignalSpy loaded(model, &MiamItemModel::loaded);
+	model->load();
+	return loaded.wait(60000);
+}
+
+void ScanBenchmark::initTestCase()
+{
+	QVERIFY(_library.isValid());
+	_trackCount = qEnvironmentVariableIsSet("MIAM_BENCH_TRACKS") ? qgetenv("MIAM_BENCH_TRACKS").toInt() : 2000;
+	QVERIFY(_trackCount > 0);
+
+	QElapsedTimer timer;
+	timer.start();
+	LibraryGenerator generator;
+	QCOMPARE(generator.generate(_library.path(), _trackCount), _trackCount);
+	qInfo() << _trackCount << "tracks and" << generator.pictureCount() << "pictures generated in" << timer.elapsed() << "ms";
+
+	SettingsPrivate::instance()->setMusicLocations(QStringList() << _library.path());
+
+	// Indexes and full-text search are built before the first scan, like they would be after an upgrade
+	SchemaMigration migration;
+	QVERIFY(migration.upgrade(*SqlDatabase::instance()));
+}
+
+void ScanBenchmark::scanLibrary_data()
+{
+	QTest::addColumn<int>("profile");
+	QTest::newRow("SSD") << static_cast<int>(SettingsPrivate::SP_SSD);
+	QTest::newRow("HDD") << static_cast<int>(SettingsPrivate::SP_HDD);
+	QTest::newRow("high latency") << static_cast<int>(SettingsPrivate::SP_HighLatency);
+}
+
+void ScanBenchmark::scanLibrary()
+{
+	// Every file is read again by each full scan, only the order and the pace of reads are changing
+	QFETCH(int, profile);
+	SettingsPrivate::instance()->setScanProfile(static_cast<SettingsPrivate::ScanProfile>(profile));
+	MusicSearchEngine engine;
+	engine.setScanMode(MusicSearchEngine::SM_Full);
+	qint64 elapsed = 0;
+	QBENCHMARK_ONCE {
+		QElapsedTimer timer;
+		timer.start();
+		engine.doSearch();
+		elapsed = timer.elapsed();
+	}
+	qInfo() << "full scan:" << _trackCount * 1000 / qMax<qint64>(1, elapsed) << "files/s";
+
+	QSqlQuery q(*SqlDatabase::instance());
+	QVERIFY(q.exec("SELECT COUNT(*) FROM tracks") && q.next());
+	QCOMPARE(q.value(0).toInt(), _trackCount);
+}
+
+void ScanBenchmark::rescanLibrary()
+{
+	// Nothing has changed: only the filesystem is walked
+	SettingsPrivate::instance()->setScanProfile(SettingsPrivate::SP_SSD);
+	MusicSearchEngine engine;
+	engine.setScanMode(MusicSearchEngine::SM_Incremental);
+	qint64 elapsed = 0;
+	QBENCHMARK_ONCE {
+		QElapsedTimer timer;
+		timer.start();
+		engine.doSearch();
+		elapsed = timer.elapsed();
+	}
+	qInfo() << "incremental scan:" << _trackCount * 1000 / qMax<qint64>(1, elapsed) << "files/s";
+}
+
+void ScanBenchmark::readTags_data()
+{
+	QTest::addColumn<int>("mode");
+	QTest::newRow("full") << static_cast<int>(FileHelper::RM_Full);
+	QTest::newRow("fast") << static_cast<int>(FileHelper::RM_Fast);
+}
+
+void ScanBenchmark::readTags()
+{
+	// Files are in the page cache since the first scan: only the parsing of tags is measured, not the disk
+	QFETCH(int, mode);
+	QStringList files;
+	QDirIterator it(_library.path(), FileHelper::suffixes(FileHelper::ET_Standard, true), QDir::Files, QDirIterator::Subdirectories);
+	while (it.hasNext()) {
+		files.append(it.next());
+	}
+	QVERIFY(!files.isEmpty());
+
+	qint64 elapsed = 0;
+	QBENCHMARK_ONCE {
+		QElapsedTimer timer;
+		timer.start();
+		for (QString file : files) {
+			FileHelper fh(file, static_cast<FileHelper::ReadMode>(mode));
+			QVERIFY(fh.isValid());
+			fh.title();
+			fh.artist();
+			fh.album();
+			fh.length();
+		}
+		elapsed = timer.elapsed();
+	}
+	qInfo() << "tags:" << files.size() * 1000 / qMax<qint64>(1, elapsed) << "files/s";
+}
+
+void ScanBenchmark::normalizeNames_data()
+{
+	QTest::addColumn<bool>("asciiOnly");
+	QTest::newRow("names of the library") << false;
+	QTest::newRow("ASCII names") << true;
+}
+
+void ScanBenchmark::normalizeNames()
+{
+	// Same strings as a scan and a load of the library: titles, artists and albums of every track
+	QFETCH(bool, asciiOnly);
+	QStringList names;
+	QSqlQuery q(*SqlDatabase::instance());
+	QVERIFY(q.exec("SELECT trackTitle, artist, album FROM cache"));
+	while (q.next()) {
+		for (int i = 0; i < 3; i++) {
+			QString name = q.value(i).toString();
+			if (!asciiOnly || std::all_of(name.cbegin(), name.cend(), [](QChar c) { return c.unicode() < 0x80; })) {
+				names.append(name);
+			}
+		}
+	}
+	QVERIFY(!names.isEmpty());
+
+	QBENCHMARK {
+		for (QString name : names) {
+			Normalizer::normalizeField(name);
+			Normalizer::separatorLetter(name);
+		}
+	}
+	qInfo() << names.size() << "names";
+}
+
+void ScanBenchmark::loadLibraryItemModel_data()
+{
+	QTest::addColumn<bool>("lazily");
+	QTest::newRow("everything") << false;
+	QTest::newRow("top level items") << true;
+}
+
+void ScanBenchmark::loadLibraryItemModel()
+{
+	QFETCH(bool, lazily);
+	SettingsPrivate::instance()->setLibraryLoadedLazily(lazily);
+	resetPeakMemory();
+	LibraryItemModel model;
+	QBENCHMARK {
+		QVERIFY(loadAndWait(&model));
+	}
+	qInfo() << "peak memory:" << peakMemory() << "kB";
+	qInfo() << "values of" << model.trackTable()->rowCount() << "tracks:" << model.trackTable()->memoryUsage() / 1024 << "kB, instead of"
+			<< model.trackTable()->variantMemoryUsage() / 1024 << "kB as roles of items";
+}
+
+void ScanBenchmark::loadUniqueLibraryItemModel()
+{
+	// Its constructor starts a load too, which is replaced by the first one that is measured
+	resetPeakMemory();
+	UniqueLibraryItemModel model;
+	QBENCHMARK {
+		QVERIFY(loadAndWait(&model));
+	}
+	qInfo() << "peak memory:" << peakMemory() << "kB";
+	qInfo() << "values of" << model.trackTable()->rowCount() << "tracks:" << model.trackTable()->memoryUsage() / 1024 << "kB, instead of"
+			<< model.trackTable()->variantMemoryUsage() / 1024 << "kB as roles of items";
+}
+
+void ScanBenchmark::searchDatabase_data()
+{
+	QTest::addColumn<QString>("text");
+	QTest::newRow("one letter") << QString("k");
+	QTest::newRow("prefix") << QString("kalo");
+	QTest::newRow("two words") << QString("ra ten");
+	QTest::newRow("accents") << QString("bjork");
+	QTest::newRow("no match") << QString("zzzz");
+}
+
+void ScanBenchmark::searchDatabase()
+{
+	// Same queries as the search dialog, for each keystroke
+	QFETCH(QString, text);
+	SqlDatabase *db = SqlDatabase::instance();
+	QBENCHMARK {
+		QSqlQuery artists = db->search("artist", text, "artist");
+		artists.exec();
+		while (artists.next()) {}
+		QSqlQuery albums = db->search("album, artist", text, "album");
+		albums.exec();
+		while (albums.next()) {}
+		QSqlQuery tracks = db->search("trackTitle, COALESCE(artistAlbum, artist), uri", text, "trackTitle");
+		tracks.exec();
+		while (tracks.next()) {}
+	}
+}
+
+void ScanBenchmark::filterLibrary_data()
+{
+	this->searchDatabase_data();
+}
+
+void ScanBenchmark::filterLibrary()
+{
+	// Filters the tree of the library, like typing in its search box. Children are read asynchronously when the library is
+	// loaded lazily, so everything is loaded first
+	QFETCH(QString, text);
+	SettingsPrivate::instance()->setLibraryLoadedLazily(false);
+	LibraryItemModel model;
+	QVERIFY(loadAndWait(&model));
+	QBENCHMARK {
+		model.proxy()->findMusic(text);
+		model.proxy()->findMusic(QString());
+	}
+}
+
+void ScanBenchmark::typeInLibrary_data()
+{
+	this->searchDatabase_data();
+}
+
+void ScanBenchmark::typeInLibrary()
+{
+	// Same as filterLibrary, one character at a time: each filter is refining the previous one
+	QFETCH(QString, text);
+	SettingsPrivate::instance()->setLibraryLoadedLazily(false);
+	LibraryItemModel model;
+	QVERIFY(loadAndWait(&model));
+	QBENCHMARK {
+		for (int i = 1; i <= text.size(); i++) {
+			model.proxy()->findMusic(text.left(i));
+		}
+		model.proxy()->findMusic(QString());
+	}
+}
+
+void ScanBenchmark::sortLibrary()
+{
+	// Changes the sort order of the whole tree, like the header of the library does
+	SettingsPrivate::instance()->setLibraryLoadedLazily(false);
+	LibraryItemModel model;
+	QVERIFY(loadAndWait(&model));
+	QBENCHMARK {
+		model.proxy()->sort(0, Qt::DescendingOrder);
+		model.proxy()->sort(0, Qt::AscendingOrder);
+	}
+}
+
+void ScanBenchmark::migrateDatabase()
+{
+	// Every track is in the single table of versions without a schema version, like after years of use. Quick steps are
+	// applied when a connection is opened, long ones in background: both are measured
+	int rowCount = qEnvironmentVariableIsSet("MIAM_BENCH_MIGRATION_ROWS") ? qgetenv("MIAM_BENCH_MIGRATION_ROWS").toInt() : 1000000;
+	QVERIFY(rowCount > 0);
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+
+	// Same kind of connection as the player, on another file
+	SqlDatabase db;
+	db.close();
+	db.setDatabaseName(dir.path() + "/mp.db");
+	QVERIFY(db.open());
+	{
+		QSqlQuery q(db);
+		QVERIFY(q.exec("CREATE TABLE cache (uri varchar(255) PRIMARY KEY ASC, trackNumber INTEGER, trackTitle varchar(255), trackLength INTEGER, " \
+					   "artist varchar(255), artistNormalized varchar(255), album varchar(255), albumNormalized varchar(255), " \
+					   "artistAlbum varchar(255), albumYear INTEGER, rating INTEGER, disc INTEGER, cover varchar(255), " \
+					   "internalCover varchar(255), host varchar(255), icon varchar(255))"));
+
+		// Ten tracks per album, twenty albums per artist
+		q.prepare("WITH RECURSIVE n(i) AS (SELECT 0 UNION ALL SELECT i + 1 FROM n WHERE i + 1 < ?) " \
+				  "INSERT INTO cache (uri, trackNumber, trackTitle, trackLength, artist, artistNormalized, album, albumNormalized, " \
+				  "artistAlbum, albumYear, rating, disc) " \
+				  "SELECT '/music/' || (i / 200) || '/' || (i / 10) || '/' || i || '.mp3', i % 10 + 1, " \
+				  "'Song ' || (i % 997) || ' of ' || (i % 31), 120 + i % 300, 'Artist ' || (i / 200), 'artist' || (i / 200), " \
+				  "'Album ' || (i / 10), 'album' || (i / 10), 'Artist ' || (i / 200), 1950 + (i / 10) % 70, -1, 1 FROM n");
+		q.addBindValue(rowCount);
+		QVERIFY(db.transaction());
+		QVERIFY(q.exec());
+		QVERIFY(db.commit());
+	}
+
+	SchemaMigration migration;
+	qint64 quickSteps = 0;
+	qint64 longSteps = 0;
+	QBENCHMARK_ONCE {
+		QElapsedTimer timer;
+		timer.start();
+		QVERIFY(migration.upgrade(db, false));
+		quickSteps = timer.restart();
+		QVERIFY(migration.upgrade(db));
+		longSteps = timer.elapsed();
+	}
+	qInfo() << rowCount << "tracks: quick steps in" << quickSteps << "ms, long steps in" << longSteps << "ms";
+
+	QCOMPARE(SchemaMigration::version(db), SchemaMigration::latestVersion());
+	QSqlQuery q(db);
+	QVERIFY(q.exec("SELECT COUNT(*) FROM tracks") && q.next());
+	QCOMPARE(q.value(0).toInt(), rowCount);
+}
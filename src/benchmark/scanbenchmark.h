@@ -0,0 +1,70 @@
+#ifndef SCANBENCHMARK_H
+#define SCANBENCHMARK_H
+
+#include <QObject>
+#include <QTemporaryDir>
+
+/// Forward declarations
+class MiamItemModel;
+
+/**
+ * \brief		The ScanBenchmark class measures how fast a synthetic library is scanned, loaded into models and searched.
+ * \details		The library is generated once in a temporary directory. Settings and the database are redirected to test
+ *				locations, so the library of the user is never touched. The number of tracks can be set with MIAM_BENCH_TRACKS
+ *				(2000 by default), and a slow filesystem can be simulated with MIAM_SCAN_LATENCY, like "5-50". The upgrade of
+ *				the schema is measured on a separate database of MIAM_BENCH_MIGRATION_ROWS tracks (1000000 by default).
+ *				Peak memory is only reported on Linux.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+class ScanBenchmark : public QObject
+{
+	Q_OBJECT
+private:
+	QTemporaryDir _library;
+
+	int _trackCount;
+
+	/** Forgets the highest memory usage of this process so far. Linux only. */
+	static void resetPeakMemory();
+
+	/** Returns the highest memory usage of this process in kB, or -1 when it's unknown. */
+	static qint64 peakMemory();
+
+	/** Loads model and waits for its items, which are read in the database thread. Returns false after a minute. */
+	static bool loadAndWait(MiamItemModel *model);
+
+private slots:
+	void initTestCase();
+
+	void scanLibrary_data();
+	void scanLibrary();
+
+	void rescanLibrary();
+
+	void readTags_data();
+	void readTags();
+
+	void normalizeNames_data();
+	void normalizeNames();
+
+	void loadLibraryItemModel_data();
+	void loadLibraryItemModel();
+
+	void loadUniqueLibraryItemModel();
+
+	void searchDatabase_data();
+	void searchDatabase();
+
+	void filterLibrary_data();
+	void filterLibrary();
+
+	void typeInLibrary_data();
+	void typeInLibrary();
+
+	void sortLibrary();
+
+	void migrateDatabase();
+};
+
+#endif // SCANBENCHMARK_H
@@ -60,6 +60,9 @@ public:
 
 	virtual ViewType type() const = 0;
 
+	/** Called after a partial rescan of the library or when tags were edited. Views which can't apply changes incrementally are reloaded. */
+	virtual void updateModel(const QStringList & /*updatedTracks*/, const QStringList & /*removedTracks*/) { this->loadModel(); }
+
 	virtual bool viewProperty(Settings::ViewProperty) const { return false; }
 
 public slots:
@@ -40,6 +40,8 @@ unix:!macx {
     QT += x11extras
     LIBS += -L$$OUT_PWD -L/usr/lib/x86_64-linux-gnu/ -ltag
     LIBS += -lQtAV
+    SOURCES += scanner/librarywatcher.cpp
+    HEADERS += scanner/librarywatcher.h
     target.path = /usr/lib$$LIB_SUFFIX/
     INSTALLS += target
 }
@@ -58,11 +60,20 @@ SOURCES += library/jumptowidget.cpp \
     mediabuttons/playbackmodebutton.cpp \
     mediabuttons/playbutton.cpp \
     mediabuttons/stopbutton.cpp \
+    model/databaseservice.cpp \
     model/genericdao.cpp \
     model/playlistdao.cpp \
+    model/schemamigration.cpp \
     model/selectedtracksmodel.cpp \
     model/sqldatabase.cpp \
     model/trackdao.cpp \
+    scanner/bufferedfilestream.cpp \
+    scanner/filefingerprint.cpp \
+    scanner/scanfilesystem.cpp \
+    scanner/scaniopolicy.cpp \
+    scanner/scanpipeline.cpp \
+    scanner/scanwalker.cpp \
+    scanner/trackrecord.cpp \
     styling/imageutils.cpp \
     styling/lineedit.cpp \
     styling/miamslider.cpp \
@@ -77,6 +88,7 @@ SOURCES += library/jumptowidget.cpp \
     mediaplaylist.cpp \
     miamsortfilterproxymodel.cpp \
     musicsearchengine.cpp \
+    normalizer.cpp \
     plugininfo.cpp \
     quickstartsearchengine.cpp \
     scrollbar.cpp \
@@ -94,11 +106,22 @@ HEADERS += interfaces/basicplugin.h \
     mediabuttons/playbackmodebutton.h \
     mediabuttons/playbutton.h \
     mediabuttons/stopbutton.h \
+    model/databaseservice.h \
     model/genericdao.h \
     model/playlistdao.h \
+    model/schemamigration.h \
     model/selectedtracksmodel.h \
     model/sqldatabase.h \
     model/trackdao.h \
+    scanner/boundedqueue.h \
+    scanner/bufferedfilestream.h \
+    scanner/filefingerprint.h \
+    scanner/pendingcall.h \
+    scanner/scanfilesystem.h \
+    scanner/scaniopolicy.h \
+    scanner/scanpipeline.h \
+    scanner/scanwalker.h \
+    scanner/trackrecord.h \
     styling/imageutils.h \
     styling/lineedit.h \
     styling/miamslider.h \
@@ -119,6 +142,7 @@ HEADERS += interfaces/basicplugin.h \
     miamcore_global.h \
     miamsortfilterproxymodel.h \
     musicsearchengine.h \
+    normalizer.h \
     plugininfo.h \
     quickstartsearchengine.h \
     scrollbar.h \
@@ -1,5 +1,6 @@
 #include "filehelper.h"
 #include "cover.h"
+#include "scanner/bufferedfilestream.h"
 
 #include <algorithm>
 #include <map>
@@ -22,6 +23,7 @@
 #include <taglib/opusfile.h>
 #include <taglib/vorbisfile.h>
 
+#include <taglib/id3v2framefactory.h>
 #include <taglib/id3v2tag.h>
 #include <taglib/id3v2frame.h>
 
@@ -41,6 +43,7 @@
 
 FileHelper::FileHelper(const QMediaContent &track)
 	: _file(nullptr)
+	, _stream(nullptr)
 	, _fileType(EXT_UNKNOWN)
 	, _isValid(false)
 {
@@ -57,18 +60,21 @@ FileHelper::FileHelper(const QMediaContent &track)
 	}
 }
 
-FileHelper::FileHelper(const QString &filePath)
+FileHelper::FileHelper(const QString &filePath, ReadMode mode)
 	: _file(nullptr)
+	, _stream(nullptr)
 	, _fileType(EXT_UNKNOWN)
 	, _isValid(false)
 {
-	bool b = init(filePath);
+	bool b = init(filePath, mode);
 	if (!b) {
-		b = init(filePath.toStdString().c_str());
+		b = init(filePath.toStdString().c_str(), mode);
 	}
 	if (!b) {
 		delete _file;
 		_file = nullptr;
+		delete _stream;
+		_stream = nullptr;
 		_fileType = EXT_UNKNOWN;
 	}
 }
@@ -99,7 +105,7 @@ std::string FileHelper::keyToStdString(Field f)
 	}
 }
 
-bool FileHelper::init(const QString &filePath)
+bool FileHelper::init(const QString &filePath, ReadMode mode)
 {
 	QString fileName;
 	if (filePath.startsWith("file")) {
@@ -115,36 +121,42 @@ bool FileHelper::init(const QString &filePath)
 	TagLib::String s(QDir::toNativeSeparators(fileName).toUtf8().constData(), TagLib::String::UTF8);
 	TagLib::FileName fp(s.toCString(true));
 #endif
+	if (mode == RM_Fast && suffixes().contains(suffix)) {
+		delete _stream;
+		_stream = new BufferedFileStream(fileName);
+	}
+	const TagLib::AudioProperties::ReadStyle fast = TagLib::AudioProperties::Fast;
 	if (suffix == "ape") {
-		_file = new TagLib::APE::File(fp);
+		_file = _stream ? new TagLib::APE::File(_stream, true, fast) : new TagLib::APE::File(fp);
 		_fileType = EXT_APE;
 	} else if (suffix == "asf") {
-		_file = new TagLib::ASF::File(fp);
+		_file = _stream ? new TagLib::ASF::File(_stream, true, fast) : new TagLib::ASF::File(fp);
 		_fileType = EXT_ASF;
 	} else if (suffix == "flac") {
-		_file = new TagLib::FLAC::File(fp);
+		_file = _stream ? new TagLib::FLAC::File(_stream, TagLib::ID3v2::FrameFactory::instance(), true, fast) : new TagLib::FLAC::File(fp);
 		_fileType = EXT_FLAC;
 	} else if (suffix == "m4a" || suffix == "mp4") {
-		_file = new TagLib::MP4::File(fp);
+		_file = _stream ? new TagLib::MP4::File(_stream, true, fast) : new TagLib::MP4::File(fp);
 		_fileType = EXT_MP4;
 	} else if (suffix == "mpc") {
-		_file = new TagLib::MPC::File(fp);
+		_file = _stream ? new TagLib::MPC::File(_stream, true, fast) : new TagLib::MPC::File(fp);
 		_fileType = EXT_MPC;
 	} else if (suffix == "mp3") {
-		_file = new TagLib::MPEG::File(fp);
+		_file = _stream ? new TagLib::MPEG::File(_stream, TagLib::ID3v2::FrameFactory::instance(), true, fast) : new TagLib::MPEG::File(fp);
 		_fileType = EXT_MP3;
 	} else if (suffix == "ogg" || suffix == "oga") {
-		_file = new TagLib::Vorbis::File(fp);
+		_file = _stream ? new TagLib::Vorbis::File(_stream, true, fast) : new TagLib::Vorbis::File(fp);
 		_fileType = EXT_OGG;
 	} else if (suffix == "opus") {
-		_file = new TagLib::Ogg::Opus::File(fp);
+		_file = _stream ? new TagLib::Ogg::Opus::File(_stream, true, fast) : new TagLib::Ogg::Opus::File(fp);
 		_fileType = EXT_OGG;
 	} else {
 		_file = nullptr;
 		_fileType = EXT_UNKNOWN;
 	}
 	if (_file != nullptr) {
-		_isValid = _fileInfo.exists();
+		// A stream has already reached the file: no need to ask the filesystem again
+		_isValid = _stream ? _stream->isOpen() : _fileInfo.exists();
 		return true;
 	} else {
 		delete _file;
@@ -160,6 +172,9 @@ FileHelper::~FileHelper()
 		delete _file;
 		_file = nullptr;
 	}
+	// TagLib doesn't take ownership of streams
+	delete _stream;
+	_stream = nullptr;
 }
 
 const QStringList FileHelper::suffixes(FileHelper::ExtensionTypes et, bool withPrefix)
@@ -14,6 +14,7 @@ class Cover;
 /// Forward declaration
 namespace TagLib {
 	class File;
+	class IOStream;
 
 	namespace ID3v2 {
 		class Tag;
@@ -34,6 +35,9 @@ class MIAMCORE_LIBRARY FileHelper
 private:
 	TagLib::File *_file;
 
+	/** Only used when reading in fast mode, deleted after _file. */
+	TagLib::IOStream *_stream;
+
 	int _fileType;
 	bool _isValid;
 
@@ -62,6 +66,13 @@ public:
 	};
 	Q_DECLARE_FLAGS(ExtensionTypes, ExtensionType)
 
+	/** Fast mode is for the scanner: tags are parsed from both ends of the file kept in memory, and audio properties are
+	 * estimated from the first frames. Files opened in fast mode can't be saved. */
+	enum ReadMode {
+		RM_Full		= 0,
+		RM_Fast		= 1
+	};
+
 	enum TagKey {
 		Artist
 	};
@@ -83,12 +94,12 @@ public:
 
 	explicit FileHelper(const QMediaContent &track);
 
-	explicit FileHelper(const QString &filePath);
+	explicit FileHelper(const QString &filePath, ReadMode mode = RM_Full);
 
 	static std::string keyToStdString(Field f);
 
 private:
-	bool init(const QString &filePath);
+	bool init(const QString &filePath, ReadMode mode = RM_Full);
 
 public:
 	virtual ~FileHelper();
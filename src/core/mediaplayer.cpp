@@ -2,7 +2,7 @@
 
 #include "settings.h"
 #include "settingsprivate.h"
-#include "model/sqldatabase.h"
+#include "model/databaseservice.h"
 #include <QDir>
 #include <QGuiApplication>
 #include <QMediaContent>
@@ -53,13 +53,14 @@ MediaPlayer::MediaPlayer(QObject *parent)
 	_localPlayer->audio()->setVolume(Settings::instance()->volume());
 
 	connect(this, &MediaPlayer::currentMediaChanged, this, [=] (const QString &uri) {
-		QWindow *w = QGuiApplication::topLevelWindows().first();
-		TrackDAO t = SqlDatabase().selectTrackByURI(uri);
-		if (t.artist().isEmpty()) {
-			w->setTitle(t.title() + " - Miam Player");
-		} else {
-			w->setTitle(t.title() + " (" + t.artist() + ") - Miam Player");
-		}
+		DatabaseService::instance()->selectTrackByURI(uri, this, [=](const TrackDAO &t) {
+			QWindow *w = QGuiApplication::topLevelWindows().first();
+			if (t.artist().isEmpty()) {
+				w->setTitle(t.title() + " - Miam Player");
+			} else {
+				w->setTitle(t.title() + " (" + t.artist() + ") - Miam Player");
+			}
+		});
 	});
 
 	// Link core multimedia actions
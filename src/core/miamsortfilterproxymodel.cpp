@@ -85,6 +85,22 @@ void MiamSortFilterProxyModel::highlightMatchingText(const QString &text)
 	emit aboutToHighlightLetters(lettersToHighlight);
 }
 
+/** Redefined to compare ranks of items in the collation order when their model has computed them. */
+bool MiamSortFilterProxyModel::lessThan(const QModelIndex &left, const QModelIndex &right) const
+{
+	// Comparing strings is the slow part of sorting big libraries. Items inserted after ranks were computed have none
+	if (sortRole() == Miam::DF_NormalizedString) {
+		bool leftHasRank = false;
+		bool rightHasRank = false;
+		int leftRank = left.data(Miam::DF_SortRank).toInt(&leftHasRank);
+		int rightRank = right.data(Miam::DF_SortRank).toInt(&rightHasRank);
+		if (leftHasRank && rightHasRank) {
+			return leftRank < rightRank;
+		}
+	}
+	return QSortFilterProxyModel::lessThan(left, right);
+}
+
 /** Reduce the size of the library when the user is typing text. */
 void MiamSortFilterProxyModel::filterLibrary(const QString &filter)
 {
@@ -30,7 +30,7 @@ public:
 	inline void setTopLevelItems(const QMultiHash<SeparatorItem*, QModelIndex> &topLevelItems) { _topLevelItems = topLevelItems; }
 
 	/** Single entry point for filtering library, and dispatch to the chosen operation defined in settings. */
-	void findMusic(const QString &text);
+	virtual void findMusic(const QString &text);
 
 	/** Highlight items in the Tree when one has activated this option in settings. */
 	void highlightMatchingText(const QString &text);
@@ -38,6 +38,10 @@ public:
 	/** For classes that are subclassing this filter, allow to change sort column (for models based on a Table for example). */
 	virtual int defaultSortColumn() const { return 0; }
 
+protected:
+	/** Redefined to compare ranks of items in the collation order when their model has computed them. */
+	virtual bool lessThan(const QModelIndex &left, const QModelIndex &right) const override;
+
 private:
 	/** Reduce the size of the library when the user is typing text. */
 	void filterLibrary(const QString &filter);
@@ -0,0 +1,65 @@
+#include "databaseservice.h"
+
+#include <QCoreApplication>
+
+DatabaseService::DatabaseService(QObject *parent)
+	: QObject(parent)
+	, _thread(new QThread(this))
+	, _worker(new DatabaseWorker)
+{
+	qRegisterMetaType<DatabaseJob>();
+	_thread->setObjectName("DatabaseService");
+	_worker->moveToThread(_thread);
+	connect(_thread, &QThread::finished, _worker, &QObject::deleteLater);
+	_thread->start();
+}
+
+DatabaseService::~DatabaseService()
+{
+	// Pending jobs are executed first, then the connection of this thread is closed
+	_thread->quit();
+	_thread->wait();
+}
+
+DatabaseService* DatabaseService::instance()
+{
+	// Deleted with the application, after it has sent aboutToQuit(): playlists can still be saved at this time
+	static DatabaseService *service = new DatabaseService(QCoreApplication::instance());
+	return service;
+}
+
+/** Queues job after those which were already sent. */
+void DatabaseService::dispatch(const DatabaseJob &job)
+{
+	// Unlike zero-timers, queued invocations to the same receiver are delivered in the order they were sent
+	QMetaObject::invokeMethod(_worker, "execute", Qt::QueuedConnection, Q_ARG(DatabaseJob, job));
+}
+
+/** Executes job in the database thread, without waiting for it. */
+void DatabaseService::post(const std::function<void(SqlDatabase*)> &job)
+{
+	this->dispatch([=]() {
+		job(SqlDatabase::instance());
+	});
+}
+
+void DatabaseService::removeCoverForAlbum(bool internalCover, const QString &artistNorm, const QString &albumNorm)
+{
+	this->post([=](SqlDatabase *db) {
+		db->removeCoverForAlbum(internalCover, artistNorm, albumNorm);
+	});
+}
+
+void DatabaseService::selectPlaylistWithTracks(uint playlistId, QObject *context, const std::function<void(const QPair<PlaylistDAO, QStringList> &)> &callback)
+{
+	this->run<QPair<PlaylistDAO, QStringList>>([=](SqlDatabase *db) {
+		return qMakePair(db->selectPlaylist(playlistId), db->selectPlaylistTracks(playlistId));
+	}, context, callback);
+}
+
+void DatabaseService::selectTrackByURI(const QString &uri, QObject *context, const std::function<void(const TrackDAO &)> &callback)
+{
+	this->run<TrackDAO>([=](SqlDatabase *db) {
+		return db->selectTrackByURI(uri);
+	}, context, callback);
+}
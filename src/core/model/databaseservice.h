@@ -0,0 +1,127 @@
+#ifndef DATABASESERVICE_H
+#define DATABASESERVICE_H
+
+#include <QObject>
+#include <QPair>
+#include <QSemaphore>
+#include <QStringList>
+#include <QThread>
+
+#include <functional>
+#include <memory>
+
+#include "../miamcore_global.h"
+#include "playlistdao.h"
+#include "sqldatabase.h"
+#include "trackdao.h"
+
+/** A job and its parameters, bound before it's sent to the database thread. */
+typedef std::function<void()> DatabaseJob;
+Q_DECLARE_METATYPE(DatabaseJob)
+
+/**
+ * \brief		The DatabaseWorker class lives in the database thread and executes jobs.
+ * \details		Jobs are sent with queued invocations: they're posted as events to this object, which are delivered in the
+ *				order they were sent.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+class MIAMCORE_LIBRARY DatabaseWorker : public QObject
+{
+	Q_OBJECT
+public:
+	explicit DatabaseWorker(QObject *parent = nullptr) : QObject(parent) {}
+
+	Q_INVOKABLE void execute(const DatabaseJob &job) { job(); }
+};
+
+/**
+ * \brief		The DatabaseReply class notifies the thread of a caller that its job has been executed.
+ * \details		It's created in the thread of the caller and its signal is emitted from the database thread, so a queued
+ *				connection is used. When the receiver is destroyed before, the callback is simply not called.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+class MIAMCORE_LIBRARY DatabaseReply : public QObject
+{
+	Q_OBJECT
+public:
+	explicit DatabaseReply(QObject *parent = nullptr) : QObject(parent) {}
+
+signals:
+	void finished();
+};
+
+/**
+ * \brief		The DatabaseService class executes queries in a dedicated thread, with its own connection to the database.
+ * \details		Widgets shouldn't wait for SQLite while they're painting or reacting to user input. Jobs are executed one by one,
+ *				in the order they were sent, and their result is given back to a callback in the thread of a context object,
+ *				like a slot. Jobs which need their result right away (like saving playlists when the application is exiting)
+ *				can use runAndWait(): the caller is still blocked, but queries aren't executed with a connection of the main
+ *				thread.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+class MIAMCORE_LIBRARY DatabaseService : public QObject
+{
+	Q_OBJECT
+private:
+	QThread *_thread;
+
+	/** Lives in _thread, jobs are sent to this object. */
+	DatabaseWorker *_worker;
+
+	explicit DatabaseService(QObject *parent = nullptr);
+
+	/** Queues job after those which were already sent. */
+	void dispatch(const DatabaseJob &job);
+
+public:
+	virtual ~DatabaseService();
+
+	static DatabaseService* instance();
+
+	/** Executes job in the database thread, without waiting for it. */
+	void post(const std::function<void(SqlDatabase*)> &job);
+
+	/** Executes job in the database thread, then callback with its result in the thread of context. */
+	template<typename T>
+	void run(const std::function<T(SqlDatabase*)> &job, QObject *context, const std::function<void(const T&)> &callback)
+	{
+		std::shared_ptr<T> result = std::make_shared<T>();
+		DatabaseReply *reply = new DatabaseReply;
+		connect(reply, &DatabaseReply::finished, context, [=]() {
+			callback(*result);
+		});
+		this->dispatch([=]() {
+			*result = job(SqlDatabase::instance());
+			emit reply->finished();
+			reply->deleteLater();
+		});
+	}
+
+	/** Executes job in the database thread and waits for its result. */
+	template<typename T>
+	T runAndWait(const std::function<T(SqlDatabase*)> &job)
+	{
+		if (QThread::currentThread() == _thread) {
+			return job(SqlDatabase::instance());
+		}
+		T result;
+		QSemaphore done;
+		this->dispatch([&]() {
+			result = job(SqlDatabase::instance());
+			done.release();
+		});
+		done.acquire();
+		return result;
+	}
+
+	void removeCoverForAlbum(bool internalCover, const QString &artistNorm, const QString &albumNorm);
+
+	void selectPlaylistWithTracks(uint playlistId, QObject *context, const std::function<void(const QPair<PlaylistDAO, QStringList> &)> &callback);
+
+	void selectTrackByURI(const QString &uri, QObject *context, const std::function<void(const TrackDAO &)> &callback);
+};
+
+#endif // DATABASESERVICE_H
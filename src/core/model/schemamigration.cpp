@@ -0,0 +1,439 @@
+#include "schemamigration.h"
+
+#include <QAtomicInt>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+
+#include <QtDebug>
+
+#include "sqldatabase.h"
+
+namespace {
+	/** Applies a step. Caller has opened a transaction, and rolls it back when false is returned. */
+	typedef bool (*Step)(SqlDatabase &db);
+
+	struct MigrationStep
+	{
+		const char *description;
+		Step apply;
+		bool isLong;
+
+		/** Optional work done before apply, in as many transactions as needed. It has to resume where it has stopped. */
+		Step fill;
+	};
+
+	/** Number of tracks added to the full-text index in each transaction, so other connections aren't kept waiting. */
+	const int fullTextChunkSize = 5000;
+
+	QAtomicInt fullTextIndexReady(0);
+
+	bool execAll(SqlDatabase &db, const QStringList &statements)
+	{
+		QSqlQuery query(db);
+		for (QString statement : statements) {
+			if (!query.exec(statement)) {
+				qWarning() << Q_FUNC_INFO << query.lastError() << statement;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool hasTable(SqlDatabase &db, const QString &name)
+	{
+		QSqlQuery query(db);
+		query.prepare("SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = ?");
+		query.addBindValue(name);
+		return query.exec() && query.next();
+	}
+
+	/** Version 1: playlists, and paths of monitored directories. */
+	bool createPlaylistTables(SqlDatabase &db)
+	{
+		return execAll(db, {
+			"CREATE TABLE IF NOT EXISTS playlists (id INTEGER PRIMARY KEY, title varchar(255), duration INTEGER, icon varchar(255), " \
+			"host varchar(255), background varchar(255), checksum varchar(255))",
+			"CREATE TABLE IF NOT EXISTS playlistTracks (uri varchar(255) PRIMARY KEY ASC, playlistId INTEGER, " \
+			"FOREIGN KEY(playlistId) REFERENCES playlists(id) ON DELETE CASCADE)",
+			"CREATE TABLE IF NOT EXISTS filesystem (path VARCHAR(255) PRIMARY KEY ASC, lastModified INTEGER)"
+		});
+	}
+
+	/** Version 2: state of every local file found during the last scan, used for incremental rescans. */
+	bool createFilesTable(SqlDatabase &db)
+	{
+		return execAll(db, { "CREATE TABLE IF NOT EXISTS files (path VARCHAR(255) PRIMARY KEY ASC, size INTEGER, lastModified INTEGER, inode INTEGER)" });
+	}
+
+	/** Version 3: tables artists, albums and tracks, and view cache which joins them like the single table of older versions. */
+	bool createLibraryTables(SqlDatabase &db)
+	{
+		// Unknown years are empty strings, like before, because they are concatenated to build keys of albums in views
+		QStringList createTables = {
+			"CREATE TABLE IF NOT EXISTS artists (id INTEGER PRIMARY KEY, name varchar(255), normalizedName varchar(255) UNIQUE)",
+			"CREATE TABLE IF NOT EXISTS albums (id INTEGER PRIMARY KEY, artistId INTEGER NOT NULL REFERENCES artists(id), " \
+			"name varchar(255), normalizedName varchar(255), year INTEGER, cover varchar(255), UNIQUE (artistId, normalizedName))",
+			"CREATE TABLE IF NOT EXISTS tracks (uri varchar(255) PRIMARY KEY ASC, albumId INTEGER NOT NULL REFERENCES albums(id), " \
+			"trackNumber INTEGER, trackTitle varchar(255), trackLength INTEGER, artist varchar(255), rating INTEGER, disc INTEGER, " \
+			"internalCover varchar(255), host varchar(255), icon varchar(255))",
+			"CREATE VIEW IF NOT EXISTS cache AS SELECT t.rowid AS trackId, t.uri, t.trackNumber, t.trackTitle, t.trackLength, " \
+			"t.artist, ar.normalizedName AS artistNormalized, al.name AS album, al.normalizedName AS albumNormalized, " \
+			"ar.name AS artistAlbum, IFNULL(al.year, '') AS albumYear, t.rating, t.disc, al.cover, t.internalCover, t.host, t.icon, " \
+			"al.id AS albumId, ar.id AS artistId " \
+			"FROM tracks t JOIN albums al ON al.id = t.albumId JOIN artists ar ON ar.id = al.artistId"
+		};
+		if (!hasTable(db, "cache")) {
+			return execAll(db, createTables);
+		}
+
+		// Tracks of older versions are moved from table cache
+		qDebug() << Q_FUNC_INFO << "moving tracks into tables artists, albums and tracks";
+		QStringList statements = {
+			"DROP TRIGGER IF EXISTS cacheSearchInsert",
+			"DROP TRIGGER IF EXISTS cacheSearchDelete",
+			"DROP TRIGGER IF EXISTS cacheSearchUpdate",
+			"DROP TABLE IF EXISTS cacheSearch",
+			"ALTER TABLE cache RENAME TO oldCache"
+		};
+		statements << createTables;
+		statements << "INSERT OR IGNORE INTO artists (name, normalizedName) SELECT artistAlbum, IFNULL(artistNormalized, '') FROM oldCache"
+				   << "INSERT OR IGNORE INTO albums (artistId, name, normalizedName, year, cover) " \
+					  "SELECT ar.id, c.album, IFNULL(c.albumNormalized, ''), NULLIF(c.albumYear, ''), c.cover FROM oldCache c " \
+					  "JOIN artists ar ON ar.normalizedName = IFNULL(c.artistNormalized, '')"
+				   << "INSERT OR REPLACE INTO tracks (uri, albumId, trackNumber, trackTitle, trackLength, artist, rating, disc, internalCover, host, icon) " \
+					  "SELECT c.uri, al.id, c.trackNumber, c.trackTitle, c.trackLength, c.artist, c.rating, c.disc, c.internalCover, c.host, c.icon " \
+					  "FROM oldCache c JOIN artists ar ON ar.normalizedName = IFNULL(c.artistNormalized, '') " \
+					  "JOIN albums al ON al.artistId = ar.id AND al.normalizedName = IFNULL(c.albumNormalized, '')"
+				   << "DROP TABLE oldCache";
+		return execAll(db, statements);
+	}
+
+	/** Version 4: lookups of albums by name, and of tracks by album (orphans, deletion of albums). */
+	bool createLibraryIndexes(SqlDatabase &db)
+	{
+		return execAll(db, {
+			"CREATE INDEX IF NOT EXISTS indexAlbumName ON albums (normalizedName)",
+			"CREATE INDEX IF NOT EXISTS indexTrackAlbum ON tracks (albumId)"
+		});
+	}
+
+	/** Triggers which keep the full-text index up to date. While it's being filled, only tracks already in it are updated. */
+	QStringList fullTextTriggers(bool isFilled)
+	{
+		QString oldCondition = isFilled ? QString() : " AND old.rowid <= (SELECT lastTrackId FROM fullTextProgress)";
+		QString newCondition = isFilled ? QString() : " AND new.rowid <= (SELECT lastTrackId FROM fullTextProgress)";
+
+		// Names of albums and artists are never modified, so they can be read again when a track is removed
+		return {
+			"CREATE TRIGGER cacheSearchInsert AFTER INSERT ON tracks BEGIN " \
+			"INSERT INTO cacheSearch (rowid, trackTitle, artist, album, artistAlbum) " \
+			"SELECT new.rowid, new.trackTitle, new.artist, al.name, ar.name FROM albums al JOIN artists ar ON ar.id = al.artistId " \
+			"WHERE al.id = new.albumId" + newCondition + "; END",
+			"CREATE TRIGGER cacheSearchDelete AFTER DELETE ON tracks BEGIN " \
+			"INSERT INTO cacheSearch (cacheSearch, rowid, trackTitle, artist, album, artistAlbum) " \
+			"SELECT 'delete', old.rowid, old.trackTitle, old.artist, al.name, ar.name FROM albums al JOIN artists ar ON ar.id = al.artistId " \
+			"WHERE al.id = old.albumId" + oldCondition + "; END",
+			"CREATE TRIGGER cacheSearchUpdate AFTER UPDATE OF trackTitle, artist, albumId ON tracks BEGIN " \
+			"INSERT INTO cacheSearch (cacheSearch, rowid, trackTitle, artist, album, artistAlbum) " \
+			"SELECT 'delete', old.rowid, old.trackTitle, old.artist, al.name, ar.name FROM albums al JOIN artists ar ON ar.id = al.artistId " \
+			"WHERE al.id = old.albumId" + oldCondition + "; " \
+			"INSERT INTO cacheSearch (rowid, trackTitle, artist, album, artistAlbum) " \
+			"SELECT new.rowid, new.trackTitle, new.artist, al.name, ar.name FROM albums al JOIN artists ar ON ar.id = al.artistId " \
+			"WHERE al.id = new.albumId" + newCondition + "; END"
+		};
+	}
+
+	/** Adds tracks of the library which come after the last one already in the full-text index, at most limit tracks if it's positive. */
+	bool indexNextTracks(SqlDatabase &db, int limit, bool &hasEnded)
+	{
+		QSqlQuery query(db);
+		if (!query.exec("SELECT lastTrackId FROM fullTextProgress") || !query.next()) {
+			return false;
+		}
+		qint64 lastTrackId = query.value(0).toLongLong();
+
+		query.prepare("SELECT MAX(trackId) FROM (SELECT trackId FROM cache WHERE trackId > ? ORDER BY trackId LIMIT ?)");
+		query.addBindValue(lastTrackId);
+		query.addBindValue(limit > 0 ? limit : -1);
+		if (!query.exec() || !query.next()) {
+			return false;
+		}
+		hasEnded = query.isNull(0);
+		if (hasEnded) {
+			return true;
+		}
+		qint64 chunkEnd = query.value(0).toLongLong();
+
+		query.prepare("INSERT INTO cacheSearch (rowid, trackTitle, artist, album, artistAlbum) " \
+					  "SELECT trackId, trackTitle, artist, album, artistAlbum FROM cache WHERE trackId > ? AND trackId <= ?");
+		query.addBindValue(lastTrackId);
+		query.addBindValue(chunkEnd);
+		if (!query.exec()) {
+			qWarning() << Q_FUNC_INFO << query.lastError();
+			return false;
+		}
+		query.prepare("UPDATE fullTextProgress SET lastTrackId = ?");
+		query.addBindValue(chunkEnd);
+		return query.exec();
+	}
+
+	/** Before version 5: creates the full-text index, then fills it with tracks already in the library. Each chunk of tracks
+	 * has its own transaction, so the library can be browsed and scanned meanwhile. */
+	bool fillFullTextIndex(SqlDatabase &db)
+	{
+		QSqlQuery query(db);
+		if (!hasTable(db, "cacheSearch")) {
+			if (!query.exec("BEGIN IMMEDIATE")) {
+				return false;
+			}
+
+			// Tokens are case and accent insensitive, like normalizeField(). Option 2 needs SQLite 3.27, older versions are
+			// keeping diacritics on few latin letters only
+			bool isCreated = false;
+			for (QString removeDiacritics : { "2", "1" }) {
+				if (query.exec("CREATE VIRTUAL TABLE cacheSearch USING fts5(trackTitle, artist, album, artistAlbum, content = 'cache', " \
+							   "content_rowid = 'trackId', tokenize = 'unicode61 remove_diacritics " + removeDiacritics + "', prefix = '2 3')")) {
+					isCreated = true;
+					break;
+				}
+			}
+			if (!isCreated) {
+				// Nothing else can be done, library will be searched with LIKE
+				qDebug() << Q_FUNC_INFO << "FTS5 is not available:" << query.lastError();
+				query.exec("ROLLBACK");
+				return true;
+			}
+			QStringList statements = {
+				"CREATE TABLE fullTextProgress (id INTEGER PRIMARY KEY CHECK (id = 1), lastTrackId INTEGER)",
+				"INSERT INTO fullTextProgress (id, lastTrackId) VALUES (1, 0)"
+			};
+			if (!execAll(db, statements << fullTextTriggers(false)) || !query.exec("COMMIT")) {
+				query.exec("ROLLBACK");
+				return false;
+			}
+		}
+
+		bool hasEnded = !hasTable(db, "fullTextProgress");
+		while (!hasEnded) {
+			if (!query.exec("BEGIN IMMEDIATE")) {
+				return false;
+			}
+			if (!indexNextTracks(db, fullTextChunkSize, hasEnded) || !query.exec("COMMIT")) {
+				query.exec("ROLLBACK");
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/** Version 5: index on titles, artists and albums, which is kept up to date by triggers on table tracks. */
+	bool createFullTextIndex(SqlDatabase &db)
+	{
+		if (!hasTable(db, "fullTextProgress")) {
+			// FTS5 is not available
+			return true;
+		}
+
+		// Tracks inserted since the last chunk, then triggers are updating every track
+		bool hasEnded = false;
+		return indexNextTracks(db, 0, hasEnded) && execAll(db, QStringList {
+			"DROP TRIGGER cacheSearchInsert",
+			"DROP TRIGGER cacheSearchDelete",
+			"DROP TRIGGER cacheSearchUpdate"
+		} << fullTextTriggers(true) << "DROP TABLE fullTextProgress");
+	}
+
+	/** Version 6: journal of tracks which were inserted, updated or removed, so views can update only what has changed. */
+	bool createTrackChanges(SqlDatabase &db)
+	{
+		// Operations: 0 for insert, 1 for update, 2 for delete. INSERT OR REPLACE is logged as a delete followed by an insert
+		return execAll(db, {
+			"CREATE TABLE IF NOT EXISTS trackChanges (id INTEGER PRIMARY KEY AUTOINCREMENT, uri varchar(255), operation INTEGER)",
+			"CREATE TRIGGER IF NOT EXISTS trackChangesInsert AFTER INSERT ON tracks BEGIN " \
+			"INSERT INTO trackChanges (uri, operation) VALUES (new.uri, 0); END",
+			"CREATE TRIGGER IF NOT EXISTS trackChangesUpdate AFTER UPDATE ON tracks BEGIN " \
+			"INSERT INTO trackChanges (uri, operation) VALUES (new.uri, 1); END",
+			"CREATE TRIGGER IF NOT EXISTS trackChangesDelete AFTER DELETE ON tracks BEGIN " \
+			"INSERT INTO trackChanges (uri, operation) VALUES (old.uri, 2); END",
+			// Covers are shared by every track of an album
+			"CREATE TRIGGER IF NOT EXISTS trackChangesCover AFTER UPDATE OF cover ON albums BEGIN " \
+			"INSERT INTO trackChanges (uri, operation) SELECT uri, 1 FROM tracks WHERE albumId = new.id; END"
+		});
+	}
+
+	/** Version 7: number of entries in every directory during the last scan, to estimate the progress of the next one. */
+	bool createDirectoriesTable(SqlDatabase &db)
+	{
+		return execAll(db, { "CREATE TABLE IF NOT EXISTS directories (path VARCHAR(255) PRIMARY KEY ASC, entryCount INTEGER)" });
+	}
+
+	/** Version 8: position of the scan in progress, removed when it ends, so an interrupted scan can be resumed. */
+	bool createScanCursor(SqlDatabase &db)
+	{
+		return execAll(db, { "CREATE TABLE IF NOT EXISTS scanCursor (id INTEGER PRIMARY KEY CHECK (id = 1), roots TEXT, " \
+							 "lastDirectory VARCHAR(255), committedFiles INTEGER)" });
+	}
+
+	/** Version 9: tracks have an explicit integer key, which VACUUM can't renumber like the implicit rowid of a table whose
+	 * primary key is a text, so the full-text index keeps pointing at the right tracks. */
+	bool createTrackIds(SqlDatabase &db)
+	{
+		QSqlQuery query(db);
+		if (!query.exec("PRAGMA table_info(tracks)")) {
+			return false;
+		}
+		while (query.next()) {
+			if (query.value("name").toString() == "id") {
+				return true;
+			}
+		}
+
+		// View cache and trigger trackChangesCover are referencing tracks, they have to be removed before it can be renamed.
+		// Triggers and indexes on tracks are dropped with it. Rowids are copied, so tracks keep the same ids
+		QStringList statements = {
+			"DROP VIEW IF EXISTS cache",
+			"DROP TRIGGER IF EXISTS trackChangesCover",
+			"CREATE TABLE tracksNew (id INTEGER PRIMARY KEY, uri varchar(255) NOT NULL UNIQUE, albumId INTEGER NOT NULL REFERENCES albums(id), " \
+			"trackNumber INTEGER, trackTitle varchar(255), trackLength INTEGER, artist varchar(255), rating INTEGER, disc INTEGER, " \
+			"internalCover varchar(255), host varchar(255), icon varchar(255))",
+			"INSERT INTO tracksNew (id, uri, albumId, trackNumber, trackTitle, trackLength, artist, rating, disc, internalCover, host, icon) " \
+			"SELECT rowid, uri, albumId, trackNumber, trackTitle, trackLength, artist, rating, disc, internalCover, host, icon FROM tracks",
+			"DROP TABLE tracks",
+			"ALTER TABLE tracksNew RENAME TO tracks",
+			"CREATE INDEX indexTrackAlbum ON tracks (albumId)",
+			"CREATE VIEW cache AS SELECT t.id AS trackId, t.uri, t.trackNumber, t.trackTitle, t.trackLength, " \
+			"t.artist, ar.normalizedName AS artistNormalized, al.name AS album, al.normalizedName AS albumNormalized, " \
+			"ar.name AS artistAlbum, IFNULL(al.year, '') AS albumYear, t.rating, t.disc, al.cover, t.internalCover, t.host, t.icon, " \
+			"al.id AS albumId, ar.id AS artistId " \
+			"FROM tracks t JOIN albums al ON al.id = t.albumId JOIN artists ar ON ar.id = al.artistId"
+		};
+		if (!execAll(db, statements) || !createTrackChanges(db)) {
+			return false;
+		}
+		if (!hasTable(db, "cacheSearch")) {
+			return true;
+		}
+
+		// Rowid of tracks is now an alias of id, triggers don't change. The index is rebuilt, in case a VACUUM has already
+		// renumbered tracks since it was filled
+		return execAll(db, fullTextTriggers(true) << "INSERT INTO cacheSearch (cacheSearch) VALUES ('rebuild')");
+	}
+
+	/** Steps are never removed nor reordered: the position of a step in this list is the version it brings the schema to.
+	 * Quick steps which come after a long one are applied before it, when a connection is opened: they have to be idempotent
+	 * and can't depend on long steps. */
+	const MigrationStep steps[] = {
+		{ QT_TRANSLATE_NOOP("SchemaMigration", "Creating tables for playlists"), createPlaylistTables, false },
+		{ QT_TRANSLATE_NOOP("SchemaMigration", "Creating table for files"), createFilesTable, false },
+		{ QT_TRANSLATE_NOOP("SchemaMigration", "Creating tables for artists, albums and tracks"), createLibraryTables, false },
+		{ QT_TRANSLATE_NOOP("SchemaMigration", "Indexing albums"), createLibraryIndexes, true },
+		{ QT_TRANSLATE_NOOP("SchemaMigration", "Indexing titles, artists and albums for search"), createFullTextIndex, true, fillFullTextIndex },
+		{ QT_TRANSLATE_NOOP("SchemaMigration", "Creating journal of changes"), createTrackChanges, false },
+		{ QT_TRANSLATE_NOOP("SchemaMigration", "Creating table for directories"), createDirectoriesTable, false },
+		{ QT_TRANSLATE_NOOP("SchemaMigration", "Creating cursor for scans"), createScanCursor, false },
+		{ QT_TRANSLATE_NOOP("SchemaMigration", "Numbering tracks"), createTrackIds, true }
+	};
+
+	const int stepCount = sizeof(steps) / sizeof(steps[0]);
+}
+
+SchemaMigration::SchemaMigration(QObject *parent)
+	: QObject(parent)
+{}
+
+/** True when the full-text index has been built and can be queried. */
+bool SchemaMigration::isFullTextIndexReady()
+{
+	return fullTextIndexReady.load() == 1;
+}
+
+/** Version of the schema expected by this version of the player. */
+int SchemaMigration::latestVersion()
+{
+	return stepCount;
+}
+
+/** Applies missing steps to db, in order. When includeLongSteps is false, long steps are skipped, and quick steps after them
+ * are applied without changing the version. */
+bool SchemaMigration::upgrade(SqlDatabase &db, bool includeLongSteps)
+{
+	int initialVersion = version(db);
+	bool success = true;
+	bool isAfterLongStep = false;
+	for (int i = initialVersion; i < stepCount; i++) {
+		const MigrationStep &step = steps[i];
+		if (step.isLong && !includeLongSteps) {
+			isAfterLongStep = true;
+			continue;
+		}
+		emit progressChanged(100 * (i - initialVersion) / (stepCount - initialVersion), tr(step.description));
+
+		// Long steps which can be split are doing most of their work in their own transactions
+		if (step.fill && !step.fill(db)) {
+			qWarning() << Q_FUNC_INFO << "schema can't be upgraded to version" << i + 1 << "-" << step.description;
+			success = false;
+			break;
+		}
+
+		// Takes the write lock immediately, so two connections can't apply the same step
+		QSqlQuery query(db);
+		if (!query.exec("BEGIN IMMEDIATE")) {
+			qWarning() << Q_FUNC_INFO << "database is locked, schema can't be upgraded:" << query.lastError();
+			success = false;
+			break;
+		}
+
+		// Version stays before the long step, this one will be applied once again after it
+		if (isAfterLongStep) {
+			if (step.apply(db) && query.exec("COMMIT")) {
+				qDebug() << Q_FUNC_INFO << "applied before previous steps:" << step.description;
+			} else {
+				qWarning() << Q_FUNC_INFO << "step can't be applied:" << step.description;
+				query.exec("ROLLBACK");
+				success = false;
+			}
+			continue;
+		}
+
+		// Another connection may have applied this step (and maybe the next ones) while we were waiting for the lock
+		int currentVersion = version(db);
+		if (currentVersion > i) {
+			query.exec("COMMIT");
+			i = currentVersion - 1;
+			continue;
+		}
+
+		if (step.apply(db) && query.exec(QString("PRAGMA user_version = %1").arg(i + 1)) && query.exec("COMMIT")) {
+			qDebug() << Q_FUNC_INFO << "schema was upgraded to version" << i + 1 << "-" << step.description;
+		} else {
+			qWarning() << Q_FUNC_INFO << "schema can't be upgraded to version" << i + 1 << "-" << step.description;
+			query.exec("ROLLBACK");
+			success = false;
+			break;
+		}
+	}
+
+	// While the index is being filled, it's incomplete
+	fullTextIndexReady.store(hasTable(db, "cacheSearch") && !hasTable(db, "fullTextProgress") ? 1 : 0);
+	return success;
+}
+
+/** Version of the schema which is currently stored in db. */
+int SchemaMigration::version(SqlDatabase &db)
+{
+	QSqlQuery query(db);
+	if (query.exec("PRAGMA user_version") && query.next()) {
+		return query.value(0).toInt();
+	}
+	return 0;
+}
+
+/** Applies every missing step with a connection which belongs to the calling thread. */
+void SchemaMigration::upgradeInBackground()
+{
+	// Quick steps are already applied by the constructor
+	bool success = this->upgrade(*SqlDatabase::instance());
+	emit progressChanged(100, QString());
+	emit upgradeHasEnded(success);
+}
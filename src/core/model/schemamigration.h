@@ -0,0 +1,55 @@
+#ifndef SCHEMAMIGRATION_H
+#define SCHEMAMIGRATION_H
+
+#include <QObject>
+
+#include "../miamcore_global.h"
+
+/// Forward declarations
+class SqlDatabase;
+
+/**
+ * \brief		The SchemaMigration class brings mp.db to the schema expected by this version of the player.
+ * \details		The schema is described by an ordered list of steps. The number of steps already applied is stored in the
+ *				database itself with PRAGMA user_version, so each step is run only once. Every step has its own transaction,
+ *				which is rolled back on error: the database is left at the previous version, and the same step is tried again
+ *				on next launch.
+ *				Quick steps (tables, views) are applied when the first connection is opened, because the rest of the player needs
+ *				them, even the ones which come after a long step. Long steps (indexes, full-text index) can take minutes on a big
+ *				library: they're skipped at this time, and applied later from a background thread with upgradeInBackground(), which
+ *				reports its progress. The full-text index is filled in several transactions, so other connections aren't waiting
+ *				for the whole upgrade.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+class MIAMCORE_LIBRARY SchemaMigration : public QObject
+{
+	Q_OBJECT
+public:
+	explicit SchemaMigration(QObject *parent = nullptr);
+
+	/** True when the full-text index has been built and can be queried. */
+	static bool isFullTextIndexReady();
+
+	/** Version of the schema expected by this version of the player. */
+	static int latestVersion();
+
+	/** Applies missing steps to db, in order. When includeLongSteps is false, long steps are skipped, and quick steps after them
+	 * are applied without changing the version. */
+	bool upgrade(SqlDatabase &db, bool includeLongSteps = true);
+
+	/** Version of the schema which is currently stored in db. */
+	static int version(SqlDatabase &db);
+
+public slots:
+	/** Applies every missing step with a connection which belongs to the calling thread. */
+	void upgradeInBackground();
+
+signals:
+	/** Sent before each step with the percentage of steps already applied. */
+	void progressChanged(int percent, const QString &description);
+
+	void upgradeHasEnded(bool success);
+};
+
+#endif // SCHEMAMIGRATION_H
@@ -2,11 +2,16 @@
 
 #include <QApplication>
 #include <QDir>
+#include <QMutex>
 #include <QRegularExpression>
+#include <QSet>
+#include <QSqlDriver>
 #include <QSqlError>
+#include <QSqlIndex>
 #include <QSqlRecord>
 #include <QSqlQuery>
 #include <QStandardPaths>
+#include <QThreadStorage>
 #include <QTimer>
 
 #include <QtDebug>
@@ -14,15 +19,128 @@
 #include "cover.h"
 #include "settingsprivate.h"
 #include "musicsearchengine.h"
+#include "normalizer.h"
+#include "schemamigration.h"
 #include "filehelper.h"
+#include "scanner/filefingerprint.h"
+#include "scanner/trackrecord.h"
 
 #include <chrono>
 #include <random>
 
+namespace {
+	/** Connection which isn't registered, only used to own a driver of Qt for SQLite. */
+	class SqliteConnection : public QSqlDatabase
+	{
+	public:
+		SqliteConnection() : QSqlDatabase("QSQLITE") {}
+	};
+
+	/** Driver which forwards everything to the driver of Qt for SQLite. Every query made on a connection is created by its
+	 * driver, with QSqlQuery or exec(): this is where the thread which is using the connection is checked. */
+	class CheckedDriver : public QSqlDriver
+	{
+	private:
+		SqliteConnection _sqlite;
+		QSqlDriver *_driver;
+
+		bool forward(bool success)
+		{
+			setLastError(_driver->lastError());
+			return success;
+		}
+
+	public:
+		CheckedDriver()
+			: QSqlDriver()
+			, _driver(_sqlite.driver())
+		{}
+
+		virtual bool hasFeature(DriverFeature feature) const override { return _driver->hasFeature(feature); }
+
+		virtual bool open(const QString &db, const QString &user, const QString &password, const QString &host, int port,
+						  const QString &options) override
+		{
+			bool isOpen = forward(_driver->open(db, user, password, host, port, options));
+			setOpen(isOpen);
+			setOpenError(!isOpen);
+			return isOpen;
+		}
+
+		virtual void close() override
+		{
+			_driver->close();
+			setOpen(false);
+			setOpenError(false);
+		}
+
+		virtual QSqlResult *createResult() const override
+		{
+			SqlDatabase::checkThread("query");
+			return _driver->createResult();
+		}
+
+		virtual bool beginTransaction() override
+		{
+			SqlDatabase::checkThread("transaction");
+			return forward(_driver->beginTransaction());
+		}
+
+		virtual bool commitTransaction() override { return forward(_driver->commitTransaction()); }
+
+		virtual bool rollbackTransaction() override { return forward(_driver->rollbackTransaction()); }
+
+		virtual QStringList tables(QSql::TableType type) const override { return _driver->tables(type); }
+
+		virtual QSqlIndex primaryIndex(const QString &table) const override { return _driver->primaryIndex(table); }
+
+		virtual QSqlRecord record(const QString &table) const override { return _driver->record(table); }
+
+		virtual QString formatValue(const QSqlField &field, bool trimStrings) const override
+		{
+			return _driver->formatValue(field, trimStrings);
+		}
+
+		virtual QString escapeIdentifier(const QString &identifier, IdentifierType type) const override
+		{
+			return _driver->escapeIdentifier(identifier, type);
+		}
+
+		virtual bool isIdentifierEscaped(const QString &identifier, IdentifierType type) const override
+		{
+			return _driver->isIdentifierEscaped(identifier, type);
+		}
+
+		virtual QString stripDelimiters(const QString &identifier, IdentifierType type) const override
+		{
+			return _driver->stripDelimiters(identifier, type);
+		}
+
+		virtual QVariant handle() const override { return _driver->handle(); }
+	};
+
+	/** Words of text typed by the user, as prefixes for the full text index. It's empty when text has no word at all. */
+	QStringList searchTerms(const QString &text, const QString &column)
+	{
+		static QRegularExpression separators("[^\\w]+");
+		QStringList terms;
+		for (QString word : text.split(separators, QString::SkipEmptyParts)) {
+			QString term = "\"" + word + "\"*";
+			if (!column.isEmpty()) {
+				term.prepend(column + " : ");
+			}
+			terms << term;
+		}
+		return terms;
+	}
+}
+
 SqlDatabase::SqlDatabase(QObject *parent)
 	: QObject(parent)
-	, QSqlDatabase("QSQLITE")
+	, QSqlDatabase(new CheckedDriver)
+	, _cache(64)
 {
+	SqlDatabase::checkThread("connection");
 	SettingsPrivate *settings = SettingsPrivate::instance();
 	QString path("%1/%2/%3");
 	path = path.arg(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation),
@@ -42,52 +160,159 @@ SqlDatabase::SqlDatabase(QObject *parent)
 	setDatabaseName(dbPath);
 
 	// DB folder exists but DB file doesn't: can be first launch or file was deleted manually
-	if (dbFile.exists()) {
-		this->init();
-	} else {
-
+	if (!dbFile.exists()) {
 		dbFile.open(QIODevice::ReadWrite);
 		dbFile.close();
+	}
+	this->init();
 
-		this->init();
+	// Missing tables are created by the first connection of this process, long steps like indexes are applied later in
+	// background. Other connections are waiting for it
+	static QMutex migrationMutex;
+	static bool isMigrated = false;
+	QMutexLocker locker(&migrationMutex);
+	if (!isMigrated) {
+		SchemaMigration migration;
+		migration.upgrade(*this, false);
+		isMigrated = true;
+	}
+}
 
-		QSqlQuery createDb(*this);
-		createDb.exec("CREATE TABLE IF NOT EXISTS cache (uri varchar(255) PRIMARY KEY ASC, trackNumber INTEGER, trackTitle varchar(255), trackLength INTEGER, " \
-					  "artist varchar(255), artistNormalized varchar(255), " \
-					  "album varchar(255), albumNormalized varchar(255), artistAlbum varchar(255), albumYear INTEGER,  " \
-					  "rating INTEGER, disc INTEGER, cover varchar(255), internalCover varchar(255), host varchar(255), icon varchar(255))");
+SqlDatabase::~SqlDatabase()
+{
+	// Statements have to be released before the connection
+	_cache.clear();
+	if (isOpen()) {
+		close();
+	}
+}
 
-		createDb.exec("CREATE TABLE IF NOT EXISTS playlists (id INTEGER PRIMARY KEY, title varchar(255), duration INTEGER, icon varchar(255), " \
-					  "host varchar(255), background varchar(255), checksum varchar(255))");
-		createDb.exec("CREATE TABLE IF NOT EXISTS playlistTracks (uri varchar(255) PRIMARY KEY ASC, playlistId INTEGER, FOREIGN KEY(playlistId) REFERENCES playlists(id) ON DELETE CASCADE)");
-		/// TEST Monitor Filesystem
-		createDb.exec("CREATE TABLE IF NOT EXISTS filesystem (path VARCHAR(255) PRIMARY KEY ASC, " \
-					  "lastModified INTEGER);");
+/** Reports queries made from the main thread when MIAM_CHECK_DB_THREAD is set, aborts when its value is "fatal". It's called
+ * by the driver of every connection, for each query and transaction. */
+void SqlDatabase::checkThread(const QString &what)
+{
+	static const QByteArray mode = qgetenv("MIAM_CHECK_DB_THREAD");
+	if (mode.isEmpty()) {
+		return;
+	}
+	QCoreApplication *app = QCoreApplication::instance();
+	if (!app || QThread::currentThread() != app->thread()) {
+		return;
+	}
+	if (mode == "fatal") {
+		qFatal("Synchronous database access from the main thread: %s", qPrintable(what));
+	}
 
-		// Wait for a few seconds and restart full scan
-		/// TODO: full rescan <> rebuild which is only for local tracks
-		/// Remote tracks (like Deezer) are still not synchronized
-		//QTimer *t = new QTimer(this);
-		//t->setSingleShot(true);
-		//t->start(5000);
-		//connect(t, &QTimer::timeout, this, &SqlDatabase::rebuild);
+	// Each statement is reported once, otherwise paint events would flood the output
+	static QSet<QString> reported;
+	if (!reported.contains(what)) {
+		reported.insert(what);
+		qWarning() << "Synchronous database access from the main thread:" << what;
 	}
+}
 
+/** Returns the connection of the calling thread. It's created on first call and deleted when this thread ends. */
+SqlDatabase* SqlDatabase::instance()
+{
+	static QThreadStorage<SqlDatabase*> connections;
+	if (!connections.hasLocalData()) {
+		connections.setLocalData(new SqlDatabase);
+	}
+	return connections.localData();
 }
 
-SqlDatabase::~SqlDatabase()
+/** Returns a forward-only query already prepared for sql. Values still have to be bound before calling exec(). */
+QSqlQuery SqlDatabase::preparedQuery(const QString &sql)
 {
-	if (isOpen()) {
-		close();
+	SqlDatabase::checkThread(sql);
+	if (!isOpen()) {
+		open();
+		this->setPragmas();
 	}
+
+	// Copies are sharing the same statement, so a query which is evicted from the cache is still valid for the caller
+	QSqlQuery *query = _cache.object(sql);
+	if (query) {
+		query->finish();
+		return *query;
+	}
+	query = new QSqlQuery(*this);
+	query->setForwardOnly(true);
+	if (!query->prepare(sql)) {
+		qDebug() << Q_FUNC_INFO << query->lastError();
+		QSqlQuery failed(*query);
+		delete query;
+		return failed;
+	}
+	QSqlQuery prepared(*query);
+	_cache.insert(sql, query);
+	return prepared;
 }
 
 void SqlDatabase::reset()
 {
-	exec("DELETE FROM cache");
-	exec("DROP INDEX indexArtist");
-	exec("DROP INDEX indexAlbum");
-	exec("DROP INDEX indexPath");
+	exec("DELETE FROM tracks");
+	exec("DELETE FROM albums");
+	exec("DELETE FROM artists");
+	exec("DELETE FROM files");
+
+	// Views are reloading everything after a full scan
+	exec("DELETE FROM trackChanges");
+}
+
+/** Identifier of the last change in the journal of tracks, or -1 when this journal doesn't exist yet. */
+qint64 SqlDatabase::lastTrackChange()
+{
+	// Identifiers are never reused, even when the journal is empty, thanks to AUTOINCREMENT
+	QSqlQuery query = this->preparedQuery("SELECT IFNULL((SELECT seq FROM sqlite_sequence WHERE name = 'trackChanges'), 0) " \
+										  "FROM sqlite_master WHERE type = 'table' AND name = 'trackChanges'");
+	if (query.exec() && query.next()) {
+		return query.value(0).toLongLong();
+	}
+	return -1;
+}
+
+/** Keeps only the most recent changes in the journal of tracks. */
+void SqlDatabase::pruneTrackChanges(int keep)
+{
+	QSqlQuery prune = this->preparedQuery("DELETE FROM trackChanges WHERE id <= (SELECT MAX(id) FROM trackChanges) - ?");
+	prune.addBindValue(keep);
+	prune.exec();
+}
+
+/** Tracks which were inserted, updated or removed after change since, up to lastChange which is returned as well. */
+bool SqlDatabase::selectTrackChanges(qint64 since, QStringList &uris, qint64 &lastChange)
+{
+	lastChange = this->lastTrackChange();
+	if (since < 0 || lastChange < since) {
+		return false;
+	} else if (lastChange == since) {
+		return true;
+	}
+
+	// Some changes were pruned (or deleted by a full scan) in the meantime
+	QSqlQuery first = this->preparedQuery("SELECT MIN(id) FROM trackChanges");
+	if (!first.exec() || !first.next() || first.value(0).isNull() || first.value(0).toLongLong() > since + 1) {
+		return false;
+	}
+
+	QSqlQuery changes = this->preparedQuery("SELECT DISTINCT uri FROM trackChanges WHERE id > ? AND id <= ?");
+	changes.addBindValue(since);
+	changes.addBindValue(lastChange);
+	if (!changes.exec()) {
+		return false;
+	}
+	while (changes.next()) {
+		uris << changes.value(0).toString();
+	}
+	return true;
+}
+
+/** Removes albums without tracks and artists without albums. */
+void SqlDatabase::removeOrphans()
+{
+	this->preparedQuery("DELETE FROM albums WHERE id NOT IN (SELECT albumId FROM tracks)").exec();
+	this->preparedQuery("DELETE FROM artists WHERE id NOT IN (SELECT artistId FROM albums)").exec();
 }
 
 void SqlDatabase::init()
@@ -172,29 +397,23 @@ bool SqlDatabase::insertIntoTableTracks(const TrackDAO &track)
 		this->setPragmas();
 	}
 
-	QSqlQuery insertTrack(*this);
-	insertTrack.prepare("INSERT INTO cache (uri, trackNumber, trackTitle, artist, album, artistAlbum, trackLength, rating, " \
-		"disc, host, icon) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
-
-	QString artistAlbum = track.artistAlbum().isEmpty() ? track.artist() : track.artistAlbum();
-	QString artistNorm = this->normalizeField(artistAlbum);
-	QString albumNorm = this->normalizeField(track.album());
-	uint artistId = qHash(artistNorm);
-	uint albumId = artistId + qHash(albumNorm, 1);
-
-	insertTrack.addBindValue(track.uri());
-	insertTrack.addBindValue(track.trackNumber());
-	insertTrack.addBindValue(track.title());
-	insertTrack.addBindValue(artistId);
-	insertTrack.addBindValue(albumId);
-	insertTrack.addBindValue(track.artistAlbum());
-	insertTrack.addBindValue(track.length());
-	insertTrack.addBindValue(track.rating());
-	insertTrack.addBindValue(track.disc());
-	insertTrack.addBindValue(track.host());
-	insertTrack.addBindValue(track.icon());
-	bool b = insertTrack.exec();
-	return b;
+	TrackRecord record;
+	record.uri = track.uri();
+	record.title = track.title();
+	record.artist = track.artist();
+	record.artistAlbum = track.artistAlbum().isEmpty() ? track.artist() : track.artistAlbum();
+	record.artistNormalized = this->normalizeField(record.artistAlbum);
+	record.album = track.album();
+	record.albumNormalized = this->normalizeField(track.album());
+	record.host = track.host();
+	record.icon = track.icon();
+	record.trackNumber = track.trackNumber().toInt();
+	record.disc = track.disc().toInt();
+	record.rating = track.rating();
+	record.year = track.year().toInt();
+	record.length = track.length().toInt();
+	record.isValid = true;
+	return this->saveFileRef(record);
 }
 
 bool SqlDatabase::insertIntoTableTracks(const std::list<TrackDAO> &tracks)
@@ -213,17 +432,27 @@ bool SqlDatabase::insertIntoTableTracks(const std::list<TrackDAO> &tracks)
 	return b;
 }
 
+/** Marks the beginning of a scan of roots. Does nothing if an interrupted scan is being resumed. */
+void SqlDatabase::insertScanCursor(const QStringList &roots)
+{
+	QSqlQuery insert = this->preparedQuery("INSERT OR IGNORE INTO scanCursor (id, roots, committedFiles) VALUES (1, ?, 0)");
+	insert.addBindValue(roots.join('\n'));
+	insert.exec();
+}
+
 void SqlDatabase::removeCoverForAlbum(bool internalCover, const QString &artistNorm, const QString &albumNorm)
 {
 	if (!isOpen()) {
 		open();
 		this->setPragmas();
 	}
-	QSqlQuery updateTrack(*this);
+	QSqlQuery updateTrack;
 	if (internalCover) {
-		updateTrack.prepare("UPDATE cache SET internalCover = NULL WHERE artistNormalized = ? AND albumNormalized = ?");
+		updateTrack = this->preparedQuery("UPDATE tracks SET internalCover = NULL WHERE albumId = (SELECT al.id FROM albums al " \
+										  "JOIN artists ar ON ar.id = al.artistId WHERE ar.normalizedName = ? AND al.normalizedName = ?)");
 	} else {
-		updateTrack.prepare("UPDATE cache SET cover = NULL WHERE artistNormalized = ? AND albumNormalized = ?");
+		updateTrack = this->preparedQuery("UPDATE albums SET cover = NULL " \
+										  "WHERE artistId = (SELECT id FROM artists WHERE normalizedName = ?) AND normalizedName = ?");
 	}
 	updateTrack.addBindValue(artistNorm);
 	updateTrack.addBindValue(albumNorm);
@@ -283,13 +512,67 @@ void SqlDatabase::removeRecordsFromHost(const QString &host)
 	qDebug() << Q_FUNC_INFO << host;
 	this->transaction();
 	QSqlQuery removeTracks(*this);
-	removeTracks.prepare("DELETE FROM cache WHERE host LIKE :h");
+	removeTracks.prepare("DELETE FROM tracks WHERE host LIKE :h");
 	removeTracks.bindValue(":h", host);
 	removeTracks.exec();
+	this->removeOrphans();
 
 	this->commit();
 }
 
+/** Marks the end of a scan, which won't be resumed. */
+void SqlDatabase::removeScanCursor()
+{
+	this->preparedQuery("DELETE FROM scanCursor").exec();
+}
+
+/** Removes tracks which were deleted from the filesystem. */
+void SqlDatabase::removeFileRefs(const QStringList &absFilePaths)
+{
+	if (!isOpen()) {
+		open();
+		this->setPragmas();
+	}
+
+	QSqlQuery removeTrack = this->preparedQuery("DELETE FROM tracks WHERE uri = ?");
+	QSqlQuery removeFile = this->preparedQuery("DELETE FROM files WHERE path = ?");
+	for (QString absFilePath : absFilePaths) {
+		removeTrack.addBindValue(absFilePath);
+		removeTrack.exec();
+		removeFile.addBindValue(absFilePath);
+		removeFile.exec();
+	}
+}
+
+/** Replaces entry counts of directories below roots. Caller is responsible for opening a transaction. */
+void SqlDatabase::saveDirectoryEntryCounts(const QStringList &roots, const QHash<QString, int> &entryCounts)
+{
+	QSqlQuery removeDirectories = this->preparedQuery("DELETE FROM directories WHERE path = ? OR (path >= ? AND path < ?)");
+	for (QString root : roots) {
+		removeDirectories.addBindValue(root);
+		removeDirectories.addBindValue(root + "/");
+		removeDirectories.addBindValue(root + "0");
+		removeDirectories.exec();
+	}
+
+	QSqlQuery saveDirectory = this->preparedQuery("INSERT OR REPLACE INTO directories (path, entryCount) VALUES (?, ?)");
+	for (auto it = entryCounts.cbegin(); it != entryCounts.cend(); ++it) {
+		saveDirectory.addBindValue(it.key());
+		saveDirectory.addBindValue(it.value());
+		saveDirectory.exec();
+	}
+}
+
+void SqlDatabase::saveFileFingerprint(const QString &absFilePath, const FileFingerprint &fingerprint)
+{
+	QSqlQuery saveFile = this->preparedQuery("INSERT OR REPLACE INTO files (path, size, lastModified, inode) VALUES (?, ?, ?, ?)");
+	saveFile.addBindValue(absFilePath);
+	saveFile.addBindValue(fingerprint.size);
+	saveFile.addBindValue(fingerprint.lastModified);
+	saveFile.addBindValue(fingerprint.inode);
+	saveFile.exec();
+}
+
 Cover* SqlDatabase::selectCoverFromURI(const QString &uri)
 {
 	if (!isOpen()) {
@@ -299,8 +582,7 @@ Cover* SqlDatabase::selectCoverFromURI(const QString &uri)
 
 	Cover *c = nullptr;
 
-	QSqlQuery selectCover(*this);
-	selectCover.prepare("SELECT DISTINCT internalCover, cover FROM cache WHERE uri = ?");
+	QSqlQuery selectCover = this->preparedQuery("SELECT DISTINCT internalCover, cover FROM cache WHERE uri = ?");
 	selectCover.addBindValue(uri);
 	if (selectCover.exec() && selectCover.next()) {
 		QString internalCover = selectCover.record().value(0).toString();
@@ -327,6 +609,107 @@ Cover* SqlDatabase::selectCoverFromURI(const QString &uri)
 	return c;
 }
 
+/** Returns the number of entries of every directory below root, as it was during the last scan. */
+QHash<QString, int> SqlDatabase::selectDirectoryEntryCounts(const QString &root)
+{
+	QHash<QString, int> entryCounts;
+	QSqlQuery results = this->preparedQuery("SELECT path, entryCount FROM directories WHERE path = ? OR (path >= ? AND path < ?)");
+	results.addBindValue(root);
+	results.addBindValue(root + "/");
+	results.addBindValue(root + "0");
+	if (results.exec()) {
+		while (results.next()) {
+			entryCounts.insert(results.value(0).toString(), results.value(1).toInt());
+		}
+	}
+	return entryCounts;
+}
+
+/** Returns the state of every local file as it was during the last scan, or only below directory when not empty. */
+QHash<QString, FileFingerprint> SqlDatabase::selectFileFingerprints(const QString &directory)
+{
+	if (!isOpen()) {
+		open();
+		this->setPragmas();
+	}
+
+	QHash<QString, FileFingerprint> fingerprints;
+	QSqlQuery results(*this);
+	results.setForwardOnly(true);
+	if (directory.isEmpty()) {
+		results.prepare("SELECT path, size, lastModified, inode FROM files");
+	} else {
+		// Range on primary key instead of LIKE, which can't use the index and would interpret '_' and '%' in paths
+		results.prepare("SELECT path, size, lastModified, inode FROM files WHERE path >= ? AND path < ?");
+		results.addBindValue(directory + "/");
+		results.addBindValue(directory + "0");
+	}
+	if (results.exec()) {
+		while (results.next()) {
+			FileFingerprint fingerprint;
+			fingerprint.size = results.value(1).toLongLong();
+			fingerprint.lastModified = results.value(2).toLongLong();
+			fingerprint.inode = results.value(3).toULongLong();
+			fingerprints.insert(results.value(0).toString(), fingerprint);
+		}
+	}
+	return fingerprints;
+}
+
+/** Returns a query on distinct columns of tracks matching text, best matches first. Values are already bound. */
+QSqlQuery SqlDatabase::search(const QString &columns, const QString &text, const QString &column, int limit)
+{
+	QSqlQuery query;
+	if (SchemaMigration::isFullTextIndexReady() && !searchTerms(text, column).isEmpty()) {
+		// Columns of the virtual table have the same names than columns in table cache, so they're hidden in a subquery
+		query = this->preparedQuery("SELECT DISTINCT " + columns + " FROM (SELECT rowid AS searchId, rank AS searchRank " \
+									"FROM cacheSearch WHERE cacheSearch MATCH ?) JOIN cache ON cache.trackId = searchId " \
+									"ORDER BY searchRank LIMIT ?");
+	} else {
+		query = this->preparedQuery("SELECT DISTINCT " + columns + " FROM cache WHERE " + this->searchCondition(text, column) + " LIMIT ?");
+	}
+	query.addBindValue(this->searchValue(text, column));
+	query.addBindValue(limit);
+	return query;
+}
+
+/** Returns a condition on table cache which keeps tracks matching text, to bind with searchValue(). Text without any word
+ * can't be matched by the full text index: it's compared with LIKE. */
+QString SqlDatabase::searchCondition(const QString &text, const QString &column) const
+{
+	if (SchemaMigration::isFullTextIndexReady() && !searchTerms(text, column).isEmpty()) {
+		return "cache.trackId IN (SELECT rowid FROM cacheSearch WHERE cacheSearch MATCH ?)";
+	} else if (column.isEmpty()) {
+		// A single value can be bound: fields are separated by a character nobody can type
+		return "(COALESCE(trackTitle, '') || char(31) || COALESCE(artist, '') || char(31) || COALESCE(album, '') LIKE ?)";
+	} else {
+		return column + " LIKE ?";
+	}
+}
+
+/** Converts text typed by the user into a value for searchCondition(). Every word is a prefix. */
+QString SqlDatabase::searchValue(const QString &text, const QString &column) const
+{
+	QStringList terms = searchTerms(text, column);
+	if (!SchemaMigration::isFullTextIndexReady() || terms.isEmpty()) {
+		return "%" + text + "%";
+	}
+	return terms.join(" AND ");
+}
+
+/** Returns true when a scan was interrupted, with the directory of the last file it has committed. */
+bool SqlDatabase::selectScanCursor(QStringList &roots, QString &lastDirectory, int &committedFiles)
+{
+	QSqlQuery cursor = this->preparedQuery("SELECT roots, lastDirectory, committedFiles FROM scanCursor");
+	if (cursor.exec() && cursor.next()) {
+		roots = cursor.value(0).toString().split('\n', QString::SkipEmptyParts);
+		lastDirectory = cursor.value(1).toString();
+		committedFiles = cursor.value(2).toInt();
+		return true;
+	}
+	return false;
+}
+
 QStringList SqlDatabase::selectPlaylistTracks(uint playlistID, bool withPrefix)
 {
 	if (!isOpen()) {
@@ -426,10 +809,9 @@ TrackDAO SqlDatabase::selectTrackByURI(const QString &uri)
 	}
 
 	TrackDAO track;
-	QSqlQuery qTracks(*this);
-	qTracks.prepare("SELECT uri, trackNumber, trackTitle, artist, album, artistAlbum, trackLength, " \
-					"rating, disc, host, icon, albumYear " \
-					"FROM cache WHERE uri = ?");
+	QSqlQuery qTracks = this->preparedQuery("SELECT uri, trackNumber, trackTitle, artist, album, artistAlbum, trackLength, " \
+											"rating, disc, host, icon, albumYear " \
+											"FROM cache WHERE uri = ?");
 	qTracks.addBindValue(uri);
 	if (qTracks.exec() && qTracks.next()) {
 		QSqlRecord r = qTracks.record();
@@ -508,62 +890,37 @@ void SqlDatabase::updateTableAlbumWithCoverImage(const QString &coverPath, const
 	update.exec();
 }
 
+/** Moves the cursor of the scan in progress. Caller is responsible for opening a transaction. */
+void SqlDatabase::updateScanCursor(const QString &lastDirectory, int committedFiles)
+{
+	QSqlQuery update = this->preparedQuery("UPDATE scanCursor SET lastDirectory = ?, committedFiles = committedFiles + ?");
+	update.addBindValue(lastDirectory);
+	update.addBindValue(committedFiles);
+	update.exec();
+}
 
 void SqlDatabase::updateTrack(const QString &absFilePath)
 {
-	FileHelper fh(absFilePath);
-	if (!fh.isValid()) {
+	TrackRecord track = TrackRecord::fromFile(absFilePath);
+	if (!track.isValid) {
 		qDebug() << Q_FUNC_INFO << "file is not valid, won't be updated";
 		return;
 	}
 
-	QSqlQuery updateTrack(*this);
-	updateTrack.setForwardOnly(true);
-	updateTrack.prepare("UPDATE cache SET trackNumber = ?, trackTitle = ?, artist = ?, artistNormalized = ?, album = ?, albumNormalized = ?, " \
-						"albumYear = ?, artistAlbum = ?, trackLength = ?, disc = ?, internalCover = ?, rating = ? WHERE uri = ?");
-
-	QString tn = fh.trackNumber();
-	QString title = fh.title();
-	QString artistAlbum = fh.artistAlbum().isEmpty() ? fh.artist() : fh.artistAlbum();
-
-	// Use Artist Album to reference tracks in table "tracks", not Artist
-	QString artistNorm = this->normalizeField(artistAlbum);
-	QString album = fh.album();
-	QString albumNorm = this->normalizeField(album);
-	QString length = fh.length();
-	int dn = fh.discNumber();
-
-	updateTrack.addBindValue(tn.toInt());
-	if (title.isEmpty()) {
-		updateTrack.addBindValue(fh.fileInfo().baseName());
-	} else {
-		updateTrack.addBindValue(title);
-	}
-	updateTrack.addBindValue(fh.artist());
-	updateTrack.addBindValue(artistNorm);
-	updateTrack.addBindValue(fh.album());
-	updateTrack.addBindValue(albumNorm);
-	updateTrack.addBindValue(fh.year());
-	updateTrack.addBindValue(artistAlbum);
-	updateTrack.addBindValue(length);
-	updateTrack.addBindValue(dn);
-	if (fh.hasCover()) {
-		updateTrack.addBindValue(absFilePath);
-	} else {
-		updateTrack.addBindValue(QVariant());
-	}
-	updateTrack.addBindValue(fh.rating());
-	updateTrack.addBindValue(absFilePath);
+	// Artist or album may have changed: the track is attached again to its album
+	this->saveFileRef(track);
 
-	if (!updateTrack.exec()) {
-		qDebug() << Q_FUNC_INFO << updateTrack.lastError();
-	}
+	// Tags were just written by ourselves, no need to read this file again on next incremental scan
+	this->saveFileFingerprint(absFilePath, FileFingerprint::fromFile(absFilePath));
 }
 
 /** Update a list of tracks. If track name has changed, will be removed from Library then added right after. */
 void SqlDatabase::updateTracks(const QStringList &oldPaths, const QStringList &newPaths)
 {
-	this->init();
+	// Reopening a connection would finalize its prepared statements
+	if (!isOpen()) {
+		this->init();
+	}
 
 	// Signals are blocked to prevent saveFileRef method to emit one. Load method will tell connected views to rebuild themselves
 	transaction();
@@ -578,103 +935,112 @@ void SqlDatabase::updateTracks(const QStringList &oldPaths, const QStringList &n
 			this->updateTrack(oldPath);
 		} else {
 
-			QSqlQuery removeTrack(*this);
-			removeTrack.prepare("DELETE FROM cache WHERE uri = :h");
-			removeTrack.bindValue(":h", oldPath);
-			removeTrack.exec();
-
+			this->removeFileRefs(QStringList(oldPath));
 			this->saveFileRef(newPath);
+			this->saveFileFingerprint(newPath, FileFingerprint::fromFile(newPath));
 		}
 	}
+	this->removeOrphans();
 
 	commit();
 	emit aboutToUpdateView();
 }
 
-/** Reads an external picture which is close to multimedia files (same folder). */
+/** Attaches an external picture to the album of a track which is already in the library. */
 void SqlDatabase::saveCoverRef(const QString &coverPath, const QString &track)
 {
-	FileHelper fh(track);
-	QString artistAlbum = fh.artistAlbum().isEmpty() ? fh.artist() : fh.artistAlbum();
-	QString artistNorm = this->normalizeField(artistAlbum);
-	QString albumNorm = this->normalizeField(fh.album());
+	// The album is found with the primary key of tracks, instead of reading tags of this file again
+	QSqlQuery updateCoverPath = this->preparedQuery("UPDATE albums SET cover = ? WHERE id = (SELECT albumId FROM tracks WHERE uri = ?)");
+	updateCoverPath.addBindValue(coverPath);
+	updateCoverPath.addBindValue(track);
+	updateCoverPath.exec();
+}
 
-	QSqlQuery updateCoverPath("UPDATE cache SET cover = ? WHERE artistNormalized = ? AND albumNormalized = ?", *this);
-	updateCoverPath.setForwardOnly(true);
+/** Attaches an external picture to an album. */
+void SqlDatabase::saveCoverRef(const QString &coverPath, const QString &artistNorm, const QString &albumNorm)
+{
+	QSqlQuery updateCoverPath = this->preparedQuery("UPDATE albums SET cover = ? " \
+													"WHERE artistId = (SELECT id FROM artists WHERE normalizedName = ?) AND normalizedName = ?");
 	updateCoverPath.addBindValue(coverPath);
 	updateCoverPath.addBindValue(artistNorm);
 	updateCoverPath.addBindValue(albumNorm);
 	updateCoverPath.exec();
 }
 
-QString SqlDatabase::normalizeField(const QString &s) const
+/** Lower case key without accents, spaces nor punctuation, like "Beyoncé Knowles" -> "beyonceknowles". */
+QString SqlDatabase::normalizeField(const QString &s)
 {
-	static QRegularExpression regExp("[^\\w]");
-	QString sNormed = s.toLower().normalized(QString::NormalizationForm_KD).remove(regExp).trimmed();
-	if (sNormed.isEmpty()) {
-		return s.toLower().remove(" ").trimmed();
-	} else {
-		return sNormed;
-	}
+	return Normalizer::normalizeField(s);
 }
 
 void SqlDatabase::setPragmas()
 {
-	this->exec("PRAGMA journal_mode = OFF");
-	this->exec("PRAGMA synchronous = OFF");
+	// With a write-ahead log, readers are working on a snapshot and are never blocked by the scanner, and a crash can only
+	// lose the last transactions. NORMAL is safe in this mode: the log is only synced on checkpoints
+	this->exec("PRAGMA journal_mode = WAL");
+	this->exec("PRAGMA synchronous = NORMAL");
+	this->exec("PRAGMA busy_timeout = 5000");
+	this->exec("PRAGMA journal_size_limit = 67108864");
 	this->exec("PRAGMA temp_store = 2");
 	this->exec("PRAGMA foreign_keys = 1");
+
+	// Otherwise INSERT OR REPLACE would silently remove old rows without updating the full-text index
+	this->exec("PRAGMA recursive_triggers = 1");
 	this->exec("PRAGMA count_changes = OFF");
 }
 
 /** Reads a file from the filesystem and adds it into the library. */
 void SqlDatabase::saveFileRef(const QString &absFilePath)
 {
-	FileHelper fh(absFilePath);
-	if (!fh.isValid()) {
+	TrackRecord track = TrackRecord::fromFile(absFilePath);
+	if (!track.isValid) {
 		qDebug() << Q_FUNC_INFO << "file is not valid, won't be saved:" << absFilePath;
 		return;
 	}
+	this->saveFileRef(track);
+}
 
-	QSqlQuery insertTrack(*this);
-	insertTrack.setForwardOnly(true);
-	insertTrack.prepare("INSERT INTO cache (uri, trackNumber, trackTitle, artist, artistNormalized, album, albumNormalized, " \
-						"albumYear, artistAlbum, trackLength, disc, internalCover, rating) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
-
-	QString tn = fh.trackNumber();
-	QString title = fh.title();
-	QString artistAlbum = fh.artistAlbum().isEmpty() ? fh.artist() : fh.artistAlbum();
-
-	// Use Artist Album to reference tracks in table "tracks", not Artist
-	QString artistNorm = this->normalizeField(artistAlbum);
-	QString album = fh.album();
-	QString albumNorm = this->normalizeField(album);
-	QString length = fh.length();
-	int dn = fh.discNumber();
-
-	insertTrack.addBindValue(absFilePath);
-	insertTrack.addBindValue(tn.toInt());
-	if (title.isEmpty()) {
-		insertTrack.addBindValue(fh.fileInfo().baseName());
-	} else {
-		insertTrack.addBindValue(title);
-	}
-	insertTrack.addBindValue(fh.artist());
-	insertTrack.addBindValue(artistNorm);
-	insertTrack.addBindValue(fh.album());
-	insertTrack.addBindValue(albumNorm);
-	insertTrack.addBindValue(fh.year());
-	insertTrack.addBindValue(artistAlbum);
-	insertTrack.addBindValue(length);
-	insertTrack.addBindValue(dn);
-	if (fh.hasCover()) {
-		insertTrack.addBindValue(absFilePath);
+/** Adds a track which has already been read from the filesystem into the library. */
+bool SqlDatabase::saveFileRef(const TrackRecord &track)
+{
+	// Artists and albums are created by their first track. Existing ones are left untouched, like their cover
+	QSqlQuery insertArtist = this->preparedQuery("INSERT OR IGNORE INTO artists (name, normalizedName) VALUES (?, ?)");
+	insertArtist.addBindValue(track.artistAlbum);
+	insertArtist.addBindValue(track.artistNormalized);
+	insertArtist.exec();
+
+	QSqlQuery insertAlbum = this->preparedQuery("INSERT OR IGNORE INTO albums (artistId, name, normalizedName, year) " \
+												"VALUES ((SELECT id FROM artists WHERE normalizedName = ?), ?, ?, ?)");
+	insertAlbum.addBindValue(track.artistNormalized);
+	insertAlbum.addBindValue(track.album);
+	insertAlbum.addBindValue(track.albumNormalized);
+	insertAlbum.addBindValue(track.year > 0 ? QVariant(track.year) : QVariant(QVariant::Int));
+	insertAlbum.exec();
+
+	QSqlQuery insertTrack = this->preparedQuery("INSERT OR REPLACE INTO tracks (uri, albumId, trackNumber, trackTitle, trackLength, " \
+												"artist, rating, disc, internalCover, host, icon) " \
+												"VALUES (?, (SELECT al.id FROM albums al JOIN artists ar ON ar.id = al.artistId " \
+												"WHERE ar.normalizedName = ? AND al.normalizedName = ?), ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+	insertTrack.addBindValue(track.uri);
+	insertTrack.addBindValue(track.artistNormalized);
+	insertTrack.addBindValue(track.albumNormalized);
+	insertTrack.addBindValue(track.trackNumber);
+	insertTrack.addBindValue(track.title);
+	insertTrack.addBindValue(track.length);
+	insertTrack.addBindValue(track.artist);
+	insertTrack.addBindValue(track.rating);
+	insertTrack.addBindValue(track.disc);
+	if (track.hasCover) {
+		insertTrack.addBindValue(track.uri);
 	} else {
 		insertTrack.addBindValue(QVariant());
 	}
-	insertTrack.addBindValue(fh.rating());
+	insertTrack.addBindValue(track.host.isEmpty() ? QVariant() : QVariant(track.host));
+	insertTrack.addBindValue(track.icon.isEmpty() ? QVariant() : QVariant(track.icon));
 
-	if (!insertTrack.exec()) {
+	bool b = insertTrack.exec();
+	if (!b) {
 		qDebug() << Q_FUNC_INFO << insertTrack.lastError();
 	}
+	return b;
 }
@@ -6,18 +6,24 @@
 #include "trackdao.h"
 #include "playlistdao.h"
 
+#include <QCache>
 #include <QFileInfo>
 #include <QSqlDatabase>
+#include <QSqlQuery>
 #include <QSqlTableModel>
 #include <QThread>
 #include <QUrl>
 
 /// Forward declarations
 class Cover;
+class FileFingerprint;
 class FileHelper;
+class TrackRecord;
 
 /**
  * \brief		The SqlDatabase class uses SQLite to store few but useful tables for tracks, playlists, etc.
+ * \details		A connection can only be used by the thread which has created it. Instead of opening a new one for each query,
+ *				instance() returns a long-lived connection per thread, which keeps its most recently used prepared statements.
  * \author      Matthieu Bachelier
  * \copyright   GNU General Public License v3
  */
@@ -25,26 +31,80 @@ class MIAMCORE_LIBRARY SqlDatabase : public QObject, public QSqlDatabase
 {
 	Q_OBJECT
 private:
-	QHash<uint, GenericDAO*> _cache;
+	/** Prepared statements keyed by SQL text. Least recently used ones are discarded first. */
+	QCache<QString, QSqlQuery> _cache;
 
 public:
 	explicit SqlDatabase(QObject *parent = nullptr);
 
 	virtual ~SqlDatabase();
 
+	/** Reports queries made from the main thread when MIAM_CHECK_DB_THREAD is set, aborts when its value is "fatal". It's called
+	 * by the driver of every connection, for each query and transaction. */
+	static void checkThread(const QString &what);
+
+	/** Returns the connection of the calling thread. It's created on first call and deleted when this thread ends. */
+	static SqlDatabase* instance();
+
+	/** Returns a forward-only query already prepared for sql. Values still have to be bound before calling exec(). */
+	QSqlQuery preparedQuery(const QString &sql);
+
 	void reset();
 
+	/** Identifier of the last change in the journal of tracks, or -1 when this journal doesn't exist yet. */
+	qint64 lastTrackChange();
+
+	/** Keeps only the most recent changes in the journal of tracks. */
+	void pruneTrackChanges(int keep = 10000);
+
+	/** Tracks which were inserted, updated or removed after change since, up to lastChange which is returned as well. */
+	bool selectTrackChanges(qint64 since, QStringList &uris, qint64 &lastChange);
+
 	uint insertIntoTablePlaylists(const PlaylistDAO &playlist, const QStringList &tracks, bool isOverwriting);
 	bool insertIntoTablePlaylistTracks(uint playlistId, const QStringList &tracks, bool isOverwriting = false);
 	bool insertIntoTableTracks(const TrackDAO &track);
 	bool insertIntoTableTracks(const std::list<TrackDAO> &tracks);
 
+	/** Marks the beginning of a scan of roots. Does nothing if an interrupted scan is being resumed. */
+	void insertScanCursor(const QStringList &roots);
+
 	void removeCoverForAlbum(bool internalCover, const QString &artistNorm, const QString &albumNorm);
 	bool removePlaylist(uint playlistId);
 	void removePlaylistsFromHost(const QString &host);
 	void removeRecordsFromHost(const QString &host);
 
+	/** Marks the end of a scan, which won't be resumed. */
+	void removeScanCursor();
+
+	/** Removes tracks which were deleted from the filesystem. Caller is responsible for opening a transaction. */
+	void removeFileRefs(const QStringList &absFilePaths);
+
+	/** Replaces entry counts of directories below roots. Caller is responsible for opening a transaction. */
+	void saveDirectoryEntryCounts(const QStringList &roots, const QHash<QString, int> &entryCounts);
+
+	void saveFileFingerprint(const QString &absFilePath, const FileFingerprint &fingerprint);
+
 	Cover *selectCoverFromURI(const QString &uri);
+
+	/** Returns the number of entries of every directory below root, as it was during the last scan. */
+	QHash<QString, int> selectDirectoryEntryCounts(const QString &root);
+
+	/** Returns the state of every local file as it was during the last scan, or only below directory when not empty. */
+	QHash<QString, FileFingerprint> selectFileFingerprints(const QString &directory = QString());
+
+	/** Returns a query on distinct columns of tracks matching text, best matches first. Values are already bound. */
+	QSqlQuery search(const QString &columns, const QString &text, const QString &column = QString(), int limit = 5);
+
+	/** Returns a condition on table cache which keeps tracks matching text, to bind with searchValue(). Text without any word
+	 * can't be matched by the full text index: it's compared with LIKE. */
+	QString searchCondition(const QString &text, const QString &column = QString()) const;
+
+	/** Converts text typed by the user into a value for searchCondition(). Every word is a prefix. */
+	QString searchValue(const QString &text, const QString &column = QString()) const;
+
+	/** Returns true when a scan was interrupted, with the directory of the last file it has committed. */
+	bool selectScanCursor(QStringList &roots, QString &lastDirectory, int &committedFiles);
+
 	QStringList selectPlaylistTracks(uint playlistID, bool withPrefix = true);
 	PlaylistDAO selectPlaylist(uint playlistId);
 	QList<PlaylistDAO> selectPlaylists();
@@ -56,10 +116,20 @@ public:
 	void updateTablePlaylistWithBackgroundImage(uint playlistID, const QString &backgroundImagePath);
 	void updateTableAlbumWithCoverImage(const QString &coverPath, const QString &album, const QString &artist);
 
+	/** Moves the cursor of the scan in progress. Caller is responsible for opening a transaction. */
+	void updateScanCursor(const QString &lastDirectory, int committedFiles);
+
 	/** Update a list of tracks. If track name has changed, it will be removed from Library then added right after. */
 	void updateTracks(const QStringList &oldPaths, const QStringList &newPaths);
 
-	QString normalizeField(const QString &s) const;
+	/** Removes albums without tracks and artists without albums. */
+	void removeOrphans();
+
+	/** Lower case key without accents, spaces nor punctuation, like "Beyoncé Knowles" -> "beyonceknowles". */
+	static QString normalizeField(const QString &s);
+
+	/** Adds a track which has already been read from the filesystem into the library. */
+	bool saveFileRef(const TrackRecord &track);
 
 private:
 	void init();
@@ -69,9 +139,12 @@ private:
 	void updateTrack(const QString &absFilePath);
 
 public slots:
-	/** Reads an external picture which is close to multimedia files (same folder). */
+	/** Attaches an external picture to the album of a track which is already in the library. */
 	void saveCoverRef(const QString &coverPath, const QString &track);
 
+	/** Attaches an external picture to every track of an album. */
+	void saveCoverRef(const QString &coverPath, const QString &artistNorm, const QString &albumNorm);
+
 	/** Reads a file from the filesystem and adds it into the library. */
 	void saveFileRef(const QString &absFilePath);
 
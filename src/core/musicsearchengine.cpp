@@ -2,11 +2,21 @@
 #include "filehelper.h"
 #include "settingsprivate.h"
 #include "model/sqldatabase.h"
+#include "scanner/filefingerprint.h"
+#include "scanner/scanfilesystem.h"
+#include "scanner/scanpipeline.h"
+#include "scanner/scanwalker.h"
+#ifdef Q_OS_LINUX
+#include "scanner/librarywatcher.h"
+#endif
 
 #include <QDateTime>
 #include <QDirIterator>
 #include <QFileInfo>
+#include <QMap>
+#include <QMutex>
 #include <QThread>
+#include <QTimer>
 
 #include <QSqlQuery>
 #include <QSqlError>
@@ -14,195 +24,268 @@
 
 #include <QtDebug>
 
-bool MusicSearchEngine::isScanning = false;
+namespace {
+	/** Held during each scan: full scans from the scan thread and rescans from the watcher thread can't run together. */
+	QMutex scanMutex;
+}
 
 MusicSearchEngine::MusicSearchEngine(QObject *parent)
 	: QObject(parent)
-	, _timer(new QTimer(this))
+	, _watcher(nullptr)
+	, _scanMode(SM_Full)
+	, _isCancelled(0)
+	, _workerCount(0)
+	, _lastEntryCount(0)
+	, _lastReadCount(0)
+{}
+
+MusicSearchEngine::~MusicSearchEngine()
+{}
+
+/** Stops the current scan as soon as possible, keeping files already read. Can be called from any thread. */
+void MusicSearchEngine::cancel()
 {
-	//_timer->setInterval(5000);
-	//connect(_timer, &QTimer::timeout, this, &MusicSearchEngine::watchForChanges);
+	_isCancelled.store(1);
+}
 
-	// Monitor filesystem
-	if (SettingsPrivate::instance()->isFileSystemMonitored()) {
-		setWatchForChanges(true);
-	}
+bool MusicSearchEngine::isCancelled() const
+{
+	return _isCancelled.load() == 1;
 }
 
-MusicSearchEngine::~MusicSearchEngine()
-{}
+/** Full scans are reading every file, incremental scans are only reading new or modified files since last scan. */
+void MusicSearchEngine::setScanMode(ScanMode mode)
+{
+	_scanMode = mode;
+}
+
+/** Overrides the number of threads reading tags for each device, 0 to use settings. */
+void MusicSearchEngine::setWorkerCount(int count)
+{
+	_workerCount = qMax(0, count);
+}
+
+/** Scans some directories instead of music locations of settings, which are left untouched. */
+void MusicSearchEngine::setLocations(const QStringList &locations)
+{
+	_locations = locations;
+}
 
 void MusicSearchEngine::setWatchForChanges(bool b)
 {
-	if (b) {
-		_timer->start();
-	} else {
-		_timer->stop();
+#ifdef Q_OS_LINUX
+	if (b && !_watcher) {
+		_watcher = new LibraryWatcher(this);
+		connect(_watcher, &LibraryWatcher::directoriesChanged, this, &MusicSearchEngine::rescanDirectories);
+		_watcher->watch(SettingsPrivate::instance()->musicLocations());
+	} else if (!b && _watcher) {
+		delete _watcher;
+		_watcher = nullptr;
 	}
+#else
+	Q_UNUSED(b)
+#endif
 }
 
-void MusicSearchEngine::doSearch()
+QStringList MusicSearchEngine::scan(const QStringList &roots, QHash<QString, FileFingerprint> &knownFiles, bool isIncremental)
 {
-	emit aboutToSearch();
+	// Instead of walking twice through the filesystem, progress is estimated with the number of entries found last time.
+	// This estimation is refined when a directory has more entries than expected
+	QHash<QString, int> expectedCounts;
+	SqlDatabase *db = SqlDatabase::instance();
+	for (QString root : roots) {
+		expectedCounts.unite(db->selectDirectoryEntryCounts(root));
+	}
+	int expectedCount = 0;
+	for (int count : expectedCounts) {
+		expectedCount += count;
+	}
+	QAtomicInt entryCount(expectedCount);
+	QAtomicInt currentEntry(0);
+	int percent = 0;
 
-	MusicSearchEngine::isScanning = true;
-	QList<QDir> locations;
-	for (QString musicPath : SettingsPrivate::instance()->musicLocations()) {
-		QDir location(musicPath);
-		location.setFilter(QDir::AllDirs | QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot);
-		locations.append(location);
-	}
-
-	int entryCount = 0;
-	// QDirIterator class is very fast to scan large directories
-	for (QDir location : locations) {
-		QDirIterator it(location.absolutePath(), QDir::AllEntries | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
-		while (it.hasNext()) {
-			it.next();
-			entryCount++;
+	// Locations on the same device are walked one after the other, locations on different devices at the same time
+	QMap<quint64, QStringList> rootsByDevice;
+	for (QString root : roots) {
+		rootsByDevice[ScanFileSystem::instance()->stat(root).device].append(root);
+	}
+
+	// Files are read and saved by other threads while walkers are going through the filesystem
+	int workerCount = _workerCount > 0 ? _workerCount : SettingsPrivate::instance()->scanWorkerCount();
+	ScanPipeline pipeline(workerCount, SettingsPrivate::instance()->scanBatchSize(),
+						  ScanIoPolicy::forProfile(SettingsPrivate::instance()->scanProfile()), rootsByDevice.size());
+	QList<ScanWalker*> walkers;
+	for (QStringList deviceRoots : rootsByDevice) {
+		ScanWalker *walker = new ScanWalker(deviceRoots, &pipeline, walkers.size(), isIncremental, &_isCancelled);
+		walker->setProgress(&expectedCounts, &currentEntry, &entryCount);
+		walkers.append(walker);
+	}
+
+	// Each walker takes known files under its own roots, others are files outside music locations
+	if (walkers.size() == 1) {
+		walkers.first()->setKnownFiles(knownFiles);
+		knownFiles.clear();
+	} else {
+		QList<QHash<QString, FileFingerprint>> knownFilesByWalker;
+		QHash<QString, FileFingerprint> outsideFiles;
+		for (int i = 0; i < walkers.size(); i++) {
+			knownFilesByWalker.append(QHash<QString, FileFingerprint>());
+		}
+		for (auto it = knownFiles.cbegin(); it != knownFiles.cend(); ++it) {
+			int i = 0;
+			while (i < walkers.size() && !walkers.at(i)->isUnderRoots(it.key())) {
+				i++;
+			}
+			if (i < walkers.size()) {
+				knownFilesByWalker[i].insert(it.key(), it.value());
+			} else {
+				outsideFiles.insert(it.key(), it.value());
+			}
 		}
+		for (int i = 0; i < walkers.size(); i++) {
+			walkers.at(i)->setKnownFiles(knownFilesByWalker.at(i));
+		}
+		knownFiles = outsideFiles;
+	}
+
+	pipeline.start();
+	for (ScanWalker *walker : walkers) {
+		walker->start();
 	}
 
-	int currentEntry = 0;
-	int percent = 1;
-	bool atLeastOneAudioFileWasFound = false;
-	bool isNewDirectory = false;
-
-	QString coverPath;
-	QString lastFileScannedNextToCover;
-
-	QStringList suffixes = FileHelper::suffixes(FileHelper::ET_Standard | FileHelper::ET_GameMusicEmu);
-
-	SqlDatabase db;
-	db.transaction();
-	for (QDir location : locations) {
-		QDirIterator it(location.absolutePath(), QDir::AllEntries | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
-		while (it.hasNext()) {
-			QString entry = it.next();
-			QFileInfo qFileInfo(entry);
-			currentEntry++;
-
-			// Directory has changed: we can discard cover
-			if (qFileInfo.isDir()) {
-				if (!coverPath.isEmpty() && !lastFileScannedNextToCover.isEmpty()) {
-					db.saveCoverRef(coverPath, lastFileScannedNextToCover);
-					coverPath.clear();
-				}
-				isNewDirectory = true;
-				atLeastOneAudioFileWasFound = false;
-				lastFileScannedNextToCover.clear();
+	// Without anything to compare with, like during the first scan, the progress is unknown. Listeners are living in
+	// other threads, it's useless to notify them more often than they can repaint
+	for (ScanWalker *walker : walkers) {
+		while (!walker->wait(100)) {
+			if (expectedCounts.isEmpty()) {
 				continue;
-			} else if (qFileInfo.suffix().toLower() == "jpg" || qFileInfo.suffix().toLower() == "png") {
-				if (atLeastOneAudioFileWasFound) {
-					coverPath = qFileInfo.absoluteFilePath();
-				} else if (isNewDirectory) {
-					coverPath = qFileInfo.absoluteFilePath();
-				}
-			} else if (suffixes.contains(qFileInfo.suffix())) {
-				db.saveFileRef(qFileInfo.absoluteFilePath());
-				atLeastOneAudioFileWasFound = true;
-				lastFileScannedNextToCover = qFileInfo.absoluteFilePath();
-				isNewDirectory = false;
 			}
-
-			if (currentEntry * 100 / entryCount > percent) {
-				percent = currentEntry * 100 / entryCount;
+			int newPercent = qMin(99, static_cast<int>(currentEntry.load() * 100LL / qMax(1, entryCount.load())));
+			if (newPercent > percent) {
+				percent = newPercent;
 				emit progressChanged(percent);
-				qApp->processEvents();
 			}
 		}
-		if (!coverPath.isEmpty() && !lastFileScannedNextToCover.isEmpty()) {
-			db.saveCoverRef(coverPath, lastFileScannedNextToCover);
-			coverPath.clear();
-			lastFileScannedNextToCover.clear();
+	}
+
+	QHash<QString, int> entryCounts;
+	QStringList updatedTracks;
+	QList<QPair<QString, FileFingerprint>> pictures;
+	for (ScanWalker *walker : walkers) {
+		entryCounts.unite(walker->entryCounts());
+		updatedTracks.append(walker->updatedTracks());
+		pictures.append(walker->pictures());
+		knownFiles.unite(walker->knownFiles());
+	}
+	qDeleteAll(walkers);
+
+	// Files waiting to be read are dropped, but those already read are committed
+	bool isCancelled = this->isCancelled();
+	if (isCancelled) {
+		pipeline.cancel();
+	}
+	pipeline.finish();
+
+	db->transaction();
+	for (auto picture : pictures) {
+		db->saveFileFingerprint(picture.first, picture.second);
+	}
+	// Files which haven't been found are not in the filesystem anymore, unless the walk was stopped before them
+	if (!isCancelled) {
+		db->removeFileRefs(knownFiles.keys());
+		db->removeOrphans();
+		db->saveDirectoryEntryCounts(roots, entryCounts);
+	}
+	db->pruneTrackChanges();
+	db->commit();
+	emit progressChanged(100);
+
+	_lastEntryCount = currentEntry.load();
+	_lastReadCount = updatedTracks.size();
+	return updatedTracks;
+}
+
+void MusicSearchEngine::doSearch()
+{
+	emit aboutToSearch();
+
+	// Waits for a rescan of the watcher which has already started
+	QMutexLocker locker(&scanMutex);
+	QStringList roots;
+	for (QString musicPath : _locations.isEmpty() ? SettingsPrivate::instance()->musicLocations() : _locations) {
+		roots << QDir(musicPath).absolutePath();
+	}
+
+	// When scan is incremental, files which are still the same since last time are skipped. In both modes, remaining items
+	// in this hash at the end of the scan are files which were deleted from the filesystem
+	QHash<QString, FileFingerprint> knownFiles;
+	SqlDatabase *db = SqlDatabase::instance();
+	if (_locations.isEmpty()) {
+		knownFiles = db->selectFileFingerprints();
+
+		// Nothing to compare with, like a library built by an older version: rebuild everything
+		if (knownFiles.isEmpty()) {
+			db->reset();
+		}
+	} else {
+		// Files outside these directories are kept in the library
+		for (QString root : roots) {
+			knownFiles.unite(db->selectFileFingerprints(root));
 		}
-		atLeastOneAudioFileWasFound = false;
 	}
-	db.commit();
 
-	db.exec("CREATE INDEX IF NOT EXISTS indexArtist ON cache (artistNormalized)");
-	db.exec("CREATE INDEX IF NOT EXISTS indexAlbum ON cache (albumNormalized)");
-	db.exec("CREATE INDEX IF NOT EXISTS indexPath ON cache (uri)");
+	// Kept until this scan is complete: if it's cancelled or if the player is closed meanwhile, it's resumed on next
+	// launch as an incremental scan, which skips files committed so far
+	db->insertScanCursor(roots);
+	this->scan(roots, knownFiles, _scanMode == SM_Incremental && !knownFiles.isEmpty());
+	if (!this->isCancelled()) {
+		db->removeScanCursor();
+	}
 
 	// Resync remote players and remote databases
 	//emit aboutToResyncRemoteSources();
 
-	MusicSearchEngine::isScanning = false;
-
+	locker.unlock();
 	emit searchHasEnded();
 }
 
-void MusicSearchEngine::watchForChanges()
+/** Incremental scan limited to some directories and their subdirectories. */
+void MusicSearchEngine::rescanDirectories(const QStringList &directories)
 {
-	if (isScanning) {
-		qDebug() << Q_FUNC_INFO << "the filesystem is already being analyzed by another process";
+	// A full scan is running: try again later, events were already coalesced by the watcher
+	if (!scanMutex.tryLock()) {
+		QTimer::singleShot(5000, this, [=]() {
+			this->rescanDirectories(directories);
+		});
 		return;
 	}
 
-	// Gather all folders registered on music locations
-	QFileInfoList dirs;
-	for (QString musicPath : SettingsPrivate::instance()->musicLocations()) {
-		QFileInfo location(musicPath);
-		QDirIterator it(location.absoluteFilePath(), QDir::Dirs | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
-		while (it.hasNext()) {
-			QString entry = it.next();
-			QFileInfo qFileInfo(entry);
-			dirs << qFileInfo;
-		}
+	QHash<QString, FileFingerprint> knownFiles;
+	SqlDatabase *db = SqlDatabase::instance();
+	for (QString directory : directories) {
+		knownFiles.unite(db->selectFileFingerprints(directory));
 	}
+	QStringList updatedTracks = this->scan(directories, knownFiles, true);
+	QStringList removedTracks = knownFiles.keys();
+	scanMutex.unlock();
 
-	SqlDatabase db;
-
-	QStringList newFoldersToAddInLibrary;
-	// Add folders that were not found first
-	for (QFileInfo f : dirs) {
-		QSqlQuery query(db);
-		query.setForwardOnly(true);
-		query.prepare("SELECT * FROM filesystem WHERE path = ?");
-		query.addBindValue(f.absoluteFilePath());
-		if (query.exec() && !query.next()) {
-			newFoldersToAddInLibrary << f.absoluteFilePath();
-			QSqlQuery prepared(db);
-			prepared.setForwardOnly(true);
-			prepared.prepare("INSERT INTO filesystem (path, lastModified) VALUES (?, ?)");
-			prepared.addBindValue(f.absoluteFilePath());
-			prepared.addBindValue(f.lastModified().toTime_t());
-			prepared.exec();
-		}
+	qDebug() << Q_FUNC_INFO << updatedTracks.size() << "tracks were updated," << removedTracks.size() << "were removed";
+	if (!updatedTracks.isEmpty() || !removedTracks.isEmpty()) {
+		emit tracksHaveChanged(updatedTracks, removedTracks);
 	}
+}
 
-	if (!newFoldersToAddInLibrary.isEmpty()) {
-		this->doSearch();
-	}
-
-	// Process in reverse mode to clean cache: from database file and check if entry exists in database
-	QSqlQuery cache("SELECT * FROM filesystem", db);
-	qDebug() << Q_FUNC_INFO << "SELECT * FROM filesystem";
-	cache.setForwardOnly(true);
-	if (cache.exec()) {
-		QStringList oldLocations;
-		while (cache.next()) {
-			QDir d(cache.record().value(0).toString());
-			d.exists();
-			QFileInfo fileInfo(cache.record().value(0).toString());
-			// Remove folder in database because it couldn't be find in the filesystem
-			if (!fileInfo.exists()) {
-				QSqlQuery deleteFromFilesystem(db);
-				deleteFromFilesystem.prepare("DELETE FROM filesystem WHERE path = ?");
-				deleteFromFilesystem.addBindValue(fileInfo.absoluteFilePath());
-				qDebug() << Q_FUNC_INFO << "DELETE FROM filesystem WHERE path = ?";
-
-				if (deleteFromFilesystem.exec()) {
-					oldLocations << fileInfo.absoluteFilePath();
-				}
-			}
-		}
-		qDebug() << Q_FUNC_INFO << oldLocations;
-		if (!oldLocations.isEmpty()) {
-			//db.rebuildFomLocations(oldLocations, QStringList());
-			//setDelta(oldLocations);
-			//db.exec("DELETE FROM cache");
-			//db.exec("DROP INDEX indexUri");
-		}
+void MusicSearchEngine::watchForChanges()
+{
+#ifdef Q_OS_LINUX
+	// Changes are notified by the kernel, there's no need to compare the filesystem with the database
+	this->setWatchForChanges(true);
+#else
+	// Files which have changed since the last scan are found with their fingerprints
+	QStringList locations;
+	for (QString musicPath : SettingsPrivate::instance()->musicLocations()) {
+		locations << QDir(musicPath).absolutePath();
 	}
+	this->rescanDirectories(locations);
+#endif
 }
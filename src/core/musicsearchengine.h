@@ -1,12 +1,17 @@
 #ifndef MUSICSEARCHENGINE_H
 #define MUSICSEARCHENGINE_H
 
+#include <QAtomicInt>
 #include <QDir>
 #include <QFileInfo>
 #include <QTimer>
 
 #include "miamcore_global.h"
 
+/// Forward declarations
+class FileFingerprint;
+class LibraryWatcher;
+
 /**
  * \brief		The MusicSearchEngine class
  * \author      Matthieu Bachelier
@@ -16,23 +21,68 @@ class MIAMCORE_LIBRARY MusicSearchEngine : public QObject
 {
 	Q_OBJECT
 private:
-	QTimer *_timer;
+	LibraryWatcher *_watcher;
 	//QStringList _delta;
 
 public:
-	static bool isScanning;
+	enum ScanMode { SM_Full			= 0,
+					SM_Incremental	= 1};
+
+private:
+	ScanMode _scanMode;
+
+	/** Set from another thread, checked by the walker for each entry. */
+	QAtomicInt _isCancelled;
+
+	/** Number of threads reading tags for each device, 0 to use settings. */
+	int _workerCount;
 
+	/** Directories to scan instead of music locations of settings. */
+	QStringList _locations;
+
+	/** Statistics of the last scan. */
+	int _lastEntryCount;
+	int _lastReadCount;
+
+public:
 	explicit MusicSearchEngine(QObject *parent = nullptr);
 
 	virtual ~MusicSearchEngine();
 
+	/** Stops the current scan as soon as possible, keeping files already read. Can be called from any thread. */
+	void cancel();
+
+	bool isCancelled() const;
+
+	/** Number of files and directories found by the last scan. */
+	inline int lastEntryCount() const { return _lastEntryCount; }
+
+	/** Number of files read by the last scan, because they were new or modified. */
+	inline int lastReadCount() const { return _lastReadCount; }
+
 	//void setDelta(const QStringList &delta);
 
+	/** Full scans are reading every file, incremental scans are only reading new or modified files since last scan. */
+	void setScanMode(ScanMode mode);
+
+	/** Overrides the number of threads reading tags for each device, 0 to use settings. */
+	void setWorkerCount(int count);
+
+	/** Scans some directories instead of music locations of settings, which are left untouched. */
+	void setLocations(const QStringList &locations);
+
 	void setWatchForChanges(bool b);
 
+private:
+	/** Walks through roots, one walker per device, and sends new or modified files to the pipeline. Files still in knownFiles are gone. */
+	QStringList scan(const QStringList &roots, QHash<QString, FileFingerprint> &knownFiles, bool isIncremental);
+
 public slots:
 	void doSearch();
 
+	/** Incremental scan limited to some directories and their subdirectories. */
+	void rescanDirectories(const QStringList &directories);
+
 	void watchForChanges();
 
 signals:
@@ -41,6 +91,9 @@ signals:
 	void progressChanged(int);
 
 	void searchHasEnded();
+
+	/** Sent after a partial rescan, with tracks which were added or modified, and tracks which were removed. */
+	void tracksHaveChanged(const QStringList &updatedTracks, const QStringList &removedTracks);
 };
 
 #endif // MUSICSEARCHENGINE_H
@@ -0,0 +1,181 @@
+#include "normalizer.h"
+
+#include <QHash>
+#include <QReadWriteLock>
+#include <QRegExp>
+#include <QRegularExpression>
+#include <QVector>
+
+namespace {
+	/** Blocks of characters which are folded with a table instead of Unicode algorithms. */
+	struct Block
+	{
+		ushort first;
+		ushort last;
+	};
+
+	const Block foldedBlocks[] = {
+		{ 0x0080, 0x04FF },	// Latin-1 Supplement, Latin Extended-A and B, IPA, Greek, Cyrillic
+		{ 0x1E00, 0x1EFF },	// Latin Extended Additional, like Vietnamese letters
+		{ 0x2000, 0x206F }	// General punctuation, like dashes and quotes
+	};
+
+	const int blockCount = sizeof(foldedBlocks) / sizeof(foldedBlocks[0]);
+
+	/** Folded characters of each block, in a single vector. */
+	class FoldTable
+	{
+	private:
+		QVector<QString> _folded;
+		int _offsets[blockCount];
+
+	public:
+		explicit FoldTable(QString (*fold)(const QString &))
+		{
+			int size = 0;
+			for (int b = 0; b < blockCount; b++) {
+				_offsets[b] = size;
+				size += foldedBlocks[b].last - foldedBlocks[b].first + 1;
+			}
+			_folded.reserve(size);
+			for (int b = 0; b < blockCount; b++) {
+				for (uint c = foldedBlocks[b].first; c <= foldedBlocks[b].last; c++) {
+					_folded.append(fold(QString(QChar(c))));
+				}
+			}
+		}
+
+		/** Returns nullptr when c isn't in the table. */
+		const QString *find(ushort c) const
+		{
+			for (int b = 0; b < blockCount; b++) {
+				if (c >= foldedBlocks[b].first && c <= foldedBlocks[b].last) {
+					return &_folded.at(_offsets[b] + c - foldedBlocks[b].first);
+				}
+			}
+			return nullptr;
+		}
+	};
+
+	/** Keys of strings with characters outside of ASCII, bounded because a scan can meet a lot of different ones. */
+	QHash<QString, QString> memo;
+	QReadWriteLock memoLock;
+	const int memoCapacity = 20000;
+
+	inline bool isAsciiWordCharacter(ushort c)
+	{
+		return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+	}
+}
+
+/** True when s contains at least one letter, digit or underscore. */
+bool Normalizer::hasWordCharacter(const QString &s)
+{
+	bool isAscii = true;
+	for (QChar c : s) {
+		if (c.unicode() >= 0x80) {
+			isAscii = false;
+		} else if (isAsciiWordCharacter(c.unicode())) {
+			return true;
+		}
+	}
+	if (isAscii) {
+		return false;
+	}
+	static const QRegularExpression wordCharacter("[\\w]");
+	return s.contains(wordCharacter);
+}
+
+/** Lower case key without accents, spaces nor punctuation, like "Beyoncé Knowles" -> "beyonceknowles". */
+QString Normalizer::normalizeField(const QString &s)
+{
+	QString normalized;
+	normalized.reserve(s.size());
+
+	// Most tags are plain ASCII: lower case letters, digits and underscores are the only characters which are kept
+	int i = 0;
+	for (; i < s.size(); i++) {
+		ushort c = s.at(i).unicode();
+		if (c >= 0x80) {
+			break;
+		} else if (c >= 'A' && c <= 'Z') {
+			normalized.append(QChar(c + ('a' - 'A')));
+		} else if (isAsciiWordCharacter(c)) {
+			normalized.append(QChar(c));
+		}
+	}
+
+	if (i < s.size()) {
+		{
+			QReadLocker locker(&memoLock);
+			auto it = memo.constFind(s);
+			if (it != memo.cend()) {
+				return it.value();
+			}
+		}
+
+		// Each character is decomposed alone: combining marks which could be reordered across characters are removed anyway
+		static const FoldTable table(&Normalizer::normalizeFieldSlow);
+		for (; i < s.size(); i++) {
+			ushort c = s.at(i).unicode();
+			if (c >= 0x80) {
+				if (const QString *folded = table.find(c)) {
+					normalized.append(*folded);
+				} else {
+					// Other scripts, surrogate pairs: the whole string is processed like before
+					normalized = normalizeFieldSlow(s);
+					break;
+				}
+			} else if (c >= 'A' && c <= 'Z') {
+				normalized.append(QChar(c + ('a' - 'A')));
+			} else if (isAsciiWordCharacter(c)) {
+				normalized.append(QChar(c));
+			}
+		}
+		if (normalized.isEmpty()) {
+			normalized = s.toLower().remove(" ").trimmed();
+		}
+
+		QWriteLocker locker(&memoLock);
+		if (memo.size() >= memoCapacity) {
+			memo.clear();
+		}
+		memo.insert(s, normalized);
+		return normalized;
+	}
+
+	if (normalized.isEmpty()) {
+		return s.toLower().remove(" ").trimmed();
+	}
+	return normalized;
+}
+
+/** Letter of the separator above text in a tree, like "E" for "Édith Piaf", or an empty string when it's not a letter. */
+QString Normalizer::separatorLetter(const QString &text)
+{
+	if (text.isEmpty()) {
+		return QString();
+	}
+	ushort c = text.at(0).unicode();
+	if (c < 0x80) {
+		if (c >= 'a' && c <= 'z') {
+			return QString(QChar(c - ('a' - 'A')));
+		} else if (c >= 'A' && c <= 'Z') {
+			return QString(QChar(c));
+		}
+		return QString();
+	}
+
+	// Like "É" -> "E", or "ǆ" -> "DZ"
+	QString letter = text.left(1).normalized(QString::NormalizationForm_KD).toUpper().remove(QRegExp("[^A-Z\\s]"));
+	if (letter.contains(QRegExp("\\w"))) {
+		return letter;
+	}
+	return QString();
+}
+
+QString Normalizer::normalizeFieldSlow(const QString &s)
+{
+	static const QRegularExpression regExp("[^\\w]");
+	return s.toLower().normalized(QString::NormalizationForm_KD).remove(regExp).trimmed();
+}
@@ -0,0 +1,33 @@
+#ifndef NORMALIZER_H
+#define NORMALIZER_H
+
+#include <QString>
+
+#include "miamcore_global.h"
+
+/**
+ * \brief		The Normalizer class builds keys used to compare, group and sort artists and albums.
+ * \details		Results are exactly the same as a Unicode decomposition followed by regular expressions, but most strings are
+ *				processed without them: ASCII characters are handled inline, Latin, Greek, Cyrillic and general punctuation are
+ *				looked up in a table computed once with the slow path, and keys of other strings are remembered because the same
+ *				artists and albums are met again and again during a scan. Can be called from any thread.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+class MIAMCORE_LIBRARY Normalizer
+{
+public:
+	/** True when s contains at least one letter, digit or underscore. */
+	static bool hasWordCharacter(const QString &s);
+
+	/** Lower case key without accents, spaces nor punctuation, like "Beyoncé Knowles" -> "beyonceknowles". */
+	static QString normalizeField(const QString &s);
+
+	/** Letter of the separator above text in a tree, like "E" for "Édith Piaf", or an empty string when it's not a letter. */
+	static QString separatorLetter(const QString &text);
+
+private:
+	static QString normalizeFieldSlow(const QString &s);
+};
+
+#endif // NORMALIZER_H
@@ -0,0 +1,84 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QQueue>
+#include <QWaitCondition>
+
+/**
+ * \brief		The BoundedQueue class is a blocking FIFO shared between producer and consumer threads.
+ * \details		Producers are put to sleep when the queue is full, so a fast directory walker cannot stack thousands of paths
+ *				that workers haven't parsed yet. Once closed, consumers drain remaining items then stop.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+template<typename T>
+class BoundedQueue
+{
+private:
+	QQueue<T> _items;
+
+	int _capacity;
+
+	bool _isClosed;
+
+	QMutex _mutex;
+	QWaitCondition _notEmpty;
+	QWaitCondition _notFull;
+
+public:
+	explicit BoundedQueue(int capacity)
+		: _capacity(capacity)
+		, _isClosed(false)
+	{}
+
+	/** Appends an item, waiting for some free space if needed. Returns false if the queue was closed. */
+	bool push(const T &item)
+	{
+		QMutexLocker locker(&_mutex);
+		while (_items.size() >= _capacity && !_isClosed) {
+			_notFull.wait(&_mutex);
+		}
+		if (_isClosed) {
+			return false;
+		}
+		_items.enqueue(item);
+		_notEmpty.wakeOne();
+		return true;
+	}
+
+	/** Takes the first item, waiting for one if needed. Returns false when the queue is closed and empty. */
+	bool pop(T &item)
+	{
+		QMutexLocker locker(&_mutex);
+		while (_items.isEmpty() && !_isClosed) {
+			_notEmpty.wait(&_mutex);
+		}
+		if (_items.isEmpty()) {
+			return false;
+		}
+		item = _items.dequeue();
+		_notFull.wakeOne();
+		return true;
+	}
+
+	/** Drops items which haven't been taken yet, and wakes up producers waiting for some free space. */
+	void clear()
+	{
+		QMutexLocker locker(&_mutex);
+		_items.clear();
+		_notFull.wakeAll();
+	}
+
+	/** No more items will be pushed: wake up everyone waiting on this queue. */
+	void close()
+	{
+		QMutexLocker locker(&_mutex);
+		_isClosed = true;
+		_notEmpty.wakeAll();
+		_notFull.wakeAll();
+	}
+};
+
+#endif // BOUNDEDQUEUE_H
@@ -0,0 +1,116 @@
+#include "bufferedfilestream.h"
+
+#include <QDir>
+#include <QFile>
+
+BufferedFileStream::BufferedFileStream(const QString &absFilePath, ScanFileSystem *fileSystem, int headSize, int tailSize)
+	: TagLib::IOStream()
+	, _fileName(absFilePath)
+	, _file(fileSystem->open(absFilePath))
+	, _encodedName(QFile::encodeName(QDir::toNativeSeparators(absFilePath)))
+	, _tailOffset(0)
+	, _length(0)
+	, _position(0)
+{
+	// Files are opened without buffer, which is useless when both ends are already in memory
+	if (_file.isNull()) {
+		return;
+	}
+	_length = _file->size();
+	_head = _file->read(qMin<qint64>(headSize, _length));
+	_tailOffset = qMax<long>(_head.size(), _length - tailSize);
+	if (_tailOffset < _length && _file->seek(_tailOffset)) {
+		_tail = _file->read(_length - _tailOffset);
+	}
+}
+
+BufferedFileStream::~BufferedFileStream()
+{}
+
+TagLib::FileName BufferedFileStream::name() const
+{
+#ifdef _WIN32
+	return TagLib::FileName(QDir::toNativeSeparators(_fileName).toStdWString().data());
+#else
+	return _encodedName.constData();
+#endif
+}
+
+TagLib::ByteVector BufferedFileStream::readBlock(unsigned long length)
+{
+	if (!isOpen() || length == 0 || _position >= _length) {
+		return TagLib::ByteVector();
+	}
+	long end = qMin<long>(_length, _position + static_cast<long>(length));
+	const char *buffer = nullptr;
+	if (end <= _head.size()) {
+		buffer = _head.constData() + _position;
+	} else if (_position >= _tailOffset && end - _tailOffset <= _tail.size()) {
+		buffer = _tail.constData() + (_position - _tailOffset);
+	}
+	if (buffer) {
+		TagLib::ByteVector data(buffer, static_cast<unsigned int>(end - _position));
+		_position = end;
+		return data;
+	}
+
+	// Range is not in memory
+	if (!_file->seek(_position)) {
+		return TagLib::ByteVector();
+	}
+	QByteArray data = _file->read(end - _position);
+	_position += data.size();
+	return TagLib::ByteVector(data.constData(), static_cast<unsigned int>(data.size()));
+}
+
+/** This stream is read-only: writing does nothing. */
+void BufferedFileStream::writeBlock(const TagLib::ByteVector &)
+{}
+
+/** This stream is read-only: writing does nothing. */
+void BufferedFileStream::insert(const TagLib::ByteVector &, unsigned long, unsigned long)
+{}
+
+/** This stream is read-only: writing does nothing. */
+void BufferedFileStream::removeBlock(unsigned long, unsigned long)
+{}
+
+bool BufferedFileStream::readOnly() const
+{
+	return true;
+}
+
+bool BufferedFileStream::isOpen() const
+{
+	return !_file.isNull() && _file->isOpen();
+}
+
+void BufferedFileStream::seek(long offset, Position p)
+{
+	switch (p) {
+	case Beginning:
+		_position = offset;
+		break;
+	case Current:
+		_position += offset;
+		break;
+	case End:
+		_position = _length + offset;
+		break;
+	}
+	_position = qMax<long>(0, _position);
+}
+
+long BufferedFileStream::tell() const
+{
+	return _position;
+}
+
+long BufferedFileStream::length()
+{
+	return _length;
+}
+
+/** This stream is read-only: truncating does nothing. */
+void BufferedFileStream::truncate(long)
+{}
@@ -0,0 +1,78 @@
+#ifndef BUFFEREDFILESTREAM_H
+#define BUFFEREDFILESTREAM_H
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QScopedPointer>
+
+#include <taglib/tiostream.h>
+
+#include "../miamcore_global.h"
+#include "scanfilesystem.h"
+
+/**
+ * \brief		The BufferedFileStream class is a read-only stream for TagLib which keeps the beginning and the end of a file in memory.
+ * \details		Tags are stored at both ends of audio files: ID3v2, FLAC metadata blocks, Vorbis comments and most MP4 atoms at the
+ *				beginning, ID3v1 and APE tags at the end. When a file is opened, these two parts are read with one call each, then
+ *				TagLib's parsers are served from memory instead of sending many small reads to the disk. Other ranges, like a large
+ *				picture or an MP4 file with its metadata at the end, are still read from the file.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+class MIAMCORE_LIBRARY BufferedFileStream : public TagLib::IOStream
+{
+private:
+	QString _fileName;
+
+	/** Null when the file couldn't be opened. */
+	QScopedPointer<QIODevice> _file;
+
+	/** Kept because TagLib only stores a pointer to the name on some platforms. */
+	QByteArray _encodedName;
+
+	QByteArray _head;
+	QByteArray _tail;
+	long _tailOffset;
+	long _length;
+	long _position;
+
+public:
+	/** Bytes kept in memory at the beginning of a file. */
+	static const int defaultHeadSize = 64 * 1024;
+
+	/** Bytes kept in memory at the end of a file. */
+	static const int defaultTailSize = 8 * 1024;
+
+	explicit BufferedFileStream(const QString &absFilePath, ScanFileSystem *fileSystem = ScanFileSystem::instance(),
+								int headSize = defaultHeadSize, int tailSize = defaultTailSize);
+
+	virtual ~BufferedFileStream();
+
+	virtual TagLib::FileName name() const override;
+
+	virtual TagLib::ByteVector readBlock(unsigned long length) override;
+
+	/** This stream is read-only: writing does nothing. */
+	virtual void writeBlock(const TagLib::ByteVector &data) override;
+
+	/** This stream is read-only: writing does nothing. */
+	virtual void insert(const TagLib::ByteVector &data, unsigned long start = 0, unsigned long replace = 0) override;
+
+	/** This stream is read-only: writing does nothing. */
+	virtual void removeBlock(unsigned long start = 0, unsigned long length = 0) override;
+
+	virtual bool readOnly() const override;
+
+	virtual bool isOpen() const override;
+
+	virtual void seek(long offset, Position p = Beginning) override;
+
+	virtual long tell() const override;
+
+	virtual long length() override;
+
+	/** This stream is read-only: truncating does nothing. */
+	virtual void truncate(long length) override;
+};
+
+#endif // BUFFEREDFILESTREAM_H
@@ -0,0 +1,42 @@
+#include "filefingerprint.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+FileFingerprint::FileFingerprint()
+	: size(-1)
+	, lastModified(0)
+	, inode(0)
+	, device(0)
+{}
+
+/** Reads the current state of a file with a single call to stat. */
+FileFingerprint FileFingerprint::fromFile(const QString &absFilePath)
+{
+	FileFingerprint fingerprint;
+#ifdef Q_OS_UNIX
+	struct stat st;
+	if (::stat(QFile::encodeName(absFilePath).constData(), &st) == 0) {
+		fingerprint.size = st.st_size;
+#if defined(Q_OS_LINUX)
+		fingerprint.lastModified = qint64(st.st_mtim.tv_sec) * 1000 + st.st_mtim.tv_nsec / 1000000;
+#else
+		fingerprint.lastModified = qint64(st.st_mtime) * 1000;
+#endif
+		fingerprint.inode = st.st_ino;
+		fingerprint.device = st.st_dev;
+	}
+#else
+	QFileInfo fileInfo(absFilePath);
+	if (fileInfo.exists()) {
+		fingerprint.size = fileInfo.size();
+		fingerprint.lastModified = fileInfo.lastModified().toMSecsSinceEpoch();
+	}
+#endif
+	return fingerprint;
+}
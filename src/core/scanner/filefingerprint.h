@@ -0,0 +1,43 @@
+#ifndef FILEFINGERPRINT_H
+#define FILEFINGERPRINT_H
+
+#include <QString>
+
+#include "../miamcore_global.h"
+
+/**
+ * \brief		The FileFingerprint class identifies a state of a file on the filesystem without reading its content.
+ * \details		Size, modification time and inode are stored in the database after a scan. When a rescan is incremental, a
+ *				file is read again only if one of these values has changed since last time.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+class MIAMCORE_LIBRARY FileFingerprint
+{
+public:
+	qint64 size;
+
+	/** Milliseconds since epoch. */
+	qint64 lastModified;
+
+	/** Always 0 on filesystems without inodes. */
+	quint64 inode;
+
+	/** Device which holds this file, always 0 when unknown. It's not stored in the database, nor compared. */
+	quint64 device;
+
+	FileFingerprint();
+
+	/** Reads the current state of a file with a single call to stat. */
+	static FileFingerprint fromFile(const QString &absFilePath);
+
+	inline bool isNull() const { return size < 0; }
+
+	inline bool operator==(const FileFingerprint &other) const {
+		return size == other.size && lastModified == other.lastModified && inode == other.inode;
+	}
+
+	inline bool operator!=(const FileFingerprint &other) const { return !(*this == other); }
+};
+
+#endif // FILEFINGERPRINT_H
@@ -0,0 +1,277 @@
+#include "librarywatcher.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSocketNotifier>
+#include <QTimer>
+
+#include <QtDebug>
+
+#include <errno.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace {
+	const uint32_t watchMask = IN_CREATE | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_EXCL_UNLINK;
+
+	/** Events are gathered during this period of time before rescanning directories. */
+	const int coalesceDelay = 2000;
+
+	/** Period of time between two checks of directories which can't be watched. */
+	const int pollInterval = 60000;
+}
+
+LibraryWatcher::LibraryWatcher(QObject *parent)
+	: QObject(parent)
+	, _fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+	, _notifier(nullptr)
+	, _coalesceTimer(new QTimer(this))
+	, _isWatchLimitReached(false)
+	, _pollTimer(new QTimer(this))
+{
+	_coalesceTimer->setSingleShot(true);
+	_coalesceTimer->setInterval(coalesceDelay);
+	connect(_coalesceTimer, &QTimer::timeout, this, &LibraryWatcher::flush);
+
+	_pollTimer->setInterval(pollInterval);
+	connect(_pollTimer, &QTimer::timeout, this, &LibraryWatcher::poll);
+
+	if (_fd < 0) {
+		qWarning() << Q_FUNC_INFO << "inotify is not available, library won't be monitored";
+		return;
+	}
+	_notifier = new QSocketNotifier(_fd, QSocketNotifier::Read, this);
+	connect(_notifier, &QSocketNotifier::activated, this, &LibraryWatcher::readEvents);
+}
+
+LibraryWatcher::~LibraryWatcher()
+{
+	if (_fd >= 0) {
+		// Closing the file descriptor releases every watch at once
+		::close(_fd);
+	}
+}
+
+/** Watches recursively every directory in locations. */
+void LibraryWatcher::watch(const QStringList &locations)
+{
+	_locations.clear();
+	for (QString location : locations) {
+		_locations << QDir::fromNativeSeparators(location);
+	}
+	if (_fd < 0) {
+		return;
+	}
+	for (QString location : _locations) {
+		this->addWatches(location);
+	}
+	qDebug() << Q_FUNC_INFO << _directories.size() << "directories are being watched," << _polledDirectories.size() << "are polled";
+}
+
+void LibraryWatcher::addWatch(const QString &directory)
+{
+	if (_descriptors.contains(directory) || _polledDirectories.contains(directory)) {
+		return;
+	}
+	int wd = _isWatchLimitReached ? -1 : inotify_add_watch(_fd, QFile::encodeName(directory).constData(), watchMask);
+	if (wd < 0) {
+		if (!_isWatchLimitReached && errno == ENOSPC) {
+			_isWatchLimitReached = true;
+			qWarning() << Q_FUNC_INFO << "maximum number of watches reached, check /proc/sys/fs/inotify/max_user_watches."
+					   << "Remaining directories are polled every" << pollInterval / 1000 << "seconds";
+		}
+		if (_isWatchLimitReached) {
+			_polledDirectories.insert(directory, QFileInfo(directory).lastModified().toMSecsSinceEpoch());
+			if (!_pollTimer->isActive()) {
+				_pollTimer->start();
+			}
+		}
+		return;
+	}
+	_directories.insert(wd, directory);
+	_descriptors.insert(directory, wd);
+	_lastModified.insert(directory, QFileInfo(directory).lastModified().toMSecsSinceEpoch());
+}
+
+void LibraryWatcher::addWatches(const QString &directory)
+{
+	this->addWatch(directory);
+	QDirIterator it(directory, QDir::Dirs | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+	while (it.hasNext()) {
+		this->addWatch(it.next());
+	}
+}
+
+void LibraryWatcher::markAsChanged(const QString &directory)
+{
+	_changedDirectories.insert(directory);
+
+	// Timer is not restarted on every event, otherwise a long copy would delay the update of the library until the end
+	if (!_coalesceTimer->isActive()) {
+		_coalesceTimer->start();
+	}
+}
+
+void LibraryWatcher::removeWatches(const QString &directory)
+{
+	QString prefix = directory + "/";
+	QList<QString> paths = _descriptors.keys();
+	for (QString path : paths) {
+		if (path == directory || path.startsWith(prefix)) {
+			int wd = _descriptors.take(path);
+			_directories.remove(wd);
+			_lastModified.remove(path);
+			inotify_rm_watch(_fd, wd);
+		}
+	}
+	paths = _polledDirectories.keys();
+	for (QString path : paths) {
+		if (path == directory || path.startsWith(prefix)) {
+			_polledDirectories.remove(path);
+		}
+	}
+}
+
+/** Called when the kernel has dropped some events. */
+void LibraryWatcher::recoverFromOverflow()
+{
+	qDebug() << Q_FUNC_INFO << "inotify queue has overflowed, looking for modified directories";
+
+	// Entries were added, removed or renamed in directories with a new modification time
+	QHashIterator<QString, qint64> it(_lastModified);
+	QStringList modifiedDirectories;
+	while (it.hasNext()) {
+		it.next();
+		QFileInfo fileInfo(it.key());
+		if (!fileInfo.exists() || fileInfo.lastModified().toMSecsSinceEpoch() != it.value()) {
+			modifiedDirectories << it.key();
+		}
+	}
+	for (QString directory : modifiedDirectories) {
+		if (QFileInfo::exists(directory)) {
+			_lastModified.insert(directory, QFileInfo(directory).lastModified().toMSecsSinceEpoch());
+		}
+		this->markAsChanged(directory);
+	}
+
+	// New subdirectories might have been created meanwhile
+	for (QString location : _locations) {
+		this->addWatches(location);
+	}
+}
+
+void LibraryWatcher::flush()
+{
+	if (_changedDirectories.isEmpty()) {
+		return;
+	}
+
+	// Keep top-most directories only, their subdirectories are going to be scanned as well. Parents are shorter than their
+	// children, but they're not always next to them in alphabetical order ("/a/b c" is between "/a/b" and "/a/b/d")
+	QStringList directories = _changedDirectories.toList();
+	std::sort(directories.begin(), directories.end(), [](const QString &a, const QString &b) {
+		return a.size() < b.size();
+	});
+	QStringList subtrees;
+	for (QString directory : directories) {
+		bool isInSubtree = false;
+		for (QString subtree : subtrees) {
+			if (directory == subtree || directory.startsWith(subtree + "/")) {
+				isInSubtree = true;
+				break;
+			}
+		}
+		if (!isInSubtree) {
+			subtrees << directory;
+		}
+	}
+	_changedDirectories.clear();
+
+	qDebug() << Q_FUNC_INFO << subtrees;
+	emit directoriesChanged(subtrees);
+}
+
+/** Compares modification times of directories which aren't watched. */
+void LibraryWatcher::poll()
+{
+	QStringList modifiedDirectories;
+	QHashIterator<QString, qint64> it(_polledDirectories);
+	while (it.hasNext()) {
+		it.next();
+		QFileInfo fileInfo(it.key());
+		if (!fileInfo.exists() || fileInfo.lastModified().toMSecsSinceEpoch() != it.value()) {
+			modifiedDirectories << it.key();
+		}
+	}
+	for (QString directory : modifiedDirectories) {
+		if (QFileInfo::exists(directory)) {
+			_polledDirectories.insert(directory, QFileInfo(directory).lastModified().toMSecsSinceEpoch());
+
+			// New subdirectories can't be watched either
+			QDirIterator subdirectories(directory, QDir::Dirs | QDir::Hidden | QDir::NoDotAndDotDot);
+			while (subdirectories.hasNext()) {
+				this->addWatches(subdirectories.next());
+			}
+		} else {
+			this->removeWatches(directory);
+		}
+		this->markAsChanged(directory);
+	}
+	if (_polledDirectories.isEmpty()) {
+		_pollTimer->stop();
+	}
+}
+
+void LibraryWatcher::readEvents()
+{
+	alignas(struct inotify_event) char buffer[64 * 1024];
+	forever {
+		ssize_t length = ::read(_fd, buffer, sizeof(buffer));
+		if (length <= 0) {
+			// EAGAIN: every pending event has been read
+			break;
+		}
+		for (char *p = buffer; p < buffer + length; ) {
+			const struct inotify_event *event = reinterpret_cast<const struct inotify_event*>(p);
+			p += sizeof(struct inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				this->recoverFromOverflow();
+				continue;
+			}
+
+			QString parent = _directories.value(event->wd);
+			if (parent.isEmpty()) {
+				continue;
+			}
+			if (event->mask & IN_IGNORED) {
+				// Watch was removed by the kernel (directory was deleted or filesystem unmounted)
+				_directories.remove(event->wd);
+				_descriptors.remove(parent);
+				_lastModified.remove(parent);
+				continue;
+			}
+
+			QString path = parent;
+			if (event->len > 0) {
+				path.append("/").append(QFile::decodeName(event->name));
+			}
+			if (event->mask & IN_ISDIR) {
+				if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+					this->addWatches(path);
+					this->markAsChanged(path);
+				} else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+					this->removeWatches(path);
+					this->markAsChanged(path);
+				}
+			} else {
+				this->markAsChanged(parent);
+			}
+		}
+	}
+}
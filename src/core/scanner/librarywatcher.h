@@ -0,0 +1,89 @@
+#ifndef LIBRARYWATCHER_H
+#define LIBRARYWATCHER_H
+
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+
+#include "../miamcore_global.h"
+
+/// Forward declarations
+class QSocketNotifier;
+class QTimer;
+
+/**
+ * \brief		The LibraryWatcher class monitors music locations with inotify (Linux only).
+ * \details		Every directory below music locations is watched. Events are not processed one by one: directories where
+ *				something has changed are gathered for a short period of time, then sent all at once, so a storm of events
+ *				(like a copy of thousands of files) ends up in a few incremental rescans of the smallest subtrees possible.
+ *				When the kernel queue overflows, events are lost: directories which have a new modification time are then
+ *				rescanned. When the maximum number of watches is reached, remaining directories are polled instead: they're
+ *				rescanned when their modification time changes, which misses files modified in place.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+class MIAMCORE_LIBRARY LibraryWatcher : public QObject
+{
+	Q_OBJECT
+private:
+	int _fd;
+
+	QSocketNotifier *_notifier;
+
+	/** Watch descriptors to absolute paths. */
+	QHash<int, QString> _directories;
+
+	/** Absolute paths to watch descriptors. */
+	QHash<QString, int> _descriptors;
+
+	/** Modification time of every watched directory, to find out what has changed when events were lost. */
+	QHash<QString, qint64> _lastModified;
+
+	QSet<QString> _changedDirectories;
+
+	QStringList _locations;
+
+	QTimer *_coalesceTimer;
+
+	bool _isWatchLimitReached;
+
+	/** Directories which can't be watched because of the limit, with their modification time. */
+	QHash<QString, qint64> _polledDirectories;
+
+	QTimer *_pollTimer;
+
+public:
+	explicit LibraryWatcher(QObject *parent = nullptr);
+
+	virtual ~LibraryWatcher();
+
+	/** Watches recursively every directory in locations. */
+	void watch(const QStringList &locations);
+
+private:
+	void addWatch(const QString &directory);
+
+	void addWatches(const QString &directory);
+
+	void markAsChanged(const QString &directory);
+
+	void removeWatches(const QString &directory);
+
+	/** Called when the kernel has dropped some events. */
+	void recoverFromOverflow();
+
+private slots:
+	void flush();
+
+	/** Compares modification times of directories which aren't watched. */
+	void poll();
+
+	void readEvents();
+
+signals:
+	/** Sent with directories (and their subdirectories) which have to be scanned again. */
+	void directoriesChanged(const QStringList &directories);
+};
+
+#endif // LIBRARYWATCHER_H
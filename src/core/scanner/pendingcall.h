@@ -0,0 +1,93 @@
+#ifndef PENDINGCALL_H
+#define PENDINGCALL_H
+
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+
+#include <functional>
+#include <memory>
+
+/**
+ * \brief		The PendingCall class runs a blocking function in a thread pool, so its caller can start many of them and collect
+ *				their results later, giving up on those which are too slow.
+ * \details		When a result is not awaited anymore, the function still runs until it returns, since a thread blocked in the
+ *				kernel can't be interrupted, but its result is simply dropped. Without pool, the function is called right away
+ *				by start().
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+template<typename T>
+class PendingCall
+{
+private:
+	/** Shared with the runnable, which may outlive this object. */
+	struct State
+	{
+		QSemaphore done;
+		T result;
+	};
+
+	std::shared_ptr<State> _state;
+
+	class Task : public QRunnable
+	{
+	private:
+		std::shared_ptr<State> _state;
+		std::function<T()> _function;
+
+	public:
+		Task(const std::shared_ptr<State> &state, const std::function<T()> &function)
+			: _state(state)
+			, _function(function)
+		{}
+
+		virtual void run() override
+		{
+			_state->result = _function();
+			_state->done.release();
+		}
+	};
+
+public:
+	PendingCall() {}
+
+	/** Calls function in pool, or in the current thread if pool is null. */
+	void start(QThreadPool *pool, const std::function<T()> &function)
+	{
+		_state = std::make_shared<State>();
+		Task *task = new Task(_state, function);
+		if (pool) {
+			pool->start(task);
+		} else {
+			task->run();
+			delete task;
+		}
+	}
+
+	/** Waits at most timeout milliseconds for the result, or forever if timeout is negative. Returns false on timeout. */
+	bool wait(int timeout, T &result)
+	{
+		if (!_state || !_state->done.tryAcquire(1, timeout)) {
+			return false;
+		}
+		result = _state->result;
+		return true;
+	}
+};
+
+/**
+ * Deletes pool once its calls have returned, waiting at most timeout milliseconds for them (forever if it's negative).
+ * Calls which are still blocked were abandoned by their callers: their pool is left behind, its threads end by themselves
+ * when these calls return. Returns false in this case.
+ */
+inline bool releasePool(QThreadPool *pool, int timeout)
+{
+	if (pool->waitForDone(timeout)) {
+		delete pool;
+		return true;
+	}
+	return false;
+}
+
+#endif // PENDINGCALL_H
@@ -0,0 +1,117 @@
+#include "scanfilesystem.h"
+
+#include <QDir>
+#include <QFile>
+#include <QStringList>
+#include <QThread>
+
+#include <QtDebug>
+
+/** Builds the filesystem returned by instance(). */
+static ScanFileSystem* createFileSystem()
+{
+	ScanFileSystem *fileSystem = new LocalScanFileSystem;
+	QString spec = QString::fromLocal8Bit(qgetenv("MIAM_SCAN_LATENCY"));
+	if (spec.isEmpty()) {
+		return fileSystem;
+	}
+	SlowScanFileSystem *slowFileSystem = SlowScanFileSystem::fromSpec(fileSystem, spec);
+	if (slowFileSystem == nullptr) {
+		qWarning() << "MIAM_SCAN_LATENCY can't be parsed, expected something like \"5-50,0.01\":" << spec;
+		return fileSystem;
+	}
+	qWarning() << "Scans are using a slow filesystem:" << spec;
+	return slowFileSystem;
+}
+
+/** Filesystem used by scans. Latency and errors are injected when MIAM_SCAN_LATENCY is set, like "5-50" or "5-50,0.01". */
+ScanFileSystem* ScanFileSystem::instance()
+{
+	// Never deleted: workers may still be using it when the application exits
+	static ScanFileSystem *fileSystem = createFileSystem();
+	return fileSystem;
+}
+
+FileFingerprint LocalScanFileSystem::stat(const QString &absFilePath)
+{
+	return FileFingerprint::fromFile(absFilePath);
+}
+
+/** Opens a file in read-only mode, without buffer. Returns nullptr when the file can't be opened. */
+QIODevice* LocalScanFileSystem::open(const QString &absFilePath)
+{
+	QFile *file = new QFile(absFilePath);
+	if (file->open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+		return file;
+	}
+	delete file;
+	return nullptr;
+}
+
+/** Lists files and subdirectories of a directory, hidden ones included. Returns an empty list when it can't be read. */
+QFileInfoList LocalScanFileSystem::entries(const QString &directory)
+{
+	// Types of entries are given by the directory itself, without calling stat
+	return QDir(directory).entryInfoList(QDir::AllEntries | QDir::Hidden | QDir::NoDotAndDotDot, QDir::NoSort);
+}
+
+SlowScanFileSystem::SlowScanFileSystem(ScanFileSystem *fileSystem, int minLatency, int maxLatency, double errorRate)
+	: _fileSystem(fileSystem)
+	, _minLatency(qMax(0, minLatency))
+	, _maxLatency(qMax(minLatency, maxLatency))
+	, _errorRate(errorRate)
+{}
+
+/** Builds a filesystem from a specification like "5-50,0.01". Returns nullptr if it can't be parsed. */
+SlowScanFileSystem* SlowScanFileSystem::fromSpec(ScanFileSystem *fileSystem, const QString &spec)
+{
+	QStringList parts = spec.split(',');
+	QStringList latencies = parts.first().split('-');
+	bool minOk = false, maxOk = false, rateOk = true;
+	int minLatency = latencies.first().toInt(&minOk);
+	int maxLatency = latencies.size() > 1 ? latencies.at(1).toInt(&maxOk) : minLatency;
+	if (latencies.size() == 1) {
+		maxOk = minOk;
+	}
+	double errorRate = parts.size() > 1 ? parts.at(1).toDouble(&rateOk) : 0.0;
+	if (!minOk || !maxOk || !rateOk || parts.size() > 2 || latencies.size() > 2) {
+		return nullptr;
+	}
+	return new SlowScanFileSystem(fileSystem, minLatency, maxLatency, errorRate);
+}
+
+/** Sleeps, then returns false if the call has to fail. */
+bool SlowScanFileSystem::delay() const
+{
+	// qrand() has a state for each thread
+	int latency = _minLatency;
+	if (_maxLatency > _minLatency) {
+		latency += qrand() % (_maxLatency - _minLatency + 1);
+	}
+	QThread::msleep(latency);
+	return _errorRate <= 0.0 || qrand() >= _errorRate * RAND_MAX;
+}
+
+FileFingerprint SlowScanFileSystem::stat(const QString &absFilePath)
+{
+	if (this->delay()) {
+		return _fileSystem->stat(absFilePath);
+	}
+	return FileFingerprint();
+}
+
+QIODevice* SlowScanFileSystem::open(const QString &absFilePath)
+{
+	if (this->delay()) {
+		return _fileSystem->open(absFilePath);
+	}
+	return nullptr;
+}
+
+QFileInfoList SlowScanFileSystem::entries(const QString &directory)
+{
+	if (this->delay()) {
+		return _fileSystem->entries(directory);
+	}
+	return QFileInfoList();
+}
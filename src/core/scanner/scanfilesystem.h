@@ -0,0 +1,80 @@
+#ifndef SCANFILESYSTEM_H
+#define SCANFILESYSTEM_H
+
+#include <QFileInfo>
+#include <QIODevice>
+#include <QString>
+
+#include "../miamcore_global.h"
+#include "filefingerprint.h"
+
+/**
+ * \brief		The ScanFileSystem class is the access to files used by the scanner, to read their state and their content.
+ * \details		Scanning a library mostly consists in waiting for the filesystem. Every call made by walkers and tag readers to
+ *				list a directory, stat or open a file goes through this class, so a scan can be run against a filesystem which behaves like a
+ *				remote mount, with a slow implementation wrapping the local one. Implementations must be thread-safe.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+class MIAMCORE_LIBRARY ScanFileSystem
+{
+public:
+	virtual ~ScanFileSystem() {}
+
+	/** Filesystem used by scans. Latency and errors are injected when MIAM_SCAN_LATENCY is set, like "5-50" or "5-50,0.01". */
+	static ScanFileSystem* instance();
+
+	/** Reads the current state of a file. Returns a null fingerprint when the file can't be reached. */
+	virtual FileFingerprint stat(const QString &absFilePath) = 0;
+
+	/** Opens a file in read-only mode, without buffer. Returns nullptr when the file can't be opened. */
+	virtual QIODevice* open(const QString &absFilePath) = 0;
+
+	/** Lists files and subdirectories of a directory, hidden ones included. Returns an empty list when it can't be read. */
+	virtual QFileInfoList entries(const QString &directory) = 0;
+};
+
+/**
+ * \brief		The LocalScanFileSystem class reads files from the operating system.
+ */
+class MIAMCORE_LIBRARY LocalScanFileSystem : public ScanFileSystem
+{
+public:
+	virtual FileFingerprint stat(const QString &absFilePath) override;
+
+	virtual QIODevice* open(const QString &absFilePath) override;
+
+	virtual QFileInfoList entries(const QString &directory) override;
+};
+
+/**
+ * \brief		The SlowScanFileSystem class delays and randomly fails calls to another filesystem.
+ * \details		Each call waits between minLatency and maxLatency milliseconds, then fails with a probability of errorRate.
+ */
+class MIAMCORE_LIBRARY SlowScanFileSystem : public ScanFileSystem
+{
+private:
+	ScanFileSystem *_fileSystem;
+
+	int _minLatency;
+	int _maxLatency;
+
+	double _errorRate;
+
+	/** Sleeps, then returns false if the call has to fail. */
+	bool delay() const;
+
+public:
+	SlowScanFileSystem(ScanFileSystem *fileSystem, int minLatency, int maxLatency, double errorRate = 0.0);
+
+	/** Builds a filesystem from a specification like "5-50,0.01". Returns nullptr if it can't be parsed. */
+	static SlowScanFileSystem* fromSpec(ScanFileSystem *fileSystem, const QString &spec);
+
+	virtual FileFingerprint stat(const QString &absFilePath) override;
+
+	virtual QIODevice* open(const QString &absFilePath) override;
+
+	virtual QFileInfoList entries(const QString &directory) override;
+};
+
+#endif // SCANFILESYSTEM_H
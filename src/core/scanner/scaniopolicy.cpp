@@ -0,0 +1,62 @@
+#include "scaniopolicy.h"
+
+#include "bufferedfilestream.h"
+#include "scanfilesystem.h"
+
+#include <QFile>
+#include <QScopedPointer>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#endif
+
+ScanIoPolicy::ScanIoPolicy()
+	: sortByInode(false)
+	, prefetch(false)
+	, maxReadsPerDevice(0)
+	, outstandingCalls(0)
+	, fileTimeout(0)
+{}
+
+ScanIoPolicy ScanIoPolicy::forProfile(SettingsPrivate::ScanProfile profile)
+{
+	ScanIoPolicy policy;
+	switch (profile) {
+	case SettingsPrivate::SP_HDD:
+		policy.sortByInode = true;
+		policy.prefetch = true;
+		policy.maxReadsPerDevice = 2;
+		break;
+	case SettingsPrivate::SP_HighLatency:
+		// Inodes don't tell where files are on a remote server, and waiting threads are cheap
+		policy.outstandingCalls = 32;
+		policy.fileTimeout = 10000;
+		break;
+	default:
+		break;
+	}
+	return policy;
+}
+
+/** Asks the kernel to load regions of a file read by BufferedFileStream, without waiting for them. */
+void ScanIoPolicy::prefetchFile(const QString &absFilePath, qint64 size)
+{
+#ifdef Q_OS_LINUX
+	// Files are opened like tag readers are doing, so a slow filesystem delays prefetching as well
+	QScopedPointer<QIODevice> device(ScanFileSystem::instance()->open(absFilePath));
+	QFile *file = qobject_cast<QFile*>(device.data());
+	if (!file) {
+		return;
+	}
+	// Pages are loaded asynchronously and stay in the page cache when the file is closed
+	int fd = file->handle();
+	::posix_fadvise(fd, 0, BufferedFileStream::defaultHeadSize, POSIX_FADV_WILLNEED);
+	if (size > BufferedFileStream::defaultHeadSize) {
+		qint64 tailOffset = qMax<qint64>(BufferedFileStream::defaultHeadSize, size - BufferedFileStream::defaultTailSize);
+		::posix_fadvise(fd, tailOffset, size - tailOffset, POSIX_FADV_WILLNEED);
+	}
+#else
+	Q_UNUSED(absFilePath)
+	Q_UNUSED(size)
+#endif
+}
@@ -0,0 +1,46 @@
+#ifndef SCANIOPOLICY_H
+#define SCANIOPOLICY_H
+
+#include <QString>
+
+#include "../miamcore_global.h"
+#include "../settingsprivate.h"
+
+/**
+ * \brief		The ScanIoPolicy class describes in which order and how fast files are read during a scan.
+ * \details		On solid state drives, files can be read in any order by as many threads as possible. On spinning disks and most
+ *				network mounts, time is spent moving heads between files: files of a directory are read in the order of their
+ *				inodes, which is close to their order on the disk, the kernel is asked to load the regions read by the tag reader
+ *				before a worker opens them, and only a few files are read at the same time on each device.
+ *				On high-latency mounts, each call waits for the network: many calls are sent at the same time to hide this
+ *				latency, and files which don't answer in time are skipped until the next scan.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+class MIAMCORE_LIBRARY ScanIoPolicy
+{
+public:
+	/** Files of a directory are sent to workers in the order of their inodes. */
+	bool sortByInode;
+
+	/** Beginning and end of files are loaded in the page cache before workers are reading them. Linux only. */
+	bool prefetch;
+
+	/** Maximum number of files read at the same time on a device, 0 for no limit. */
+	int maxReadsPerDevice;
+
+	/** Number of stat and open calls which can be waiting at the same time on a walker or a lane, 0 to make them one by one. */
+	int outstandingCalls;
+
+	/** Time in milliseconds after which a file is skipped, 0 to wait forever. */
+	int fileTimeout;
+
+	ScanIoPolicy();
+
+	static ScanIoPolicy forProfile(SettingsPrivate::ScanProfile profile);
+
+	/** Asks the kernel to load regions of a file read by BufferedFileStream, without waiting for them. */
+	static void prefetchFile(const QString &absFilePath, qint64 size);
+};
+
+#endif // SCANIOPOLICY_H
@@ -0,0 +1,347 @@
+#include "scanpipeline.h"
+
+#include "model/sqldatabase.h"
+#include "pendingcall.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QRunnable>
+#include <QSemaphore>
+
+#include <QtDebug>
+
+#include <algorithm>
+
+/**
+ * \brief		The DeviceReadLimiter class limits the number of files read at the same time on each device.
+ */
+class DeviceReadLimiter
+{
+private:
+	QMutex _mutex;
+	QHash<quint64, QSemaphore*> _devices;
+	int _maxReads;
+
+public:
+	explicit DeviceReadLimiter(int maxReads)
+		: _maxReads(maxReads)
+	{}
+
+	~DeviceReadLimiter()
+	{
+		qDeleteAll(_devices);
+	}
+
+	/** Blocks until a file can be read on device. Does nothing without limit. */
+	void acquire(quint64 device)
+	{
+		if (_maxReads > 0) {
+			this->semaphore(device)->acquire();
+		}
+	}
+
+	void release(quint64 device)
+	{
+		if (_maxReads > 0) {
+			this->semaphore(device)->release();
+		}
+	}
+
+private:
+	QSemaphore* semaphore(quint64 device)
+	{
+		QMutexLocker locker(&_mutex);
+		QSemaphore *&s = _devices[device];
+		if (s == nullptr) {
+			s = new QSemaphore(_maxReads);
+		}
+		return s;
+	}
+};
+
+/**
+ * \brief		The ScanWorker class reads tags of files taken from the queue of jobs until this queue is closed.
+ */
+class ScanWorker : public QRunnable
+{
+private:
+	BoundedQueue<ScanJob> *_jobs;
+	BoundedQueue<TrackRecord> *_records;
+	DeviceReadLimiter *_limiter;
+
+	/** Runs reads which can be abandoned, null when files are read without timeout. */
+	QThreadPool *_readers;
+	int _timeout;
+
+public:
+	ScanWorker(BoundedQueue<ScanJob> *jobs, BoundedQueue<TrackRecord> *records, DeviceReadLimiter *limiter, QThreadPool *readers, int timeout)
+		: _jobs(jobs)
+		, _records(records)
+		, _limiter(limiter)
+		, _readers(readers)
+		, _timeout(timeout)
+	{}
+
+	virtual void run() override
+	{
+		ScanJob job;
+		while (_jobs->pop(job)) {
+			_limiter->acquire(job.fingerprint.device);
+			TrackRecord record;
+			PendingCall<TrackRecord> read;
+			QString absFilePath = job.absFilePath;
+			read.start(_readers, [absFilePath]() {
+				return TrackRecord::fromFile(absFilePath);
+			});
+			bool isRead = read.wait(_timeout, record);
+			_limiter->release(job.fingerprint.device);
+
+			// Without fingerprint in the database, this file will be read again by the next scan
+			if (!isRead) {
+				qWarning() << Q_FUNC_INFO << "file was skipped after" << _timeout << "ms:" << job.absFilePath;
+				continue;
+			}
+			if (!record.isValid) {
+				qDebug() << Q_FUNC_INFO << "file is not valid, won't be saved:" << job.absFilePath;
+			}
+			// Invalid files are sent too: their fingerprint prevents from reading them again on next incremental scan
+			record.fingerprint = job.fingerprint;
+			_records->push(record);
+		}
+	}
+};
+
+/**
+ * \brief		The ScanLane class holds files found on a device until workers of this lane are reading them.
+ */
+class ScanLane
+{
+public:
+	BoundedQueue<ScanJob> jobs;
+
+	QThreadPool workers;
+
+	/** Files of the current directory, which are waiting to be sorted when the policy asks for it. */
+	QList<ScanJob> run;
+
+	explicit ScanLane(int workerCount)
+		: jobs(256)
+	{
+		workers.setMaxThreadCount(workerCount);
+	}
+};
+
+/**
+ * \brief		The ScanWriter class is the only thread which writes records in the database during a scan.
+ */
+class ScanWriter : public QThread
+{
+private:
+	BoundedQueue<TrackRecord> *_records;
+
+	/** Number of tracks inserted in a single transaction. */
+	int _batchSize;
+
+	/** Number of transactions between two checkpoints of the write-ahead log. */
+	static const int checkpointInterval = 10;
+
+	/** Maximum time in milliseconds between two commits, which is what can be lost if the player is killed. */
+	static const int commitInterval = 1000;
+
+public:
+	ScanWriter(BoundedQueue<TrackRecord> *records, int batchSize)
+		: QThread()
+		, _records(records)
+		, _batchSize(qMax(1, batchSize))
+	{}
+
+protected:
+	virtual void run() override
+	{
+		// Connection of this thread, released when it ends
+		SqlDatabase *db = SqlDatabase::instance();
+		int pending = 0;
+		int batches = 0;
+
+		// Normalized artist and album of tracks saved during this scan, to attach pictures without reading files again
+		QHash<QString, QPair<QString, QString>> albumKeys;
+
+		// Pictures of tracks which haven't been saved yet: workers are running in parallel, so a track can arrive after the
+		// picture next to it
+		QHash<QString, QString> waitingCovers;
+
+		// Cursor of the scan, committed with files
+		QString lastDirectory;
+		QElapsedTimer lastCommit;
+		lastCommit.start();
+
+		db->transaction();
+		TrackRecord record;
+		while (_records->pop(record)) {
+			if (record.coverPath.isEmpty()) {
+				if (record.isValid) {
+					db->saveFileRef(record);
+					albumKeys.insert(record.uri, qMakePair(record.artistNormalized, record.albumNormalized));
+					QString coverPath = waitingCovers.take(record.uri);
+					if (!coverPath.isEmpty()) {
+						db->saveCoverRef(coverPath, record.artistNormalized, record.albumNormalized);
+					}
+				}
+				if (!record.fingerprint.isNull()) {
+					db->saveFileFingerprint(record.uri, record.fingerprint);
+				}
+				lastDirectory = record.uri.left(record.uri.lastIndexOf('/'));
+				if (++pending == _batchSize || lastCommit.elapsed() >= commitInterval) {
+					db->updateScanCursor(lastDirectory, pending);
+					db->commit();
+					pending = 0;
+					lastCommit.restart();
+
+					// Readers may prevent a checkpoint from being complete, so the log is only moved to the database
+					// without waiting for them
+					if (++batches % checkpointInterval == 0) {
+						db->exec("PRAGMA wal_checkpoint(PASSIVE)");
+					}
+					db->transaction();
+				}
+			} else {
+				auto keys = albumKeys.constFind(record.uri);
+				if (keys == albumKeys.cend()) {
+					waitingCovers.insert(record.uri, record.coverPath);
+				} else {
+					db->saveCoverRef(record.coverPath, keys->first, keys->second);
+				}
+			}
+		}
+
+		// Remaining tracks weren't read by this scan because they haven't changed: their album is already in the database
+		for (auto it = waitingCovers.cbegin(); it != waitingCovers.cend(); ++it) {
+			db->saveCoverRef(it.value(), it.key());
+		}
+		if (pending > 0) {
+			db->updateScanCursor(lastDirectory, pending);
+		}
+		db->commit();
+		db->exec("PRAGMA wal_checkpoint(TRUNCATE)");
+	}
+};
+
+ScanPipeline::ScanPipeline(int workerCount, int batchSize, const ScanIoPolicy &policy, int laneCount)
+	: _records(1024)
+	, _writer(new ScanWriter(&_records, batchSize))
+	, _workerCount(qMax(1, workerCount))
+	, _policy(policy)
+	, _limiter(new DeviceReadLimiter(policy.maxReadsPerDevice))
+	, _readers(new QThreadPool)
+{
+	// Threads waiting for a slow filesystem aren't using any CPU
+	_workerCount = qMax(_workerCount, policy.outstandingCalls);
+	for (int i = 0; i < qMax(1, laneCount); i++) {
+		_lanes.append(new ScanLane(_workerCount));
+	}
+
+	// Abandoned reads are still running: twice the number of workers leaves room for new ones
+	_readers->setMaxThreadCount(2 * _workerCount * _lanes.size());
+}
+
+ScanPipeline::~ScanPipeline()
+{
+	this->finish();
+	qDeleteAll(_lanes);
+	delete _writer;
+	delete _limiter;
+}
+
+/** Sends jobs of the current directory of a lane to its workers. */
+void ScanPipeline::flushRun(ScanLane *lane)
+{
+	// Inodes of a directory are usually allocated close to each other, in the order files were written
+	std::sort(lane->run.begin(), lane->run.end(), [](const ScanJob &a, const ScanJob &b) {
+		return a.fingerprint.inode < b.fingerprint.inode;
+	});
+	if (_policy.prefetch) {
+		for (const ScanJob &job : lane->run) {
+			ScanIoPolicy::prefetchFile(job.absFilePath, job.fingerprint.size);
+		}
+	}
+	for (const ScanJob &job : lane->run) {
+		lane->jobs.push(job);
+	}
+	lane->run.clear();
+}
+
+/** Starts workers and the writer thread. */
+void ScanPipeline::start()
+{
+	_writer->start();
+	for (ScanLane *lane : _lanes) {
+		for (int i = 0; i < _workerCount; i++) {
+			QThreadPool *readers = _policy.fileTimeout > 0 ? _readers : nullptr;
+			lane->workers.start(new ScanWorker(&lane->jobs, &_records, _limiter, readers, _policy.fileTimeout > 0 ? _policy.fileTimeout : -1));
+		}
+	}
+}
+
+/** Queues a file to be read by workers of a lane. Blocks the caller when these workers are busy. */
+void ScanPipeline::addFile(const QString &absFilePath, const FileFingerprint &fingerprint, int lane)
+{
+	ScanLane *l = _lanes.at(lane);
+	ScanJob job;
+	job.absFilePath = absFilePath;
+	job.fingerprint = fingerprint;
+	if (!_policy.sortByInode) {
+		l->jobs.push(job);
+		return;
+	}
+	if (!l->run.isEmpty()) {
+		const QString &previous = l->run.last().absFilePath;
+		int length = previous.lastIndexOf('/');
+		if (length != absFilePath.lastIndexOf('/') || !absFilePath.startsWith(previous.left(length + 1))) {
+			this->flushRun(l);
+		}
+	}
+	l->run.append(job);
+}
+
+/** Queues an external picture which will be attached to the album of track, without reading this file again. */
+void ScanPipeline::addCover(const QString &coverPath, const QString &track)
+{
+	TrackRecord cover;
+	cover.uri = track;
+	cover.coverPath = coverPath;
+	_records.push(cover);
+}
+
+/** Drops files which haven't been read yet. Files already read are still committed by finish(). Walkers must be stopped. */
+void ScanPipeline::cancel()
+{
+	for (ScanLane *lane : _lanes) {
+		lane->run.clear();
+		lane->jobs.clear();
+	}
+}
+
+/** Waits until every queued file has been parsed and committed. */
+void ScanPipeline::finish()
+{
+	for (ScanLane *lane : _lanes) {
+		this->flushRun(lane);
+		lane->jobs.close();
+	}
+	// Workers are giving up on files which don't answer in time, so they're always ending
+	for (ScanLane *lane : _lanes) {
+		lane->workers.waitForDone();
+	}
+
+	// Reads abandoned by workers can be waited for as long as a single file. Beyond that, they're blocked in the kernel: they
+	// are left behind with their pool, their result is dropped anyway
+	if (_readers) {
+		if (!releasePool(_readers, _policy.fileTimeout > 0 ? _policy.fileTimeout : -1)) {
+			qWarning() << Q_FUNC_INFO << "some reads are still blocked, they're abandoned";
+		}
+		_readers = nullptr;
+	}
+	_records.close();
+	_writer->wait();
+}
@@ -0,0 +1,94 @@
+#ifndef SCANPIPELINE_H
+#define SCANPIPELINE_H
+
+#include <QList>
+#include <QThread>
+#include <QThreadPool>
+
+#include "../miamcore_global.h"
+#include "boundedqueue.h"
+#include "scaniopolicy.h"
+#include "trackrecord.h"
+
+/// Forward declarations
+class DeviceReadLimiter;
+class ScanLane;
+class ScanWriter;
+
+/**
+ * \brief		The ScanJob class is a unit of work sent by the directory walker to tag readers.
+ */
+class ScanJob
+{
+public:
+	QString absFilePath;
+
+	FileFingerprint fingerprint;
+};
+
+/**
+ * \brief		The ScanPipeline class parses files in parallel and saves them into the database.
+ * \details		A directory walker feeds a bounded queue of files. A pool of workers reads tags with FileHelper and builds
+ *				TrackRecord objects, and a single writer thread commits them to the database in large batches, because SQLite
+ *				only accepts one writer at a time. The walker is put to sleep when workers can't keep up with it.
+ *				External pictures are sent straight to the writer: it remembers the album of every track saved during the scan,
+ *				so a picture is attached to its album in memory, in the same transaction as the tracks of its directory.
+ *				Each file is committed with its fingerprint, at least every second, so files which were saved before a scan was
+ *				interrupted are skipped when this scan is resumed.
+ *				How files are sent to workers depends on a ScanIoPolicy: on spinning disks, files of a directory are sorted by
+ *				inode and prefetched before being queued, and the number of files read at the same time is limited per device.
+ *				On high-latency mounts, more workers are started and reads which take too long are abandoned.
+ *				Music locations stored on different devices are walked at the same time: each walker feeds its own lane, with
+ *				its own workers, so a slow device doesn't hold back the others. All lanes are sharing the same writer.
+ *				Because the database is in WAL mode, views can still read the library while a scan is running: they are
+ *				seeing the last committed batch.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+class MIAMCORE_LIBRARY ScanPipeline
+{
+private:
+	/** One lane per device, each with its own queue of files and its own workers. */
+	QList<ScanLane*> _lanes;
+
+	BoundedQueue<TrackRecord> _records;
+
+	ScanWriter *_writer;
+
+	int _workerCount;
+
+	ScanIoPolicy _policy;
+
+	DeviceReadLimiter *_limiter;
+
+	/** Reads files when they have a timeout, so workers can give up on them. Left behind if some reads are still blocked. */
+	QThreadPool *_readers;
+
+	/** Sends jobs of the current directory of a lane to its workers. */
+	void flushRun(ScanLane *lane);
+
+public:
+	explicit ScanPipeline(int workerCount = QThread::idealThreadCount(), int batchSize = 2000, const ScanIoPolicy &policy = ScanIoPolicy(),
+						  int laneCount = 1);
+
+	virtual ~ScanPipeline();
+
+	inline const ScanIoPolicy & policy() const { return _policy; }
+
+	/** Starts workers and the writer thread. */
+	void start();
+
+	/** Queues a file to be read by workers of a lane. Blocks the caller when these workers are busy. */
+	void addFile(const QString &absFilePath, const FileFingerprint &fingerprint = FileFingerprint(), int lane = 0);
+
+	/** Queues an external picture which will be attached to the album of track, without reading this file again. */
+	void addCover(const QString &coverPath, const QString &track);
+
+	/** Drops files which haven't been read yet. Files already read are still committed by finish(). Walkers must be stopped. */
+	void cancel();
+
+	/** Waits until every queued file has been parsed and committed. */
+	void finish();
+};
+
+#endif // SCANPIPELINE_H
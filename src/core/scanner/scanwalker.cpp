@@ -0,0 +1,240 @@
+#include "scanwalker.h"
+
+#include "filehelper.h"
+#include "pendingcall.h"
+#include "scanfilesystem.h"
+#include "scanpipeline.h"
+
+#include <QFileInfo>
+#include <QQueue>
+
+#include <QtDebug>
+
+/**
+ * \brief		The WalkedEntry class is an entry found by a walker, whose state may still be read by another thread.
+ */
+class WalkedEntry
+{
+public:
+	QFileInfo fileInfo;
+	bool isPicture;
+	bool isTrack;
+	PendingCall<FileFingerprint> fingerprint;
+
+	WalkedEntry() : isPicture(false), isTrack(false) {}
+};
+
+/**
+ * \brief		The ScanDirIterator class walks through a directory and its subdirectories like QDirIterator, but directories
+ *				are listed by ScanFileSystem.
+ * \details		A subdirectory is returned before its entries, which are followed by the remaining entries of its parent.
+ *				Symbolic links to directories are returned, but they're not followed.
+ */
+class ScanDirIterator
+{
+private:
+	ScanFileSystem *_fileSystem;
+
+	/** Entries of each directory being walked, with the position of the next one. */
+	QList<QPair<QFileInfoList, int>> _directories;
+
+	void push(const QString &directory)
+	{
+		QFileInfoList entries = _fileSystem->entries(directory);
+		if (!entries.isEmpty()) {
+			_directories.append(qMakePair(entries, 0));
+		}
+	}
+
+public:
+	ScanDirIterator(ScanFileSystem *fileSystem, const QString &root)
+		: _fileSystem(fileSystem)
+	{
+		this->push(root);
+	}
+
+	bool hasNext()
+	{
+		while (!_directories.isEmpty() && _directories.last().second >= _directories.last().first.size()) {
+			_directories.removeLast();
+		}
+		return !_directories.isEmpty();
+	}
+
+	/** hasNext() must have returned true. */
+	QFileInfo next()
+	{
+		QPair<QFileInfoList, int> &current = _directories.last();
+		QFileInfo fileInfo = current.first.at(current.second++);
+		if (fileInfo.isDir() && !fileInfo.isSymLink()) {
+			this->push(fileInfo.absoluteFilePath());
+		}
+		return fileInfo;
+	}
+};
+
+ScanWalker::ScanWalker(const QStringList &roots, ScanPipeline *pipeline, int lane, bool isIncremental, const QAtomicInt *isCancelled,
+					   QObject *parent)
+	: QThread(parent)
+	, _roots(roots)
+	, _pipeline(pipeline)
+	, _lane(lane)
+	, _isIncremental(isIncremental)
+	, _expectedCounts(nullptr)
+	, _currentEntry(nullptr)
+	, _entryCount(nullptr)
+	, _isCancelled(isCancelled)
+	, _statCalls(new QThreadPool)
+{}
+
+ScanWalker::~ScanWalker()
+{
+	if (_statCalls) {
+		_statCalls->waitForDone();
+		delete _statCalls;
+	}
+}
+
+/** Returns true if absFilePath is under one of the roots of this walker. */
+bool ScanWalker::isUnderRoots(const QString &absFilePath) const
+{
+	for (const QString &root : _roots) {
+		if (!absFilePath.startsWith(root)) {
+			continue;
+		}
+		if (absFilePath.length() == root.length() || root.endsWith('/') || absFilePath.at(root.length()) == '/') {
+			return true;
+		}
+	}
+	return false;
+}
+
+void ScanWalker::setKnownFiles(const QHash<QString, FileFingerprint> &knownFiles)
+{
+	_knownFiles = knownFiles;
+}
+
+void ScanWalker::setProgress(const QHash<QString, int> *expectedCounts, QAtomicInt *currentEntry, QAtomicInt *entryCount)
+{
+	_expectedCounts = expectedCounts;
+	_currentEntry = currentEntry;
+	_entryCount = entryCount;
+}
+
+void ScanWalker::run()
+{
+	bool atLeastOneAudioFileWasFound = false;
+	bool isNewDirectory = false;
+	bool directoryHasChanged = !_isIncremental;
+
+	QString coverPath;
+	QString lastFileScannedNextToCover;
+
+	QStringList suffixes = FileHelper::suffixes(FileHelper::ET_Standard | FileHelper::ET_GameMusicEmu);
+
+	// On high-latency mounts, next files are already being examined while waiting for the current one
+	ScanFileSystem *fileSystem = ScanFileSystem::instance();
+	const ScanIoPolicy &policy = _pipeline->policy();
+	QThreadPool *statPool = nullptr;
+	if (policy.outstandingCalls > 0) {
+		_statCalls->setMaxThreadCount(policy.outstandingCalls);
+		statPool = _statCalls;
+	}
+	int lookahead = qMax(1, policy.outstandingCalls);
+	int timeout = policy.fileTimeout > 0 ? policy.fileTimeout : -1;
+
+	for (QString root : _roots) {
+		ScanDirIterator it(fileSystem, root);
+		QQueue<WalkedEntry> window;
+		while (_isCancelled->load() == 0) {
+			while (window.size() < lookahead && it.hasNext()) {
+				WalkedEntry walked;
+
+				// Type of entries is usually given by the directory itself, without calling stat
+				walked.fileInfo = it.next();
+				QString suffix = walked.fileInfo.suffix();
+				walked.isPicture = suffix.toLower() == "jpg" || suffix.toLower() == "png";
+				walked.isTrack = !walked.isPicture && suffixes.contains(suffix);
+				if (!walked.fileInfo.isDir() && (walked.isPicture || walked.isTrack)) {
+					QString absFilePath = walked.fileInfo.absoluteFilePath();
+					walked.fingerprint.start(statPool, [fileSystem, absFilePath]() {
+						return fileSystem->stat(absFilePath);
+					});
+				}
+				window.enqueue(walked);
+			}
+			if (window.isEmpty()) {
+				break;
+			}
+			WalkedEntry walked = window.dequeue();
+			const QFileInfo &qFileInfo = walked.fileInfo;
+			_currentEntry->ref();
+			int &directoryCount = _entryCounts[qFileInfo.absolutePath()];
+			if (++directoryCount > _expectedCounts->value(qFileInfo.absolutePath())) {
+				_entryCount->ref();
+			}
+
+			// Directory has changed: we can discard cover
+			if (qFileInfo.isDir()) {
+				if (!coverPath.isEmpty() && !lastFileScannedNextToCover.isEmpty() && directoryHasChanged) {
+					_pipeline->addCover(coverPath, lastFileScannedNextToCover);
+					coverPath.clear();
+				}
+				isNewDirectory = true;
+				atLeastOneAudioFileWasFound = false;
+				directoryHasChanged = !_isIncremental;
+				lastFileScannedNextToCover.clear();
+				continue;
+			} else if (!walked.isPicture && !walked.isTrack) {
+				continue;
+			}
+
+			// A file which doesn't answer is neither read nor removed from the library, it's examined again next time
+			FileFingerprint fingerprint;
+			if (!walked.fingerprint.wait(timeout, fingerprint)) {
+				qWarning() << Q_FUNC_INFO << "file was skipped after" << timeout << "ms:" << qFileInfo.absoluteFilePath();
+				_knownFiles.remove(qFileInfo.absoluteFilePath());
+				continue;
+			}
+
+			if (walked.isPicture) {
+				if (atLeastOneAudioFileWasFound) {
+					coverPath = qFileInfo.absoluteFilePath();
+				} else if (isNewDirectory) {
+					coverPath = qFileInfo.absoluteFilePath();
+				}
+				// A new picture has to be attached again to tracks, even if they haven't changed. Known files are taken in both
+				// modes: those which remain at the end are not in the filesystem anymore
+				bool isModified = _knownFiles.take(qFileInfo.absoluteFilePath()) != fingerprint;
+				if (!_isIncremental || isModified) {
+					directoryHasChanged = true;
+					_pictures.append(qMakePair(qFileInfo.absoluteFilePath(), fingerprint));
+				}
+			} else {
+				bool isModified = _knownFiles.take(qFileInfo.absoluteFilePath()) != fingerprint;
+				if (!_isIncremental || isModified) {
+					_pipeline->addFile(qFileInfo.absoluteFilePath(), fingerprint, _lane);
+					_updatedTracks << qFileInfo.absoluteFilePath();
+					directoryHasChanged = true;
+				}
+				atLeastOneAudioFileWasFound = true;
+				lastFileScannedNextToCover = qFileInfo.absoluteFilePath();
+				isNewDirectory = false;
+			}
+		}
+		if (!coverPath.isEmpty() && !lastFileScannedNextToCover.isEmpty() && directoryHasChanged) {
+			_pipeline->addCover(coverPath, lastFileScannedNextToCover);
+		}
+		coverPath.clear();
+		lastFileScannedNextToCover.clear();
+		atLeastOneAudioFileWasFound = false;
+		directoryHasChanged = !_isIncremental;
+	}
+
+	// Calls which weren't awaited because the scan was cancelled can be waited for as long as a single call. Beyond that,
+	// they're blocked: they're abandoned with their pool
+	if (!releasePool(_statCalls, timeout)) {
+		qWarning() << Q_FUNC_INFO << "some calls are still blocked, they're abandoned";
+	}
+	_statCalls = nullptr;
+}
@@ -0,0 +1,88 @@
+#ifndef SCANWALKER_H
+#define SCANWALKER_H
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QStringList>
+#include <QThread>
+#include <QThreadPool>
+
+#include "../miamcore_global.h"
+#include "filefingerprint.h"
+
+/// Forward declaration
+class ScanPipeline;
+
+/**
+ * \brief		The ScanWalker class walks through music locations stored on the same device and sends their files to a lane of
+ *				a ScanPipeline.
+ * \details		Locations on different devices don't compete for the same disk heads or the same network link, so one walker
+ *				is started for each device. Walkers are only sharing read-only data and atomic counters: files already known by
+ *				the database are split between them before they start, and their results are gathered once they are done.
+ *				When the policy of the pipeline allows outstanding calls, the state of next files is read in advance, and files
+ *				which don't answer in time are skipped.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+class MIAMCORE_LIBRARY ScanWalker : public QThread
+{
+private:
+	QStringList _roots;
+
+	ScanPipeline *_pipeline;
+
+	int _lane;
+
+	bool _isIncremental;
+
+	/** Files under roots found in the database. Files which are still in this hash after the walk are gone. */
+	QHash<QString, FileFingerprint> _knownFiles;
+
+	/** Number of entries of each directory found during the previous scan, shared by all walkers. */
+	const QHash<QString, int> *_expectedCounts;
+
+	/** Shared by all walkers to estimate the progress. */
+	QAtomicInt *_currentEntry;
+	QAtomicInt *_entryCount;
+
+	const QAtomicInt *_isCancelled;
+
+	/** Reads the state of next files on high-latency mounts. Left behind if some calls are still blocked after the walk. */
+	QThreadPool *_statCalls;
+
+	QHash<QString, int> _entryCounts;
+	QStringList _updatedTracks;
+	QList<QPair<QString, FileFingerprint>> _pictures;
+
+public:
+	ScanWalker(const QStringList &roots, ScanPipeline *pipeline, int lane, bool isIncremental, const QAtomicInt *isCancelled,
+			   QObject *parent = nullptr);
+
+	virtual ~ScanWalker();
+
+	/** Number of entries of each directory found by this walker. */
+	inline const QHash<QString, int> & entryCounts() const { return _entryCounts; }
+
+	/** Files sent to the pipeline because they are new or have changed. */
+	inline const QStringList & updatedTracks() const { return _updatedTracks; }
+
+	/** Pictures which are new or have changed. */
+	inline const QList<QPair<QString, FileFingerprint>> & pictures() const { return _pictures; }
+
+	/** Files which haven't been found. */
+	inline const QHash<QString, FileFingerprint> & knownFiles() const { return _knownFiles; }
+
+	/** Returns true if absFilePath is under one of the roots of this walker. */
+	bool isUnderRoots(const QString &absFilePath) const;
+
+	void setKnownFiles(const QHash<QString, FileFingerprint> &knownFiles);
+
+	void setProgress(const QHash<QString, int> *expectedCounts, QAtomicInt *currentEntry, QAtomicInt *entryCount);
+
+protected:
+	virtual void run() override;
+};
+
+#endif // SCANWALKER_H
@@ -0,0 +1,46 @@
+#include "trackrecord.h"
+
+#include "filehelper.h"
+#include "model/sqldatabase.h"
+
+TrackRecord::TrackRecord()
+	: trackNumber(0)
+	, disc(0)
+	, rating(-1)
+	, year(0)
+	, length(0)
+	, hasCover(false)
+	, isValid(false)
+{}
+
+/** Reads tags from the filesystem. Can be called from any thread. */
+TrackRecord TrackRecord::fromFile(const QString &absFilePath)
+{
+	TrackRecord record;
+	record.uri = absFilePath;
+
+	FileHelper fh(absFilePath, FileHelper::RM_Fast);
+	if (!fh.isValid()) {
+		return record;
+	}
+
+	record.trackNumber = fh.trackNumber().toInt();
+	record.title = fh.title();
+	if (record.title.isEmpty()) {
+		record.title = fh.fileInfo().baseName();
+	}
+	record.artist = fh.artist();
+	record.artistAlbum = fh.artistAlbum().isEmpty() ? record.artist : fh.artistAlbum();
+
+	// Use Artist Album to reference tracks in table "tracks", not Artist
+	record.artistNormalized = SqlDatabase::normalizeField(record.artistAlbum);
+	record.album = fh.album();
+	record.albumNormalized = SqlDatabase::normalizeField(record.album);
+	record.year = fh.year().toInt();
+	record.length = fh.length().toInt();
+	record.disc = fh.discNumber();
+	record.hasCover = fh.hasCover();
+	record.rating = fh.rating();
+	record.isValid = true;
+	return record;
+}
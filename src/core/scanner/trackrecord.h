@@ -0,0 +1,56 @@
+#ifndef TRACKRECORD_H
+#define TRACKRECORD_H
+
+#include <QString>
+
+#include "../miamcore_global.h"
+#include "filefingerprint.h"
+
+/**
+ * \brief		The TrackRecord class holds every field extracted from a local file which is needed to fill the library.
+ * \details		Unlike TrackDAO, this is a plain value class: it can be built in a worker thread and moved to the thread which
+ *				owns the database connection without any QObject affinity issue.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+class MIAMCORE_LIBRARY TrackRecord
+{
+public:
+	QString uri;
+	QString title;
+	QString artist;
+	QString artistAlbum;
+	QString artistNormalized;
+	QString album;
+	QString albumNormalized;
+
+	/** Empty for local files. */
+	QString host;
+	QString icon;
+
+	int trackNumber;
+	int disc;
+	int rating;
+
+	/** Zero when unknown. */
+	int year;
+
+	/** In seconds. */
+	int length;
+
+	bool hasCover;
+	bool isValid;
+
+	/** State of the file when it was read. */
+	FileFingerprint fingerprint;
+
+	/** When not empty, this record only asks to attach an external picture to the album of track uri. Tags aren't read. */
+	QString coverPath;
+
+	TrackRecord();
+
+	/** Reads tags from the filesystem. Can be called from any thread. */
+	static TrackRecord fromFile(const QString &absFilePath);
+};
+
+#endif // TRACKRECORD_H
@@ -10,6 +10,7 @@
 #include <QScrollBar>
 #include <QStandardPaths>
 #include <QTabWidget>
+#include <QThread>
 
 #include <QtDebug>
 
@@ -19,6 +20,11 @@ SettingsPrivate* SettingsPrivate::settings = nullptr;
 SettingsPrivate::SettingsPrivate(const QString &organization, const QString &application)
 	: QSettings(IniFormat, UserScope, organization, application)
 {
+	// Console tools like miam-scan are running without any palette
+	if (qobject_cast<QApplication*>(QCoreApplication::instance()) == nullptr) {
+		return;
+	}
+
 	QPalette p = QApplication::palette();
 	_standardPalette = p;
 
@@ -196,6 +202,12 @@ bool SettingsPrivate::isLibraryFilteredByArticles() const
 	return value("isLibraryFilteredByArticles", false).toBool();
 }
 
+/** Returns true if children of top level items in the library are read from the database when they're expanded. */
+bool SettingsPrivate::isLibraryLoadedLazily() const
+{
+	return value("libraryLoadedLazily", true).toBool();
+}
+
 bool SettingsPrivate::isPlaylistResizeColumns() const
 {
 	return value("playlistResizeColumns", true).toBool();
@@ -335,6 +347,24 @@ uint SettingsPrivate::remoteControlPort() const
 	return value("remoteControlPort", 5600).toUInt();
 }
 
+/** Number of tracks saved in a single transaction when scanning the library. */
+int SettingsPrivate::scanBatchSize() const
+{
+	return value("scanBatchSize", 2000).toInt();
+}
+
+/** Order and pace of reads when scanning the library, depending on the storage which holds music locations. */
+SettingsPrivate::ScanProfile SettingsPrivate::scanProfile() const
+{
+	return static_cast<ScanProfile>(value("scanProfile", SP_SSD).toInt());
+}
+
+/** Number of threads reading tags when scanning the library. */
+int SettingsPrivate::scanWorkerCount() const
+{
+	return value("scanWorkerCount", QThread::idealThreadCount()).toInt();
+}
+
 void SettingsPrivate::setCustomColorRole(QPalette::ColorRole cr, const QColor &color)
 {
 	QPalette palette = this->customPalette();
@@ -617,6 +647,12 @@ void SettingsPrivate::setLibraryFilteredByArticles(const QStringList &tagList)
 	}
 }
 
+/** Sets if children of top level items in the library are read from the database when they're expanded. */
+void SettingsPrivate::setLibraryLoadedLazily(bool b)
+{
+	setValue("libraryLoadedLazily", b);
+}
+
 /** Sets if MiamPlayer should launch background process to keep library up-to-date. */
 void SettingsPrivate::setMonitorFileSystem(bool b)
 {
@@ -668,6 +704,21 @@ void SettingsPrivate::setRemoteControlPort(uint port)
 	emit remoteControlChanged(true, port);
 }
 
+void SettingsPrivate::setScanBatchSize(int size)
+{
+	setValue("scanBatchSize", size);
+}
+
+void SettingsPrivate::setScanProfile(ScanProfile profile)
+{
+	setValue("scanProfile", profile);
+}
+
+void SettingsPrivate::setScanWorkerCount(int count)
+{
+	setValue("scanWorkerCount", count);
+}
+
 void SettingsPrivate::setTabsOverlappingLength(int l)
 {
 	setValue("tabsOverlappingLength", l);
@@ -62,6 +62,11 @@ public:
 								 PDA_SaveOnClose		= 1,
 								 PDA_DiscardOnClose		= 2};
 
+	/** Order and pace of reads when scanning the library, depending on the storage which holds music locations. */
+	enum ScanProfile { SP_SSD			= 0,
+					   SP_HDD			= 1,
+					   SP_HighLatency	= 2};
+
 	QTranslator playerTranslator, defaultQtTranslator;
 
 	/** Singleton Pattern to easily use Settings everywhere in the app. */
@@ -110,6 +115,9 @@ public:
 	/** Returns the hierarchical order of the library tree view. */
 	bool isLibraryFilteredByArticles() const;
 
+	/** Returns true if children of top level items in the library are read from the database when they're expanded. */
+	bool isLibraryLoadedLazily() const;
+
 	bool isPlaylistResizeColumns() const;
 
 	/** Returns true if tabs should be displayed like rectangles. */
@@ -159,6 +167,15 @@ public:
 
 	uint remoteControlPort() const;
 
+	/** Number of tracks saved in a single transaction when scanning the library. */
+	int scanBatchSize() const;
+
+	/** Order and pace of reads when scanning the library, depending on the storage which holds music locations. */
+	ScanProfile scanProfile() const;
+
+	/** Number of threads reading tags when scanning the library. */
+	int scanWorkerCount() const;
+
 	void setCustomColorRole(QPalette::ColorRole cr, const QColor &color);
 
 	/** Custom icons in CustomizeTheme */
@@ -228,6 +245,9 @@ public slots:
 	/** Sets user defined list of articles to sort the Library. */
 	void setLibraryFilteredByArticles(const QStringList &tagList);
 
+	/** Sets if children of top level items in the library are read from the database when they're expanded. */
+	void setLibraryLoadedLazily(bool b);
+
 	/** Sets if MiamPlayer should launch background process to keep library up-to-date. */
 	void setMonitorFileSystem(bool b);
 
@@ -239,6 +259,12 @@ public slots:
 
 	void setRemoteControlPort(uint port);
 
+	void setScanBatchSize(int size);
+
+	void setScanProfile(ScanProfile profile);
+
+	void setScanWorkerCount(int count);
+
 	void setReorderArtistsArticle(bool b);
 
 	void setSearchAndExcludeLibrary(bool b);
@@ -1,7 +1,7 @@
 #include "coverfetcher.h"
 
 #include <settings.h>
-#include <model/sqldatabase.h>
+#include <model/databaseservice.h>
 #include <filehelper.h>
 #include <cover.h>
 
@@ -66,9 +66,6 @@ void CoverFetcher::fetch(SelectedTracksModel *selectedTracksModel)
 		selectedTracksModel->updateSelectedTracks();
 	});
 
-	SqlDatabase db;
-	db.open();
-
 	// Format and concatenate all tracks in one big string. Replaces single quote with double quote
 	/// FIXME
 	QStringList tracks;
@@ -80,101 +77,110 @@ void CoverFetcher::fetch(SelectedTracksModel *selectedTracksModel)
 	QString strArtistsAlbums = "SELECT artistAlbum, album, cover, internalCover " \
 		"FROM cache WHERE uri IN (" + l + ") GROUP BY artistAlbum, album, cover ORDER BY artistAlbum, album";
 
-	QSqlQuery qArtistsAlbums(db);
-	qArtistsAlbums.exec(strArtistsAlbums);
-
-	QString prevArtist = "";
-	int size = Settings::instance()->value("providers/coverValueSize").toInt();
-	QSize s(size, size);
-	while (qArtistsAlbums.next()) {
-		QString artistAlbum = qArtistsAlbums.record().value(0).toString();
-		QString album = qArtistsAlbums.record().value(1).toString();
-		QString cover = qArtistsAlbums.record().value(2).toString();
-		QString internalCover = qArtistsAlbums.record().value(3).toString();
-
-		// Send a new request for fetching artists only if it's a new one
-		if (artistAlbum != prevArtist) {
-			QLabel *labelArtist = new QLabel("Artist: " + artistAlbum);
-			fetchDialog->scrollAreaWidgetContents->layout()->addWidget(labelArtist);
-		}
-
-		// Query all registered providers
-		for (CoverArtProvider *cp : _providers) {
-			QUrl url = cp->query(artistAlbum, album);
-			QNetworkRequest request(url);
-			request.setAttribute(QNetworkRequest::User, CoverArtProvider::FO_Search);
-			request.setHeader(QNetworkRequest::UserAgentHeader, "MiamPlayer/0.8.1 ( https://www.miam-player.org/ )" );
-			QNetworkReply *n = _manager->get(request);
-			n->setProperty("type", cp->type());
-			n->setProperty("requestType", CoverArtProvider::FO_Search);
-			n->setProperty("artist", artistAlbum);
-			n->setProperty("album", album);
+	// Albums are read in the database thread, then requests are sent and the dialog is filled
+	DatabaseService::instance()->run<QList<QSqlRecord>>([strArtistsAlbums](SqlDatabase *db) {
+		QList<QSqlRecord> records;
+		QSqlQuery qArtistsAlbums(*db);
+		if (qArtistsAlbums.exec(strArtistsAlbums)) {
+			while (qArtistsAlbums.next()) {
+				records.append(qArtistsAlbums.record());
+			}
 		}
+		return records;
+	}, fetchDialog, [=](const QList<QSqlRecord> &records) {
+		QString prevArtist = "";
+		int size = Settings::instance()->value("providers/coverValueSize").toInt();
+		QSize s(size, size);
+		for (QSqlRecord r : records) {
+			QString artistAlbum = r.value(0).toString();
+			QString album = r.value(1).toString();
+			QString cover = r.value(2).toString();
+			QString internalCover = r.value(3).toString();
+
+			// Send a new request for fetching artists only if it's a new one
+			if (artistAlbum != prevArtist) {
+				QLabel *labelArtist = new QLabel("Artist: " + artistAlbum);
+				fetchDialog->scrollAreaWidgetContents->layout()->addWidget(labelArtist);
+			}
 
-		QGroupBox *templateCover = new QGroupBox;
-		templateCover->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
-		templateCover->setTitle(tr("Album « %1 »").arg(album));
-		templateCover->setProperty("album", album);
-		QHBoxLayout *hbox = new QHBoxLayout;
-		hbox->setMargin(0);
-		templateCover->setLayout(hbox);
-
-		QLabel *currentCover = new QLabel;
-		currentCover->setScaledContents(true);
-
-		QPixmap p;
-		if (!internalCover.isEmpty()) {
-			FileHelper fh(internalCover);
-			Cover *c = fh.extractCover();
-			if (c && p.loadFromData(c->byteArray())) {
-				currentCover->setPixmap(p);
+			// Query all registered providers
+			for (CoverArtProvider *cp : _providers) {
+				QUrl url = cp->query(artistAlbum, album);
+				QNetworkRequest request(url);
+				request.setAttribute(QNetworkRequest::User, CoverArtProvider::FO_Search);
+				request.setHeader(QNetworkRequest::UserAgentHeader, "MiamPlayer/0.8.1 ( https://www.miam-player.org/ )" );
+				QNetworkReply *n = _manager->get(request);
+				n->setProperty("type", cp->type());
+				n->setProperty("requestType", CoverArtProvider::FO_Search);
+				n->setProperty("artist", artistAlbum);
+				n->setProperty("album", album);
 			}
-			delete c;
-		} else {
-			if (cover.isEmpty()) {
-				p.load(":/icons/disc");
+
+			QGroupBox *templateCover = new QGroupBox;
+			templateCover->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
+			templateCover->setTitle(tr("Album « %1 »").arg(album));
+			templateCover->setProperty("album", album);
+			QHBoxLayout *hbox = new QHBoxLayout;
+			hbox->setMargin(0);
+			templateCover->setLayout(hbox);
+
+			QLabel *currentCover = new QLabel;
+			currentCover->setScaledContents(true);
+
+			QPixmap p;
+			if (!internalCover.isEmpty()) {
+				FileHelper fh(internalCover);
+				Cover *c = fh.extractCover();
+				if (c && p.loadFromData(c->byteArray())) {
+					currentCover->setPixmap(p);
+				}
+				delete c;
 			} else {
-				p.load(cover);
+				if (cover.isEmpty()) {
+					p.load(":/icons/disc");
+				} else {
+					p.load(cover);
+				}
+				currentCover->setPixmap(p);
 			}
-			currentCover->setPixmap(p);
+			currentCover->setMinimumSize(s);
+			currentCover->setMaximumSize(s);
+
+			QStackedWidget *remoteCovers = new QStackedWidget;
+			remoteCovers->setMinimumSize(s);
+			remoteCovers->setMaximumSize(s);
+			remoteCovers->setProperty("artistAlbum", artistAlbum);
+			remoteCovers->setProperty("album", album);
+
+			BrowseImageWidget *biw = new BrowseImageWidget(remoteCovers);
+			biw->setMinimumSize(s);
+			biw->setMaximumSize(s);
+
+			QStackedLayout *stackedLayout = new QStackedLayout;
+			stackedLayout->setStackingMode(QStackedLayout::StackAll);
+			stackedLayout->addWidget(remoteCovers);
+			stackedLayout->addWidget(biw);
+			stackedLayout->setMargin(0);
+			stackedLayout->setSpacing(0);
+
+			hbox->addSpacerItem(new QSpacerItem(1, 1, QSizePolicy::Expanding, QSizePolicy::Fixed));
+			hbox->addWidget(currentCover);
+			QWidget *w = new QWidget;
+			w->setObjectName("container");
+			w->setLayout(stackedLayout);
+			w->setMinimumSize(s);
+			w->setMaximumSize(s);
+			hbox->addWidget(w);
+			hbox->addSpacerItem(new QSpacerItem(1, 1, QSizePolicy::Expanding, QSizePolicy::Fixed));
+			fetchDialog->scrollAreaWidgetContents->layout()->addWidget(templateCover);
+			prevArtist = artistAlbum;
 		}
-		currentCover->setMinimumSize(s);
-		currentCover->setMaximumSize(s);
-
-		QStackedWidget *remoteCovers = new QStackedWidget;
-		remoteCovers->setMinimumSize(s);
-		remoteCovers->setMaximumSize(s);
-		remoteCovers->setProperty("artistAlbum", artistAlbum);
-		remoteCovers->setProperty("album", album);
-
-		BrowseImageWidget *biw = new BrowseImageWidget(remoteCovers);
-		biw->setMinimumSize(s);
-		biw->setMaximumSize(s);
-
-		QStackedLayout *stackedLayout = new QStackedLayout;
-		stackedLayout->setStackingMode(QStackedLayout::StackAll);
-		stackedLayout->addWidget(remoteCovers);
-		stackedLayout->addWidget(biw);
-		stackedLayout->setMargin(0);
-		stackedLayout->setSpacing(0);
-
-		hbox->addSpacerItem(new QSpacerItem(1, 1, QSizePolicy::Expanding, QSizePolicy::Fixed));
-		hbox->addWidget(currentCover);
-		QWidget *w = new QWidget;
-		w->setObjectName("container");
-		w->setLayout(stackedLayout);
-		w->setMinimumSize(s);
-		w->setMaximumSize(s);
-		hbox->addWidget(w);
-		hbox->addSpacerItem(new QSpacerItem(1, 1, QSizePolicy::Expanding, QSizePolicy::Fixed));
-		fetchDialog->scrollAreaWidgetContents->layout()->addWidget(templateCover);
-		prevArtist = artistAlbum;
-	}
 
-	QSpacerItem *vSpacer = new QSpacerItem(1, 1, QSizePolicy::Fixed, QSizePolicy::Expanding);
-	fetchDialog->scrollAreaWidgetContents->layout()->addItem(vSpacer);
-	fetchDialog->show();
-	fetchDialog->activateWindow();
+		QSpacerItem *vSpacer = new QSpacerItem(1, 1, QSizePolicy::Fixed, QSizePolicy::Expanding);
+		fetchDialog->scrollAreaWidgetContents->layout()->addItem(vSpacer);
+		fetchDialog->show();
+		fetchDialog->activateWindow();
+	});
 }
 
 /** When one is checking items in the list, providers are added or removed dynamically. */
@@ -1,6 +1,6 @@
 #include "fetchdialog.h"
 
-#include <model/sqldatabase.h>
+#include <model/databaseservice.h>
 #include <filehelper.h>
 #include <settings.h>
 #include "browseimagewidget.h"
@@ -8,6 +8,7 @@
 #include <QAbstractButton>
 #include <QDir>
 #include <QGroupBox>
+#include <QImage>
 #include <QListWidget>
 #include <QScrollBar>
 #include <QSqlError>
@@ -36,8 +37,9 @@ FetchDialog::FetchDialog(const QList<CoverArtProvider *> &providers, QWidget *pa
 	connect(buttonBox, &QDialogButtonBox::clicked, this, [=](QAbstractButton *button) {
 		if (QDialogButtonBox::ApplyRole == buttonBox->buttonRole(button)) {
 			this->applyChanges();
+		} else {
+			this->deleteLater();
 		}
-		this->deleteLater();
 	});
 
 	for (CoverArtProvider *coverArtProvider : providers) {
@@ -55,12 +57,10 @@ void FetchDialog::closeEvent(QCloseEvent *)
 	Settings::instance()->setValue("providers/geometry", saveGeometry());
 }
 
-bool FetchDialog::copyCoverToFolder(Cover *cover, QString artistAlbum, QString album)
+/** Saves cover next to the first track of an album. It runs in the database thread. */
+bool FetchDialog::copyCoverToFolder(SqlDatabase *db, Cover *cover, QString artistAlbum, QString album)
 {
-	SqlDatabase db;
-	db.open();
-
-	QSqlQuery findFirstTrack(db);
+	QSqlQuery findFirstTrack(*db);
 	findFirstTrack.prepare("SELECT uri FROM cache WHERE artistAlbum = ? AND album = ? LIMIT 1");
 	findFirstTrack.addBindValue(artistAlbum);
 	findFirstTrack.addBindValue(album);
@@ -77,12 +77,13 @@ bool FetchDialog::copyCoverToFolder(Cover *cover, QString artistAlbum, QString a
 			b = file.remove();
 		}
 		if (b) {
-			QPixmap p;
-			p.loadFromData(cover->byteArray(), cover->format());
-			b = p.save(absCover);
+			// Pixmaps can't be used outside the GUI thread
+			QImage image;
+			image.loadFromData(cover->byteArray(), cover->format());
+			b = image.save(absCover);
 
-			QSqlQuery updateTracks(db);
-			updateTracks.prepare("UPDATE cache SET cover = ? WHERE artistAlbum = ? AND album = ?");
+			QSqlQuery updateTracks(*db);
+			updateTracks.prepare("UPDATE albums SET cover = ? WHERE id IN (SELECT albumId FROM cache WHERE artistAlbum = ? AND album = ?)");
 			updateTracks.addBindValue(absCover);
 			updateTracks.addBindValue(artistAlbum);
 			updateTracks.addBindValue(album);
@@ -94,14 +95,13 @@ bool FetchDialog::copyCoverToFolder(Cover *cover, QString artistAlbum, QString a
 	}
 }
 
-bool FetchDialog::integrateCoverToFile(Cover *cover, QString artistAlbum, QString album)
+/** Saves cover in each track of an album. It runs in the database thread. */
+bool FetchDialog::integrateCoverToFile(SqlDatabase *db, Cover *cover, QString artistAlbum, QString album)
 {
-	SqlDatabase db;
-	db.open();
-	bool b = db.transaction();
+	bool b = db->transaction();
 
 	// Before creating the cover, we have to know which file to process
-	QSqlQuery findTracks(db);
+	QSqlQuery findTracks(*db);
 	findTracks.prepare("SELECT uri FROM cache WHERE artistAlbum = ? AND album = ?");
 	findTracks.addBindValue(artistAlbum);
 	findTracks.addBindValue(album);
@@ -111,8 +111,8 @@ bool FetchDialog::integrateCoverToFile(Cover *cover, QString artistAlbum, QStrin
 		fh.setCover(cover);
 		if (fh.save()) {
 			// Cover has been successfully integrated into file
-			QSqlQuery updateTrack(db);
-			updateTrack.prepare("UPDATE cache SET internalCover = ? WHERE uri = ?");
+			QSqlQuery updateTrack(*db);
+			updateTrack.prepare("UPDATE tracks SET internalCover = ? WHERE uri = ?");
 			updateTrack.addBindValue(fh.fileInfo().absoluteFilePath());
 			updateTrack.addBindValue(fh.fileInfo().absoluteFilePath());
 			b = b & updateTrack.exec();
@@ -121,9 +121,9 @@ bool FetchDialog::integrateCoverToFile(Cover *cover, QString artistAlbum, QStrin
 		}
 	}
 	if (b) {
-		db.commit();
+		db->commit();
 	} else {
-		db.rollback();
+		db->rollback();
 	}
 	return b;
 }
@@ -151,26 +151,40 @@ void FetchDialog::applyChanges()
 {
 	bool integrateCoverToFiles = Settings::instance()->value("providers/integrateCoverToFiles").toBool();
 
+	// Covers which were chosen, with the artist and the album they belong to
+	QList<QPair<QByteArray, QStringList>> covers;
 	for (QGroupBox *gb : this->findChildren<QGroupBox*>()) {
 
 		QStackedWidget *remoteCoverList = gb->findChild<QStackedWidget*>();
 		QWidget * current = remoteCoverList->currentWidget();
 		QLabel *cover = qobject_cast<QLabel*>(current);
 		if (cover) {
-			Cover *c = new Cover(cover->property("coverByteArray").toByteArray());
 			QString artistAlbum = remoteCoverList->property("artistAlbum").toString();
 			QString album = remoteCoverList->property("album").toString();
+			covers.append(qMakePair(cover->property("coverByteArray").toByteArray(), QStringList({ artistAlbum, album })));
+		}
+	}
+
+	// Files and the database are updated in the database thread. The dialog is hidden meanwhile, then closed
+	this->hide();
+	DatabaseService::instance()->run<bool>([covers, integrateCoverToFiles](SqlDatabase *db) {
+		for (auto cover : covers) {
+			Cover c(cover.first);
+			QString artistAlbum = cover.second.first();
+			QString album = cover.second.last();
 
 			// Create cover for each file
 			if (integrateCoverToFiles) {
-				this->integrateCoverToFile(c, artistAlbum, album);
+				integrateCoverToFile(db, &c, artistAlbum, album);
 			} else {
-				this->copyCoverToFolder(c, artistAlbum, album);
+				copyCoverToFolder(db, &c, artistAlbum, album);
 			}
 		}
-	}
-	this->close();
-	emit refreshView();
+		return true;
+	}, this, [this](const bool &) {
+		emit refreshView();
+		this->close();
+	});
 }
 
 void FetchDialog::updateCoverSize(int value)
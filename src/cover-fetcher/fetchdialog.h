@@ -8,6 +8,9 @@
 #include "miamcoverfetcher_global.hpp"
 #include "ui_fetchdialog.h"
 
+/// Forward declarations
+class SqlDatabase;
+
 /**
  * \brief       The FetchDialog class
  * \author      Matthieu Bachelier
@@ -28,9 +31,11 @@ protected:
 	virtual void closeEvent(QCloseEvent *e) override;
 
 private:
-	bool copyCoverToFolder(Cover *cover, QString artistAlbum, QString album);
+	/** Saves cover next to the first track of an album. It runs in the database thread. */
+	static bool copyCoverToFolder(SqlDatabase *db, Cover *cover, QString artistAlbum, QString album);
 
-	bool integrateCoverToFile(Cover *cover, QString artistAlbum, QString album);
+	/** Saves cover in each track of an album. It runs in the database thread. */
+	static bool integrateCoverToFile(SqlDatabase *db, Cover *cover, QString artistAlbum, QString album);
 
 public slots:
 	void addCover(const QString &album, const QByteArray &coverByteArray);
@@ -1,4 +1,4 @@
-QT      += sql multimedia widgets
+QT      += concurrent sql multimedia widgets
 
 TEMPLATE = lib
 
@@ -19,6 +19,7 @@ SOURCES += albumitem.cpp \
     miamitemmodel.cpp \
     separatoritem.cpp \
     trackitem.cpp \
+    tracktable.cpp \
     yearitem.cpp
 
 HEADERS += albumitem.h \
@@ -37,6 +38,7 @@ HEADERS += albumitem.h \
     miamlibrary_global.hpp \
     separatoritem.h \
     trackitem.h \
+    tracktable.h \
     yearitem.h
 
 FORMS += libraryorderdialog.ui
@@ -1,13 +1,50 @@
 #include "libraryfilterproxymodel.h"
 
 #include <settingsprivate.h>
+#include "libraryitemmodel.h"
+#include "trackitem.h"
 
 #include <QtDebug>
 
+namespace {
+	/** Appends an item and all its children. */
+	void appendItems(QStandardItem *item, QList<QStandardItem*> &items)
+	{
+		items.append(item);
+		for (int i = 0; i < item->rowCount(); i++) {
+			appendItems(item->child(i), items);
+		}
+	}
+}
+
 LibraryFilterProxyModel::LibraryFilterProxyModel(QObject *parent) :
-	MiamSortFilterProxyModel(parent)
+	MiamSortFilterProxyModel(parent),
+	_matchedRole(-1),
+	_matchesAreDirty(true)
 {}
 
+/** Redefined to read children of top level items matching text first, when the library is loaded lazily. */
+void LibraryFilterProxyModel::findMusic(const QString &text)
+{
+	_pendingText = text;
+	LibraryItemModel *model = qobject_cast<LibraryItemModel*>(sourceModel());
+	if (!model) {
+		MiamSortFilterProxyModel::findMusic(text);
+		return;
+	}
+	model->fetchMatching(text, [this, text](bool fetched) {
+		// Another text was typed meanwhile: children read for this one are kept, but they aren't filtered
+		if (text != _pendingText) {
+			return;
+		}
+		// Rows inserted in the source model aren't sorted by this proxy
+		if (fetched) {
+			this->sort(this->defaultSortColumn(), this->sortOrder());
+		}
+		MiamSortFilterProxyModel::findMusic(text);
+	});
+}
+
 /** Redefined to override Qt::FontRole. */
 QVariant LibraryFilterProxyModel::data(const QModelIndex &index, int role) const
 {
@@ -18,32 +55,53 @@ QVariant LibraryFilterProxyModel::data(const QModelIndex &index, int role) const
 	}
 }
 
-bool LibraryFilterProxyModel::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
+/** Redefined to keep accepted items up to date when the source model is changing. */
+void LibraryFilterProxyModel::setSourceModel(QAbstractItemModel *model)
 {
-	if (filterAcceptsRowItself(sourceRow, sourceParent)) {
-		return true;
+	if (sourceModel()) {
+		sourceModel()->disconnect(this);
 	}
+	_matchesAreDirty = true;
+	_matchingItems.clear();
+	_acceptedTracks.clear();
+	_acceptedItems.clear();
+	if (model) {
+		// Connected before the proxy itself, which filters inserted rows when it receives the same signal
+		connect(model, &QAbstractItemModel::rowsInserted, this, &LibraryFilterProxyModel::matchInsertedRows);
+		connect(model, &QAbstractItemModel::rowsAboutToBeRemoved, this, [=]() {
+			_matchesAreDirty = true;
+		});
+		connect(model, &QAbstractItemModel::modelReset, this, [=]() {
+			_matchesAreDirty = true;
+		});
+		connect(model, &QAbstractItemModel::dataChanged, this, [=](const QModelIndex &, const QModelIndex &, const QVector<int> &roles) {
+			if (roles.isEmpty() || roles.contains(_matchedRole)) {
+				_matchesAreDirty = true;
+			}
+		});
+	}
+	MiamSortFilterProxyModel::setSourceModel(model);
+}
 
-	// Accept if any of the parents is accepted on it's own merits
-	QModelIndex parent = sourceParent;
-	while (parent.isValid()) {
-		if (filterAcceptsRowItself(parent.row(), parent.parent())) {
-			return true;
-		}
-		parent = parent.parent();
+bool LibraryFilterProxyModel::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
+{
+	QStandardItemModel *model = qobject_cast<QStandardItemModel*>(sourceModel());
+	if (!model || filterRegExp().isEmpty()) {
+		return MiamSortFilterProxyModel::filterAcceptsRow(sourceRow, sourceParent);
 	}
 
-	// Accept if any of the children is accepted on it's own merits
-	if (hasAcceptedChildren(sourceRow, sourceParent)) {
+	// Accept if the item itself, any of its parents or any of its children is matching the filter
+	this->updateMatches();
+	QStandardItem *item = model->itemFromIndex(model->index(sourceRow, 0, sourceParent));
+	if (item && this->isAccepted(item)) {
 		return true;
 	}
 
 	// Accept separators if any top level items and its children are accepted
-	QStandardItemModel *model = qobject_cast<QStandardItemModel*>(sourceModel());
-	QStandardItem *item = model->itemFromIndex(model->index(sourceRow, 0, sourceParent));
 	if (item && item->type() == Miam::IT_Separator) {
 		for (QModelIndex index : _topLevelItems.values(static_cast<SeparatorItem*>(item))) {
-			if (filterAcceptsRow(index.row(), sourceParent)) {
+			QStandardItem *topLevelItem = model->item(index.row());
+			if (topLevelItem && this->isAccepted(topLevelItem)) {
 				return true;
 			}
 		}
@@ -120,30 +178,18 @@ bool LibraryFilterProxyModel::lessThan(const QModelIndex &idxLeft, const QModelI
 		}
 		break;
 
-	// Sort tracks by their numbers
+	// Sort tracks by their numbers, which are packed in one key by their table
 	case Miam::IT_Track: {
-		int dLeft = left->data(Miam::DF_DiscNumber).toInt();
-		int lTrackNumber = left->data(Miam::DF_TrackNumber).toInt();
-		int dRight = right->data(Miam::DF_DiscNumber).toInt();
+		qint64 lKey = static_cast<TrackItem*>(left)->sortKey();
 		if (rType == Miam::IT_Track) {
-			int rTrackNumber = right->data(Miam::DF_TrackNumber).toInt();
-			if (dLeft == dRight) {
-				// If there are both remote and local tracks under the same album, display first tracks from hard disk
-				// Otherwise tracks will be displayed like #1 - local, #1 - remote, #2 - local, #2 - remote, etc
-				bool lIsRemote = left->data(Miam::DF_IsRemote).toBool();
-				bool rIsRemote = right->data(Miam::DF_IsRemote).toBool();
-				if ((lIsRemote && rIsRemote) || (!lIsRemote && !rIsRemote)) {
-					result = (lTrackNumber < rTrackNumber && sortOrder() == Qt::AscendingOrder) ||
-						(rTrackNumber < lTrackNumber && sortOrder() == Qt::DescendingOrder);
-				} else {
-					result = (rIsRemote && sortOrder() == Qt::AscendingOrder) ||
-						(lIsRemote && sortOrder() == Qt::DescendingOrder);
-				}
-			} else {
-				result = (dLeft < dRight && sortOrder() == Qt::AscendingOrder) ||
-						  (dRight < dLeft && sortOrder() == Qt::DescendingOrder);
-			}
+			// If there are both remote and local tracks under the same album, display first tracks from hard disk
+			// Otherwise tracks will be displayed like #1 - local, #1 - remote, #2 - local, #2 - remote, etc
+			qint64 rKey = static_cast<TrackItem*>(right)->sortKey();
+			result = (lKey < rKey && sortOrder() == Qt::AscendingOrder) ||
+					  (rKey < lKey && sortOrder() == Qt::DescendingOrder);
 		} else if (rType == Miam::IT_Disc) {
+			int dLeft = static_cast<int>(lKey >> 33);
+			int dRight = right->data(Miam::DF_DiscNumber).toInt();
 			result = (dLeft < dRight && sortOrder() == Qt::AscendingOrder) ||
 					  (dRight < dLeft && sortOrder() == Qt::DescendingOrder);
 		} else {
@@ -165,32 +211,122 @@ bool LibraryFilterProxyModel::lessThan(const QModelIndex &idxLeft, const QModelI
 	return result;
 }
 
-bool LibraryFilterProxyModel::filterAcceptsRowItself(int sourceRow, const QModelIndex &sourceParent) const
+void LibraryFilterProxyModel::accept(QStandardItem *item) const
+{
+	// Parents of an accepted item are already accepted
+	for (QStandardItem *i = item; i && !this->isAccepted(i); i = i->parent()) {
+		if (i->type() == Miam::IT_Track) {
+			int row = static_cast<TrackItem*>(i)->tableRow();
+			if (row >= _acceptedTracks.size()) {
+				_acceptedTracks.resize(row + 1);
+			}
+			_acceptedTracks.setBit(row);
+		} else {
+			_acceptedItems.insert(i);
+		}
+	}
+}
+
+void LibraryFilterProxyModel::acceptChildren(QStandardItem *item) const
+{
+	for (int i = 0; i < item->rowCount(); i++) {
+		QStandardItem *child = item->child(i);
+		this->accept(child);
+		this->acceptChildren(child);
+	}
+}
+
+bool LibraryFilterProxyModel::isAccepted(const QStandardItem *item) const
+{
+	if (item->type() == Miam::IT_Track) {
+		int row = static_cast<const TrackItem*>(item)->tableRow();
+		return row < _acceptedTracks.size() && _acceptedTracks.testBit(row);
+	}
+	return _acceptedItems.contains(item);
+}
+
+/** Same test as QSortFilterProxyModel::filterAcceptsRow(), on a single item. */
+bool LibraryFilterProxyModel::isMatching(const QStandardItem *item) const
+{
+	QString text = item->data(_matchedRole).toString();
+	if (_matchedRegExp.patternSyntax() == QRegExp::FixedString) {
+		return text.contains(_matchedRegExp.pattern(), _matchedRegExp.caseSensitivity());
+	}
+	return text.contains(_matchedRegExp);
+}
+
+/** Tests candidates against the current filter, then accepts them with their parents and their children. */
+void LibraryFilterProxyModel::match(const QList<QStandardItem*> &candidates) const
 {
-	return MiamSortFilterProxyModel::filterAcceptsRow(sourceRow, sourceParent);
+	for (QStandardItem *item : candidates) {
+		if (this->isMatching(item)) {
+			_matchingItems.append(item);
+			this->accept(item);
+			this->acceptChildren(item);
+		}
+	}
 }
 
-bool LibraryFilterProxyModel::hasAcceptedChildren(int sourceRow, const QModelIndex &sourceParent) const
+/** Tests items inserted in the source model against the current filter. */
+void LibraryFilterProxyModel::matchInsertedRows(const QModelIndex &parent, int first, int last)
 {
-	QModelIndex item = sourceModel()->index(sourceRow, 0, sourceParent);
-	if (!item.isValid()) {
-		return false;
+	if (_matchesAreDirty) {
+		return;
+	}
+	QStandardItemModel *model = qobject_cast<QStandardItemModel*>(sourceModel());
+	if (!model || _matchedRegExp != filterRegExp() || _matchedRole != filterRole()) {
+		// Inserted items can't be refined later: everything is computed again
+		_matchesAreDirty = true;
+		return;
 	}
 
-	// Check if there are children
-	int childCount = item.model()->rowCount(item);
-	if (childCount == 0) {
-		return false;
+	QStandardItem *parentItem = parent.isValid() ? model->itemFromIndex(parent) : model->invisibleRootItem();
+	QList<QStandardItem*> candidates;
+	for (int row = first; row <= last; row++) {
+		appendItems(parentItem->child(row), candidates);
 	}
+	this->match(candidates);
 
-	for (int i = 0; i < childCount; ++i) {
-		if (filterAcceptsRowItself(i, item)) {
-			return true;
+	// Rows inserted below a matching item are accepted too
+	for (QStandardItem *item = model->itemFromIndex(parent); item; item = item->parent()) {
+		if (this->isMatching(item)) {
+			for (int row = first; row <= last; row++) {
+				this->accept(parentItem->child(row));
+				this->acceptChildren(parentItem->child(row));
+			}
+			break;
 		}
-		// Recursive call
-		if (hasAcceptedChildren(i, item)) {
-			return true;
+	}
+}
+
+/** Computes accepted items again if the filter has changed, refining the previous ones when possible. */
+void LibraryFilterProxyModel::updateMatches() const
+{
+	QRegExp regExp = filterRegExp();
+	if (!_matchesAreDirty && _matchedRegExp == regExp && _matchedRole == filterRole()) {
+		return;
+	}
+
+	// If one has typed more characters, items matching the new text were also matching the previous one
+	bool refine = !_matchesAreDirty && !_matchedRegExp.isEmpty() && _matchedRole == filterRole() && _matchedRole == Qt::DisplayRole &&
+		_matchedRegExp.patternSyntax() == QRegExp::FixedString && regExp.patternSyntax() == QRegExp::FixedString &&
+		_matchedRegExp.caseSensitivity() == Qt::CaseInsensitive && regExp.pattern().contains(_matchedRegExp.pattern(), Qt::CaseInsensitive);
+
+	QList<QStandardItem*> candidates;
+	if (refine) {
+		candidates.swap(_matchingItems);
+	} else {
+		QStandardItem *root = qobject_cast<QStandardItemModel*>(sourceModel())->invisibleRootItem();
+		for (int i = 0; i < root->rowCount(); i++) {
+			appendItems(root->child(i), candidates);
 		}
 	}
-	return false;
+
+	_matchedRegExp = regExp;
+	_matchedRole = filterRole();
+	_matchesAreDirty = false;
+	_matchingItems.clear();
+	_acceptedTracks.fill(false);
+	_acceptedItems.clear();
+	this->match(candidates);
 }
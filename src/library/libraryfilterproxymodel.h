@@ -1,6 +1,8 @@
 #ifndef LIBRARYFILTERPROXYMODEL_H
 #define LIBRARYFILTERPROXYMODEL_H
 
+#include <QBitArray>
+#include <QSet>
 #include <QStandardItem>
 #include <miamsortfilterproxymodel.h>
 
@@ -10,20 +12,51 @@
 
 /**
  * \brief		The LibraryFilterProxyModel class is used to filter Library by looking in all items
- * \details		When filtering, the method filterAcceptsRow will not stop if a search term was not found in a node. The algorithm
- *				will continue recursively until all subnodes and leaves are evaluated.
+ * \details		An item is accepted if itself, one of its parents or one of its children is matching the filter. Instead of walking
+ *				the tree for each row, items which are accepted are computed once per filter: tracks are bits indexed by their row
+ *				in the TrackTable, other items are kept in a set. When one is typing more characters, only items which were matching
+ *				the previous filter are tested again.
  * \author      Matthieu Bachelier
  * \copyright   GNU General Public License v3
  */
 class MIAMLIBRARY_LIBRARY LibraryFilterProxyModel : public MiamSortFilterProxyModel
 {
 	Q_OBJECT
+private:
+	/** Last text given to findMusic(), while children of top level items are read. */
+	QString _pendingText;
+
+	/** Filter and role which were used to compute accepted items. */
+	mutable QRegExp _matchedRegExp;
+	mutable int _matchedRole;
+
+	/** True when items were removed or changed since accepted items were computed. */
+	mutable bool _matchesAreDirty;
+
+	/** Items which are matching the filter on their own, kept to refine them. */
+	mutable QList<QStandardItem*> _matchingItems;
+
+	/** Accepted tracks, one bit per row of the TrackTable of the source model. */
+	mutable QBitArray _acceptedTracks;
+
+	/** Accepted items which aren't tracks. */
+	mutable QSet<const QStandardItem*> _acceptedItems;
+
 public:
 	explicit LibraryFilterProxyModel(QObject *parent = nullptr);
 
+	/** Last text given to findMusic(). */
+	inline const QString& lastSearch() const { return _pendingText; }
+
+	/** Redefined to read children of top level items matching text first, when the library is loaded lazily. */
+	virtual void findMusic(const QString &text) override;
+
 	/** Redefined to override Qt::FontRole. */
 	virtual QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
 
+	/** Redefined to keep accepted items up to date when the source model is changing. */
+	virtual void setSourceModel(QAbstractItemModel *sourceModel) override;
+
 protected:
 	/** Redefined from QSortFilterProxyModel. */
 	virtual bool filterAcceptsRow(int sourceRow, const QModelIndex &parent) const override;
@@ -32,8 +65,23 @@ protected:
 	virtual bool lessThan(const QModelIndex &idxLeft, const QModelIndex &idxRight) const override;
 
 private:
-	bool filterAcceptsRowItself(int sourceRow, const QModelIndex &sourceParent) const;
-	bool hasAcceptedChildren(int sourceRow, const QModelIndex &sourceParent) const;
+	void accept(QStandardItem *item) const;
+
+	void acceptChildren(QStandardItem *item) const;
+
+	bool isAccepted(const QStandardItem *item) const;
+
+	/** Same test as QSortFilterProxyModel::filterAcceptsRow(), on a single item. */
+	bool isMatching(const QStandardItem *item) const;
+
+	/** Tests candidates against the current filter, then accepts them with their parents and their children. */
+	void match(const QList<QStandardItem*> &candidates) const;
+
+	/** Tests items inserted in the source model against the current filter. */
+	void matchInsertedRows(const QModelIndex &parent, int first, int last);
+
+	/** Computes accepted items again if the filter has changed, refining the previous ones when possible. */
+	void updateMatches() const;
 };
 
 #endif // LIBRARYFILTERPROXYMODEL_H
@@ -2,6 +2,7 @@
 
 #include <library/jumptowidget.h>
 #include <styling/imageutils.h>
+#include <model/databaseservice.h>
 #include <cover.h>
 #include <librarytreeview.h>
 #include <settingsprivate.h>
@@ -119,8 +120,7 @@ void LibraryItemDelegate::drawAlbum(QPainter *painter, QStyleOptionViewItem &opt
 				QImage image = imageReader.read();
 				if (image.isNull()) {
 					itemHasNoIcon = true;
-					SqlDatabase db;
-					db.removeCoverForAlbum(false, item->data(Miam::DF_NormArtist).toString(), item->data(Miam::DF_NormAlbum).toString());
+					DatabaseService::instance()->removeCoverForAlbum(false, item->data(Miam::DF_NormArtist).toString(), item->data(Miam::DF_NormAlbum).toString());
 					item->setData("", Miam::DF_CoverPath);
 				} else {
 					item->setIcon(QPixmap::fromImage(image));
@@ -142,8 +142,7 @@ void LibraryItemDelegate::drawAlbum(QPainter *painter, QStyleOptionViewItem &opt
 				}
 			} else {
 				// We couldn't extract inner cover: maybe the file was modified somewhere else
-				SqlDatabase db;
-				db.removeCoverForAlbum(true, item->data(Miam::DF_NormArtist).toString(), item->data(Miam::DF_NormAlbum).toString());
+				DatabaseService::instance()->removeCoverForAlbum(true, item->data(Miam::DF_NormArtist).toString(), item->data(Miam::DF_NormAlbum).toString());
 				item->setData("", Miam::DF_InternalCover);
 			}
 		}
@@ -1,7 +1,9 @@
 #include "libraryitemmodel.h"
 
 #include <settingsprivate.h>
+#include <model/databaseservice.h>
 #include <model/sqldatabase.h>
+#include <normalizer.h>
 #include "albumitem.h"
 #include "artistitem.h"
 #include "trackitem.h"
@@ -9,15 +11,16 @@
 
 #include <functional>
 
-#include <QRegularExpression>
 #include <QSqlQuery>
 #include <QSqlRecord>
+#include <QThread>
 
 #include <QtDebug>
 
 LibraryItemModel::LibraryItemModel(QObject *parent)
 	: MiamItemModel(parent)
 	, _proxy(new LibraryFilterProxyModel(this))
+	, _lastBuild(std::make_shared<QAtomicInt>(0))
 {
 	setColumnCount(1);
 	_proxy->setSourceModel(this);
@@ -27,262 +30,709 @@ LibraryItemModel::LibraryItemModel(QObject *parent)
 LibraryItemModel::~LibraryItemModel()
 {}
 
-/** Read all tracks entries in the database and send them to connected views. */
+namespace {
+	/** Columns of the query which reads tracks, used by load() and updateTracks(). */
+	const QString trackColumns = "uri, trackNumber, trackTitle, artist, artistNormalized, album, albumNormalized, artistAlbum, " \
+		"albumYear, trackLength, rating, disc, internalCover, cover, host, icon, artistId, albumId";
+
+	enum TrackColumn : int { TC_Uri = 0, TC_TrackNumber, TC_TrackTitle, TC_Artist, TC_ArtistNorm, TC_Album, TC_AlbumNorm,
+		TC_ArtistAlbum, TC_Year, TC_TrackLength, TC_Rating, TC_Disc, TC_InternalCover, TC_Cover, TC_Host, TC_Icon, TC_ArtistId, TC_AlbumId };
+
+	/** Reads one row per top level item, with the columns of trackColumns which are used to build these items. */
+	QString topLevelQuery(SettingsPrivate::InsertPolicy ip)
+	{
+		switch (ip) {
+		case SettingsPrivate::IP_Artists:
+			return "SELECT NULL, NULL, NULL, ar.name, ar.normalizedName, NULL, NULL, ar.name, '', NULL, NULL, NULL, NULL, NULL, NULL, NULL, " \
+				"ar.id, NULL FROM artists ar WHERE EXISTS (SELECT 1 FROM albums al JOIN tracks t ON t.albumId = al.id WHERE al.artistId = ar.id)";
+		case SettingsPrivate::IP_Years:
+			return "SELECT DISTINCT NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, IFNULL(al.year, ''), NULL, NULL, NULL, NULL, NULL, NULL, " \
+				"NULL, NULL, NULL FROM albums al WHERE EXISTS (SELECT 1 FROM tracks t WHERE t.albumId = al.id)";
+		default:
+			return "SELECT NULL, NULL, NULL, ar.name, ar.normalizedName, al.name, al.normalizedName, ar.name, IFNULL(al.year, ''), NULL, NULL, " \
+				"NULL, (SELECT internalCover FROM tracks WHERE albumId = al.id AND internalCover IS NOT NULL LIMIT 1), al.cover, " \
+				"(SELECT host FROM tracks WHERE albumId = al.id LIMIT 1), (SELECT icon FROM tracks WHERE albumId = al.id LIMIT 1), ar.id, al.id " \
+				"FROM albums al JOIN artists ar ON ar.id = al.artistId WHERE EXISTS (SELECT 1 FROM tracks t WHERE t.albumId = al.id)";
+		}
+	}
+
+	/** Column of view cache which identifies the top level item of a track, compared as text like years in other views. */
+	QString topLevelKeyColumn(SettingsPrivate::InsertPolicy ip)
+	{
+		switch (ip) {
+		case SettingsPrivate::IP_Artists:
+			return "artistId";
+		case SettingsPrivate::IP_Years:
+			return "CAST(albumYear AS TEXT)";
+		default:
+			return "albumId";
+		}
+	}
+
+	/** Value of topLevelKeyColumn() for a record read with trackColumns or topLevelQuery(). */
+	QString topLevelKey(SettingsPrivate::InsertPolicy ip, const QSqlRecord &r)
+	{
+		switch (ip) {
+		case SettingsPrivate::IP_Artists:
+			return r.value(TC_ArtistId).toString();
+		case SettingsPrivate::IP_Years:
+			return r.value(TC_Year).toString();
+		default:
+			return r.value(TC_AlbumId).toString();
+		}
+	}
+
+	/** Reads tracks of some top level items in the database thread, in the order the proxy would sort them. */
+	QList<QSqlRecord> selectChildren(SqlDatabase *db, const QString &keyColumn, const QStringList &keys)
+	{
+		QList<QSqlRecord> records;
+		QSqlQuery q = db->preparedQuery("SELECT " + trackColumns + " FROM cache WHERE " + keyColumn + " = ? " \
+			"ORDER BY CAST(albumYear AS INTEGER), artistNormalized, albumNormalized, disc, IFNULL(host, '') <> '', trackNumber");
+		for (QString key : keys) {
+			q.addBindValue(key);
+			if (q.exec()) {
+				while (q.next()) {
+					records.append(q.record());
+				}
+			}
+		}
+		return records;
+	}
+
+	/** Grammatical articles which are moved at the end of names of artists, like "Artist, The". */
+	QStringList filteredArticles()
+	{
+		auto s = SettingsPrivate::instance();
+		if (s->isLibraryFilteredByArticles() && !s->libraryFilteredByArticles().isEmpty()) {
+			return s->libraryFilteredByArticles();
+		}
+		return QStringList();
+	}
+
+	void setTrackData(QStandardItem *trackItem, const QSqlRecord &r)
+	{
+		trackItem->setText(r.value(TC_TrackTitle).toString());
+		trackItem->setData(r.value(TC_Uri).toString(), Miam::DF_URI);
+		trackItem->setData(r.value(TC_TrackNumber).toString(), Miam::DF_TrackNumber);
+		trackItem->setData(r.value(TC_Disc).toString(), Miam::DF_DiscNumber);
+		trackItem->setData(r.value(TC_TrackLength).toUInt(), Miam::DF_TrackLength);
+		if (r.value(TC_Rating).toInt() != -1) {
+			trackItem->setData(r.value(TC_Rating).toInt(), Miam::DF_Rating);
+		} else if (!trackItem->data(Miam::DF_Rating).isNull()) {
+			trackItem->setData(QVariant(), Miam::DF_Rating);
+		}
+		trackItem->setData(r.value(TC_Artist).toString(), Miam::DF_Artist);
+		trackItem->setData(r.value(TC_Album).toString(), Miam::DF_Album);
+		trackItem->setData(!r.value(TC_Host).toString().isEmpty(), Miam::DF_IsRemote);
+	}
+}
+
+/** Current values of settings. Must be called from the GUI thread. */
+LibraryItemModel::BuildSettings LibraryItemModel::BuildSettings::current()
+{
+	BuildSettings settings;
+	settings.insertPolicy = SettingsPrivate::instance()->insertPolicy();
+	settings.articles = filteredArticles();
+	settings.isLazy = SettingsPrivate::instance()->isLibraryLoadedLazily();
+	return settings;
+}
+
+/** Read all tracks entries in the database and send them to connected views, once they're read in the database thread. */
 void LibraryItemModel::load(const QString &)
 {
-	this->reset();
+	this->loadInBackground();
+}
+
+/** Reads items from the database with settings. Returns false if isCancelled() became true meanwhile. It runs in the
+ * database thread: it must not read settings, nor touch anything else which belongs to the GUI thread. */
+bool LibraryItemModel::build(const BuildSettings &settings, const std::function<bool()> &isCancelled)
+{
+	SqlDatabase *db = SqlDatabase::instance();
+	_settings = settings;
 
-	SqlDatabase db;
+	// Changes made while tracks are read are applied once again on next update, it doesn't matter
+	_lastChange = db->lastTrackChange();
 
-	QSqlQuery q("SELECT uri, trackNumber, trackTitle, artist, artistNormalized, album, albumNormalized, artistAlbum, " \
-				"albumYear, trackLength, rating, disc, internalCover, cover, host, icon FROM cache ORDER BY uri, internalCover", db);
+	QSqlQuery q(*db);
 	q.setForwardOnly(true);
-	if (!q.exec()) {
-		return;
+	if (settings.isLazy) {
+		// Only top level items, their tracks are read by fetchMore()
+		if (!q.exec(topLevelQuery(settings.insertPolicy))) {
+			return true;
+		}
+		while (q.next()) {
+			if (isCancelled()) {
+				return false;
+			}
+			QSqlRecord r = q.record();
+			this->addUnfetchedKey(this->insertTopLevelItem(r), topLevelKey(settings.insertPolicy, r));
+		}
+	} else {
+		if (!q.exec("SELECT " + trackColumns + " FROM cache ORDER BY uri, internalCover")) {
+			return true;
+		}
+		while (q.next()) {
+			if (isCancelled()) {
+				return false;
+			}
+			this->insertTrack(q.record());
+		}
 	}
-	const int uri = 0, trackNumber = 1, trackTitle = 2, artist = 3, artistNorm = 4, album = 5, albumNorm = 6, artistAlbum = 7,
-			year = 8, trackLength = 9, rating = 10, disc = 11, internalCover = 12, cover = 13, host = 14, icon = 15;
-
-	// Lambda function to reduce duplicate code which is relevant in this method only
-	auto loadTrack = [=] (QSqlRecord& r) -> TrackItem* {
-		TrackItem *trackItem = new TrackItem;
-		trackItem->setText(r.value(trackTitle).toString());
-		trackItem->setData(r.value(uri).toString(), Miam::DF_URI);
-		trackItem->setData(r.value(trackNumber).toString(), Miam::DF_TrackNumber);
-		trackItem->setData(r.value(disc).toString(), Miam::DF_DiscNumber);
-		trackItem->setData(r.value(trackLength).toUInt(), Miam::DF_TrackLength);
-		if (r.value(rating).toInt() != -1) {
-			trackItem->setData(r.value(rating).toInt(), Miam::DF_Rating);
-		}
-		trackItem->setData(r.value(artist).toString(), Miam::DF_Artist);
-		trackItem->setData(r.value(album).toString(), Miam::DF_Album);
-		trackItem->setData(!r.value(host).toString().isEmpty(), Miam::DF_IsRemote);
-		return trackItem;
+
+	// Collation is the slow part of sorting: it's done once here, the proxy is only comparing ranks
+	if (isCancelled()) {
+		return false;
+	}
+	this->updateSortRanks();
+	this->sort(0);
+	return !isCancelled();
+}
+
+/** Builds items in the database thread, then swaps them with items of this model. A build which hasn't ended is cancelled. */
+void LibraryItemModel::loadInBackground()
+{
+	int number = _lastBuild->fetchAndAddOrdered(1) + 1;
+	std::shared_ptr<QAtomicInt> lastBuild = _lastBuild;
+	auto isCancelled = [lastBuild, number]() -> bool {
+		return lastBuild->load() != number;
 	};
 
-	auto s = SettingsPrivate::instance();
-	switch (s->insertPolicy()) {
-	case SettingsPrivate::IP_Artists: {
-		QStringList filters;
-		if (s->isLibraryFilteredByArticles() && !s->libraryFilteredByArticles().isEmpty()) {
-			filters = s->libraryFilteredByArticles();
+	// Settings belong to this thread
+	BuildSettings settings = BuildSettings::current();
+	QThread *thread = this->thread();
+	DatabaseService::instance()->run<std::shared_ptr<LibraryItemModel>>([settings, isCancelled, thread](SqlDatabase *) {
+		LibraryItemModel *tree = new LibraryItemModel;
+
+		// This model isn't displayed: its proxy would only slow down insertions
+		tree->_proxy->setSourceModel(nullptr);
+		if (!tree->build(settings, isCancelled)) {
+			delete tree;
+			return std::shared_ptr<LibraryItemModel>();
+		}
+		tree->moveToThread(thread);
+		return std::shared_ptr<LibraryItemModel>(tree, [](LibraryItemModel *m) { m->deleteLater(); });
+	}, this, [this, isCancelled](const std::shared_ptr<LibraryItemModel> &tree) {
+		if (tree && !isCancelled()) {
+			this->swapItems(tree.get());
+			emit loaded();
 		}
+	});
+}
 
-		QHash<uint, ArtistItem*> _artists;
-		QHash<uint, AlbumItem*> _albums;
+/** Returns true if children of parent haven't been read yet. */
+bool LibraryItemModel::canFetchMore(const QModelIndex &parent) const
+{
+	return _unfetched.contains(itemFromIndex(parent));
+}
 
-		while (q.next()) {
-			QSqlRecord r = q.record();
+/** Reads tracks of a top level item, and albums between them if any. */
+void LibraryItemModel::fetchMore(const QModelIndex &parent)
+{
+	QStandardItem *item = itemFromIndex(parent);
+	if (_unfetched.contains(item)) {
+		this->fetchItems({ item }, []() {});
+	}
+}
 
-			ArtistItem *artistItem = new ArtistItem;
-			QString artistNormalized = r.value(artistNorm).toString();
-			QString albumNormalized = r.value(albumNorm).toString();
-			QString artist = r.value(3).toString();
-			QString aa = r.value(artistAlbum).toString();
-			artistItem->setText(aa);
-			for (QString filter : filters) {
-				if (artist.startsWith(filter + " ", Qt::CaseInsensitive)) {
-					artist = artist.mid(filter.length() + 1);
-					artistItem->setData(artist + ", " + filter, Miam::DF_CustomDisplayText);
-					break;
-				}
+/** Reads tracks of top level items in the database thread, then inserts them and calls callback. */
+void LibraryItemModel::fetchItems(const QList<QStandardItem*> &items, const std::function<void()> &callback)
+{
+	// Items are still expandable while their children are being read
+	QStringList keys;
+	QList<QPersistentModelIndex> indexes;
+	for (QStandardItem *item : items) {
+		keys.append(this->takeUnfetchedKeys(item));
+		_fetching.insert(item);
+		indexes.append(item->index());
+	}
+	QString keyColumn = topLevelKeyColumn(_settings.insertPolicy);
+	int build = _lastBuild->load();
+	DatabaseService::instance()->run<QList<QSqlRecord>>([keyColumn, keys](SqlDatabase *db) {
+		return selectChildren(db, keyColumn, keys);
+	}, this, [this, indexes, build, callback](const QList<QSqlRecord> &records) {
+		// Items were replaced meanwhile
+		if (_lastBuild->load() != build) {
+			callback();
+			return;
+		}
+
+		// Tracks which were updated meanwhile are already there, with ranks. Otherwise children are all compared by strings
+		bool hasRankedChildren = false;
+		for (QPersistentModelIndex index : indexes) {
+			QStandardItem *item = itemFromIndex(index);
+			hasRankedChildren = hasRankedChildren || (item && item->rowCount() > 0);
+		}
+		for (QSqlRecord r : records) {
+			if (!_tracks.contains(r.value(TC_Uri).toString())) {
+				this->insertTrack(r);
 			}
+		}
+		if (hasRankedChildren) {
+			this->rankAndSort();
+		}
 
-			if (artistNormalized.isEmpty() || !artistNormalized.contains(QRegularExpression("[\\w]"))) {
-				artistItem->setData("0", Miam::DF_NormalizedString);
-			} else {
-				artistItem->setData(artistNormalized, Miam::DF_NormalizedString);
+		// Tracks were removed since top level items were read
+		bool topLevelItemWasRemoved = false;
+		for (QPersistentModelIndex index : indexes) {
+			QStandardItem *item = itemFromIndex(index);
+			_fetching.remove(item);
+			if (item && item->rowCount() == 0) {
+				topLevelItemWasRemoved = this->removeEmptyItems(item) || topLevelItemWasRemoved;
 			}
+		}
+		if (topLevelItemWasRemoved) {
+			this->removeEmptySeparators();
+		}
+		callback();
+	});
+}
 
-			// Add artist
-			if (_artists.contains(artistItem->hash())) {
-				//qDebug() << "hash found:" << artistItem->hash() << "for" << artistItem->text() ;
-				auto it = _artists.find(artistItem->hash());
-				delete artistItem;
-				artistItem = (*it);
-			} else {
-				_artists.insert(artistItem->hash(), artistItem);
-				invisibleRootItem()->appendRow(artistItem);
+/** Reads children of top level items which have tracks matching text, before text is used to filter or highlight items. */
+void LibraryItemModel::fetchMatching(const QString &text, const std::function<void(bool)> &callback)
+{
+	if (_unfetched.isEmpty() || text.isEmpty()) {
+		callback(false);
+		return;
+	}
 
-				// Also check if newly inserted artist needs to insert a separator
-				if (SeparatorItem *separator = this->insertSeparator(artistItem)) {
-					_topLevelItems.insert(separator, artistItem->index());
-				}
+	// Text is compared like the proxy does: ratings for stars, otherwise a part of names of tracks and their parents
+	QString condition;
+	QVariant value;
+	if (text.contains(QRegExp("^(\\*){1,5}$"))) {
+		condition = "rating >= ?";
+		value = text.size();
+	} else {
+		QString escaped = text;
+		escaped.replace("\\", "\\\\").replace("%", "\\%").replace("_", "\\_");
+		condition = "(COALESCE(trackTitle, '') || char(31) || COALESCE(album, '') || char(31) || COALESCE(artist, '') || char(31) || " \
+			"COALESCE(artistAlbum, '') || char(31) || albumYear) LIKE ? ESCAPE '\\'";
+		value = "%" + escaped + "%";
+	}
+	QString select = "SELECT DISTINCT " + topLevelKeyColumn(_settings.insertPolicy) + " FROM cache WHERE " + condition;
+
+	// Every track is compared, in the database thread
+	DatabaseService::instance()->run<QStringList>([select, value](SqlDatabase *db) -> QStringList {
+		QStringList keys;
+		QSqlQuery q = db->preparedQuery(select);
+		q.addBindValue(value);
+		if (q.exec()) {
+			while (q.next()) {
+				keys << q.value(0).toString();
+			}
+		}
+		return keys;
+	}, this, [this, callback](const QStringList &keys) {
+		QList<QStandardItem*> items;
+		for (QString key : keys) {
+			QStandardItem *item = _unfetchedKeys.value(key);
+			if (item && !items.contains(item)) {
+				items.append(item);
 			}
+		}
+		if (items.isEmpty()) {
+			callback(false);
+		} else {
+			this->fetchItems(items, [callback]() {
+				callback(true);
+			});
+		}
+	});
+}
+
+/** Returns true if parent has children, or if they haven't been read yet. */
+bool LibraryItemModel::hasChildren(const QModelIndex &parent) const
+{
+	return this->canFetchMore(parent) || _fetching.contains(itemFromIndex(parent)) || MiamItemModel::hasChildren(parent);
+}
+
+/** Reads tracks of an item whose children haven't been read yet, without adding them to this model. */
+QList<QUrl> LibraryItemModel::unfetchedTracks(const QStandardItem *item) const
+{
+	QStringList keys = _unfetched.value(const_cast<QStandardItem*>(item));
+	if (keys.isEmpty()) {
+		return QList<QUrl>();
+	}
 
-			AlbumItem *albumItem = new AlbumItem;
-			if (r.value(albumNorm).toString().isEmpty() || !r.value(albumNorm).toString().contains(QRegularExpression("[\\w]"))) {
-				albumItem->setData("0", Miam::DF_NormalizedString);
+	// Callers like drag and drop need tracks right away: the main thread waits, but it doesn't execute queries itself
+	QString keyColumn = topLevelKeyColumn(_settings.insertPolicy);
+	return DatabaseService::instance()->runAndWait<QList<QUrl>>([keyColumn, keys](SqlDatabase *db) {
+		QList<QUrl> tracks;
+		for (QSqlRecord r : selectChildren(db, keyColumn, keys)) {
+			if (r.value(TC_Host).toString().isEmpty()) {
+				tracks.append(QUrl::fromLocalFile(r.value(TC_Uri).toString()));
 			} else {
-				albumItem->setData(r.value(albumNorm).toString(), Miam::DF_NormalizedString);
+				tracks.append(QUrl(r.value(TC_Uri).toString()));
 			}
-			albumItem->setData(artistNormalized, Miam::DF_NormArtist);
-			albumItem->setData(albumNormalized, Miam::DF_NormAlbum);
-			albumItem->setData(r.value(year).toString(), Miam::DF_Year);
-
-			QString internalCoverPath = r.value(internalCover).toString();
-			QString coverPath = r.value(cover).toString();
-
-			// Add album
-			if (_albums.contains(albumItem->hash())) {
-				auto it = _albums.find(albumItem->hash());
-				delete albumItem;
-				albumItem = *it;
-				if (albumItem->data(Miam::DF_InternalCover).toString().isEmpty() && !internalCoverPath.isEmpty()) {
-					albumItem->setData(internalCoverPath, Miam::DF_InternalCover);
-				}
-				if (albumItem->data(Miam::DF_CoverPath).toString().isEmpty() && !coverPath.isEmpty()) {
-					albumItem->setData(coverPath, Miam::DF_CoverPath);
-				}
-			} else {
+		}
+		return tracks;
+	});
+}
+
+void LibraryItemModel::addUnfetchedKey(QStandardItem *item, const QString &key)
+{
+	QStringList &keys = _unfetched[item];
+	if (!keys.contains(key)) {
+		keys.append(key);
+		_unfetchedKeys.insert(key, item);
+	}
+}
+
+/** Adds a track, and its parents (artist, album, etc.) when they don't exist yet. */
+TrackItem* LibraryItemModel::insertTrack(const QSqlRecord &r)
+{
+	SettingsPrivate::InsertPolicy ip = _settings.insertPolicy;
+	QStandardItem *topLevelItem = this->insertTopLevelItem(r);
+
+	// This track will be read with its siblings, when its top level item is expanded
+	if (_unfetched.contains(topLevelItem)) {
+		this->addUnfetchedKey(topLevelItem, topLevelKey(ip, r));
+		return nullptr;
+	}
+
+	QString artistNormalized = r.value(TC_ArtistNorm).toString();
+	QString albumNormalized = r.value(TC_AlbumNorm).toString();
+	AlbumItem *albumItem = nullptr;
 
-				albumItem->setText(r.value(album).toString());
+	switch (ip) {
+	case SettingsPrivate::IP_Artists: {
+		albumItem = new AlbumItem;
+		if (albumNormalized.isEmpty() || !Normalizer::hasWordCharacter(albumNormalized)) {
+			albumItem->setData("0", Miam::DF_NormalizedString);
+		} else {
+			albumItem->setData(albumNormalized, Miam::DF_NormalizedString);
+		}
+		albumItem->setData(artistNormalized, Miam::DF_NormArtist);
+		albumItem->setData(albumNormalized, Miam::DF_NormAlbum);
+		albumItem->setData(r.value(TC_Year).toString(), Miam::DF_Year);
+
+		QString internalCoverPath = r.value(TC_InternalCover).toString();
+		QString coverPath = r.value(TC_Cover).toString();
+
+		// Add album
+		if (_albums.contains(albumItem->hash())) {
+			auto it = _albums.find(albumItem->hash());
+			delete albumItem;
+			albumItem = *it;
+			if (albumItem->data(Miam::DF_InternalCover).toString().isEmpty() && !internalCoverPath.isEmpty()) {
 				albumItem->setData(internalCoverPath, Miam::DF_InternalCover);
+			}
+			if (albumItem->data(Miam::DF_CoverPath).toString().isEmpty() && !coverPath.isEmpty()) {
 				albumItem->setData(coverPath, Miam::DF_CoverPath);
-				albumItem->setData(r.value(icon).toString(), Miam::DF_IconPath);
-				albumItem->setData(!r.value(host).toString().isEmpty(), Miam::DF_IsRemote);
-
-				_albums.insert(albumItem->hash(), albumItem);
-				artistItem->appendRow(albumItem);
 			}
-
-			// Add tracks
-			albumItem->appendRow(loadTrack(r));
+		} else {
+			albumItem->setText(r.value(TC_Album).toString());
+			albumItem->setData(internalCoverPath, Miam::DF_InternalCover);
+			albumItem->setData(coverPath, Miam::DF_CoverPath);
+			albumItem->setData(r.value(TC_Icon).toString(), Miam::DF_IconPath);
+			albumItem->setData(!r.value(TC_Host).toString().isEmpty(), Miam::DF_IsRemote);
+
+			_albums.insert(albumItem->hash(), albumItem);
+			topLevelItem->appendRow(albumItem);
 		}
 		break;
 	}
-	case SettingsPrivate::IP_Albums: {
+	case SettingsPrivate::IP_Albums:
+	case SettingsPrivate::IP_ArtistsAlbums:
+		albumItem = static_cast<AlbumItem*>(topLevelItem);
+		break;
+	case SettingsPrivate::IP_Years: {
+		// Add Artist - Album
+		albumItem = new AlbumItem;
+		albumItem->setText(r.value(TC_Artist).toString() + " – " + r.value(TC_Album).toString());
+		albumItem->setData(artistNormalized + "|" + albumNormalized, Miam::DF_NormalizedString);
+		albumItem->setData(artistNormalized, Miam::DF_NormArtist);
+		albumItem->setData(albumNormalized, Miam::DF_NormAlbum);
+		albumItem->setData(r.value(TC_Year).toString(), Miam::DF_Year);
+		albumItem->setData(r.value(TC_Cover).toString(), Miam::DF_CoverPath);
+		albumItem->setData(r.value(TC_Icon).toString(), Miam::DF_IconPath);
+		albumItem->setData(!r.value(TC_Host).toString().isEmpty(), Miam::DF_IsRemote);
+
+		if (_albums.contains(albumItem->hash())) {
+			auto it = _albums.find(albumItem->hash());
+			delete albumItem;
+			albumItem = *it;
+		} else {
+			_albums.insert(albumItem->hash(), albumItem);
+			topLevelItem->appendRow(albumItem);
+		}
+		break;
+	}
+	}
 
-		QHash<uint, AlbumItem*> _albums;
-		while (q.next()) {
-			QSqlRecord r = q.record();
-			QString artistNormalized = r.value(artistNorm).toString();
-			QString albumNormalized = r.value(albumNorm).toString();
+	// Add tracks
+	TrackItem *trackItem = new TrackItem(_trackTable);
+	setTrackData(trackItem, r);
+	albumItem->appendRow(trackItem);
+	_tracks.insert(trackItem->data(Miam::DF_URI).toString(), trackItem);
+	return trackItem;
+}
 
-			AlbumItem *albumItem = new AlbumItem;
-			albumItem->setText(r.value(album).toString());
-			if (r.value(albumNorm).toString().isEmpty() || !r.value(albumNorm).toString().contains(QRegularExpression("[\\w]"))) {
-				albumItem->setData("0", Miam::DF_NormalizedString);
-			} else {
-				albumItem->setData(r.value(albumNorm).toString(), Miam::DF_NormalizedString);
-			}
-			albumItem->setData(artistNormalized, Miam::DF_NormArtist);
-			albumItem->setData(albumNormalized, Miam::DF_NormAlbum);
-			albumItem->setData(r.value(year).toString(), Miam::DF_Year);
-			if (!r.value(internalCover).toString().isEmpty()) {
-				albumItem->setData(r.value(internalCover).toString(), Miam::DF_InternalCover);
-			}
-			albumItem->setData(r.value(cover).toString(), Miam::DF_CoverPath);
-			albumItem->setData(r.value(icon).toString(), Miam::DF_IconPath);
-			albumItem->setData(!r.value(host).toString().isEmpty(), Miam::DF_IsRemote);
-
-			// Add album
-			if (_albums.contains(albumItem->hash())) {
-				auto it = _albums.find(albumItem->hash());
-				delete albumItem;
-				albumItem = (*it);
-			} else {
-				_albums.insert(albumItem->hash(), albumItem);
-				invisibleRootItem()->appendRow(albumItem);
-				// Also check if newly inserted artist needs to insert a separator
-				if (SeparatorItem *separator = this->insertSeparator(albumItem)) {
-					_topLevelItems.insert(separator, albumItem->index());
-				}
+/** Adds the top level item of a record (artist, album or year, depending on the insert policy) when it doesn't exist yet. */
+QStandardItem* LibraryItemModel::insertTopLevelItem(const QSqlRecord &r)
+{
+	QString artistNormalized = r.value(TC_ArtistNorm).toString();
+	QString albumNormalized = r.value(TC_AlbumNorm).toString();
+
+	switch (_settings.insertPolicy) {
+	case SettingsPrivate::IP_Artists: {
+		ArtistItem *artistItem = new ArtistItem;
+		QString artist = r.value(TC_Artist).toString();
+		artistItem->setText(r.value(TC_ArtistAlbum).toString());
+		for (QString filter : _settings.articles) {
+			if (artist.startsWith(filter + " ", Qt::CaseInsensitive)) {
+				artist = artist.mid(filter.length() + 1);
+				artistItem->setData(artist + ", " + filter, Miam::DF_CustomDisplayText);
+				break;
 			}
+		}
 
-			// Add tracks
-			albumItem->appendRow(loadTrack(r));
+		if (artistNormalized.isEmpty() || !Normalizer::hasWordCharacter(artistNormalized)) {
+			artistItem->setData("0", Miam::DF_NormalizedString);
+		} else {
+			artistItem->setData(artistNormalized, Miam::DF_NormalizedString);
 		}
-		break;
+
+		// Add artist
+		if (_hash.contains(artistItem->hash())) {
+			auto it = _hash.find(artistItem->hash());
+			delete artistItem;
+			return *it;
+		}
+		_hash.insert(artistItem->hash(), artistItem);
+		invisibleRootItem()->appendRow(artistItem);
+
+		// Also check if newly inserted artist needs to insert a separator
+		if (SeparatorItem *separator = this->insertSeparator(artistItem)) {
+			_topLevelItems.insert(separator, artistItem->index());
+		}
+		return artistItem;
+	}
+	case SettingsPrivate::IP_Albums: {
+		AlbumItem *albumItem = new AlbumItem;
+		albumItem->setText(r.value(TC_Album).toString());
+		if (albumNormalized.isEmpty() || !Normalizer::hasWordCharacter(albumNormalized)) {
+			albumItem->setData("0", Miam::DF_NormalizedString);
+		} else {
+			albumItem->setData(albumNormalized, Miam::DF_NormalizedString);
+		}
+		albumItem->setData(artistNormalized, Miam::DF_NormArtist);
+		albumItem->setData(albumNormalized, Miam::DF_NormAlbum);
+		albumItem->setData(r.value(TC_Year).toString(), Miam::DF_Year);
+		if (!r.value(TC_InternalCover).toString().isEmpty()) {
+			albumItem->setData(r.value(TC_InternalCover).toString(), Miam::DF_InternalCover);
+		}
+		albumItem->setData(r.value(TC_Cover).toString(), Miam::DF_CoverPath);
+		albumItem->setData(r.value(TC_Icon).toString(), Miam::DF_IconPath);
+		albumItem->setData(!r.value(TC_Host).toString().isEmpty(), Miam::DF_IsRemote);
+
+		// Add album
+		if (_albums.contains(albumItem->hash())) {
+			auto it = _albums.find(albumItem->hash());
+			delete albumItem;
+			return *it;
+		}
+		_albums.insert(albumItem->hash(), albumItem);
+		invisibleRootItem()->appendRow(albumItem);
+		// Also check if newly inserted artist needs to insert a separator
+		if (SeparatorItem *separator = this->insertSeparator(albumItem)) {
+			_topLevelItems.insert(separator, albumItem->index());
+		}
+		return albumItem;
 	}
 	case SettingsPrivate::IP_ArtistsAlbums: {
-		QHash<uint, AlbumItem*> _albums;
-		while (q.next()) {
-			QSqlRecord r = q.record();
-			QString artistNormalized = r.value(artistNorm).toString();
-			QString albumNormalized = r.value(albumNorm).toString();
-
-			AlbumItem *albumItem = new AlbumItem;
-			albumItem->setText(r.value(artist).toString() + " – " + r.value(album).toString());
-			albumItem->setData(artistNormalized + "|" + albumNormalized, Miam::DF_NormalizedString);
-			albumItem->setData(artistNormalized, Miam::DF_NormArtist);
-			albumItem->setData(albumNormalized, Miam::DF_NormAlbum);
-			albumItem->setData(r.value(year).toString(), Miam::DF_Year);
-			albumItem->setData(r.value(cover).toString(), Miam::DF_CoverPath);
-			albumItem->setData(r.value(icon).toString(), Miam::DF_IconPath);
-			albumItem->setData(!r.value(host).toString().isEmpty(), Miam::DF_IsRemote);
-
-			// Add album
-			if (_albums.contains(albumItem->hash())) {
-				auto it = _albums.find(albumItem->hash());
-				delete albumItem;
-				albumItem = *it;
-			} else {
-				_albums.insert(albumItem->hash(), albumItem);
-				invisibleRootItem()->appendRow(albumItem);
-				// Also check if newly inserted artist needs to insert a separator
-				if (SeparatorItem *separator = this->insertSeparator(albumItem)) {
-					_topLevelItems.insert(separator, albumItem->index());
+		AlbumItem *albumItem = new AlbumItem;
+		albumItem->setText(r.value(TC_Artist).toString() + " – " + r.value(TC_Album).toString());
+		albumItem->setData(artistNormalized + "|" + albumNormalized, Miam::DF_NormalizedString);
+		albumItem->setData(artistNormalized, Miam::DF_NormArtist);
+		albumItem->setData(albumNormalized, Miam::DF_NormAlbum);
+		albumItem->setData(r.value(TC_Year).toString(), Miam::DF_Year);
+		albumItem->setData(r.value(TC_Cover).toString(), Miam::DF_CoverPath);
+		albumItem->setData(r.value(TC_Icon).toString(), Miam::DF_IconPath);
+		albumItem->setData(!r.value(TC_Host).toString().isEmpty(), Miam::DF_IsRemote);
+
+		// Add album
+		if (_albums.contains(albumItem->hash())) {
+			auto it = _albums.find(albumItem->hash());
+			delete albumItem;
+			return *it;
+		}
+		_albums.insert(albumItem->hash(), albumItem);
+		invisibleRootItem()->appendRow(albumItem);
+		// Also check if newly inserted artist needs to insert a separator
+		if (SeparatorItem *separator = this->insertSeparator(albumItem)) {
+			_topLevelItems.insert(separator, albumItem->index());
+		}
+		return albumItem;
+	}
+	case SettingsPrivate::IP_Years:
+	default: {
+		YearItem *yearItem = new YearItem(r.value(TC_Year).toString());
+
+		// Add year
+		if (_hash.contains(yearItem->hash())) {
+			auto it = _hash.find(yearItem->hash());
+			delete yearItem;
+			return *it;
+		}
+		_hash.insert(yearItem->hash(), yearItem);
+		invisibleRootItem()->appendRow(yearItem);
+
+		// Also check if newly inserted artist needs to insert a separator
+		if (SeparatorItem *separator = this->insertSeparator(yearItem)) {
+			_topLevelItems.insert(separator, yearItem->index());
+		}
+		return yearItem;
+	}
+	}
+}
+
+/** Removes an item, and its parents when they're empty. Returns true if a top level item was removed. */
+bool LibraryItemModel::removeEmptyItems(QStandardItem *item)
+{
+	// Keys are searched by value: hash of artists can't be computed again once separators have changed their normalized name
+	while (item && item->rowCount() == 0) {
+		_fetching.remove(item);
+		if (item->type() == Miam::IT_Album) {
+			for (auto it = _albums.begin(); it != _albums.end(); ++it) {
+				if (it.value() == item) {
+					_albums.erase(it);
+					break;
+				}
+			}
+		} else {
+			for (auto it = _hash.begin(); it != _hash.end(); ++it) {
+				if (it.value() == item) {
+					_hash.erase(it);
+					break;
 				}
 			}
+		}
+		QStandardItem *parent = item->parent();
+		if (parent) {
+			parent->removeRow(item->row());
+		} else {
+			invisibleRootItem()->removeRow(item->row());
+			return true;
+		}
+		item = parent;
+	}
+	return false;
+}
 
-			// Add tracks
-			albumItem->appendRow(loadTrack(r));
+/** Removes top level items whose children haven't been read yet, and which don't have any track anymore. */
+bool LibraryItemModel::removeEmptyUnfetchedItems(const QHash<QString, QSqlRecord> &keys)
+{
+	bool topLevelItemWasRemoved = false;
+	for (QStandardItem *item : _unfetched.keys()) {
+		bool isEmpty = true;
+		for (QString key : _unfetched.value(item)) {
+			if (keys.contains(key)) {
+				isEmpty = false;
+				break;
+			}
+		}
+		if (isEmpty) {
+			this->takeUnfetchedKeys(item);
+			topLevelItemWasRemoved = this->removeEmptyItems(item) || topLevelItemWasRemoved;
 		}
-		break;
 	}
-	case SettingsPrivate::IP_Years: {
+	return topLevelItemWasRemoved;
+}
 
-		QHash<uint, YearItem*> _years;
-		QHash<uint, AlbumItem*> _artistAlbums;
+/** Removes a track, and its parents when they're empty. Returns true if a top level item was removed. */
+bool LibraryItemModel::removeTrack(TrackItem *track)
+{
+	_tracks.remove(track->data(Miam::DF_URI).toString());
+	QStandardItem *parent = track->parent();
+	parent->removeRow(track->row());
+	return this->removeEmptyItems(parent);
+}
 
-		while (q.next()) {
-			QSqlRecord r = q.record();
-			YearItem *yearItem = new YearItem(r.value(year).toString());
+QStringList LibraryItemModel::takeUnfetchedKeys(QStandardItem *item)
+{
+	QStringList keys = _unfetched.take(item);
+	for (QString key : keys) {
+		_unfetchedKeys.remove(key);
+	}
+	return keys;
+}
 
-			// Add year
-			if (_years.contains(yearItem->hash())) {
-				auto it = _years.find(yearItem->hash());
-				delete yearItem;
-				yearItem = (*it);
-			} else {
-				_years.insert(yearItem->hash(), yearItem);
-				invisibleRootItem()->appendRow(yearItem);
+/** Hierarchy of items of the last build. */
+SettingsPrivate::InsertPolicy LibraryItemModel::insertPolicy() const
+{
+	return _settings.insertPolicy;
+}
 
-				// Also check if newly inserted artist needs to insert a separator
-				if (SeparatorItem *separator = this->insertSeparator(yearItem)) {
-					_topLevelItems.insert(separator, yearItem->index());
+/** Function which reads records of changed tracks. */
+MiamItemModel::RecordReader LibraryItemModel::recordReader() const
+{
+	// Keys of top level items are needed to remove those whose children haven't been read, when they're empty
+	QString keyColumn = _unfetched.isEmpty() ? QString() : topLevelKeyColumn(_settings.insertPolicy);
+	return [keyColumn](SqlDatabase *db, TrackChanges &changes) {
+		QSqlQuery query = db->preparedQuery("SELECT " + trackColumns + " FROM cache WHERE uri = ?");
+		for (QString uri : changes.uris) {
+			query.addBindValue(uri);
+			if (query.exec() && query.next()) {
+				changes.tracks.insert(uri, query.record());
+			}
+		}
+		if (!keyColumn.isEmpty()) {
+			QSqlQuery keys = db->preparedQuery("SELECT DISTINCT " + keyColumn + " FROM cache");
+			if (keys.exec()) {
+				while (keys.next()) {
+					changes.groups.insert(keys.value(0).toString(), keys.record());
 				}
 			}
+		}
+	};
+}
 
-			// Add Artist - Album
-			AlbumItem *artistAlbumItem = new AlbumItem;
-			artistAlbumItem->setText(r.value(3).toString() + " – " + r.value(album).toString());
-			artistAlbumItem->setData(r.value(artistNorm).toString() + "|" + r.value(albumNorm).toString(), Miam::DF_NormalizedString);
-			artistAlbumItem->setData(r.value(artistNorm).toString(), Miam::DF_NormArtist);
-			artistAlbumItem->setData(r.value(albumNorm).toString(), Miam::DF_NormAlbum);
-			artistAlbumItem->setData(r.value(year).toString(), Miam::DF_Year);
-			artistAlbumItem->setData(r.value(cover).toString(), Miam::DF_CoverPath);
-			artistAlbumItem->setData(r.value(icon).toString(), Miam::DF_IconPath);
-			artistAlbumItem->setData(!r.value(14).toString().isEmpty(), Miam::DF_IsRemote);
-
-			if (_artistAlbums.contains(artistAlbumItem->hash())) {
-				auto it = _artistAlbums.find(artistAlbumItem->hash());
-				delete artistAlbumItem;
-				artistAlbumItem = *it;
-			} else {
-				_artistAlbums.insert(artistAlbumItem->hash(), artistAlbumItem);
-				yearItem->appendRow(artistAlbumItem);
+/** Updates changed tracks. A track which is still in the same album is updated in place, otherwise it's moved. */
+bool LibraryItemModel::updateTracks(const TrackChanges &changes)
+{
+	bool topLevelItemWasRemoved = false;
+	bool hasUnfetchedTracks = false;
+	bool itemWasInserted = false;
+	for (QString uri : changes.uris) {
+		bool exists = changes.tracks.contains(uri);
+		QSqlRecord r = changes.tracks.value(uri);
+		TrackItem *track = _tracks.value(uri);
+		hasUnfetchedTracks = hasUnfetchedTracks || !track;
+
+		if (track && exists) {
+			QStandardItem *album = track->parent();
+			if (album->data(Miam::DF_NormArtist).toString() == r.value(TC_ArtistNorm).toString() &&
+					album->data(Miam::DF_NormAlbum).toString() == r.value(TC_AlbumNorm).toString() &&
+					album->data(Miam::DF_Year).toString() == r.value(TC_Year).toString()) {
+				setTrackData(track, r);
+				if (album->data(Miam::DF_CoverPath).toString() != r.value(TC_Cover).toString()) {
+					album->setData(r.value(TC_Cover).toString(), Miam::DF_CoverPath);
+				}
+				continue;
 			}
-
-			// Add tracks
-			artistAlbumItem->appendRow(loadTrack(r));
 		}
-		break;
+		if (track) {
+			topLevelItemWasRemoved = this->removeTrack(track) || topLevelItemWasRemoved;
+		}
+		if (exists) {
+			this->insertTrack(r);
+			itemWasInserted = true;
+		}
+	}
+
+	// A track which wasn't read may have been the last one of a top level item
+	if (hasUnfetchedTracks && !_unfetched.isEmpty()) {
+		topLevelItemWasRemoved = this->removeEmptyUnfetchedItems(changes.groups) || topLevelItemWasRemoved;
 	}
+	if (topLevelItemWasRemoved) {
+		this->removeEmptySeparators();
 	}
 
-	this->sort(0);
+	// Inserted items have no rank yet: the proxy can't compare them with ranks of their siblings
+	if (itemWasInserted) {
+		this->rankAndSort();
+	}
+	return true;
 }
 
 /** For every item in the library, gets the top level letter attached to it. */
@@ -317,12 +767,8 @@ LibraryFilterProxyModel* LibraryItemModel::proxy() const
 /** Rebuild the list of separators when one has changed grammatical articles in options. */
 void LibraryItemModel::rebuildSeparators()
 {
-	SqlDatabase db;
-	auto s = SettingsPrivate::instance();
-	QStringList filters;
-	if (s->isLibraryFilteredByArticles() && !s->libraryFilteredByArticles().isEmpty()) {
-		filters = s->libraryFilteredByArticles();
-	}
+	_settings.articles = filteredArticles();
+	QStringList filters = _settings.articles;
 
 	// Reset custom displayed text, like "Artist, the"
 	QHashIterator<SeparatorItem*, QModelIndex> i(_topLevelItems);
@@ -332,14 +778,14 @@ void LibraryItemModel::rebuildSeparators()
 			if (!i.value().data(Miam::DF_CustomDisplayText).toString().isEmpty()) {
 				item->setData(QString(), Miam::DF_CustomDisplayText);
 				// Recompute standard normalized name: "The Artist" -> "theartist"
-				item->setData(db.normalizeField(item->text()), Miam::DF_NormalizedString);
+				item->setData(Normalizer::normalizeField(item->text()), Miam::DF_NormalizedString);
 			} else if (!filters.isEmpty()) {
 				for (QString filter : filters) {
 					QString text = item->text();
 					if (text.startsWith(filter + " ", Qt::CaseInsensitive)) {
 						text = text.mid(filter.length() + 1);
 						item->setData(text + ", " + filter, Miam::DF_CustomDisplayText);
-						item->setData(db.normalizeField(text), Miam::DF_NormalizedString);
+						item->setData(Normalizer::normalizeField(text), Miam::DF_NormalizedString);
 						break;
 					}
 				}
@@ -375,11 +821,27 @@ void LibraryItemModel::rebuildSeparators()
 			}
 		}
 	}
+
+	// Normalized strings of artists have changed
+	this->updateSortRanks();
+}
+
+/** Computes ranks of all items again, then sorts the proxy, which isn't sorting again by itself when ranks are changing. */
+void LibraryItemModel::rankAndSort()
+{
+	this->updateSortRanks();
+	if (_proxy->sortColumn() >= 0) {
+		_proxy->sort(_proxy->sortColumn(), _proxy->sortOrder());
+	}
 }
 
 void LibraryItemModel::reset()
 {
 	this->deleteCache();
+	_albums.clear();
+	_unfetched.clear();
+	_unfetchedKeys.clear();
+	_fetching.clear();
 	switch (SettingsPrivate::instance()->insertPolicy()) {
 	case SettingsPrivate::IP_Artists:
 		horizontalHeaderItem(0)->setText(tr("  Artists \\ Albums"));
@@ -395,3 +857,53 @@ void LibraryItemModel::reset()
 		break;
 	}
 }
+
+/** Replaces items of this model with items of tree, which was built in another thread. */
+void LibraryItemModel::swapItems(LibraryItemModel *tree)
+{
+	// Views are told about everything at once, when the reset ends
+	this->beginResetModel();
+	bool blocked = this->blockSignals(true);
+	tree->blockSignals(true);
+	_settings = tree->_settings;
+	this->reset();
+
+	// Rows are taken from the end, which doesn't move other rows
+	QList<QStandardItem*> rows;
+	for (int row = tree->rowCount() - 1; row >= 0; row--) {
+		rows.prepend(tree->takeRow(row).first());
+	}
+	invisibleRootItem()->appendRows(rows);
+
+	// Pointers to items are still valid, unlike indexes
+	_hash = tree->_hash;
+	_letters = tree->_letters;
+	_tracks = tree->_tracks;
+	_albums = tree->_albums;
+	_unfetched = tree->_unfetched;
+	_unfetchedKeys = tree->_unfetchedKeys;
+	_lastChange = tree->_lastChange;
+	std::swap(_trackTable, tree->_trackTable);
+	tree->_hash.clear();
+	tree->_letters.clear();
+	tree->_tracks.clear();
+	tree->_albums.clear();
+	tree->_unfetched.clear();
+	tree->_unfetchedKeys.clear();
+	for (int row = 0; row < rowCount(); row++) {
+		auto item = this->item(row);
+		if (item->type() != Miam::IT_Separator) {
+			if (auto separator = this->insertSeparator(item)) {
+				_topLevelItems.insert(separator, item->index());
+			}
+		}
+	}
+
+	this->blockSignals(blocked);
+	this->endResetModel();
+
+	// Children which are matching the current search haven't been read yet, and items aren't highlighted
+	if (!_proxy->lastSearch().isEmpty()) {
+		_proxy->findMusic(_proxy->lastSearch());
+	}
+}
@@ -1,8 +1,15 @@
 #ifndef LIBRARYITEMMODEL_H
 #define LIBRARYITEMMODEL_H
 
+#include <QAtomicInt>
 #include <QSet>
+#include <QUrl>
+
+#include <functional>
+#include <memory>
+
 #include <model/genericdao.h>
+#include <settingsprivate.h>
 #include <filehelper.h>
 #include "miamitemmodel.h"
 #include "separatoritem.h"
@@ -10,24 +17,72 @@
 
 #include "libraryfilterproxymodel.h"
 
+/// Forward declarations
+class AlbumItem;
+class QSqlRecord;
+
 /**
  * \brief		The LibraryItemModel class is used to cache information from the database, in order to increase performance.
+ * \details		When the library is loaded lazily, only top level items (and their separators) are read at first. Their children
+ *				are read when they're expanded, or before they're filtered.
  * \author      Matthieu Bachelier
  * \copyright   GNU General Public License v3
  */
 class MIAMLIBRARY_LIBRARY LibraryItemModel : public MiamItemModel
 {
 	Q_OBJECT
+public:
+	/** Settings which are used to build items, copied in the GUI thread so that builds never read them from another one. */
+	struct BuildSettings
+	{
+		SettingsPrivate::InsertPolicy insertPolicy = SettingsPrivate::IP_Artists;
+		QStringList articles;
+		bool isLazy = false;
+
+		/** Current values of settings. Must be called from the GUI thread. */
+		static BuildSettings current();
+	};
+
 private:
 	LibraryFilterProxyModel *_proxy;
 
+	/** Albums already in the tree, like artists and years in _hash. */
+	QHash<uint, AlbumItem*> _albums;
+
+	/** Top level items whose children haven't been read yet, with keys of their tracks in view cache. */
+	QHash<QStandardItem*, QStringList> _unfetched;
+
+	/** Top level item of each key in _unfetched. */
+	QHash<QString, QStandardItem*> _unfetchedKeys;
+
+	/** Top level items whose children are being read in the database thread. */
+	QSet<QStandardItem*> _fetching;
+
+	/** Number of the last build started by loadInBackground(), shared with builds which are running. */
+	std::shared_ptr<QAtomicInt> _lastBuild;
+
+	/** Settings of the last build, also used to insert tracks which are read later. */
+	BuildSettings _settings;
+
 public:
 	explicit LibraryItemModel(QObject *parent = nullptr);
 
 	virtual ~LibraryItemModel();
 
+	/** Returns true if children of parent haven't been read yet. */
+	virtual bool canFetchMore(const QModelIndex &parent) const override;
+
 	virtual QChar currentLetter(const QModelIndex &index) const override;
 
+	/** Reads tracks of a top level item, and albums between them if any. */
+	virtual void fetchMore(const QModelIndex &parent) override;
+
+	/** Reads children of top level items which have tracks matching text, before text is used to filter or highlight items. */
+	void fetchMatching(const QString &text, const std::function<void(bool)> &callback);
+
+	/** Returns true if parent has children, or if they haven't been read yet. */
+	virtual bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+
 	virtual LibraryFilterProxyModel* proxy() const override;
 
 	/** Rebuild the list of separators when one has changed grammatical articles in options. */
@@ -37,8 +92,58 @@ public:
 
 	inline QMultiHash<SeparatorItem*, QModelIndex> topLevelItems() const { return _topLevelItems; }
 
+	/** Reads tracks of an item whose children haven't been read yet, without adding them to this model. */
+	QList<QUrl> unfetchedTracks(const QStandardItem *item) const;
+
+protected:
+	/** Hierarchy of items of the last build. */
+	virtual SettingsPrivate::InsertPolicy insertPolicy() const override;
+
+	/** Function which reads records of changed tracks. */
+	virtual RecordReader recordReader() const override;
+
+	/** Updates changed tracks. A track which is still in the same album is updated in place, otherwise it's moved. */
+	virtual bool updateTracks(const TrackChanges &changes) override;
+
+private:
+	void addUnfetchedKey(QStandardItem *item, const QString &key);
+
+	/** Reads tracks of top level items in the database thread, then inserts them and calls callback. */
+	void fetchItems(const QList<QStandardItem*> &items, const std::function<void()> &callback);
+
+	/** Reads items from the database with settings. Returns false if isCancelled() became true meanwhile. It runs in the
+	 * database thread: it must not read settings, nor touch anything else which belongs to the GUI thread. */
+	bool build(const BuildSettings &settings, const std::function<bool()> &isCancelled);
+
+	/** Adds a track, and its parents (artist, album, etc.) when they don't exist yet. */
+	TrackItem* insertTrack(const QSqlRecord &r);
+
+	/** Adds the top level item of a record (artist, album or year, depending on the insert policy) when it doesn't exist yet. */
+	QStandardItem* insertTopLevelItem(const QSqlRecord &r);
+
+	/** Computes ranks of all items again, then sorts the proxy, which isn't sorting again by itself when ranks are changing. */
+	void rankAndSort();
+
+	/** Removes an item, and its parents when they're empty. Returns true if a top level item was removed. */
+	bool removeEmptyItems(QStandardItem *item);
+
+	/** Removes top level items whose children haven't been read yet, and which don't have any track anymore. */
+	bool removeEmptyUnfetchedItems(const QHash<QString, QSqlRecord> &keys);
+
+	/** Removes a track, and its parents when they're empty. Returns true if a top level item was removed. */
+	bool removeTrack(TrackItem *track);
+
+	/** Replaces items of this model with items of tree, which was built in another thread. */
+	void swapItems(LibraryItemModel *tree);
+
+	QStringList takeUnfetchedKeys(QStandardItem *item);
+
 public slots:
+	/** Read all tracks entries in the database and send them to connected views, once they're read in the database thread. */
 	virtual void load(const QString & = QString::null) override;
+
+	/** Builds items in the database thread, then swaps them with items of this model. A build which hasn't ended is cancelled. */
+	void loadInBackground();
 };
 
 #endif // LIBRARYITEMMODEL_H
@@ -72,6 +72,9 @@ LibraryTreeView::LibraryTreeView(QWidget *parent)
 
 	connect(_proxyModel, &MiamSortFilterProxyModel::aboutToHighlightLetters, _jumpToWidget, &JumpToWidget::highlightLetters);
 
+	// Items are replaced when the library is built in background
+	connect(_proxyModel, &QAbstractItemModel::modelAboutToBeReset, this, &LibraryTreeView::saveState);
+
 	connect(settingsPrivate, &SettingsPrivate::languageAboutToChange, this, [=](const QString &newLanguage) {
 		QApplication::removeTranslator(&translator);
 		translator.load(":/translations/library_" + newLanguage);
@@ -114,8 +117,12 @@ const QImage *LibraryTreeView::expandedCover(AlbumItem *album) const
 /** Reimplemented. */
 void LibraryTreeView::findAll(const QModelIndex &index, QList<QUrl> *tracks) const
 {
-	QStandardItem *item = _libraryModel->itemFromIndex(_proxyModel->mapToSource(index));
-	if (item && item->hasChildren()) {
+	QModelIndex source = _proxyModel->mapToSource(index);
+	QStandardItem *item = _libraryModel->itemFromIndex(source);
+	if (item && _libraryModel->canFetchMore(source)) {
+		// Tracks are read from the database instead of building items which aren't displayed
+		tracks->append(_libraryModel->unfetchedTracks(item));
+	} else if (item && item->hasChildren()) {
 		for (int i = 0; i < item->rowCount(); i++) {
 			// Recursive call on children
 			this->findAll(index.child(i, 0), tracks);
@@ -211,9 +218,9 @@ void LibraryTreeView::scrollToLetter(const QString &letter)
 
 void LibraryTreeView::updateSelectedTracks()
 {
-	/// Like the tagEditor, it's easier to proceed with complete clean/rebuild from dabatase
+	// Only tracks which were changed in the database are read again
 	qDebug() << Q_FUNC_INFO;
-	model()->load();
+	model()->applyChanges();
 }
 
 /** Redefined to display a small context menu in the view. */
@@ -285,11 +292,103 @@ void LibraryTreeView::paintEvent(QPaintEvent *event)
 	}
 }
 
+/** Finds an item saved by pathFromIndex(), reading children of top level items if needed. */
+QModelIndex LibraryTreeView::indexFromPath(const QStringList &path) const
+{
+	QStandardItem *item = _libraryModel->invisibleRootItem();
+	for (const QString &key : path) {
+		if (_libraryModel->canFetchMore(item->index())) {
+			_libraryModel->fetchMore(item->index());
+		}
+		QStandardItem *child = nullptr;
+		for (int i = 0; i < item->rowCount() && !child; i++) {
+			QStandardItem *c = item->child(i);
+			if ((c->type() == Miam::IT_Track ? c->data(Miam::DF_URI).toString() : c->text()) == key) {
+				child = c;
+			}
+		}
+		if (!child) {
+			return QModelIndex();
+		}
+		item = child;
+	}
+	return _proxyModel->mapFromSource(item->index());
+}
+
+/** Texts of an item and its parents, or its uri for a track, which are still valid when the model has been reset. */
+QStringList LibraryTreeView::pathFromIndex(const QModelIndex &index) const
+{
+	QStringList path;
+	QStandardItem *item = _libraryModel->itemFromIndex(_proxyModel->mapToSource(index));
+	while (item) {
+		path.prepend(item->type() == Miam::IT_Track ? item->data(Miam::DF_URI).toString() : item->text());
+		item = item->parent();
+	}
+	return path;
+}
+
+void LibraryTreeView::restoreState()
+{
+	// Parents were saved before their children: they're expanded first
+	for (const QStringList &path : _expandedPaths) {
+		QModelIndex index = this->indexFromPath(path);
+		if (index.isValid()) {
+			this->expand(index);
+		}
+	}
+	QItemSelection selection;
+	for (const QStringList &path : _selectedPaths) {
+		QModelIndex index = this->indexFromPath(path);
+		if (index.isValid()) {
+			selection.select(index, index);
+		}
+	}
+	if (!selection.isEmpty()) {
+		this->selectionModel()->select(selection, QItemSelectionModel::ClearAndSelect | QItemSelectionModel::Rows);
+	}
+	if (!_topPath.isEmpty()) {
+		QModelIndex index = this->indexFromPath(_topPath);
+		if (index.isValid()) {
+			this->scrollTo(index, PositionAtTop);
+		}
+	}
+	_expandedPaths.clear();
+	_selectedPaths.clear();
+	_topPath.clear();
+}
+
+void LibraryTreeView::saveExpandedPaths(const QModelIndex &parent)
+{
+	// Children of collapsed items aren't visible, it doesn't matter if they're expanded
+	for (int i = 0; i < _proxyModel->rowCount(parent); i++) {
+		QModelIndex index = _proxyModel->index(i, 0, parent);
+		if (this->isExpanded(index)) {
+			_expandedPaths.append(this->pathFromIndex(index));
+			this->saveExpandedPaths(index);
+		}
+	}
+}
+
+void LibraryTreeView::saveState()
+{
+	_expandedPaths.clear();
+	_selectedPaths.clear();
+	this->saveExpandedPaths(QModelIndex());
+	for (const QModelIndex &index : this->selectionModel()->selectedRows()) {
+		_selectedPaths.append(this->pathFromIndex(index));
+	}
+	QModelIndex top = this->indexAt(this->viewport()->rect().topLeft());
+	_topPath = top.isValid() ? this->pathFromIndex(top) : QStringList();
+}
+
 /** Recursive count for leaves only. */
 int LibraryTreeView::count(const QModelIndex &index) const
 {
-	QStandardItem *item = _libraryModel->itemFromIndex(_proxyModel->mapToSource(index));
-	if (item) {
+	QModelIndex source = _proxyModel->mapToSource(index);
+	QStandardItem *item = _libraryModel->itemFromIndex(source);
+	if (item && _libraryModel->canFetchMore(source)) {
+		return _libraryModel->unfetchedTracks(item).size();
+	} else if (item) {
 		int tmp = 0;
 		for (int i = 0; i < item->rowCount(); i++) {
 			tmp += count(index.child(i, 0));
@@ -330,17 +429,11 @@ void LibraryTreeView::changeSortOrder()
 	}
 }*/
 
-/** Reimplemented. */
+/** Reimplemented to restore expanded items, selection and scroll position. */
 void LibraryTreeView::reset()
 {
-	if (sender() == nullptr) {
-		return;
-	}
-	if (_libraryModel->rowCount() > 0) {
-		_proxyModel->setFilterRegExp(QString());
-		this->verticalScrollBar()->setValue(0);
-	}
-	_libraryModel->reset();
+	TreeView::reset();
+	this->restoreState();
 }
 
 void LibraryTreeView::endPopulateTree()
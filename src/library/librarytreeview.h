@@ -52,6 +52,11 @@ private:
 
 	LibraryItemDelegate *_delegate;
 
+	/** Items saved before the model is reset, restored after. Each item is a path of keys from the root: see pathFromIndex(). */
+	QList<QStringList> _expandedPaths;
+	QList<QStringList> _selectedPaths;
+	QStringList _topPath;
+
 	QTranslator translator;
 
 public:
@@ -92,6 +97,18 @@ private:
 	/** Reimplemented. */
 	virtual int countAll(const QModelIndexList &indexes) const override;
 
+	/** Finds an item saved by pathFromIndex(), reading children of top level items if needed. */
+	QModelIndex indexFromPath(const QStringList &path) const;
+
+	/** Texts of an item and its parents, or its uri for a track, which are still valid when the model has been reset. */
+	QStringList pathFromIndex(const QModelIndex &index) const;
+
+	void restoreState();
+
+	void saveExpandedPaths(const QModelIndex &parent);
+
+	void saveState();
+
 	/** Reimplemented. */
 	virtual void updateSelectedTracks() override;
 
@@ -99,7 +116,7 @@ public slots:
 	/** Invert the current sort order. */
 	void changeSortOrder();
 
-	/** Reimplemented. */
+	/** Reimplemented to restore expanded items, selection and scroll position. */
 	virtual void reset() override;
 
 private slots:
@@ -1,37 +1,105 @@
 #include "miamitemmodel.h"
 #include "albumitem.h"
 
+#include <model/databaseservice.h>
+#include <model/sqldatabase.h>
+#include <normalizer.h>
 #include <settingsprivate.h>
 
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include <QCollator>
+#include <QSet>
+#include <QThread>
+#include <QtConcurrent>
+
 #include <QtDebug>
 
+namespace {
+	/** Above this number of tracks, it's faster to load everything again. */
+	const int maxIncrementalChanges = 1000;
+
+	typedef std::pair<QCollatorSortKey, int> CollationEntry;
+
+	/** Strings sorted by their collation keys, each with its index in the list of strings to sort. */
+	struct CollationRun
+	{
+		int first;
+		int last;
+		std::vector<CollationEntry> entries;
+	};
+
+	bool collatesBefore(const CollationEntry &left, const CollationEntry &right)
+	{
+		return left.first.compare(right.first) < 0;
+	}
+}
+
 MiamItemModel::MiamItemModel(QObject *parent)
 	: QStandardItemModel(parent)
+	, _trackTable(new TrackTable)
+	, _lastChange(-1)
 {}
 
 MiamItemModel::~MiamItemModel()
 {
+	// Tracks are releasing their rows in _trackTable: they're deleted before it
 	this->deleteCache();
+	delete _trackTable;
 }
 
-void MiamItemModel::deleteCache()
+/** Applies changes of the journal of tracks which were made after the last load or update. */
+void MiamItemModel::applyChanges()
 {
-	qDeleteAll(_hash);
-	qDeleteAll(_letters);
-	qDeleteAll(_tracks);
+	qint64 since = _lastChange;
+	RecordReader readRecords = this->recordReader();
+	DatabaseService::instance()->run<TrackChanges>([since, readRecords](SqlDatabase *db) {
+		TrackChanges changes;
+		changes.isIncremental = db->selectTrackChanges(since, changes.uris, changes.lastChange) &&
+				changes.uris.size() <= maxIncrementalChanges;
+		if (changes.isIncremental && !changes.uris.isEmpty()) {
+			readRecords(db, changes);
+		}
+		return changes;
+	}, this, [=](const TrackChanges &changes) {
+		if (!changes.isIncremental) {
+			qDebug() << Q_FUNC_INFO << "journal can't be used, loading everything";
+			this->load();
+		} else if (!changes.uris.isEmpty() && changes.lastChange > _lastChange) {
+			// Tracks which were already updated by a previous call are read again, it doesn't matter
+			if (this->updateTracks(changes)) {
+				_lastChange = changes.lastChange;
+			} else {
+				this->load();
+			}
+		}
+	});
+}
 
+void MiamItemModel::deleteCache()
+{
+	// Items are all owned by this model, they're deleted with their rows
 	_hash.clear();
 	_letters.clear();
 	_topLevelItems.clear();
 	_tracks.clear();
 
 	this->removeRows(0, this->rowCount());
+	_trackTable->clear();
+}
+
+/** Hierarchy of items, which decides how separators are built. */
+SettingsPrivate::InsertPolicy MiamItemModel::insertPolicy() const
+{
+	return SettingsPrivate::instance()->insertPolicy();
 }
 
 SeparatorItem *MiamItemModel::insertSeparator(const QStandardItem *node)
 {
 	// Items are grouped every ten years in this particular case
-	switch (SettingsPrivate::instance()->insertPolicy()) {
+	switch (this->insertPolicy()) {
 	case SettingsPrivate::IP_Years: {
 		int year = node->text().toInt();
 		if (year == 0) {
@@ -51,18 +119,14 @@ SeparatorItem *MiamItemModel::insertSeparator(const QStandardItem *node)
 	}
 	// Other types of hierarchy, separators are built from letters
 	default:
-		QString c;
+		QString letter;
 		if (node->data(Miam::DF_CustomDisplayText).toString().isEmpty()) {
-			c = node->text().left(1).normalized(QString::NormalizationForm_KD).toUpper().remove(QRegExp("[^A-Z\\s]"));
+			letter = Normalizer::separatorLetter(node->text());
 		} else {
-			QString reorderedText = node->data(Miam::DF_CustomDisplayText).toString();
-			c = reorderedText.left(1).normalized(QString::NormalizationForm_KD).toUpper().remove(QRegExp("[^A-Z\\s]"));
+			letter = Normalizer::separatorLetter(node->data(Miam::DF_CustomDisplayText).toString());
 		}
-		QString letter;
 		bool topLevelLetter = false;
-		if (c.contains(QRegExp("\\w"))) {
-			letter = c;
-		} else {
+		if (letter.isEmpty()) {
 			letter = tr("Various");
 			topLevelLetter = true;
 		}
@@ -82,3 +146,113 @@ SeparatorItem *MiamItemModel::insertSeparator(const QStandardItem *node)
 	}
 	return nullptr;
 }
+
+/** Sets DF_SortRank of all items: the position of their DF_NormalizedString in the collation order. */
+void MiamItemModel::updateSortRanks()
+{
+	// Items sharing a string are sharing its rank
+	QList<QStandardItem*> items;
+	QVector<int> itemStrings;
+	QStringList strings;
+	QHash<QString, int> stringIds;
+	std::function<void(QStandardItem*)> appendItems = [&](QStandardItem *item) {
+		QVariant normalizedString = item->data(Miam::DF_NormalizedString);
+		if (normalizedString.isValid()) {
+			QString s = normalizedString.toString();
+			int id = stringIds.value(s, -1);
+			if (id < 0) {
+				id = strings.size();
+				strings.append(s);
+				stringIds.insert(s, id);
+			}
+			items.append(item);
+			itemStrings.append(id);
+		}
+		for (int row = 0; row < item->rowCount(); row++) {
+			for (int column = 0; column < item->columnCount(); column++) {
+				if (QStandardItem *child = item->child(row, column)) {
+					appendItems(child);
+				}
+			}
+		}
+	};
+	appendItems(invisibleRootItem());
+	if (strings.isEmpty()) {
+		return;
+	}
+
+	// Merge sort: each core computes collation keys of a part of strings and sorts them, then parts are merged two by two.
+	// A collator is created for each part, they can't be shared between threads
+	int count = qBound(1, QThread::idealThreadCount(), strings.size());
+	std::vector<CollationRun> runs(count);
+	for (int i = 0; i < count; i++) {
+		runs[i].first = strings.size() * i / count;
+		runs[i].last = strings.size() * (i + 1) / count;
+	}
+	QtConcurrent::blockingMap(runs, [&strings](CollationRun &run) {
+		QCollator collator;
+		run.entries.reserve(run.last - run.first);
+		for (int i = run.first; i < run.last; i++) {
+			run.entries.push_back(CollationEntry(collator.sortKey(strings.at(i)), i));
+		}
+		std::sort(run.entries.begin(), run.entries.end(), collatesBefore);
+	});
+	while (runs.size() > 1) {
+		std::vector<CollationRun> merged((runs.size() + 1) / 2);
+		for (int i = 0; i < static_cast<int>(merged.size()); i++) {
+			merged[i].first = 2 * i;
+			merged[i].last = qMin(2 * i + 2, static_cast<int>(runs.size()));
+		}
+		QtConcurrent::blockingMap(merged, [&runs](CollationRun &run) {
+			const std::vector<CollationEntry> &left = runs.at(run.first).entries;
+			if (run.last - run.first == 1) {
+				run.entries = left;
+			} else {
+				const std::vector<CollationEntry> &right = runs.at(run.first + 1).entries;
+				run.entries.reserve(left.size() + right.size());
+				std::merge(left.begin(), left.end(), right.begin(), right.end(), std::back_inserter(run.entries), collatesBefore);
+			}
+		});
+		runs.swap(merged);
+	}
+
+	// Strings which are equal for the collator have the same rank
+	const std::vector<CollationEntry> &sorted = runs.front().entries;
+	QVector<int> ranks(strings.size());
+	int rank = 0;
+	for (size_t i = 0; i < sorted.size(); i++) {
+		if (i > 0 && sorted.at(i - 1).first.compare(sorted.at(i).first) != 0) {
+			rank++;
+		}
+		ranks[sorted.at(i).second] = rank;
+	}
+
+	// Ranks aren't displayed: views don't need to be notified
+	bool blocked = this->blockSignals(true);
+	for (int i = 0; i < items.size(); i++) {
+		items.at(i)->setData(ranks.at(itemStrings.at(i)), Miam::DF_SortRank);
+	}
+	this->blockSignals(blocked);
+}
+
+/** Removes separators which are not attached to any top level item anymore. */
+void MiamItemModel::removeEmptySeparators()
+{
+	// Separators are never created here: each top level item already has its own
+	QSet<SeparatorItem*> separators;
+	for (int row = 0; row < rowCount(); row++) {
+		QStandardItem *node = item(row);
+		if (node && node->type() != Miam::IT_Separator) {
+			separators.insert(this->insertSeparator(node));
+		}
+	}
+	QMutableHashIterator<QString, SeparatorItem*> it(_letters);
+	while (it.hasNext()) {
+		it.next();
+		if (!separators.contains(it.value())) {
+			_topLevelItems.remove(it.value());
+			removeRow(it.value()->row());
+			it.remove();
+		}
+	}
+}
@@ -3,14 +3,24 @@
 
 #include <QStandardItemModel>
 #include <QSortFilterProxyModel>
+#include <QSqlRecord>
+
+#include <functional>
+
+#include <settingsprivate.h>
 #include "separatoritem.h"
 #include "trackitem.h"
+#include "tracktable.h"
 
 #include "miamlibrary_global.hpp"
 
+/// Forward declarations
+class SqlDatabase;
+
 /**
  * \brief		The MiamItemModel class
- * \details
+ * \details		Items are still QStandardItems, because views, delegates and proxies are using itemFromIndex() and types of items.
+ *				Values of tracks, which are most of the items, are rows of a TrackTable instead of roles of each item.
  * \author      Matthieu Bachelier
  * \copyright   GNU General Public License v3
  */
@@ -29,7 +39,35 @@ protected:
 
 	QHash<QString, TrackItem*> _tracks;
 
+	/** Values of all tracks in this model, instead of roles stored by each item. Tracks are keeping a pointer to it. */
+	TrackTable *_trackTable;
+
+	/** Last change of the journal of tracks which is already in this model. */
+	qint64 _lastChange;
+
 public:
+	/** Changes of the journal of tracks, with records which were read in the database thread to apply them. */
+	struct TrackChanges
+	{
+		/** False when the journal can't be used, and the whole model has to be loaded. */
+		bool isIncremental;
+
+		qint64 lastChange;
+
+		QStringList uris;
+
+		/** Tracks which still exist, by uri. */
+		QHash<QString, QSqlRecord> tracks;
+
+		/** Items which tracks are attached to, by key, when a model needs them. */
+		QHash<QString, QSqlRecord> groups;
+
+		TrackChanges() : isIncremental(false), lastChange(-1) {}
+	};
+
+	/** Reads records of changes in the database thread. It can't use the model, which may have been deleted meanwhile. */
+	typedef std::function<void(SqlDatabase*, TrackChanges &)> RecordReader;
+
 	explicit MiamItemModel(QObject *parent = nullptr);
 
 	virtual ~MiamItemModel();
@@ -38,14 +76,41 @@ public:
 
 	inline QStandardItem* letterItem(const QString &letter) const { return _letters.value(letter); }
 
+	/** Reads items in the database thread, then replaces items of this model and emits loaded(). */
 	virtual void load(const QString & = QString::null) = 0;
 
 	virtual QSortFilterProxyModel* proxy() const = 0;
 
+	/** Values of tracks, and an estimate of the memory they're using. */
+	inline const TrackTable* trackTable() const { return _trackTable; }
+
+signals:
+	/** Items read by load() have replaced the previous ones. */
+	void loaded();
+
+public slots:
+	/** Applies changes of the journal of tracks which were made after the last load or update. */
+	virtual void applyChanges();
+
 protected:
 	void deleteCache();
 
+	/** Hierarchy of items, which decides how separators are built. */
+	virtual SettingsPrivate::InsertPolicy insertPolicy() const;
+
 	SeparatorItem *insertSeparator(const QStandardItem *node);
+
+	/** Removes separators which are not attached to any top level item anymore. */
+	void removeEmptySeparators();
+
+	/** Sets DF_SortRank of all items: the position of their DF_NormalizedString in the collation order. */
+	void updateSortRanks();
+
+	/** Function which reads records of changed tracks, and records which updateTracks() needs with them. */
+	virtual RecordReader recordReader() const = 0;
+
+	/** Updates tracks with records of changes. Returns false when it's not possible, and the whole model has to be loaded. */
+	virtual bool updateTracks(const TrackChanges &changes) = 0;
 };
 
 #endif // MIAMITEMMODEL_H
@@ -1,11 +1,43 @@
 #include "trackitem.h"
 #include "miamcore_global.h"
+#include "tracktable.h"
 
-TrackItem::TrackItem()
+TrackItem::TrackItem(TrackTable *table)
+	: QStandardItem()
+	, _table(table)
+	, _row(table->append())
 {
 
 }
 
+TrackItem::~TrackItem()
+{
+	_table->remove(_row);
+}
+
+QVariant TrackItem::data(int role) const
+{
+	if (TrackTable::hasRole(role)) {
+		return _table->value(_row, role);
+	}
+	return QStandardItem::data(role);
+}
+
+void TrackItem::setData(const QVariant &value, int role)
+{
+	if (!TrackTable::hasRole(role)) {
+		QStandardItem::setData(value, role);
+	} else if (_table->setValue(_row, role, value)) {
+		this->emitDataChanged();
+	}
+}
+
+/** Key which orders tracks by disc, then local before remote, then by track number. */
+qint64 TrackItem::sortKey() const
+{
+	return _table->sortKey(_row);
+}
+
 int TrackItem::type() const
 {
 	return Miam::IT_Track;
@@ -4,17 +4,35 @@
 #include <QStandardItem>
 #include "miamlibrary_global.hpp"
 
+class TrackTable;
+
 /**
  * \brief		The TrackItem class
+ * \details		Values of a track are stored in a row of a TrackTable owned by its model, only other roles (like highlighting)
+ *				are stored in the item itself.
  * \author      Matthieu Bachelier
  * \copyright   GNU General Public License v3
  */
 class MIAMLIBRARY_LIBRARY TrackItem : public QStandardItem
 {
+private:
+	TrackTable *_table;
+	int _row;
+
 public:
-	explicit TrackItem();
+	explicit TrackItem(TrackTable *table);
+
+	virtual ~TrackItem();
+
+	virtual QVariant data(int role = Qt::UserRole + 1) const override;
+
+	virtual void setData(const QVariant &value, int role = Qt::UserRole + 1) override;
+
+	/** Key which orders tracks by disc, then local before remote, then by track number. */
+	qint64 sortKey() const;
 
-	virtual ~TrackItem() {}
+	/** Row of this track in its TrackTable. */
+	inline int tableRow() const { return _row; }
 
 	virtual int type() const override;
 };
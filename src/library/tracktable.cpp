@@ -0,0 +1,313 @@
+#include "tracktable.h"
+#include "miamcore_global.h"
+
+#include <limits>
+
+namespace {
+	/** Size of a string on the heap, not counting the QString itself. */
+	qint64 stringBytes(const QString &s)
+	{
+		return s.isNull() ? 0 : sizeof(QArrayData) + (s.capacity() + 1) * sizeof(QChar);
+	}
+
+	template<typename T>
+	qint64 vectorBytes(const QVector<T> &v)
+	{
+		return sizeof(QArrayData) + v.capacity() * sizeof(T);
+	}
+
+	/** Same layout as the private class QStandardItemData: one per role of an item. */
+	struct RoleData
+	{
+		int role;
+		QVariant value;
+	};
+}
+
+const int TrackTable::noRating = std::numeric_limits<int>::min();
+
+/** Returns true if values of this role are stored in a column of this table. */
+bool TrackTable::hasRole(int role)
+{
+	switch (role) {
+	case Qt::DisplayRole:
+	case Qt::EditRole:
+	case Miam::DF_URI:
+	case Miam::DF_NormalizedString:
+	case Miam::DF_Artist:
+	case Miam::DF_Album:
+	case Miam::DF_TrackNumber:
+	case Miam::DF_DiscNumber:
+	case Miam::DF_TrackLength:
+	case Miam::DF_Rating:
+	case Miam::DF_IsRemote:
+	case Miam::DF_SortRank:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/** Returns the index of an empty row. */
+int TrackTable::append()
+{
+	if (!_freeRows.isEmpty()) {
+		int row = _freeRows.takeLast();
+		_used.setBit(row);
+		return row;
+	}
+	int row = _titles.size();
+	_titles.append(QString());
+	_uris.append(QString());
+	_normalizedStrings.append(QString());
+	_artists.append(-1);
+	_albums.append(-1);
+	_trackNumbers.append(-1);
+	_discNumbers.append(-1);
+	_lengths.append(0);
+	_ratings.append(noRating);
+	_sortRanks.append(-1);
+	_sortKeys.append(0);
+	_remote.resize(row + 1);
+	_used.resize(row + 1);
+	_used.setBit(row);
+	return row;
+}
+
+void TrackTable::clear()
+{
+	_titles.clear();
+	_uris.clear();
+	_normalizedStrings.clear();
+	_artists.clear();
+	_albums.clear();
+	_trackNumbers.clear();
+	_discNumbers.clear();
+	_lengths.clear();
+	_ratings.clear();
+	_sortRanks.clear();
+	_sortKeys.clear();
+	_remote.clear();
+	_used.clear();
+	_freeRows.clear();
+	_strings.clear();
+	_stringIds.clear();
+}
+
+/** Estimated size in bytes of this table. */
+qint64 TrackTable::memoryUsage() const
+{
+	qint64 bytes = vectorBytes(_titles) + vectorBytes(_uris) + vectorBytes(_normalizedStrings) + vectorBytes(_artists) +
+			vectorBytes(_albums) + vectorBytes(_trackNumbers) + vectorBytes(_discNumbers) + vectorBytes(_lengths) +
+			vectorBytes(_ratings) + vectorBytes(_freeRows) + vectorBytes(_strings) + (_remote.size() + _used.size()) / 8;
+	for (int row = 0; row < _titles.size(); row++) {
+		bytes += stringBytes(_titles.at(row)) + stringBytes(_uris.at(row)) + stringBytes(_normalizedStrings.at(row));
+	}
+	for (const QString &s : _strings) {
+		bytes += stringBytes(s);
+	}
+	// Keys of the hash are sharing their data with _strings
+	bytes += _stringIds.capacity() * sizeof(void*) + _stringIds.size() * (2 * sizeof(void*) + sizeof(QString) + sizeof(int));
+	return bytes;
+}
+
+/** Releases a row, which can be reused by the next track. */
+void TrackTable::remove(int row)
+{
+	_titles[row].clear();
+	_uris[row].clear();
+	_normalizedStrings[row].clear();
+	_artists[row] = -1;
+	_albums[row] = -1;
+	_trackNumbers[row] = -1;
+	_discNumbers[row] = -1;
+	_lengths[row] = 0;
+	_ratings[row] = noRating;
+	_sortRanks[row] = -1;
+	_sortKeys[row] = 0;
+	_remote.clearBit(row);
+	_used.clearBit(row);
+	_freeRows.append(row);
+}
+
+/** Number of tracks in this table. */
+int TrackTable::rowCount() const
+{
+	return _titles.size() - _freeRows.size();
+}
+
+/** Sets a value in a row. Returns true if the value has changed. */
+bool TrackTable::setValue(int row, int role, const QVariant &value)
+{
+	auto setString = [&value](QString &s) -> bool {
+		QString v = value.toString();
+		if (s == v && s.isNull() == v.isNull()) {
+			return false;
+		}
+		s = v;
+		return true;
+	};
+	auto setInterned = [this, &value](int &id) -> bool {
+		int v = value.isValid() ? this->intern(value.toString()) : -1;
+		if (id == v) {
+			return false;
+		}
+		id = v;
+		return true;
+	};
+
+	switch (role) {
+	case Qt::DisplayRole:
+	case Qt::EditRole:
+		return setString(_titles[row]);
+	case Miam::DF_URI:
+		return setString(_uris[row]);
+	case Miam::DF_NormalizedString:
+		if (!setString(_normalizedStrings[row])) {
+			return false;
+		}
+		// The rank of the previous string isn't valid anymore
+		_sortRanks[row] = -1;
+		return true;
+	case Miam::DF_Artist:
+		return setInterned(_artists[row]);
+	case Miam::DF_Album:
+		return setInterned(_albums[row]);
+	case Miam::DF_TrackNumber:
+		if (!setInterned(_trackNumbers[row])) {
+			return false;
+		}
+		this->updateSortKey(row);
+		return true;
+	case Miam::DF_DiscNumber:
+		if (!setInterned(_discNumbers[row])) {
+			return false;
+		}
+		this->updateSortKey(row);
+		return true;
+	case Miam::DF_TrackLength: {
+		uint length = value.toUInt();
+		if (_lengths.at(row) == length) {
+			return false;
+		}
+		_lengths[row] = length;
+		return true;
+	}
+	case Miam::DF_Rating: {
+		int rating = value.isNull() ? noRating : value.toInt();
+		if (_ratings.at(row) == rating) {
+			return false;
+		}
+		_ratings[row] = rating;
+		return true;
+	}
+	case Miam::DF_IsRemote: {
+		bool remote = value.toBool();
+		if (_remote.testBit(row) == remote) {
+			return false;
+		}
+		_remote.setBit(row, remote);
+		this->updateSortKey(row);
+		return true;
+	}
+	case Miam::DF_SortRank: {
+		int rank = value.isValid() ? value.toInt() : -1;
+		if (_sortRanks.at(row) == rank) {
+			return false;
+		}
+		_sortRanks[row] = rank;
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+/** Returns the value of a row, like QStandardItem::data() would return it. */
+QVariant TrackTable::value(int row, int role) const
+{
+	auto string = [](const QString &s) -> QVariant {
+		return s.isNull() ? QVariant() : QVariant(s);
+	};
+
+	switch (role) {
+	case Qt::DisplayRole:
+	case Qt::EditRole:
+		return string(_titles.at(row));
+	case Miam::DF_URI:
+		return string(_uris.at(row));
+	case Miam::DF_NormalizedString:
+		return string(_normalizedStrings.at(row));
+	case Miam::DF_Artist:
+		return interned(_artists.at(row));
+	case Miam::DF_Album:
+		return interned(_albums.at(row));
+	case Miam::DF_TrackNumber:
+		return interned(_trackNumbers.at(row));
+	case Miam::DF_DiscNumber:
+		return interned(_discNumbers.at(row));
+	case Miam::DF_TrackLength:
+		return _lengths.at(row);
+	case Miam::DF_Rating:
+		return _ratings.at(row) == noRating ? QVariant() : QVariant(_ratings.at(row));
+	case Miam::DF_IsRemote:
+		return _remote.testBit(row);
+	case Miam::DF_SortRank:
+		return _sortRanks.at(row) < 0 ? QVariant() : QVariant(_sortRanks.at(row));
+	default:
+		return QVariant();
+	}
+}
+
+/** Estimated size in bytes of the same values, stored as roles of QStandardItem. */
+qint64 TrackTable::variantMemoryUsage() const
+{
+	// Each string was a copy read from the database: nothing was shared between items
+	qint64 bytes = 0;
+	for (int row = 0; row < _titles.size(); row++) {
+		if (!_used.testBit(row)) {
+			continue;
+		}
+		// Title, uri, length and remote flag are always set
+		int roles = 4;
+		bytes += stringBytes(_titles.at(row)) + stringBytes(_uris.at(row)) + stringBytes(_normalizedStrings.at(row));
+		for (int id : { _artists.at(row), _albums.at(row), _trackNumbers.at(row), _discNumbers.at(row) }) {
+			if (id >= 0) {
+				bytes += stringBytes(_strings.at(id));
+				roles++;
+			}
+		}
+		if (_ratings.at(row) != noRating) {
+			roles++;
+		}
+		if (_sortRanks.at(row) >= 0) {
+			roles++;
+		}
+		if (!_normalizedStrings.at(row).isNull()) {
+			roles++;
+		}
+		bytes += roles * sizeof(RoleData);
+	}
+	return bytes;
+}
+
+int TrackTable::intern(const QString &s)
+{
+	auto it = _stringIds.constFind(s);
+	if (it != _stringIds.constEnd()) {
+		return it.value();
+	}
+	int id = _strings.size();
+	_strings.append(s);
+	_stringIds.insert(s, id);
+	return id;
+}
+
+void TrackTable::updateSortKey(int row)
+{
+	// Same integers as QVariant::toInt() on strings, an empty number is 0. The sign bit of track numbers is flipped to keep
+	// their order once unsigned
+	int disc = _discNumbers.at(row) < 0 ? 0 : _strings.at(_discNumbers.at(row)).toInt();
+	int trackNumber = _trackNumbers.at(row) < 0 ? 0 : _strings.at(_trackNumbers.at(row)).toInt();
+	_sortKeys[row] = qint64(disc) * (Q_INT64_C(1) << 33) + (qint64(_remote.testBit(row)) << 32) + (quint32(trackNumber) ^ 0x80000000u);
+}
@@ -0,0 +1,92 @@
+#ifndef TRACKTABLE_H
+#define TRACKTABLE_H
+
+#include <QBitArray>
+#include <QHash>
+#include <QVariant>
+#include <QVector>
+
+#include "miamlibrary_global.hpp"
+
+/**
+ * \brief		The TrackTable class stores values of tracks displayed in a library model, one column per role.
+ * \details		A QStandardItem keeps each role in its own QVariant, and every string read from the database is a new copy. With
+ *				hundreds of thousands of tracks, this is most of the memory used by a library model. Tracks are rows of this table
+ *				instead: titles and uris are kept once, names of artists and albums, track and disc numbers are interned and stored
+ *				as integers, lengths, ratings and flags are plain arrays. Rows of deleted tracks are reused by the next ones.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+class MIAMLIBRARY_LIBRARY TrackTable
+{
+private:
+	QVector<QString> _titles;
+	QVector<QString> _uris;
+	QVector<QString> _normalizedStrings;
+
+	/** Indexes in _strings, or -1 when there's no value. */
+	QVector<int> _artists;
+	QVector<int> _albums;
+	QVector<int> _trackNumbers;
+	QVector<int> _discNumbers;
+
+	QVector<uint> _lengths;
+
+	/** Tracks without rating are noRating. */
+	QVector<int> _ratings;
+
+	/** Position of normalized strings in the collation order, or -1 when it isn't known. */
+	QVector<int> _sortRanks;
+
+	/** Disc number, remote flag and track number packed in one integer: see sortKey(). */
+	QVector<qint64> _sortKeys;
+
+	QBitArray _remote;
+	QBitArray _used;
+	QVector<int> _freeRows;
+
+	/** Interned strings. They're kept until the table is cleared, even if no track is using them anymore. */
+	QVector<QString> _strings;
+	QHash<QString, int> _stringIds;
+
+	static const int noRating;
+
+public:
+	/** Returns true if values of this role are stored in a column of this table. */
+	static bool hasRole(int role);
+
+	/** Returns the index of an empty row. */
+	int append();
+
+	void clear();
+
+	/** Estimated size in bytes of this table. */
+	qint64 memoryUsage() const;
+
+	/** Releases a row, which can be reused by the next track. */
+	void remove(int row);
+
+	/** Number of tracks in this table. */
+	int rowCount() const;
+
+	/** Sets a value in a row. Returns true if the value has changed. */
+	bool setValue(int row, int role, const QVariant &value);
+
+	/** Key which orders tracks by disc, then local before remote, then by track number. The disc number is sortKey() >> 33. */
+	inline qint64 sortKey(int row) const { return _sortKeys.at(row); }
+
+	/** Returns the value of a row, like QStandardItem::data() would return it. */
+	QVariant value(int row, int role) const;
+
+	/** Estimated size in bytes of the same values, stored as roles of QStandardItem. */
+	qint64 variantMemoryUsage() const;
+
+private:
+	int intern(const QString &s);
+
+	void updateSortKey(int row);
+
+	inline QVariant interned(int id) const { return id < 0 ? QVariant() : QVariant(_strings.at(id)); }
+};
+
+#endif // TRACKTABLE_H
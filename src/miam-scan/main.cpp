@@ -0,0 +1,110 @@
+#include <musicsearchengine.h>
+#include <settingsprivate.h>
+#include <model/schemamigration.h>
+#include <model/sqldatabase.h>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QSqlQuery>
+#include <QTextStream>
+
+#include <csignal>
+
+/** Engine of the running scan, stopped by SIGINT and SIGTERM. */
+static MusicSearchEngine *runningEngine = nullptr;
+
+/** Only sets an atomic flag, which is safe in a signal handler. Files committed so far are kept for the next scan. */
+static void cancelScan(int)
+{
+	if (runningEngine) {
+		runningEngine->cancel();
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	// No display is needed: the database and settings are the same as the player's ones
+	QCoreApplication app(argc, argv);
+	QCoreApplication::setApplicationName("miam-scan");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Builds or refreshes the library of Miam-Player without starting it.");
+	parser.addHelpOption();
+	parser.addPositionalArgument("locations", "Directories to scan, which are added to the library of the player. "
+											  "When none is given, locations of the player are scanned.", "[locations...]");
+	QCommandLineOption fullOption(QStringList() << "f" << "full", "Reads every file again, instead of new or modified files only.");
+	QCommandLineOption threadsOption(QStringList() << "t" << "threads", "Number of threads reading tags for each device.", "count");
+	QCommandLineOption quietOption(QStringList() << "q" << "quiet", "Prints nothing but errors.");
+	parser.addOption(fullOption);
+	parser.addOption(threadsOption);
+	parser.addOption(quietOption);
+	parser.process(app);
+
+	QTextStream out(stdout);
+	QTextStream err(stderr);
+
+	MusicSearchEngine engine;
+	if (parser.isSet(threadsOption)) {
+		bool ok = false;
+		int threads = parser.value(threadsOption).toInt(&ok);
+		if (!ok || threads < 1) {
+			err << "Invalid number of threads: " << parser.value(threadsOption) << endl;
+			return 1;
+		}
+		engine.setWorkerCount(threads);
+	}
+
+	// Locations of the player are not modified
+	QStringList locations;
+	for (QString location : parser.positionalArguments()) {
+		QDir dir(location);
+		if (!dir.exists()) {
+			err << "Location doesn't exist: " << location << endl;
+			return 1;
+		}
+		locations << dir.absolutePath();
+	}
+	engine.setLocations(locations);
+	if (locations.isEmpty() && SettingsPrivate::instance()->musicLocations().isEmpty()) {
+		err << "No music location to scan" << endl;
+		return 1;
+	}
+
+	// The player isn't there to apply long steps in background
+	SchemaMigration migration;
+	if (!migration.upgrade(*SqlDatabase::instance())) {
+		err << "The database can't be upgraded" << endl;
+		return 1;
+	}
+
+	bool isQuiet = parser.isSet(quietOption);
+	if (!isQuiet) {
+		QObject::connect(&engine, &MusicSearchEngine::progressChanged, [&out](int percent) {
+			out << "\r" << percent << "%" << flush;
+		});
+	}
+
+	runningEngine = &engine;
+	std::signal(SIGINT, cancelScan);
+	std::signal(SIGTERM, cancelScan);
+
+	engine.setScanMode(parser.isSet(fullOption) ? MusicSearchEngine::SM_Full : MusicSearchEngine::SM_Incremental);
+	QElapsedTimer timer;
+	timer.start();
+	engine.doSearch();
+	qint64 elapsed = qMax<qint64>(1, timer.elapsed());
+	runningEngine = nullptr;
+
+	if (!isQuiet) {
+		QSqlQuery q(*SqlDatabase::instance());
+		int trackCount = q.exec("SELECT COUNT(*) FROM tracks") && q.next() ? q.value(0).toInt() : 0;
+		out << "\r" << (engine.isCancelled() ? "Scan cancelled, it will be resumed next time" : "Scan complete") << endl;
+		out << "  entries walked: " << engine.lastEntryCount() << " (" << engine.lastEntryCount() * 1000LL / elapsed << "/s)" << endl;
+		out << "  files read:     " << engine.lastReadCount() << " (" << engine.lastReadCount() * 1000LL / elapsed << "/s)" << endl;
+		out << "  tracks:         " << trackCount << endl;
+		out << "  time:           " << QString::number(elapsed / 1000.0, 'f', 2) << " s" << endl;
+	}
+	return engine.isCancelled() ? 2 : 0;
+}
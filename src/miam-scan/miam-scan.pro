@@ -0,0 +1,48 @@
+# No window is created, but headers of miam-core like settingsprivate.h are including QtWidgets
+QT += sql multimedia widgets
+
+TEMPLATE = app
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+SOURCES += main.cpp
+
+TARGET = miam-scan
+
+CONFIG(debug, debug|release) {
+    win32 {
+        LIBS += -L$$PWD/../../lib/debug/win-x64/ -ltag
+        LIBS += -L$$OUT_PWD/../core/debug/ -lmiam-core
+    }
+    OBJECTS_DIR = debug/.obj
+    MOC_DIR = debug/.moc
+    RCC_DIR = debug/.rcc
+}
+
+CONFIG(release, debug|release) {
+    win32 {
+        LIBS += -L$$PWD/../../lib/release/win-x64/ -ltag
+        LIBS += -L$$OUT_PWD/../core/release/ -lmiam-core
+    }
+    OBJECTS_DIR = release/.obj
+    MOC_DIR = release/.moc
+    RCC_DIR = release/.rcc
+}
+unix {
+    LIBS += -L$$OUT_PWD/../core/ -lmiam-core
+}
+unix:!macx {
+    target.path = /usr/bin
+    INSTALLS += target
+}
+macx {
+    LIBS += -L$$PWD/../../lib/osx/ -ltag
+}
+
+3rdpartyDir  = $$PWD/../core/3rdparty
+INCLUDEPATH += $$3rdpartyDir
+DEPENDPATH += $$3rdpartyDir
+
+INCLUDEPATH += $$PWD/../core
+DEPENDPATH += $$PWD/../core
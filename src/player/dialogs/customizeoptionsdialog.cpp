@@ -1,6 +1,6 @@
 #include "customizeoptionsdialog.h"
 
-#include <model/sqldatabase.h>
+#include <model/databaseservice.h>
 #include <flowlayout.h>
 #include <musicsearchengine.h>
 #include <settings.h>
@@ -533,22 +533,23 @@ void CustomizeOptionsDialog::updateMusicLocations(bool immediateRescan)
 				removedLocations << savedLocation;
 			}
 		}
-		SqlDatabase db;
-
-		// Remove old locations from database cache
-		db.transaction();
-		for (QString removedLocation : removedLocations) {
-			QSqlQuery syncDb(db);
-			syncDb.setForwardOnly(true);
-			syncDb.prepare("DELETE FROM cache WHERE uri LIKE :path ");
-			syncDb.bindValue(":path", QDir::fromNativeSeparators(removedLocation) + "%");
-			syncDb.exec();
-		}
-		db.commit();
-
-		if (immediateRescan) {
-			settings->setMusicLocations(newLocations);
-			settings->sync();
-		}
+		// Remove old locations from database cache, before a scan is started
+		DatabaseService::instance()->run<bool>([removedLocations](SqlDatabase *db) {
+			db->transaction();
+			for (QString removedLocation : removedLocations) {
+				QSqlQuery syncDb(*db);
+				syncDb.setForwardOnly(true);
+				syncDb.prepare("DELETE FROM tracks WHERE uri LIKE :path ");
+				syncDb.bindValue(":path", QDir::fromNativeSeparators(removedLocation) + "%");
+				syncDb.exec();
+			}
+			db->removeOrphans();
+			return db->commit();
+		}, settings, [=](const bool &) {
+			if (immediateRescan) {
+				settings->setMusicLocations(newLocations);
+				settings->sync();
+			}
+		});
 	}
 }
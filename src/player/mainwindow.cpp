@@ -3,6 +3,9 @@
 #include <mediabuttons/mediabutton.h>
 #include <abstractviewplaylists.h>
 #include <musicsearchengine.h>
+#include <model/databaseservice.h>
+#include <model/schemamigration.h>
+#include <model/sqldatabase.h>
 #include <quickstart.h>
 #include <settings.h>
 #include <settingsprivate.h>
@@ -32,6 +35,10 @@ MainWindow::MainWindow(QWidget *parent)
 	, _shortcutStop(new QxtGlobalShortcut(QKeySequence(Qt::Key_MediaStop), this))
 	, _shortcutPlayPause(new QxtGlobalShortcut(QKeySequence(Qt::Key_MediaPlay), this))
 	, _shortcutSkipForward(new QxtGlobalShortcut(QKeySequence(Qt::Key_MediaNext), this))
+	, _watcherThread(nullptr)
+	, _migrationThread(nullptr)
+	, _scanThread(nullptr)
+	, _scanWorker(nullptr)
 {
 	setupUi(this);
 	actionPlay->setIcon(style()->standardIcon(QStyle::SP_MediaPlay));
@@ -197,6 +204,13 @@ void MainWindow::setupActions()
 	connect(actionScanLibrary, &QAction::triggered, this, [=]() {
 		this->syncLibrary(QStringList(), settingsPrivate->musicLocations());
 	});
+	connect(actionCancelScan, &QAction::triggered, this, [=]() {
+		// Called directly: the thread of the worker is busy until the end of the scan
+		if (_scanWorker) {
+			_scanWorker->cancel();
+			actionCancelScan->setEnabled(false);
+		}
+	});
 	connect(actionShowHelp, &QAction::triggered, this, [=]() {
 		QDesktopServices::openUrl(QUrl("http://miam-player.org/wiki/index.php"));
 	});
@@ -212,23 +226,7 @@ void MainWindow::setupActions()
 
 	connect(actionMute, &QAction::triggered, _mediaPlayer, &MediaPlayer::toggleMute);
 
-	connect(settingsPrivate, &SettingsPrivate::monitorFileSystemChanged, this, [=](bool b) {
-		if (b) {
-			MusicSearchEngine *worker = new MusicSearchEngine;
-			QThread *thread = new QThread;
-			worker->moveToThread(thread);
-			connect(thread, &QThread::started, worker, &MusicSearchEngine::watchForChanges);
-			connect(thread, &QThread::finished, thread, &QThread::deleteLater);
-			thread->start();
-
-			if (_currentView && _currentView->viewProperty(Settings::VP_HasAreaForRescan)) {
-				_currentView->setMusicSearchEngine(worker);
-			}
-			qDebug() << Q_FUNC_INFO << "create new instance of file system watcher";
-		} else {
-			qDebug() << Q_FUNC_INFO << "delete any instance of file system watcher";
-		}
-	});
+	connect(settingsPrivate, &SettingsPrivate::monitorFileSystemChanged, this, &MainWindow::monitorFileSystem);
 
 	connect(settingsPrivate, &SettingsPrivate::fontHasChanged, this, [=](SettingsPrivate::FontFamily ff) {
 		if (ff == SettingsPrivate::FF_Menu) {
@@ -249,6 +247,19 @@ void MainWindow::setupActions()
 			_remoteControl->deleteLater();
 		}
 	});
+
+	// New locations have to be watched
+	connect(settingsPrivate, &SettingsPrivate::musicLocationsHaveChanged, this, [=]() {
+		if (settingsPrivate->isFileSystemMonitored()) {
+			this->monitorFileSystem(false);
+			this->monitorFileSystem(true);
+		}
+	});
+	if (settingsPrivate->isFileSystemMonitored()) {
+		this->monitorFileSystem(true);
+	}
+
+	this->upgradeDatabase();
 }
 
 /** Update fonts for menu and context menus. */
@@ -281,6 +292,19 @@ void MainWindow::changeEvent(QEvent *event)
 
 void MainWindow::closeEvent(QCloseEvent *)
 {
+	this->monitorFileSystem(false);
+	if (_scanWorker) {
+		// Files read so far are committed, the rest of the scan is resumed on next launch
+		_scanWorker->cancel();
+		_scanThread->quit();
+		_scanThread->wait();
+	}
+	if (_migrationThread) {
+		// Otherwise the current step would be rolled back and started again on next launch
+		qDebug() << Q_FUNC_INFO << "waiting for the end of the schema upgrade";
+		_migrationThread->quit();
+		_migrationThread->wait();
+	}
 	auto settingsPrivate = SettingsPrivate::instance();
 	if (_currentView && _currentView->viewProperty(Settings::VP_PlaylistFeature) && settingsPrivate->playbackKeepPlaylists()) {
 		if (AbstractViewPlaylists *v = static_cast<AbstractViewPlaylists*>(_currentView)) {
@@ -362,6 +386,91 @@ bool MainWindow::eventFilter(QObject *watched, QEvent *event)
 	return QMainWindow::eventFilter(watched, event);
 }
 
+/** Starts or stops the thread which keeps the library in sync with the filesystem. */
+void MainWindow::monitorFileSystem(bool enabled)
+{
+	if (enabled && !_watcherThread) {
+		MusicSearchEngine *watcher = new MusicSearchEngine;
+		_watcherThread = new QThread(this);
+		watcher->moveToThread(_watcherThread);
+		connect(_watcherThread, &QThread::started, watcher, &MusicSearchEngine::watchForChanges);
+		connect(_watcherThread, &QThread::finished, watcher, &QObject::deleteLater);
+
+		// Only changes are sent to the current view, instead of reloading the whole library
+		connect(watcher, &MusicSearchEngine::tracksHaveChanged, this, [=](const QStringList &updatedTracks, const QStringList &removedTracks) {
+			if (_currentView) {
+				_currentView->updateModel(updatedTracks, removedTracks);
+			}
+		});
+		_watcherThread->start();
+		qDebug() << Q_FUNC_INFO << "create new instance of file system watcher";
+	} else if (!enabled && _watcherThread) {
+		_watcherThread->quit();
+		_watcherThread->wait();
+		_watcherThread->deleteLater();
+		_watcherThread = nullptr;
+		qDebug() << Q_FUNC_INFO << "delete any instance of file system watcher";
+	}
+}
+
+/** Applies long steps of the schema migration (like indexes) in background, if they're missing. */
+void MainWindow::upgradeDatabase()
+{
+	DatabaseService::instance()->run<int>([](SqlDatabase *db) {
+		return SchemaMigration::version(*db);
+	}, this, [=](const int &version) {
+		if (version >= SchemaMigration::latestVersion()) {
+			this->resumeInterruptedScan();
+			return;
+		}
+
+		// The library can be browsed meanwhile, but a scan would have to wait for the write lock
+		SchemaMigration *migration = new SchemaMigration;
+		_migrationThread = new QThread(this);
+		migration->moveToThread(_migrationThread);
+		connect(_migrationThread, &QThread::started, migration, &SchemaMigration::upgradeInBackground);
+		connect(_migrationThread, &QThread::finished, migration, &QObject::deleteLater);
+		connect(migration, &SchemaMigration::progressChanged, this, [=](int percent, const QString &description) {
+			qDebug() << Q_FUNC_INFO << percent << description;
+			actionScanLibrary->setStatusTip(tr("Upgrading library (%1%)").arg(percent));
+		});
+		connect(migration, &SchemaMigration::upgradeHasEnded, this, [=](bool success) {
+			qDebug() << Q_FUNC_INFO << "schema upgrade has ended, success:" << success;
+			_migrationThread->quit();
+			_migrationThread->wait();
+			_migrationThread->deleteLater();
+			_migrationThread = nullptr;
+			actionScanLibrary->setStatusTip(QString());
+			actionScanLibrary->setEnabled(!SettingsPrivate::instance()->musicLocations().isEmpty());
+			if (success) {
+				this->resumeInterruptedScan();
+			}
+		});
+		actionScanLibrary->setEnabled(false);
+		_migrationThread->start();
+	});
+}
+
+/** Starts again a scan which was cancelled, or which was running when the player was closed. */
+void MainWindow::resumeInterruptedScan()
+{
+	DatabaseService::instance()->run<bool>([](SqlDatabase *db) {
+		QStringList roots;
+		QString lastDirectory;
+		int committedFiles = 0;
+		bool isInterrupted = db->selectScanCursor(roots, lastDirectory, committedFiles);
+		if (isInterrupted) {
+			qDebug() << Q_FUNC_INFO << "scan was interrupted after" << committedFiles << "files, in" << lastDirectory;
+		}
+		return isInterrupted;
+	}, this, [=](const bool &isInterrupted) {
+		QStringList locations = SettingsPrivate::instance()->musicLocations();
+		if (isInterrupted && !_scanWorker && !locations.isEmpty()) {
+			this->syncLibrary(QStringList(), locations);
+		}
+	});
+}
+
 void MainWindow::initQuickStart()
 {
 	// Clean any existing view first
@@ -746,7 +855,7 @@ void MainWindow::switchToMiniPlayer()
 	}
 }
 
-void MainWindow::syncLibrary(const QStringList &oldLocations, const QStringList &newLocations)
+void MainWindow::syncLibrary(const QStringList &, const QStringList &newLocations)
 {
 	if (!_currentView) {
 		this->activateLastView();
@@ -756,23 +865,11 @@ void MainWindow::syncLibrary(const QStringList &oldLocations, const QStringList
 		return;
 	}
 
-	bool same = true;
-	if (oldLocations.size() == newLocations.size()) {
-		for (int i = 0; i < newLocations.size(); i++) {
-			same = same && QString::compare(newLocations.at(i), oldLocations.at(i)) == 0;
-		}
-
-	} else {
-		same = false;
-	}
-
-	if (!same) {
-		SqlDatabase db;
-		db.reset();
-	}
-
+	// No need to reset the library, even if locations have changed: files which are not in new locations are going to be
+	// removed, and only new or modified files are going to be read
 	QThread *thread = new QThread;
 	MusicSearchEngine *worker = new MusicSearchEngine;
+	worker->setScanMode(MusicSearchEngine::SM_Incremental);
 	if (_currentView->viewProperty(Settings::VP_HasAreaForRescan)) {
 		_currentView->setMusicSearchEngine(worker);
 	}
@@ -787,17 +884,25 @@ void MainWindow::syncLibrary(const QStringList &oldLocations, const QStringList
 	connect(worker, &MusicSearchEngine::aboutToSearch, this, [=]() {
 		menuView->setEnabled(false);
 		actionScanLibrary->setEnabled(false);
+		actionCancelScan->setEnabled(true);
 	});
 	connect(thread, &QThread::finished, thread, &QThread::deleteLater);
 	connect(worker, &MusicSearchEngine::searchHasEnded, this, [=]() {
 		qDebug() << "MainWindow -> searchHasEnded";
+		if (_scanWorker == worker) {
+			_scanWorker = nullptr;
+			_scanThread = nullptr;
+		}
 		worker->deleteLater();
 		thread->quit();
 		menuView->setEnabled(true);
 		actionScanLibrary->setEnabled(true);
+		actionCancelScan->setEnabled(false);
 		_currentView->loadModel();
 	});
 
+	_scanThread = thread;
+	_scanWorker = worker;
 	thread->start();
 }
 
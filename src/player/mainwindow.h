@@ -41,6 +41,12 @@ private:
 	QxtGlobalShortcut *_shortcutSkipForward;
 	QTranslator _translator;
 	QSet<QShortcut*> _menuShortcuts;
+	QThread *_watcherThread;
+	QThread *_migrationThread;
+
+	/** Scan in progress, if any. */
+	QThread *_scanThread;
+	MusicSearchEngine *_scanWorker;
 
 public:
 	explicit MainWindow(QWidget *parent = nullptr);
@@ -82,6 +88,15 @@ protected:
 private:
 	void initQuickStart();
 
+	/** Starts or stops the thread which keeps the library in sync with the filesystem. */
+	void monitorFileSystem(bool enabled);
+
+	/** Starts again a scan which was cancelled, or which was running when the player was closed. */
+	void resumeInterruptedScan();
+
+	/** Applies long steps of the schema migration (like indexes) in background, if they're missing. */
+	void upgradeDatabase();
+
 public slots:
 	void createCustomizeOptionsDialog();
 
@@ -1,6 +1,6 @@
 #include "minimodewidget.h"
 
-#include "model/sqldatabase.h"
+#include "model/databaseservice.h"
 #include "settings.h"
 #include "mainwindow.h"
 
@@ -62,9 +62,9 @@ MiniModeWidget::MiniModeWidget(MainWindow *mainWindow)
 	connect(closeButton, &QPushButton::clicked, &QApplication::quit);
 
 	connect(mediaPlayerControl->mediaPlayer(), &MediaPlayer::currentMediaChanged, this, [=](const QString &uri) {
-		SqlDatabase db;
-		TrackDAO track = db.selectTrackByURI(uri);
-		currentTrack->setText(track.trackNumber().append(" - ").append(track.title()));
+		DatabaseService::instance()->selectTrackByURI(uri, currentTrack, [=](const TrackDAO &track) {
+			currentTrack->setText(track.trackNumber().append(" - ").append(track.title()));
+		});
 	});
 
 	connect(mediaPlayerControl->mediaPlayer(), &MediaPlayer::stateChanged, this, [=](QMediaPlayer::State state) {
@@ -1,6 +1,6 @@
 #include "remotecontrol.h"
 
-#include <model/sqldatabase.h>
+#include <model/databaseservice.h>
 #include <cover.h>
 #include <filehelper.h>
 #include <mediaplayer.h>
@@ -217,13 +217,19 @@ void RemoteControl::sendAllPlaylists() const
 		return;
 	}
 
-	QStringList args;
-	args << QString::number(CMD_AllPlaylists);
-
-	for (PlaylistDAO p : SqlDatabase().selectPlaylists()) {
-		args << p.title();
-	}
-	_webSocket->sendTextMessage(args.join(QChar::Null));
+	DatabaseService::instance()->run<QList<PlaylistDAO>>([](SqlDatabase *db) {
+		return db->selectPlaylists();
+	}, this, [=](const QList<PlaylistDAO> &playlists) {
+		if (!_webSocket) {
+			return;
+		}
+		QStringList args;
+		args << QString::number(CMD_AllPlaylists);
+		for (PlaylistDAO p : playlists) {
+			args << p.title();
+		}
+		_webSocket->sendTextMessage(args.join(QChar::Null));
+	});
 }
 
 void RemoteControl::sendPosition(qint64 pos, qint64 duration)
@@ -246,23 +252,34 @@ void RemoteControl::sendTrackInfos(const QString &track)
 		return;
 	}
 
-	QStringList args;
-	args << QString::number(CMD_Track);
-
-	SqlDatabase db;
-	TrackDAO dao = db.selectTrackByURI(track);
-	args << dao.uri();
-	args << dao.artistAlbum();
-	args << dao.album();
-	args << dao.title();
-	args << dao.trackNumber();
-	args << QString::number(dao.rating());
-	_webSocket->sendTextMessage(args.join(QChar::Null));
+	// Covers can be extracted from files: it's done in the database thread as well
+	DatabaseService::instance()->run<QPair<TrackDAO, QByteArray>>([track](SqlDatabase *db) {
+		QByteArray coverData;
+		if (Cover *cover = db->selectCoverFromURI(track)) {
+			coverData = cover->byteArray();
+			delete cover;
+		}
+		return qMakePair(db->selectTrackByURI(track), coverData);
+	}, this, [=](const QPair<TrackDAO, QByteArray> &result) {
+		if (!_webSocket) {
+			return;
+		}
+		const TrackDAO &dao = result.first;
+		QStringList args;
+		args << QString::number(CMD_Track);
+		args << dao.uri();
+		args << dao.artistAlbum();
+		args << dao.album();
+		args << dao.title();
+		args << dao.trackNumber();
+		args << QString::number(dao.rating());
+		_webSocket->sendTextMessage(args.join(QChar::Null));
 
-	// Send cover if any
-	if (Cover *cover = db.selectCoverFromURI(track)) {
-		_webSocket->sendBinaryMessage(cover->byteArray());
-	}
+		// Send cover if any
+		if (!result.second.isEmpty()) {
+			_webSocket->sendBinaryMessage(result.second);
+		}
+	});
 }
 
 void RemoteControl::sendVolume(qreal volume)
@@ -1,5 +1,6 @@
 ﻿#include "playlistdialog.h"
 
+#include <model/databaseservice.h>
 #include <model/playlistdao.h>
 #include <model/trackdao.h>
 #include <scrollbar.h>
@@ -236,33 +237,35 @@ void PlaylistDialog::exportSelectedPlaylist()
 
 	QStandardItem *item = _savedPlaylistModel->itemFromIndex(indexes.first());
 	uint playlistId = item->data(PlaylistID).toUInt();
-	SqlDatabase db;
-	PlaylistDAO dao = db.selectPlaylist(playlistId);
-	QString title = this->convertNameToValidFileName(dao.title());
-
-	// Open a file dialog and ask the user to choose a location
-	QString newName = QFileDialog::getSaveFileName(this, tr("Export playlist"), exportedPlaylistLocation + QDir::separator() + title, tr("Playlist (*.m3u8)"));
-	if (QFile::exists(newName)) {
-		QFile removePreviousOne(newName);
-		if (!removePreviousOne.remove()) {
-			qDebug() << Q_FUNC_INFO << "Cannot remove" << newName;
+	DatabaseService::instance()->run<QPair<PlaylistDAO, QStringList>>([playlistId](SqlDatabase *db) {
+		return qMakePair(db->selectPlaylist(playlistId), db->selectPlaylistTracks(playlistId, false));
+	}, this, [=](const QPair<PlaylistDAO, QStringList> &playlist) {
+		QString title = this->convertNameToValidFileName(playlist.first.title());
+
+		// Open a file dialog and ask the user to choose a location
+		QString newName = QFileDialog::getSaveFileName(this, tr("Export playlist"), exportedPlaylistLocation + QDir::separator() + title, tr("Playlist (*.m3u8)"));
+		if (QFile::exists(newName)) {
+			QFile removePreviousOne(newName);
+			if (!removePreviousOne.remove()) {
+				qDebug() << Q_FUNC_INFO << "Cannot remove" << newName;
+			}
 		}
-	}
-	if (newName.isEmpty()) {
-		return;
-	} else {
-		QFile f(newName);
-		if (f.open(QIODevice::ReadWrite | QIODevice::Text)) {
-			QTextStream stream(&f);
-			stream.setGenerateByteOrderMark(true);
-			stream.setCodec("UTF-8");
-			for (QString track : db.selectPlaylistTracks(playlistId, false)) {
-				stream << QDir::toNativeSeparators(track);
-				endl(stream);
+		if (newName.isEmpty()) {
+			return;
+		} else {
+			QFile f(newName);
+			if (f.open(QIODevice::ReadWrite | QIODevice::Text)) {
+				QTextStream stream(&f);
+				stream.setGenerateByteOrderMark(true);
+				stream.setCodec("UTF-8");
+				for (QString track : playlist.second) {
+					stream << QDir::toNativeSeparators(track);
+					endl(stream);
+				}
 			}
+			f.close();
 		}
-		f.close();
-	}
+	});
 }
 
 /** Load every saved playlists. */
@@ -285,21 +288,29 @@ void PlaylistDialog::populatePreviewFromSaved(const QItemSelection &, const QIte
 	this->clearPreview(!empty);
 	if (indexes.size() == 1) {
 		uint playlistId = _savedPlaylistModel->itemFromIndex(indexes.first())->data(PlaylistID).toUInt();
-		QStringList tracks = SqlDatabase().selectPlaylistTracks(playlistId);
-		for (int i = 0; i < tracks.size(); i++) {
-			QString track = tracks.at(i);
-			QTreeWidgetItem *item = new QTreeWidgetItem;
-			FileHelper fh(track);
-			item->setText(0, QString("%1 (%2 - %3)").arg(fh.title(), fh.artist(), fh.album()));
-			previewPlaylist->addTopLevelItem(item);
-
-			if (i + 1 == MAX_TRACKS_PREVIEW_AREA) {
+		DatabaseService::instance()->run<QStringList>([playlistId](SqlDatabase *db) {
+			return db->selectPlaylistTracks(playlistId);
+		}, this, [=](const QStringList &tracks) {
+			// Another playlist was selected meanwhile
+			QModelIndexList selected = savedPlaylists->selectionModel()->selectedIndexes();
+			if (selected.size() != 1 || selected.first().data(PlaylistID).toUInt() != playlistId) {
+				return;
+			}
+			for (int i = 0; i < tracks.size(); i++) {
+				QString track = tracks.at(i);
 				QTreeWidgetItem *item = new QTreeWidgetItem;
-				item->setText(0, tr("And more tracks..."));
+				FileHelper fh(track);
+				item->setText(0, QString("%1 (%2 - %3)").arg(fh.title(), fh.artist(), fh.album()));
 				previewPlaylist->addTopLevelItem(item);
-				break;
+
+				if (i + 1 == MAX_TRACKS_PREVIEW_AREA) {
+					QTreeWidgetItem *item = new QTreeWidgetItem;
+					item->setText(0, tr("And more tracks..."));
+					previewPlaylist->addTopLevelItem(item);
+					break;
+				}
 			}
-		}
+		});
 	}
 	loadPlaylists->setDisabled(empty);
 	deletePlaylists->setDisabled(empty);
@@ -361,7 +372,9 @@ void PlaylistDialog::renameItem(QStandardItem *item)
 		} else {
 			PlaylistDAO dao = _saved.value(item);
 			dao.setTitle(item->text());
-			SqlDatabase().updateTablePlaylist(dao);
+			DatabaseService::instance()->post([dao](SqlDatabase *db) {
+				db->updateTablePlaylist(dao);
+			});
 			emit aboutToRenameTab(dao);
 		}
 	}
@@ -370,37 +383,41 @@ void PlaylistDialog::renameItem(QStandardItem *item)
 /** Update saved playlists when one is adding a new one. */
 void PlaylistDialog::updatePlaylists()
 {
-	// Populate saved playlists area
-	_savedPlaylistModel->clear();
-	_savedPlaylistModel->blockSignals(true);
+	// Populate saved playlists area, once they're read in the database thread
+	DatabaseService::instance()->run<QList<PlaylistDAO>>([](SqlDatabase *db) {
+		return db->selectPlaylists();
+	}, this, [=](const QList<PlaylistDAO> &playlists) {
+		_savedPlaylistModel->clear();
+		_savedPlaylistModel->blockSignals(true);
 
-	QMap<uint, Playlist*> map;
-	for (int i = 0; i < _playlists.count(); i++) {
-		Playlist *p = _playlists.at(i);
-		if (p->id() != 0) {
-			map.insert(p->id(), p);
+		QMap<uint, Playlist*> map;
+		for (int i = 0; i < _playlists.count(); i++) {
+			Playlist *p = _playlists.at(i);
+			if (p->id() != 0) {
+				map.insert(p->id(), p);
+			}
 		}
-	}
 
-	for (PlaylistDAO playlist : SqlDatabase().selectPlaylists()) {
-		QStandardItem *item = new QStandardItem(playlist.title());
-		item->setData(playlist.id(), PlaylistID);
-		if (playlist.icon().isEmpty()) {
-			Playlist *p = map.value(playlist.id().toUInt());
-			if (p && p->isModified()) {
-				item->setIcon(QIcon(":/icons/playlist_modified"));
-				item->setData(true, PlaylistModified);
-				item->setToolTip(tr("This playlist has changed"));
+		for (PlaylistDAO playlist : playlists) {
+			QStandardItem *item = new QStandardItem(playlist.title());
+			item->setData(playlist.id(), PlaylistID);
+			if (playlist.icon().isEmpty()) {
+				Playlist *p = map.value(playlist.id().toUInt());
+				if (p && p->isModified()) {
+					item->setIcon(QIcon(":/icons/playlist_modified"));
+					item->setData(true, PlaylistModified);
+					item->setToolTip(tr("This playlist has changed"));
+				} else {
+					item->setIcon(QIcon(":/icons/playlist"));
+				}
 			} else {
-				item->setIcon(QIcon(":/icons/playlist"));
+				item->setIcon(QIcon(playlist.icon()));
 			}
-		} else {
-			item->setIcon(QIcon(playlist.icon()));
+			_savedPlaylistModel->appendRow(item);
+			_saved.insert(item, playlist);
 		}
-		_savedPlaylistModel->appendRow(item);
-		_saved.insert(item, playlist);
-	}
-	_savedPlaylistModel->blockSignals(false);
+		_savedPlaylistModel->blockSignals(false);
+	});
 
 	// Reset buttons status
 	loadPlaylists->setEnabled(false);
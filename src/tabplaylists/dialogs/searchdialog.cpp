@@ -11,7 +11,7 @@
 
 #include "viewplaylists.h"
 #include <settings.h>
-#include <model/sqldatabase.h>
+#include <model/databaseservice.h>
 
 #include <QtDebug>
 
@@ -202,21 +202,7 @@ void SearchDialog::artistWasDoubleClicked(const QModelIndex &artistIndex)
 {
 	const QStandardItemModel *m = qobject_cast<const QStandardItemModel*>(artistIndex.model());
 	QStandardItem *item = m->itemFromIndex(artistIndex);
-
-	SqlDatabase db;
-
-	QSqlQuery q(db);
-	q.prepare("SELECT uri FROM cache WHERE artist = ?");
-	q.addBindValue(item->data(Miam::DF_Artist).toString());
-	if (q.exec()) {
-		QList<QMediaContent> tracks;
-		while (q.next()) {
-			tracks.append(QMediaContent(QUrl::fromLocalFile(q.record().value(0).toString())));
-		}
-
-		Playlist *p = _viewPlaylists->tabPlaylists->currentPlayList();
-		p->insertMedias(-1, tracks);
-	}
+	this->insertTracks("SELECT uri FROM cache WHERE artist = ?", item->data(Miam::DF_Artist).toString());
 	this->clear();
 }
 
@@ -224,22 +210,27 @@ void SearchDialog::albumWasDoubleClicked(const QModelIndex &albumIndex)
 {
 	const QStandardItemModel *m = qobject_cast<const QStandardItemModel*>(albumIndex.model());
 	QStandardItem *item = m->itemFromIndex(albumIndex);
+	this->insertTracks("SELECT uri FROM cache WHERE album = ?", item->data(Miam::DF_Album).toString());
+	this->clear();
+}
 
-	SqlDatabase db;
-
-	QSqlQuery q(db);
-	q.prepare("SELECT uri FROM cache WHERE album = ?");
-	qDebug() << Q_FUNC_INFO << item->data(Miam::DF_Album).toString();
-	q.addBindValue(item->data(Miam::DF_Album).toString());
-	if (q.exec()) {
+/** Reads tracks in the database thread, then appends them to the current playlist. */
+void SearchDialog::insertTracks(const QString &select, const QString &value)
+{
+	Playlist *p = _viewPlaylists->tabPlaylists->currentPlayList();
+	DatabaseService::instance()->run<QList<QMediaContent>>([select, value](SqlDatabase *db) {
 		QList<QMediaContent> tracks;
-		while (q.next()) {
-			tracks.append(QMediaContent(QUrl::fromLocalFile(q.record().value(0).toString())));
+		QSqlQuery q = db->preparedQuery(select);
+		q.addBindValue(value);
+		if (q.exec()) {
+			while (q.next()) {
+				tracks.append(QMediaContent(QUrl::fromLocalFile(q.record().value(0).toString())));
+			}
 		}
-		Playlist *p = _viewPlaylists->tabPlaylists->currentPlayList();
+		return tracks;
+	}, p, [p](const QList<QMediaContent> &tracks) {
 		p->insertMedias(-1, tracks);
-	}
-	this->clear();
+	});
 }
 
 void SearchDialog::trackWasDoubleClicked(const QModelIndex &track)
@@ -256,52 +247,58 @@ void SearchDialog::localSearch(const QString &text)
 		return;
 	}
 
-	SqlDatabase db;
+	// Results of a previous search which are sent after this one are discarded
+	_localSearchText = text;
+	typedef QList<QList<QSqlRecord>> Results;
+	DatabaseService::instance()->run<Results>([text](SqlDatabase *db) {
+		QList<QSqlQuery> queries = { db->search("artist", text, "artist"),
+									 db->search("album, artist", text, "album"),
+									 db->search("trackTitle, COALESCE(artistAlbum, artist), uri", text, "trackTitle") };
+		Results results;
+		for (QSqlQuery q : queries) {
+			QList<QSqlRecord> records;
+			if (q.exec()) {
+				while (q.next()) {
+					records.append(q.record());
+				}
+			}
+			results.append(records);
+		}
+		return results;
+	}, this, [=](const Results &results) {
+		if (text != _localSearchText) {
+			return;
+		}
 
-	/// XXX: Factorize this, 3 times the (almost) same code
-	QSqlQuery qSearchForArtists(db);
-	qSearchForArtists.prepare("SELECT DISTINCT artist FROM cache WHERE artist LIKE :t LIMIT 5");
-	qSearchForArtists.bindValue(":t", "%" + text + "%");
-	if (qSearchForArtists.exec()) {
+		/// XXX: Factorize this, 3 times the (almost) same code
 		QList<QStandardItem*> artistList;
-		while (qSearchForArtists.next()) {
-			QString artistName = qSearchForArtists.record().value(0).toString();
+		for (QSqlRecord r : results.at(0)) {
+			QString artistName = r.value(0).toString();
 			QStandardItem *artist = new QStandardItem(artistName);
 			artist->setData(artistName, Miam::DF_Artist);
 			artist->setData(_checkBoxLibrary->text(), DT_Origin);
 			artistList.append(artist);
 		}
 		this->processResults(Artist, artistList);
-	}
 
-	QSqlQuery qSearchForAlbums(db);
-	qSearchForAlbums.prepare("SELECT DISTINCT album, artist FROM cache WHERE album LIKE :t LIMIT 5");
-	qSearchForAlbums.bindValue(":t", "%" + text + "%");
-	if (qSearchForAlbums.exec()) {
 		QList<QStandardItem*> albumList;
-		while (qSearchForAlbums.next()) {
-			QStandardItem *album = new QStandardItem(qSearchForAlbums.record().value(0).toString() + " – " + qSearchForAlbums.record().value(1).toString());
-			album->setData(qSearchForAlbums.record().value(0).toString(), Miam::DF_Album);
+		for (QSqlRecord r : results.at(1)) {
+			QStandardItem *album = new QStandardItem(r.value(0).toString() + " – " + r.value(1).toString());
+			album->setData(r.value(0).toString(), Miam::DF_Album);
 			album->setData(_checkBoxLibrary->text(), DT_Origin);
 			albumList.append(album);
 		}
 		this->processResults(Album, albumList);
-	}
 
-	QSqlQuery qSearchForTracks(db);
-	qSearchForTracks.prepare("SELECT DISTINCT trackTitle, COALESCE(artistAlbum, artist), uri FROM cache WHERE trackTitle LIKE :t LIMIT 5");
-	qSearchForTracks.bindValue(":t", "%" + text + "%");
-	if (qSearchForTracks.exec()) {
 		QList<QStandardItem*> trackList;
-		while (qSearchForTracks.next()) {
-			QSqlRecord r = qSearchForTracks.record();
+		for (QSqlRecord r : results.at(2)) {
 			QStandardItem *track = new QStandardItem(r.value(0).toString() + " – " + r.value(1).toString());
 			track->setData(r.value(2).toString(), Miam::DF_URI);
 			track->setData(_checkBoxLibrary->text(), DT_Origin);
 			trackList.append(track);
 		}
 		this->processResults(Track, trackList);
-	}
+	});
 }
 
 /** Expand this dialog to all available space. */
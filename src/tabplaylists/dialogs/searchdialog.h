@@ -27,6 +27,9 @@ private:
 	QMap<QListView*, QList<QStandardItem*>> _hiddenItems;
 	bool _isMaximized;
 
+	/** Text of the last search in the library, whose results are being read. */
+	QString _localSearchText;
+
 public:
 	/** Constructor. */
 	explicit SearchDialog(ViewPlaylists *viewPlaylists);
@@ -55,6 +58,9 @@ protected:
 	virtual void paintEvent(QPaintEvent *) override;
 
 private:
+	/** Reads tracks in the database thread, then appends them to the current playlist. */
+	void insertTracks(const QString &select, const QString &value);
+
 	/** Start search again more but fetch more results. */
 	void searchMoreResults();
 
@@ -1,6 +1,6 @@
 #include "playlistitemdelegate.h"
 
-#include <model/sqldatabase.h>
+#include <model/databaseservice.h>
 #include <filehelper.h>
 #include <settingsprivate.h>
 #include "playlist.h"
@@ -68,8 +68,9 @@ void PlaylistItemDelegate::commitAndClose()
 		tracksToUpdate << fileName;
 		tracksToUpdate2 << QString();
 	}
-	SqlDatabase db;
-	db.updateTracks(tracksToUpdate, tracksToUpdate2);
+	DatabaseService::instance()->post([=](SqlDatabase *db) {
+		db->updateTracks(tracksToUpdate, tracksToUpdate2);
+	});
 }
 
 /** Redefined. */
@@ -1,7 +1,7 @@
 #include "playlistmanager.h"
 
 #include <model/playlistdao.h>
-#include <model/sqldatabase.h>
+#include <model/databaseservice.h>
 #include <settingsprivate.h>
 #include "playlist.h"
 #include "tabplaylist.h"
@@ -59,13 +59,14 @@ bool PlaylistManager::loadPlaylist(Playlist *p, const QFileInfo &fileInfo)
 
 bool PlaylistManager::deletePlaylist(uint playlistId)
 {
-	return SqlDatabase().removePlaylist(playlistId);
+	return DatabaseService::instance()->runAndWait<bool>([=](SqlDatabase *db) {
+		return db->removePlaylist(playlistId);
+	});
 }
 
 uint PlaylistManager::savePlaylist(Playlist *p, bool isOverwriting, bool isExiting)
 {
 	uint id = 0;
-	SqlDatabase db;
 
 	for (int i = 0; i < _tabPlaylists->count(); i++) {
 		Playlist *pl = _tabPlaylists->playlist(i);
@@ -80,7 +81,10 @@ uint PlaylistManager::savePlaylist(Playlist *p, bool isOverwriting, bool isExiti
 		PlaylistDAO playlist;
 
 		// Check first if one has the same playlist in database
-		for (PlaylistDAO dao : db.selectPlaylists()) {
+		QList<PlaylistDAO> playlists = DatabaseService::instance()->runAndWait<QList<PlaylistDAO>>([](SqlDatabase *db) {
+			return db->selectPlaylists();
+		});
+		for (PlaylistDAO dao : playlists) {
 			if (dao.checksum().toUInt() == generateNewHash) {
 				playlist = dao;
 				break;
@@ -127,7 +131,10 @@ uint PlaylistManager::savePlaylist(Playlist *p, bool isOverwriting, bool isExiti
 			tracks << p->model()->index(j, p->COL_TRACK_DAO).data().toString();
 		}
 
-		id = db.insertIntoTablePlaylists(playlist, tracks, isOverwriting);
+		// Waits for the database thread: when exiting, playlists have to be written before the application ends
+		id = DatabaseService::instance()->runAndWait<uint>([=](SqlDatabase *db) {
+			return db->insertIntoTablePlaylists(playlist, tracks, isOverwriting);
+		});
 
 		p->setId(id);
 		p->setHash(generateNewHash);
@@ -1,6 +1,6 @@
 #include "playlistmodel.h"
 
-#include "model/sqldatabase.h"
+#include "model/databaseservice.h"
 #include "filehelper.h"
 #include "settingsprivate.h"
 #include "starrating.h"
@@ -35,7 +35,6 @@ void PlaylistModel::clear()
 bool PlaylistModel::insertMedias(int rowIndex, const QList<QMediaContent> &tracks)
 {
 	int c = this->rowCount();
-	SqlDatabase db;
 	if (_mediaPlaylist->insertMedia(rowIndex, tracks)) {
 		for (QMediaContent track : tracks) {
 			if (track.canonicalUrl().isLocalFile()) {
@@ -44,9 +43,18 @@ bool PlaylistModel::insertMedias(int rowIndex, const QList<QMediaContent> &track
 					this->insertMedia(rowIndex++, f);
 				}
 			} else {
-				qDebug() << Q_FUNC_INFO << track.canonicalUrl();
-				TrackDAO t = db.selectTrackByURI(track.canonicalUrl().toString());
-				this->createLine(rowIndex++, t);
+				// Tags of remote tracks are in the database: the line is completed when they have been loaded
+				QString uri = track.canonicalUrl().toString();
+				TrackDAO placeholder;
+				placeholder.setUri(uri);
+				placeholder.setTitle(uri);
+				this->createLine(rowIndex, placeholder);
+				QPersistentModelIndex index(this->index(rowIndex++, 0));
+				DatabaseService::instance()->selectTrackByURI(uri, this, [=](const TrackDAO &t) {
+					if (index.isValid()) {
+						this->updateLine(index.row(), t);
+					}
+				});
 			}
 		}
 	}
@@ -67,6 +75,20 @@ bool PlaylistModel::insertMedias(int rowIndex, const QList<TrackDAO> &tracks)
 }
 
 void PlaylistModel::createLine(int row, const TrackDAO &track)
+{
+	this->insertRow(row, this->createItems(track));
+}
+
+/** Replaces the content of a line, once tags of a remote track have been loaded. */
+void PlaylistModel::updateLine(int row, const TrackDAO &track)
+{
+	QList<QStandardItem *> items = this->createItems(track);
+	for (int column = 0; column < items.size(); column++) {
+		this->setItem(row, column, items.at(column));
+	}
+}
+
+QList<QStandardItem *> PlaylistModel::createItems(const TrackDAO &track) const
 {
 	QStandardItem *trackItem = new QStandardItem;
 	if (!track.trackNumber().isEmpty()) {
@@ -104,8 +126,7 @@ void PlaylistModel::createLine(int row, const TrackDAO &track)
 	QList<QStandardItem *> items;
 	items << trackItem << titleItem << albumItem << lengthItem << artistItem << ratingItem \
 		  << yearItem << iconItem << trackDAO;
-
-	this->insertRow(row, items);
+	return items;
 }
 
 void PlaylistModel::insertMedia(int rowIndex, const FileHelper &fileHelper)
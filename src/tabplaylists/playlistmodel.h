@@ -54,6 +54,11 @@ public:
 private:
 	void createLine(int row, const TrackDAO &track);
 
+	/** Replaces the content of a line, once tags of a remote track have been loaded. */
+	void updateLine(int row, const TrackDAO &track);
+
+	QList<QStandardItem *> createItems(const TrackDAO &track) const;
+
 	void insertMedia(int rowIndex, const FileHelper &fileHelper);
 };
 
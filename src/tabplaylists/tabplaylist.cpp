@@ -1,6 +1,6 @@
 #include "tabplaylist.h"
 
-#include <model/sqldatabase.h>
+#include <model/databaseservice.h>
 #include <settings.h>
 #include <settingsprivate.h>
 
@@ -175,35 +175,35 @@ void TabPlaylist::init(MediaPlayer *mediaPlayer)
 void TabPlaylist::loadPlaylist(uint playlistId)
 {
 	Playlist *playlist = nullptr;
-	SqlDatabase db;
-	PlaylistDAO playlistDao = db.selectPlaylist(playlistId);
 
 	/// TODO: Do not load the playlist if it's already displayed
 
+	// The tab is chosen right now to keep the order of the session, it's filled when tracks have been read from the database
 	int index = currentIndex();
 	if (index >= 0) {
 		playlist = this->playlist(index);
 		if (!playlist->mediaPlaylist()->isEmpty()) {
 			playlist = addPlaylist();
-			this->tabBar()->setTabText(count() - 1, playlistDao.title());
-		} else {
-			this->tabBar()->setTabText(index, playlistDao.title());
 		}
 	} else {
 		playlist = addPlaylist();
-		this->tabBar()->setTabText(count() - 1, playlistDao.title());
 	}
-	playlist->setHash(playlistDao.checksum().toUInt());
 
-	/// Reload tracks from filesystem
-	/// TODO: remote files!
-	QList<QMediaContent> tracks;
-	for (QString track : db.selectPlaylistTracks(playlistId)) {
-		tracks << QMediaContent(QUrl::fromLocalFile(track));
-	}
-	playlist->insertMedias(-1, tracks);
-	playlist->setId(playlistId);
-	playlist->mediaPlaylist()->setTitle(playlistDao.title());
+	DatabaseService::instance()->selectPlaylistWithTracks(playlistId, playlist, [=](const QPair<PlaylistDAO, QStringList> &result) {
+		const PlaylistDAO &playlistDao = result.first;
+		this->tabBar()->setTabText(this->indexOf(playlist), playlistDao.title());
+		playlist->setHash(playlistDao.checksum().toUInt());
+
+		/// Reload tracks from filesystem
+		/// TODO: remote files!
+		QList<QMediaContent> tracks;
+		for (QString track : result.second) {
+			tracks << QMediaContent(QUrl::fromLocalFile(track));
+		}
+		playlist->insertMedias(-1, tracks);
+		playlist->setId(playlistId);
+		playlist->mediaPlaylist()->setTitle(playlistDao.title());
+	});
 
 	//this->setTabIcon(index, defaultIcon(QIcon::Disabled));
 }
@@ -162,7 +162,8 @@ ViewPlaylists::ViewPlaylists(MediaPlayer *mediaPlayer, QWidget *parent)
 	});
 
 	connect(this, &AbstractView::modelReloadRequested, this, [=]() {
-		library->model()->load();
+		// The library stays usable while it's read again, then expanded items and selection are restored
+		library->model()->loadInBackground();
 		for (Playlist *p : tabPlaylists->playlists()) {
 			p->model()->reload();
 		}
@@ -290,6 +291,16 @@ void ViewPlaylists::setMusicSearchEngine(MusicSearchEngine *musicSearchEngine)
 	});
 }
 
+/** Applies changes to the library instead of reloading it. Playlists are reloaded. */
+void ViewPlaylists::updateModel(const QStringList &, const QStringList &)
+{
+	// Tracks are read from the journal of changes, which also knows about covers
+	library->model()->applyChanges();
+	for (Playlist *p : tabPlaylists->playlists()) {
+		p->model()->reload();
+	}
+}
+
 bool ViewPlaylists::viewProperty(Settings::ViewProperty vp) const
 {
 	switch (vp) {
@@ -52,6 +52,9 @@ public:
 
 	virtual void setMusicSearchEngine(MusicSearchEngine *musicSearchEngine) override;
 
+	/** Applies changes to the library instead of reloading it. Playlists are reloaded. */
+	virtual void updateModel(const QStringList &updatedTracks, const QStringList &removedTracks) override;
+
 	inline virtual QSize sizeHint() const override { return QSize(1024, 768); }
 
 	inline virtual ViewType type() const override { return VT_BuiltIn; }
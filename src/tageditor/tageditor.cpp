@@ -9,6 +9,7 @@
 #include <taglib/tpropertymap.h>
 
 #include <acoustid.h>
+#include <model/databaseservice.h>
 
 #include <QDir>
 #include <QDirIterator>
@@ -424,9 +425,22 @@ void TagEditor::commitChanges()
 
 		// Check if files are already in the library, and then update them
 		if (!oldPaths.isEmpty()) {
-			SqlDatabase db;
-			connect(&db, &SqlDatabase::aboutToUpdateView, origin(), &AbstractView::modelReloadRequested);
-			db.updateTracks(oldPaths, newPaths);
+			// Views are updating only these tracks, instead of reloading the whole library
+			QStringList updatedTracks, removedTracks;
+			for (int i = 0; i < oldPaths.size(); i++) {
+				if (newPaths.at(i).isEmpty()) {
+					updatedTracks << oldPaths.at(i);
+				} else {
+					updatedTracks << newPaths.at(i);
+					removedTracks << oldPaths.at(i);
+				}
+			}
+			DatabaseService::instance()->run<bool>([oldPaths, newPaths](SqlDatabase *db) {
+				db->updateTracks(oldPaths, newPaths);
+				return true;
+			}, this, [=](const bool &) {
+				origin()->updateModel(updatedTracks, removedTracks);
+			});
 		}
 	}
 
@@ -442,12 +456,34 @@ void TagEditor::commitChanges()
 
 /** Displays a cover only if all the selected items have exactly the same cover. */
 void TagEditor::displayCover()
+{
+	QString joinedTracks;
+	for (QModelIndex track : tagEditorWidget->selectionModel()->selectedRows(Miam::COL_Filename)) {
+		joinedTracks += "\"" + track.data(Qt::UserRole).toString() + "\",";
+	}
+	joinedTracks.append("\"\"");
+
+	// Fill the comboBox for the absolute path to the cover (if exists). Covers of the selection are read when paths have
+	// arrived: they may have been deleted meanwhile
+	DatabaseService::instance()->run<QSet<QString>>([joinedTracks](SqlDatabase *db) {
+		QSqlQuery coverPathQuery = db->exec("SELECT DISTINCT cover FROM tracks WHERE uri IN (" + joinedTracks + ")");
+		QSet<QString> coversPath;
+		while (coverPathQuery.next()) {
+			coversPath << coverPathQuery.record().value(0).toString();
+		}
+		return coversPath;
+	}, this, [this](const QSet<QString> &coversPath) {
+		this->displaySelectedCovers(coversPath);
+	});
+}
+
+/** Displays covers of the selected items, with paths of their covers in the database. */
+void TagEditor::displaySelectedCovers(const QSet<QString> &coversPath)
 {
 	static Cover *_cover = nullptr;
 
 	QMap<uint, Cover*> selectedCovers;
 	QMap<int, QString> selectedAlbums;
-	QString joinedTracks;
 	// Extract only a subset of columns from the selected rows, in our case, only one column: displayed album name
 	for (QModelIndex item : tagEditorWidget->selectionModel()->selectedRows(Miam::COL_Album)) {
 		Cover *cover = nullptr;
@@ -465,18 +501,6 @@ void TagEditor::displayCover()
 			selectedCovers.insert(qHash(cover->byteArray()), cover);
 		}
 		selectedAlbums.insert(item.row(), item.data().toString());
-		QModelIndex track = item.sibling(item.row(), Miam::COL_Filename);
-		joinedTracks += "\"" + track.data(Qt::UserRole).toString() + "\",";
-	}
-	joinedTracks.append("\"\"");
-
-	// Fill the comboBox for the absolute path to the cover (if exists)
-	SqlDatabase db;
-
-	QSqlQuery coverPathQuery = db.exec("SELECT DISTINCT cover FROM tracks WHERE uri IN (" + joinedTracks + ")");
-	QSet<QString> coversPath;
-	while (coverPathQuery.next()) {
-		coversPath << coverPathQuery.record().value(0).toString();
 	}
 
 	coverPathComboBox->clear();
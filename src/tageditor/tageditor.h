@@ -81,6 +81,9 @@ private:
 	/** Splits tracks into columns to be able to edit metadatas. */
 	void addTracks(const QStringList &tracks);
 
+	/** Displays covers of the selected items, with paths of their covers in the database. */
+	void displaySelectedCovers(const QSet<QString> &coversPath);
+
 public slots:
 	/** Wrapper for addItemsToEditor. */
 	void addItemsToEditor(const QList<QUrl> &tracks);
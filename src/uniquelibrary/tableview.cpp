@@ -1,6 +1,6 @@
 #include "tableview.h"
 
-#include <model/sqldatabase.h>
+#include <model/databaseservice.h>
 #include <libraryfilterproxymodel.h>
 #include <libraryscrollbar.h>
 #include <settingsprivate.h>
@@ -10,6 +10,7 @@
 #include <QPainter>
 #include <QRegularExpression>
 #include <QScrollBar>
+#include <QSet>
 #include <QSqlQuery>
 #include <QSqlRecord>
 
@@ -167,35 +168,19 @@ QList<QUrl> TableView::selectedTracks()
 {
 	QStringList results;
 	auto proxy = model()->proxy();
-	QStringList artists, albums, tracks;
+	QSet<QString> groups;
 	for (QModelIndex i : selectedIndexes()) {
 		if (QStandardItem *item = model()->itemFromIndex(proxy->mapToSource(i))) {
-			if (item->type() == Miam::IT_Artist) {
-				artists << '"' + item->data(Miam::DF_NormalizedString).toString() + '"';
-			} else if (item->type() == Miam::IT_Album) {
-				albums << '"' + item->data(Miam::DF_NormAlbum).toString() + '"';
+			if (item->type() == Miam::IT_Artist || item->type() == Miam::IT_Album) {
+				groups << item->data(Miam::DF_NormalizedString).toString();
 			} else if (item->type() == Miam::IT_Track) {
-				tracks << '"' + item->data(Miam::DF_URI).toString() + '"';
+				results << item->data(Miam::DF_URI).toString();
 			}
 		}
 	}
-	SqlDatabase db;
-	QSqlQuery q(db);
-	if (q.exec("SELECT uri FROM cache WHERE artistNormalized IN (" + artists.join(",") + ")")) {
-		while (q.next()) {
-			results << q.record().value(0).toString();
-		}
-	}
-	if (q.exec("SELECT uri FROM cache WHERE albumNormalized IN (" + albums.join(",") + ")")) {
-		while (q.next()) {
-			results << q.record().value(0).toString();
-		}
-	}
-	if (q.exec("SELECT uri FROM cache WHERE uri IN (" + tracks.join(",") + ")")) {
-		while (q.next()) {
-			results << q.record().value(0).toString();
-		}
-	}
+
+	// Tracks of artists and albums are already in the model: when it's filtered, only matching tracks are sent
+	results << model()->tracksOfGroups(groups);
 
 	results.removeDuplicates();
 	results.sort();
@@ -208,7 +193,7 @@ QList<QUrl> TableView::selectedTracks()
 
 void TableView::updateSelectedTracks()
 {
-
+	_model->applyChanges();
 }
 
 void TableView::contextMenuEvent(QContextMenuEvent *e)
@@ -265,21 +250,34 @@ void TableView::paintEvent(QPaintEvent *event)
 
 void TableView::jumpTo(const QString &letter)
 {
-	SqlDatabase db;
-	QSqlQuery firstArtist(db);
-	firstArtist.prepare("SELECT DISTINCT artistAlbum FROM cache WHERE artistAlbum LIKE ? ORDER BY artistAlbum COLLATE NOCASE LIMIT ?");
-	firstArtist.addBindValue(letter + "%");
-	firstArtist.addBindValue(_skipCount);
-	if (firstArtist.exec() && firstArtist.last()) {
-		if (_skipCount != firstArtist.at() + 1) {
-			firstArtist.first();
+	// Artists are read in the database thread, the last one is the one to scroll to
+	int skipCount = _skipCount;
+	DatabaseService::instance()->run<QStringList>([letter, skipCount](SqlDatabase *db) {
+		QStringList artists;
+		QSqlQuery firstArtist = db->preparedQuery("SELECT DISTINCT artistAlbum FROM cache WHERE artistAlbum LIKE ? " \
+												  "ORDER BY artistAlbum COLLATE NOCASE LIMIT ?");
+		firstArtist.addBindValue(letter + "%");
+		firstArtist.addBindValue(skipCount);
+		if (firstArtist.exec()) {
+			while (firstArtist.next()) {
+				artists << firstArtist.record().value(0).toString();
+			}
+		}
+		return artists;
+	}, this, [=](const QStringList &artists) {
+		if (artists.isEmpty()) {
+			return;
+		}
+		QString artist = artists.last();
+		if (skipCount != artists.size()) {
+			artist = artists.first();
 			_skipCount = 1;
 		}
-		for (QStandardItem *i : _model->findItems(firstArtist.record().value(0).toString(), Qt::MatchExactly, 1)) {
+		for (QStandardItem *i : _model->findItems(artist, Qt::MatchExactly, 1)) {
 			if (i->type() == Miam::IT_Artist) {
 				this->scrollTo(_model->proxy()->mapFromSource(i->index()), PositionAtTop);
 				break;
 			}
 		}
-	}
+	});
 }
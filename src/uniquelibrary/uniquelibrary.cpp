@@ -14,6 +14,7 @@
 #include <QStandardItemModel>
 
 #include <ctime>
+#include <memory>
 #include <random>
 
 #include <QtDebug>
@@ -64,11 +65,11 @@ UniqueLibrary::UniqueLibrary(MediaPlayer *mediaPlayer, QWidget *parent)
 			_currentTrack = nullptr;
 		}
 		uniqueTable->model()->load(text);
-		uniqueTable->adjust();
-
 		uniqueTable->scrollToTop();
 		uniqueTable->verticalScrollBar()->setValue(0);
 	});
+	// Rows are read in the database thread
+	connect(uniqueTable->model(), &MiamItemModel::loaded, uniqueTable, &TableView::adjust);
 	connect(uniqueTable, &TableView::doubleClicked, this, [=](const QModelIndex &index) {
 		this->play(index, QAbstractItemView::EnsureVisible);
 	});
@@ -144,23 +145,33 @@ UniqueLibrary::~UniqueLibrary()
 
 void UniqueLibrary::loadModel()
 {
-	uniqueTable->model()->load();
-	uniqueTable->adjust();
-
-	auto settingsPrivate = SettingsPrivate::instance();
-	if (!settingsPrivate->value("uniqueLibraryLastPlayed").isNull()) {
-		int track = settingsPrivate->value("uniqueLibraryLastPlayed").toInt();
-		QModelIndex lastPlayed = uniqueTable->model()->index(track, 1);
-		if (lastPlayed.isValid()) {
-			QModelIndex p = uniqueTable->model()->proxy()->mapFromSource(lastPlayed);
-			QStandardItem *trackItem = uniqueTable->model()->itemFromIndex(lastPlayed);
-			if (p.isValid() && trackItem != nullptr) {
-				_currentTrack = trackItem;
-				uniqueTable->setCurrentIndex(p);
-				uniqueTable->scrollTo(p, QAbstractItemView::PositionAtCenter);
+	// The last played track is selected once rows are read, only for this load
+	auto connection = std::make_shared<QMetaObject::Connection>();
+	*connection = connect(uniqueTable->model(), &MiamItemModel::loaded, this, [=]() {
+		QObject::disconnect(*connection);
+		auto settingsPrivate = SettingsPrivate::instance();
+		if (!settingsPrivate->value("uniqueLibraryLastPlayed").isNull()) {
+			int track = settingsPrivate->value("uniqueLibraryLastPlayed").toInt();
+			QModelIndex lastPlayed = uniqueTable->model()->index(track, 1);
+			if (lastPlayed.isValid()) {
+				QModelIndex p = uniqueTable->model()->proxy()->mapFromSource(lastPlayed);
+				QStandardItem *trackItem = uniqueTable->model()->itemFromIndex(lastPlayed);
+				if (p.isValid() && trackItem != nullptr) {
+					_currentTrack = trackItem;
+					uniqueTable->setCurrentIndex(p);
+					uniqueTable->scrollTo(p, QAbstractItemView::PositionAtCenter);
+				}
 			}
 		}
-	}
+	});
+	uniqueTable->model()->load();
+}
+
+/** Applies changes to the model instead of reloading it. */
+void UniqueLibrary::updateModel(const QStringList &, const QStringList &)
+{
+	// Tracks are read from the journal of changes, which also knows about covers
+	uniqueTable->model()->applyChanges();
 }
 
 bool UniqueLibrary::viewProperty(Settings::ViewProperty vp) const
@@ -45,6 +45,9 @@ public:
 
 	inline virtual ViewType type() const override { return VT_BuiltIn; }
 
+	/** Applies changes to the model instead of reloading it. */
+	virtual void updateModel(const QStringList &updatedTracks, const QStringList &removedTracks) override;
+
 	virtual bool viewProperty(Settings::ViewProperty vp) const override;
 
 protected:
@@ -2,7 +2,7 @@
 
 #include <QStandardItemModel>
 #include <separatoritem.h>
-#include <model/sqldatabase.h>
+#include <model/databaseservice.h>
 #include <QSqlQuery>
 
 #include <QtDebug>
@@ -12,6 +12,48 @@ UniqueLibraryFilterProxyModel::UniqueLibraryFilterProxyModel(QObject *parent)
 	, _model(nullptr)
 {}
 
+/** Redefined to read artists, albums and discs matching text in the database thread first, once per text. */
+void UniqueLibraryFilterProxyModel::findMusic(const QString &text)
+{
+	_pendingText = text;
+	if (text.isEmpty()) {
+		_matches = Matches();
+		MiamSortFilterProxyModel::findMusic(text);
+		return;
+	}
+
+	DatabaseService::instance()->run<Matches>([text](SqlDatabase *db) -> Matches {
+		// Text is compared like the proxy does: ratings for stars, otherwise names of tracks and their parents
+		QString condition;
+		QVariant value;
+		if (text.contains(QRegExp("^(\\*){1,5}$"))) {
+			condition = "rating >= ?";
+			value = text.size();
+		} else {
+			condition = db->searchCondition(text);
+			value = db->searchValue(text);
+		}
+		Matches matches;
+		QSqlQuery q = db->preparedQuery("SELECT DISTINCT artistNormalized, albumNormalized, disc > 0 FROM cache WHERE " + condition);
+		q.addBindValue(value);
+		if (q.exec()) {
+			while (q.next()) {
+				matches.artists.insert(q.value(0).toString());
+				matches.albums.insert(q.value(1).toString());
+				matches.hasDiscs = matches.hasDiscs || q.value(2).toBool();
+			}
+		}
+		return matches;
+	}, this, [this, text](const Matches &matches) {
+		// Another text was typed meanwhile
+		if (text != _pendingText) {
+			return;
+		}
+		_matches = matches;
+		MiamSortFilterProxyModel::findMusic(text);
+	});
+}
+
 /** Redefined from QSortFilterProxyModel. */
 void UniqueLibraryFilterProxyModel::setSourceModel(QAbstractItemModel *sourceModel)
 {
@@ -32,36 +74,22 @@ bool UniqueLibraryFilterProxyModel::filterAcceptsRow(int sourceRow, const QModel
 		if (MiamSortFilterProxyModel::filterAcceptsRow(sourceRow, sourceParent)) {
 			result = true;
 		} else {
-			SqlDatabase db;
-			QSqlQuery getArtist(db);
-			getArtist.setForwardOnly(true);
-			getArtist.prepare("SELECT * FROM cache WHERE trackTitle LIKE ?");
-			getArtist.addBindValue("%" + filterRegExp().pattern() + "%");
-			result = getArtist.exec() && getArtist.next();
+			// Artist is kept when at least one of its tracks is matching
+			result = _matches.artists.contains(item->data(Miam::DF_NormalizedString).toString());
 		}
 		break;
 	case Miam::IT_Album:
 		if (item->text().contains(filterRegExp().pattern(), Qt::CaseInsensitive)) {
 			result = true;
 		} else {
-			SqlDatabase db;
-			QSqlQuery getAlbum(db);
-			getAlbum.setForwardOnly(true);
-			getAlbum.prepare("SELECT * FROM cache WHERE trackTitle LIKE ?");
-			getAlbum.addBindValue("%" + filterRegExp().pattern() + "%");
-			result = getAlbum.exec() && getAlbum.next();
+			result = _matches.albums.contains(item->data(Miam::DF_NormAlbum).toString());
 		}
 		break;
 	case Miam::IT_Disc:
 		if (filterRegExp().indexIn(item->data(Miam::DF_Artist).toString()) != -1) {
 			result = true;
 		} else {
-			SqlDatabase db;
-			QSqlQuery getDiscAlbum(db);
-			getDiscAlbum.setForwardOnly(true);
-			getDiscAlbum.prepare("SELECT * FROM cache WHERE disc > 0 AND trackTitle LIKE ?");
-			getDiscAlbum.addBindValue("%" + filterRegExp().pattern() + "%");
-			result = getDiscAlbum.exec() && getDiscAlbum.next();
+			result = _matches.hasDiscs;
 		}
 		break;
 	case Miam::IT_Track:
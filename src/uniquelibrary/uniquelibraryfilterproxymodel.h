@@ -4,6 +4,7 @@
 #include "miamsortfilterproxymodel.h"
 #include "miamuniquelibrary_global.hpp"
 
+#include <QSet>
 #include <QStandardItemModel>
 
 /**
@@ -18,11 +19,28 @@ class MIAMUNIQUELIBRARY_LIBRARY UniqueLibraryFilterProxyModel : public MiamSortF
 private:
 	QStandardItemModel *_model;
 
+	/** Artists, albums and discs which have at least one track matching a text. */
+	struct Matches
+	{
+		QSet<QString> artists;
+		QSet<QString> albums;
+		bool hasDiscs = false;
+	};
+
+	/** Read for the last text which was given to findMusic(). */
+	Matches _matches;
+
+	/** Last text given to findMusic(), maybe still compared in the database thread. */
+	QString _pendingText;
+
 public:
 	UniqueLibraryFilterProxyModel(QObject *parent = nullptr);
 
 	virtual int defaultSortColumn() const override { return 1; }
 
+	/** Redefined to read artists, albums and discs matching text in the database thread first, once per text. */
+	virtual void findMusic(const QString &text) override;
+
 	/** Redefined from QSortFilterProxyModel. */
 	void setSourceModel(QAbstractItemModel *sourceModel) override;
 
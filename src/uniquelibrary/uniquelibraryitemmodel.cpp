@@ -1,20 +1,194 @@
 #include "uniquelibraryitemmodel.h"
 
-#include <model/sqldatabase.h>
+#include <model/databaseservice.h>
 #include <albumitem.h>
 #include <artistitem.h>
 #include <discitem.h>
 #include <trackitem.h>
 #include "coveritem.h"
 
+#include <QSet>
 #include <QSqlQuery>
 #include <QSqlRecord>
 
 #include <QtDebug>
 
+namespace {
+	/** Columns of queries for each type of row, in the order expected by functions below. */
+	const QString artistColumns = "artistAlbum, artistNormalized, icon, host";
+
+	const QString albumColumns = "ar.normalizedName || '|' || IFNULL(al.year, '') || '|' || al.normalizedName, al.normalizedName, al.name, ar.name, " \
+		"IFNULL(al.year, ''), (SELECT icon FROM tracks WHERE albumId = al.id LIMIT 1), " \
+		"(SELECT internalCover FROM tracks WHERE albumId = al.id AND internalCover IS NOT NULL LIMIT 1), al.cover";
+
+	const QString discColumns = "artistNormalized || '|' || albumYear  || '|' || albumNormalized || '|' || substr('0' || disc, -1, 1), artistAlbum, disc";
+
+	const QString trackColumns = "artistNormalized || '|' || albumYear  || '|' || albumNormalized || '|' || substr('0' || disc, -1, 1) || '|' || " \
+		"substr('00' || trackNumber, -2, 2)  || '|' || trackTitle, trackTitle, uri, trackNumber, artistAlbum, album, trackLength, rating, disc, host";
+
+	ArtistItem* createArtist(const QSqlRecord &r)
+	{
+		ArtistItem *artist = new ArtistItem;
+		int i = -1;
+		artist->setText(r.value(++i).toString());
+		artist->setData(r.value(++i).toString(), Miam::DF_NormalizedString);
+		artist->setData(r.value(++i).toString(), Miam::DF_IconPath);
+		artist->setData(!r.value(++i).toString().isEmpty(), Miam::DF_IsRemote);
+		return artist;
+	}
+
+	/** Returns the cover (which can be null) and the album. */
+	QList<QStandardItem*> createAlbumRow(const QSqlRecord &r)
+	{
+		AlbumItem *album = new AlbumItem;
+		int i = -1;
+		album->setData(r.value(++i).toString(), Miam::DF_NormalizedString);
+		album->setData(r.value(++i).toString(), Miam::DF_NormAlbum);
+		album->setText(r.value(++i).toString());
+		album->setData(r.value(++i).toString(), Miam::DF_Artist);
+		album->setData(r.value(++i).toString(), Miam::DF_Year);
+		album->setData(r.value(++i).toString(), Miam::DF_IconPath);
+		QString internalCover = r.value(++i).toString();
+		QString coverPath = r.value(++i).toString();
+		CoverItem *cover = nullptr;
+		if (!internalCover.isEmpty() || !coverPath.isEmpty()) {
+			cover = new CoverItem;
+			if (internalCover.isEmpty()) {
+				cover->setData(coverPath, Miam::DF_CoverPath);
+			} else {
+				cover->setData(internalCover, Miam::DF_InternalCover);
+			}
+		}
+		return { cover, album };
+	}
+
+	DiscItem* createDisc(const QSqlRecord &r)
+	{
+		DiscItem *disc = new DiscItem;
+		int i = -1;
+		disc->setData(r.value(++i).toString(), Miam::DF_NormalizedString);
+		disc->setData(r.value(++i).toString(), Miam::DF_Artist);
+		disc->setText(r.value(++i).toString());
+		return disc;
+	}
+
+	void setTrackData(QStandardItem *track, const QSqlRecord &r)
+	{
+		int i = -1;
+		track->setData(r.value(++i).toString(), Miam::DF_NormalizedString);
+		track->setText(r.value(++i).toString());
+		track->setData(r.value(++i).toString(), Miam::DF_URI);
+		track->setData(r.value(++i).toString(), Miam::DF_TrackNumber);
+		track->setData(r.value(++i).toString(), Miam::DF_Artist);
+		track->setData(r.value(++i).toString(), Miam::DF_Album);
+		track->setData(r.value(++i).toUInt(), Miam::DF_TrackLength);
+		track->setData(r.value(++i).toInt(), Miam::DF_Rating);
+		track->setData(r.value(++i).toString(), Miam::DF_DiscNumber);
+		track->setData(!r.value(++i).toString().isEmpty(), Miam::DF_IsRemote);
+	}
+
+	/** Keys of the artist, the album and the disc a track is attached to, extracted from the key of this track. */
+	QSet<QString> groupKeys(const QString &trackKey)
+	{
+		// Normalized strings are made of letters and digits only, so they can't contain the separator
+		QStringList parts = trackKey.split("|");
+		QSet<QString> keys;
+		if (parts.size() < 4) {
+			return keys;
+		}
+		keys << parts.at(0) << QStringList(parts.mid(0, 3)).join("|");
+		if (parts.at(3) != "0") {
+			keys << QStringList(parts.mid(0, 4)).join("|");
+		}
+		return keys;
+	}
+
+	/** Records of a load, read in the database thread. */
+	struct LoadedRecords
+	{
+		qint64 lastChange = -1;
+		QList<QSqlRecord> artists;
+		QList<QSqlRecord> albums;
+		QList<QSqlRecord> discs;
+		QList<QSqlRecord> tracks;
+	};
+
+	/** Reads artists, albums, discs and tracks which are matching filter, or everything when it's empty. */
+	LoadedRecords selectRecords(SqlDatabase *db, const QString &filter)
+	{
+		LoadedRecords records;
+		records.lastChange = db->lastTrackChange();
+
+		// Same condition for artists, albums, discs and tracks: tracks which are matching the filter in their title, artist or album
+		QString matching = db->searchCondition(filter);
+		QString value = db->searchValue(filter);
+
+		QSqlQuery query(*db);
+		query.setForwardOnly(true);
+		if (filter.isEmpty()) {
+			query.prepare("SELECT DISTINCT " + artistColumns + " FROM cache");
+		} else {
+			query.prepare("SELECT DISTINCT " + artistColumns + " FROM cache WHERE " + matching);
+			query.addBindValue(value);
+		}
+		if (query.exec()) {
+			while (query.next()) {
+				records.artists.append(query.record());
+			}
+		}
+
+		if (filter.isEmpty()) {
+			// One row per album, read from its own table instead of grouping every track
+			query.prepare("SELECT " + albumColumns + " FROM albums al JOIN artists ar ON ar.id = al.artistId");
+		} else {
+			query.prepare("SELECT DISTINCT artistNormalized || '|' || albumYear  || '|' || albumNormalized, albumNormalized, album, artistAlbum, " \
+						  "albumYear, icon, internalCover, cover FROM cache WHERE " + matching + " ORDER BY uri, internalCover");
+			query.addBindValue(value);
+		}
+		if (query.exec()) {
+			QString normalizedStringPrevious;
+			while (query.next()) {
+				QString normalizedString = query.value(0).toString();
+				if (normalizedStringPrevious == normalizedString) {
+					continue;
+				} else {
+					normalizedStringPrevious = normalizedString;
+				}
+				records.albums.append(query.record());
+			}
+		}
+
+		if (filter.isEmpty()) {
+			query.prepare("SELECT DISTINCT " + discColumns + " FROM cache WHERE disc > 0");
+		} else {
+			query.prepare("SELECT DISTINCT " + discColumns + " FROM cache WHERE (disc > 0) AND " + matching);
+			query.addBindValue(value);
+		}
+		if (query.exec()) {
+			while (query.next()) {
+				records.discs.append(query.record());
+			}
+		}
+
+		if (filter.isEmpty()) {
+			query.prepare("SELECT " + trackColumns + " FROM cache");
+		} else {
+			query.prepare("SELECT " + trackColumns + " FROM cache WHERE " + matching);
+			query.addBindValue(value);
+		}
+		if (query.exec()) {
+			while (query.next()) {
+				records.tracks.append(query.record());
+			}
+		}
+		return records;
+	}
+}
+
 UniqueLibraryItemModel::UniqueLibraryItemModel(QObject *parent)
 	: MiamItemModel(parent)
 	, _proxy(new UniqueLibraryFilterProxyModel(this))
+	, _lastLoad(0)
 {
 	setColumnCount(2);
 	_proxy->setSourceModel(this);
@@ -43,126 +217,196 @@ UniqueLibraryFilterProxyModel *UniqueLibraryItemModel::proxy() const
 	return _proxy;
 }
 
-void UniqueLibraryItemModel::load(const QString &filter)
+/** Tracks in this model attached to some artists or albums, by their normalized strings. */
+QStringList UniqueLibraryItemModel::tracksOfGroups(const QSet<QString> &groups) const
 {
-	this->deleteCache();
-
-	SqlDatabase db;
-
-	QSqlQuery query(db);
-	query.setForwardOnly(true);
-	if (filter.isEmpty()) {
-		query.prepare("SELECT DISTINCT artistAlbum, artistNormalized, icon, host FROM cache");
-	} else {
-		query.prepare("SELECT DISTINCT artistAlbum, artistNormalized, icon, host FROM cache " \
-					  "WHERE trackTitle LIKE :t OR artist LIKE :ar OR album LIKE :al");
-		query.bindValue(":t", "%" + filter + "%");
-		query.bindValue(":ar", "%" + filter + "%");
-		query.bindValue(":al", "%" + filter + "%");
+	QStringList tracks;
+	if (groups.isEmpty()) {
+		return tracks;
 	}
-	if (query.exec()) {
-		while (query.next()) {
-			ArtistItem *artist = new ArtistItem;
-			int i = -1;
-			artist->setText(query.record().value(++i).toString());
-			artist->setData(query.record().value(++i).toString(), Miam::DF_NormalizedString);
-			artist->setData(query.record().value(++i).toString(), Miam::DF_IconPath);
-			artist->setData(!query.record().value(++i).toString().isEmpty(), Miam::DF_IsRemote);
-			appendRow({ nullptr, artist });
+	for (auto it = _tracks.cbegin(); it != _tracks.cend(); ++it) {
+		if (groupKeys(it.value()->data(Miam::DF_NormalizedString).toString()).intersects(groups)) {
+			tracks << it.key();
 		}
 	}
+	return tracks;
+}
 
-	if (filter.isEmpty()) {
-		query.prepare("SELECT DISTINCT artistNormalized || '|' || albumYear  || '|' || albumNormalized, albumNormalized, album, artistAlbum, " \
-					  "albumYear, icon, internalCover, cover FROM cache ORDER BY uri, internalCover");
+/** Applies changes of the journal of tracks. A filtered model is loaded again with the same filter. */
+void UniqueLibraryItemModel::applyChanges()
+{
+	if (_filter.isEmpty()) {
+		MiamItemModel::applyChanges();
 	} else {
-		query.prepare("SELECT DISTINCT artistNormalized || '|' || albumYear  || '|' || albumNormalized, albumNormalized, album, artistAlbum, " \
-					  "albumYear, icon, internalCover, cover FROM cache WHERE trackTitle LIKE :t OR artist LIKE :ar OR album LIKE :al ORDER BY uri, internalCover");
-		query.bindValue(":t", "%" + filter + "%");
-		query.bindValue(":ar", "%" + filter + "%");
-		query.bindValue(":al", "%" + filter + "%");
+		this->load(_filter);
 	}
-	if (query.exec()) {
-		QString normalizedStringPrevious;
-		while (query.next()) {
-			int i = -1;
-			QString normalizedString = query.record().value(++i).toString();
-			if (normalizedStringPrevious == normalizedString) {
-				continue;
+}
+
+/** Reads artists, albums, discs and tracks matching filter in the database thread, then replaces items of this model. */
+void UniqueLibraryItemModel::load(const QString &filter)
+{
+	_filter = filter;
+	int number = ++_lastLoad;
+	DatabaseService::instance()->run<LoadedRecords>([filter](SqlDatabase *db) {
+		return selectRecords(db, filter);
+	}, this, [this, number](const LoadedRecords &records) {
+		// Another load was started meanwhile
+		if (number != _lastLoad) {
+			return;
+		}
+		this->deleteCache();
+		_groups.clear();
+		_lastChange = records.lastChange;
+		for (QSqlRecord r : records.artists) {
+			ArtistItem *artist = createArtist(r);
+			_groups.insert(artist->data(Miam::DF_NormalizedString).toString(), artist);
+			appendRow({ nullptr, artist });
+		}
+		for (QSqlRecord r : records.albums) {
+			QList<QStandardItem*> albumRow = createAlbumRow(r);
+			_groups.insert(r.value(0).toString(), albumRow.last());
+			appendRow(albumRow);
+		}
+		for (QSqlRecord r : records.discs) {
+			DiscItem *disc = createDisc(r);
+			_groups.insert(disc->data(Miam::DF_NormalizedString).toString(), disc);
+			appendRow({ nullptr, disc });
+		}
+		for (QSqlRecord r : records.tracks) {
+			TrackItem *track = new TrackItem(_trackTable);
+			setTrackData(track, r);
+			_tracks.insert(track->data(Miam::DF_URI).toString(), track);
+			appendRow({ nullptr, track });
+		}
+		this->updateSortRanks();
+		this->proxy()->sort(this->proxy()->defaultSortColumn());
+		this->proxy()->setDynamicSortFilter(false);
+		emit loaded();
+	});
+}
+
+/** Function which reads records of changed tracks, and artists, albums or discs they're now attached to. */
+MiamItemModel::RecordReader UniqueLibraryItemModel::recordReader() const
+{
+	return [](SqlDatabase *db, TrackChanges &changes) {
+		QSqlQuery selectTrack = db->preparedQuery("SELECT " + trackColumns + " FROM cache WHERE uri = ?");
+		QSet<QString> keys;
+		for (QString uri : changes.uris) {
+			selectTrack.addBindValue(uri);
+			if (selectTrack.exec() && selectTrack.next()) {
+				QSqlRecord r = selectTrack.record();
+				changes.tracks.insert(uri, r);
+				keys.unite(groupKeys(r.value(0).toString()));
+			}
+		}
+
+		// Years are compared as text, like in keys of tracks
+		for (QString key : keys) {
+			QStringList parts = key.split("|");
+			QSqlQuery selectGroup;
+			if (parts.size() == 1) {
+				selectGroup = db->preparedQuery("SELECT " + artistColumns + " FROM cache WHERE artistNormalized = ? LIMIT 1");
+			} else if (parts.size() == 3) {
+				selectGroup = db->preparedQuery("SELECT " + albumColumns + " FROM albums al JOIN artists ar ON ar.id = al.artistId " \
+												"WHERE ar.normalizedName = ? AND CAST(IFNULL(al.year, '') AS TEXT) = ? AND al.normalizedName = ?");
 			} else {
-				normalizedStringPrevious = normalizedString;
+				selectGroup = db->preparedQuery("SELECT " + discColumns + " FROM cache WHERE artistNormalized = ? AND CAST(albumYear AS TEXT) = ? " \
+												"AND albumNormalized = ? AND disc > 0 AND substr('0' || disc, -1, 1) = ? LIMIT 1");
 			}
-			AlbumItem *album = new AlbumItem;
-			album->setData(normalizedString, Miam::DF_NormalizedString);
-			album->setData(query.record().value(++i).toString(), Miam::DF_NormAlbum);
-			album->setText(query.record().value(++i).toString());
-			album->setData(query.record().value(++i).toString(), Miam::DF_Artist);
-			album->setData(query.record().value(++i).toString(), Miam::DF_Year);
-			album->setData(query.record().value(++i).toString(), Miam::DF_IconPath);
-			QString internalCover = query.record().value(++i).toString();
-			QString coverPath = query.record().value(++i).toString();
-			CoverItem *cover = nullptr;
-			if (!internalCover.isEmpty() || !coverPath.isEmpty()) {
-				cover = new CoverItem;
-				if (internalCover.isEmpty()) {
-					cover->setData(coverPath, Miam::DF_CoverPath);
-				} else {
-					cover->setData(internalCover, Miam::DF_InternalCover);
-				}
+			for (QString part : parts) {
+				selectGroup.addBindValue(part);
+			}
+			if (selectGroup.exec() && selectGroup.next()) {
+				changes.groups.insert(key, selectGroup.record());
 			}
-			appendRow({ cover, album });
 		}
-	}
+	};
+}
 
-	if (filter.isEmpty()) {
-		query.prepare("SELECT DISTINCT artistNormalized || '|' || albumYear  || '|' || albumNormalized || '|' || substr('0' || disc, -1, 1)" \
-					  ", artistAlbum, disc FROM cache WHERE disc > 0");
-	} else {
-		query.prepare("SELECT DISTINCT artistNormalized || '|' || albumYear  || '|' || albumNormalized || '|' || substr('0' || disc, -1, 1)" \
-					  ", artistAlbum, disc FROM cache WHERE (disc > 0) AND (trackTitle LIKE :t OR artist LIKE :ar OR album LIKE :al)");
-		query.bindValue(":t", "%" + filter + "%");
-		query.bindValue(":ar", "%" + filter + "%");
-		query.bindValue(":al", "%" + filter + "%");
+/** Updates changed tracks, and artists, albums or discs they were or are now attached to. */
+bool UniqueLibraryItemModel::updateTracks(const TrackChanges &changes)
+{
+	// Keys of artists, albums and discs
+	QSet<QString> oldGroups, newGroups;
+	bool needsSort = false;
+	for (QString uri : changes.uris) {
+		TrackItem *track = _tracks.value(uri);
+		if (track) {
+			oldGroups.unite(groupKeys(track->data(Miam::DF_NormalizedString).toString()));
+		}
+		if (changes.tracks.contains(uri)) {
+			QSqlRecord r = changes.tracks.value(uri);
+			if (!track) {
+				track = new TrackItem(_trackTable);
+				_tracks.insert(uri, track);
+				appendRow({ nullptr, track });
+				needsSort = true;
+			} else if (track->data(Miam::DF_NormalizedString).toString() != r.value(0).toString()) {
+				needsSort = true;
+			}
+			setTrackData(track, r);
+			newGroups.unite(groupKeys(r.value(0).toString()));
+		} else if (track) {
+			_tracks.remove(uri);
+			removeRow(track->row());
+		}
 	}
-	if (query.exec()) {
-		while (query.next()) {
-			DiscItem *disc = new DiscItem;
-			int i = -1;
-			disc->setData(query.record().value(++i).toString(), Miam::DF_NormalizedString);
-			disc->setData(query.record().value(++i).toString(), Miam::DF_Artist);
-			disc->setText(query.record().value(++i).toString());
+
+	// Rows for artists, albums and discs which have appeared, or which need a new cover
+	for (QString key : newGroups) {
+		int partCount = key.count("|") + 1;
+		if ((partCount != 3 && _groups.contains(key)) || !changes.groups.contains(key)) {
+			continue;
+		}
+		QSqlRecord r = changes.groups.value(key);
+		if (partCount == 1) {
+			QStandardItem *artist = createArtist(r);
+			_groups.insert(key, artist);
+			appendRow({ nullptr, artist });
+			needsSort = true;
+		} else if (partCount == 3) {
+			QList<QStandardItem*> albumRow = createAlbumRow(r);
+			if (QStandardItem *album = _groups.value(key)) {
+				// Only the cover can change, other columns are the key of this album
+				QStandardItem *cover = this->item(album->row(), 0);
+				QStandardItem *newCover = albumRow.first();
+				if ((cover ? cover->data(Miam::DF_CoverPath) : QVariant()) != (newCover ? newCover->data(Miam::DF_CoverPath) : QVariant()) ||
+						(cover ? cover->data(Miam::DF_InternalCover) : QVariant()) != (newCover ? newCover->data(Miam::DF_InternalCover) : QVariant())) {
+					this->setItem(album->row(), 0, newCover);
+				} else {
+					delete newCover;
+				}
+				delete albumRow.last();
+			} else {
+				_groups.insert(key, albumRow.last());
+				appendRow(albumRow);
+				needsSort = true;
+			}
+		} else {
+			QStandardItem *disc = createDisc(r);
+			_groups.insert(key, disc);
 			appendRow({ nullptr, disc });
 		}
 	}
 
-	if (filter.isEmpty()) {
-		query.prepare("SELECT artistNormalized || '|' || albumYear  || '|' || albumNormalized || '|' || substr('0' || disc, -1, 1) || '|' || substr('00' || trackNumber, -2, 2)  || '|' || trackTitle, " \
-					  "trackTitle, uri, trackNumber, artistAlbum, album, trackLength, rating, disc, host FROM cache");
-	} else {
-		query.prepare("SELECT artistNormalized || '|' || albumYear  || '|' || albumNormalized || '|' || substr('0' || disc, -1, 1) || '|' || substr('00' || trackNumber, -2, 2)  || '|' || trackTitle, " \
-					  "trackTitle, uri, trackNumber, artistAlbum, album, trackLength, rating, disc, host FROM cache WHERE trackTitle LIKE :t OR artist LIKE :ar OR album LIKE :al");
-		query.bindValue(":t", "%" + filter + "%");
-		query.bindValue(":ar", "%" + filter + "%");
-		query.bindValue(":al", "%" + filter + "%");
-	}
-	if (query.exec()) {
-		while (query.next()) {
-			TrackItem *track = new TrackItem;
-			int i = -1;
-			track->setData(query.record().value(++i).toString(), Miam::DF_NormalizedString);
-			track->setText(query.record().value(++i).toString());
-			track->setData(query.record().value(++i).toString(), Miam::DF_URI);
-			track->setData(query.record().value(++i).toString(), Miam::DF_TrackNumber);
-			track->setData(query.record().value(++i).toString(), Miam::DF_Artist);
-			track->setData(query.record().value(++i).toString(), Miam::DF_Album);
-			track->setData(query.record().value(++i).toUInt(), Miam::DF_TrackLength);
-			track->setData(query.record().value(++i).toInt(), Miam::DF_Rating);
-			track->setData(query.record().value(++i).toString(), Miam::DF_DiscNumber);
-			track->setData(!query.record().value(++i).toString().isEmpty(), Miam::DF_IsRemote);
-			appendRow({ nullptr, track });
+	// Rows for artists, albums and discs without tracks. This model isn't filtered, it has every track of the library
+	oldGroups.subtract(newGroups);
+	if (!oldGroups.isEmpty()) {
+		QSet<QString> usedGroups;
+		for (TrackItem *track : _tracks) {
+			usedGroups.unite(groupKeys(track->data(Miam::DF_NormalizedString).toString()));
 		}
+		for (QString key : oldGroups) {
+			if (_groups.contains(key) && !usedGroups.contains(key)) {
+				removeRow(_groups.take(key)->row());
+			}
+		}
+	}
 
+	// Proxy isn't sorting dynamically: new rows are at the end, without a rank to be compared with others
+	if (needsSort) {
+		this->updateSortRanks();
+		this->proxy()->sort(this->proxy()->defaultSortColumn());
 	}
-	this->proxy()->sort(this->proxy()->defaultSortColumn());
-	this->proxy()->setDynamicSortFilter(false);
+	return true;
 }
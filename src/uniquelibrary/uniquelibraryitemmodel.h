@@ -1,6 +1,8 @@
 #ifndef UNIQUELIBRARYITEMMODEL_H
 #define UNIQUELIBRARYITEMMODEL_H
 
+#include <QSet>
+
 #include "miamuniquelibrary_global.hpp"
 #include <miamitemmodel.h>
 #include "uniquelibraryfilterproxymodel.h"
@@ -19,6 +21,15 @@ class MIAMUNIQUELIBRARY_LIBRARY UniqueLibraryItemModel : public MiamItemModel
 private:
 	UniqueLibraryFilterProxyModel *_proxy;
 
+	/** Rows of artists, albums and discs, by normalized string. */
+	QHash<QString, QStandardItem*> _groups;
+
+	/** Text used to filter tracks on last load. */
+	QString _filter;
+
+	/** Number of the last load: records of older loads are dropped when they arrive. */
+	int _lastLoad;
+
 public:
 	explicit UniqueLibraryItemModel(QObject *parent = nullptr);
 
@@ -26,7 +37,21 @@ public:
 
 	virtual UniqueLibraryFilterProxyModel* proxy() const override;
 
+	/** Tracks in this model attached to some artists or albums, by their normalized strings. */
+	QStringList tracksOfGroups(const QSet<QString> &groups) const;
+
+protected:
+	/** Function which reads records of changed tracks, and artists, albums or discs they're now attached to. */
+	virtual RecordReader recordReader() const override;
+
+	/** Updates changed tracks, and artists, albums or discs they were or are now attached to. */
+	virtual bool updateTracks(const TrackChanges &changes) override;
+
 public slots:
+	/** Applies changes of the journal of tracks. A filtered model is loaded again with the same filter. */
+	virtual void applyChanges() override;
+
+	/** Reads artists, albums, discs and tracks matching filter in the database thread, then replaces items of this model. */
 	virtual void load(const QString & filter = QString::null) override;
 };
 